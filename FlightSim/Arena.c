@@ -0,0 +1,221 @@
+
+/************************************************************************************
+
+	File: 			Arena.c
+
+	Description:	Arena allocator. Allocations are bumped along the block
+					being filled and are never freed one at a time. Resetting
+					keeps the first block for the next fill and frees the rest,
+					releasing frees every block.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for arena types and functions
+#include "Arena.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+// memcpy and memset
+#include <string.h>
+
+/************************************************************************
+
+	Function:		arenaPadding
+
+	Description:	Returns the bytes to skip so the next allocation in a
+					block starts on ARENA_ALIGNMENT.
+
+*************************************************************************/
+static size_t arenaPadding(ArenaBlock *block) {
+	size_t address = (size_t)((char*)(block + 1) + block->used);
+
+	return (ARENA_ALIGNMENT - (address & (ARENA_ALIGNMENT - 1))) & (ARENA_ALIGNMENT - 1);
+}
+
+/************************************************************************
+
+	Function:		arenaAddUsed
+
+	Description:	Counts bytes handed out and keeps the peak.
+
+*************************************************************************/
+static void arenaAddUsed(Arena *arena, size_t bytes) {
+	arena->bytesUsed += bytes;
+	if(arena->bytesUsed > arena->peakBytesUsed) {
+		arena->peakBytesUsed = arena->bytesUsed;
+	}
+}
+
+/************************************************************************
+
+	Function:		arenaInit
+
+	Description:	Sets up an empty arena. No memory is taken until the
+					first allocation.
+
+*************************************************************************/
+void arenaInit(Arena *arena, const char *name, size_t blockSize) {
+	arena->name = name;
+	arena->blockSize = blockSize;
+	arena->blocks = NULL;
+	arena->bytesUsed = 0;
+	arena->bytesReserved = 0;
+	arena->peakBytesUsed = 0;
+	arena->allocationCount = 0;
+}
+
+/************************************************************************
+
+	Function:		arenaAlloc
+
+	Description:	Hands out size bytes aligned to ARENA_ALIGNMENT. When the
+					block being filled is too small a new one is made. One
+					bigger than a block gets its own block behind the one
+					being filled, so the space left there is still used.
+					Exits if memory runs out.
+
+*************************************************************************/
+void *arenaAlloc(Arena *arena, size_t size) {
+	ArenaBlock *block = arena->blocks;
+	size_t padding = 0;
+	size_t blockSize = arena->blockSize;
+	char *memory;
+
+	if(block != NULL) {
+		padding = arenaPadding(block);
+	}
+
+	if(block == NULL || block->used + padding + size > block->size) {
+		// Room to line up the start however malloc aligns it
+		if(size + ARENA_ALIGNMENT > blockSize) {
+			blockSize = size + ARENA_ALIGNMENT;
+		}
+		block = (ArenaBlock*)memoryAlloc(MEMORY_ARENAS, sizeof(ArenaBlock) + blockSize);
+		if(block == NULL) {
+			exit(1);
+		}
+		block->size = blockSize;
+		block->used = 0;
+		arena->bytesReserved += blockSize;
+
+		if(arena->blocks != NULL && blockSize > arena->blockSize) {
+			block->next = arena->blocks->next;
+			arena->blocks->next = block;
+		} else {
+			block->next = arena->blocks;
+			arena->blocks = block;
+		}
+		padding = arenaPadding(block);
+	}
+
+	memory = (char*)(block + 1) + block->used + padding;
+	block->used += padding + size;
+	arenaAddUsed(arena, padding + size);
+	arena->allocationCount++;
+
+	return memory;
+}
+
+/************************************************************************
+
+	Function:		arenaAllocZeroed
+
+	Description:	Hands out size bytes set to zero.
+
+*************************************************************************/
+void *arenaAllocZeroed(Arena *arena, size_t size) {
+	void *memory = arenaAlloc(arena, size);
+
+	memset(memory, 0, size);
+	return memory;
+}
+
+/************************************************************************
+
+	Function:		arenaGrow
+
+	Description:	Makes an allocation newSize bytes long, like realloc.
+					The last allocation in the block being filled grows where
+					it is, anything else is copied to a new allocation and the
+					old bytes stay used until the arena is reset. NULL makes a
+					new allocation.
+
+*************************************************************************/
+void *arenaGrow(Arena *arena, void *memory, size_t oldSize, size_t newSize) {
+	ArenaBlock *block = arena->blocks;
+	void *newMemory;
+
+	if(memory == NULL) {
+		return arenaAlloc(arena, newSize);
+	}
+	if(newSize <= oldSize) {
+		return memory;
+	}
+
+	// Ends where the block's used bytes end and the rest still fits
+	if(block != NULL && (char*)memory + oldSize == (char*)(block + 1) + block->used &&
+		block->used + (newSize - oldSize) <= block->size) {
+		block->used += newSize - oldSize;
+		arenaAddUsed(arena, newSize - oldSize);
+		return memory;
+	}
+
+	newMemory = arenaAlloc(arena, newSize);
+	memcpy(newMemory, memory, oldSize);
+	return newMemory;
+}
+
+/************************************************************************
+
+	Function:		arenaReset
+
+	Description:	Gives back everything handed out in one step. The first
+					block is kept to fill again, the rest are freed.
+
+*************************************************************************/
+void arenaReset(Arena *arena) {
+	ArenaBlock *block = arena->blocks;
+	ArenaBlock *next;
+
+	if(block == NULL) {
+		return;
+	}
+
+	while(block->next != NULL) {
+		next = block->next;
+		arena->bytesReserved -= block->size;
+		memoryFree(block);
+		block = next;
+	}
+
+	block->used = 0;
+	arena->blocks = block;
+	arena->bytesUsed = 0;
+	arena->allocationCount = 0;
+}
+
+/************************************************************************
+
+	Function:		arenaRelease
+
+	Description:	Gives back everything handed out and frees every block.
+
+*************************************************************************/
+void arenaRelease(Arena *arena) {
+	ArenaBlock *block = arena->blocks;
+	ArenaBlock *next;
+
+	while(block != NULL) {
+		next = block->next;
+		memoryFree(block);
+		block = next;
+	}
+
+	arena->blocks = NULL;
+	arena->bytesUsed = 0;
+	arena->bytesReserved = 0;
+	arena->allocationCount = 0;
+}
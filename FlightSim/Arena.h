@@ -0,0 +1,58 @@
+/*
+ * Arena.h
+ * Mike Northorp
+ * Arena (bump) allocator. Memory is handed out from large blocks and
+ * given back all at once by resetting the arena, so a subsystem's storage
+ * can be thrown away and built again without fragmenting the heap. Not
+ * thread safe, each arena is filled by one thread.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+// size_t
+#include <stddef.h>
+
+/* Defines */
+
+// Every allocation starts on this many bytes so SSE loads work on it
+#define ARENA_ALIGNMENT 16
+
+/* Typedefs and structs */
+
+// One block of memory, the bytes handed out follow the header
+typedef struct ArenaBlock {
+	struct ArenaBlock *next;
+	// Bytes after the header and how many are handed out
+	size_t size;
+	size_t used;
+} ArenaBlock;
+
+// Allocations come from the newest block, a new block is added when it
+// fills up. Anything bigger than a block gets a block of its own
+typedef struct {
+	// Shown in the memory reports
+	const char *name;
+	size_t blockSize;
+	// Block being filled first, the first block made is always last
+	ArenaBlock *blocks;
+
+	// Bytes handed out since the last reset, counting alignment padding
+	size_t bytesUsed;
+	// Bytes held in blocks
+	size_t bytesReserved;
+	// Most bytes ever handed out at once
+	size_t peakBytesUsed;
+	int allocationCount;
+} Arena;
+
+/* Function list */
+
+void arenaInit(Arena *arena, const char *name, size_t blockSize);
+void *arenaAlloc(Arena *arena, size_t size);
+void *arenaAllocZeroed(Arena *arena, size_t size);
+void *arenaGrow(Arena *arena, void *memory, size_t oldSize, size_t newSize);
+void arenaReset(Arena *arena);
+void arenaRelease(Arena *arena);
+
+#endif /* ARENA_H_ */
@@ -0,0 +1,351 @@
+
+/************************************************************************************
+
+	File: 			AssetPack.c
+
+	Description:	Reads and writes the asset pack. Reading maps the whole file
+					and checks the table of contents once, after that meshes and
+					images are handed out as pointers into the mapping with no
+					copying. Writing puts each array on an ASSET_PACK_ALIGNMENT
+					boundary and fills in the table of contents last.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for asset pack types and functions
+#include "AssetPack.h"
+// String functions
+#include <string.h>
+
+/************************************************************************
+
+	Function:		assetPackIsInside
+
+	Description:	Returns 1 if count elements of elementSize bytes at
+					offset fit inside the pack and start aligned.
+
+*************************************************************************/
+static int assetPackIsInside(const AssetPack *pack, unsigned int offset, unsigned int count, size_t elementSize) {
+	if(offset % ASSET_PACK_ALIGNMENT != 0 || offset > pack->size) {
+		return 0;
+	}
+	return count <= (pack->size - offset) / elementSize;
+}
+
+/************************************************************************
+
+	Function:		assetPackOpen
+
+	Description:	Maps a pack read only and checks its header and that
+					every entry lies inside the file. Returns 0 and leaves
+					the pack closed if the file is missing or does not check
+					out.
+
+*************************************************************************/
+int assetPackOpen(AssetPack *pack, const char *fileName) {
+	LARGE_INTEGER fileSize;
+	const AssetPackEntry *entry;
+	size_t sizes[4] = {sizeof(MeshVertex), sizeof(unsigned int), sizeof(unsigned int), sizeof(MeshPolygon)};
+	unsigned int i = 0;
+	int k = 0;
+	int isValid = 1;
+
+	memset(pack, 0, sizeof(AssetPack));
+	pack->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(pack->file == INVALID_HANDLE_VALUE) {
+		pack->file = NULL;
+		return 0;
+	}
+	if(!GetFileSizeEx(pack->file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(AssetPackHeader) || fileSize.QuadPart > 0x7FFFFFFF) {
+		assetPackClose(pack);
+		return 0;
+	}
+	pack->size = (size_t)fileSize.QuadPart;
+
+	pack->mapping = CreateFileMappingA(pack->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(pack->mapping != NULL) {
+		pack->data = (const unsigned char*)MapViewOfFile(pack->mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if(pack->data == NULL) {
+		assetPackClose(pack);
+		return 0;
+	}
+
+	// Header has to match this build
+	pack->header = (const AssetPackHeader*)pack->data;
+	pack->entries = (const AssetPackEntry*)(pack->data + sizeof(AssetPackHeader));
+	if(pack->header->magic != ASSET_PACK_MAGIC || pack->header->version != ASSET_PACK_VERSION ||
+		pack->header->vertexBytes != sizeof(MeshVertex) || pack->header->polygonBytes != sizeof(MeshPolygon) ||
+		pack->header->fileBytes != pack->size || pack->header->entryCount > ASSET_PACK_MAX_ENTRIES ||
+		sizeof(AssetPackHeader) + ASSET_PACK_MAX_ENTRIES * sizeof(AssetPackEntry) > pack->size) {
+		assetPackClose(pack);
+		return 0;
+	}
+
+	// Every array of every entry inside the file
+	for(i = 0; i < pack->header->entryCount && isValid; i++) {
+		entry = &pack->entries[i];
+		if(memchr(entry->name, '\0', ASSET_PACK_NAME_SIZE) == NULL) {
+			isValid = 0;
+		} else if(entry->type == ASSET_PACK_MESH) {
+			for(k = 0; k < 4; k++) {
+				isValid = isValid && assetPackIsInside(pack, entry->offsets[k], entry->counts[k], sizes[k]);
+			}
+		} else if(entry->type == ASSET_PACK_IMAGE) {
+			isValid = entry->counts[0] > 0 && entry->counts[1] > 0 && entry->counts[2] > 0 &&
+				entry->counts[0] <= 0xFFFF && entry->counts[1] <= 0xFFFF && entry->counts[2] <= 4 &&
+				assetPackIsInside(pack, entry->offsets[0], entry->counts[0] * entry->counts[1], entry->counts[2]);
+		}
+	}
+	if(!isValid) {
+		assetPackClose(pack);
+		return 0;
+	}
+
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		assetPackClose
+
+	Description:	Unmaps the pack. Meshes and images from it can not be
+					used after this.
+
+*************************************************************************/
+void assetPackClose(AssetPack *pack) {
+	if(pack->data != NULL) {
+		UnmapViewOfFile(pack->data);
+	}
+	if(pack->mapping != NULL) {
+		CloseHandle(pack->mapping);
+	}
+	if(pack->file != NULL) {
+		CloseHandle(pack->file);
+	}
+	memset(pack, 0, sizeof(AssetPack));
+}
+
+/************************************************************************
+
+	Function:		assetPackFind
+
+	Description:	Returns the entry with the name and type, or NULL if the
+					pack is not open or does not have it.
+
+*************************************************************************/
+const AssetPackEntry *assetPackFind(const AssetPack *pack, const char *name, unsigned int type) {
+	unsigned int i = 0;
+
+	if(pack->data == NULL) {
+		return NULL;
+	}
+	for(i = 0; i < pack->header->entryCount; i++) {
+		if(pack->entries[i].type == type && strcmp(pack->entries[i].name, name) == 0) {
+			return &pack->entries[i];
+		}
+	}
+
+	return NULL;
+}
+
+/************************************************************************
+
+	Function:		assetPackGetMesh
+
+	Description:	Points a mesh at a model in the pack. The arrays are read
+					only and stay in the mapping, the mesh keeps its arena so
+					it is never freed and anything added to it is copied out
+					first. Returns 0 and leaves the mesh alone if the pack
+					does not have the model.
+
+*************************************************************************/
+int assetPackGetMesh(const AssetPack *pack, const char *name, Mesh *mesh) {
+	const AssetPackEntry *entry = assetPackFind(pack, name, ASSET_PACK_MESH);
+
+	if(entry == NULL) {
+		return 0;
+	}
+
+	mesh->vertices = (MeshVertex*)(pack->data + entry->offsets[0]);
+	mesh->vertexCount = mesh->vertexCapacity = (int)entry->counts[0];
+	mesh->triangleIndices = (unsigned int*)(pack->data + entry->offsets[1]);
+	mesh->triangleIndexCount = mesh->triangleIndexCapacity = (int)entry->counts[1];
+	mesh->edgeIndices = (unsigned int*)(pack->data + entry->offsets[2]);
+	mesh->edgeIndexCount = mesh->edgeIndexCapacity = (int)entry->counts[2];
+	mesh->polygons = (MeshPolygon*)(pack->data + entry->offsets[3]);
+	mesh->polygonCount = mesh->polygonCapacity = (int)entry->counts[3];
+
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		assetPackGetImage
+
+	Description:	Returns the pixels of an image in the pack, read only,
+					and its size. NULL if the pack does not have it.
+
+*************************************************************************/
+const unsigned char *assetPackGetImage(const AssetPack *pack, const char *name, int *width, int *height) {
+	const AssetPackEntry *entry = assetPackFind(pack, name, ASSET_PACK_IMAGE);
+
+	if(entry == NULL) {
+		return NULL;
+	}
+	*width = (int)entry->counts[0];
+	*height = (int)entry->counts[1];
+
+	return pack->data + entry->offsets[0];
+}
+
+/************************************************************************
+
+	Function:		assetPackWrite
+
+	Description:	Writes an array at the next aligned offset and returns
+					the offset, padding the file up to it first.
+
+*************************************************************************/
+static unsigned int assetPackWrite(AssetPackWriter *writer, const void *data, size_t bytes) {
+	static const unsigned char padding[ASSET_PACK_ALIGNMENT] = {0};
+	unsigned int offset = (writer->offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+
+	if(fwrite(padding, 1, offset - writer->offset, writer->file) != offset - writer->offset ||
+		(bytes > 0 && fwrite(data, 1, bytes, writer->file) != bytes)) {
+		writer->isFailed = 1;
+	}
+	writer->offset = offset + (unsigned int)bytes;
+
+	return offset;
+}
+
+/************************************************************************
+
+	Function:		assetPackAddEntry
+
+	Description:	Takes the next table of contents entry and names it.
+					Returns NULL if the table is full or the name too long.
+
+*************************************************************************/
+static AssetPackEntry *assetPackAddEntry(AssetPackWriter *writer, const char *name, unsigned int type) {
+	AssetPackEntry *entry;
+
+	if(writer->header.entryCount >= ASSET_PACK_MAX_ENTRIES || strlen(name) >= ASSET_PACK_NAME_SIZE) {
+		writer->isFailed = 1;
+		return NULL;
+	}
+	entry = &writer->entries[writer->header.entryCount++];
+	memset(entry, 0, sizeof(AssetPackEntry));
+	strcpy(entry->name, name);
+	entry->type = type;
+
+	return entry;
+}
+
+/************************************************************************
+
+	Function:		assetPackBegin
+
+	Description:	Starts writing a pack, leaving room at the front for the
+					header and a full table of contents. Returns 0 if the
+					file can not be made.
+
+*************************************************************************/
+int assetPackBegin(AssetPackWriter *writer, const char *fileName) {
+	memset(writer, 0, sizeof(AssetPackWriter));
+	writer->file = fopen(fileName, "wb");
+	if(writer->file == NULL) {
+		return 0;
+	}
+
+	writer->header.magic = ASSET_PACK_MAGIC;
+	writer->header.version = ASSET_PACK_VERSION;
+	writer->header.vertexBytes = sizeof(MeshVertex);
+	writer->header.polygonBytes = sizeof(MeshPolygon);
+	if(fwrite(&writer->header, sizeof(AssetPackHeader), 1, writer->file) != 1 ||
+		fwrite(writer->entries, sizeof(writer->entries), 1, writer->file) != 1) {
+		writer->isFailed = 1;
+	}
+	writer->offset = sizeof(AssetPackHeader) + sizeof(writer->entries);
+
+	return !writer->isFailed;
+}
+
+/************************************************************************
+
+	Function:		assetPackAddMesh
+
+	Description:	Writes a mesh's vertex, index and polygon arrays.
+
+*************************************************************************/
+int assetPackAddMesh(AssetPackWriter *writer, const char *name, const Mesh *mesh) {
+	AssetPackEntry *entry = assetPackAddEntry(writer, name, ASSET_PACK_MESH);
+
+	if(entry == NULL) {
+		return 0;
+	}
+	entry->counts[0] = mesh->vertexCount;
+	entry->counts[1] = mesh->triangleIndexCount;
+	entry->counts[2] = mesh->edgeIndexCount;
+	entry->counts[3] = mesh->polygonCount;
+	entry->offsets[0] = assetPackWrite(writer, mesh->vertices, mesh->vertexCount * sizeof(MeshVertex));
+	entry->offsets[1] = assetPackWrite(writer, mesh->triangleIndices, mesh->triangleIndexCount * sizeof(unsigned int));
+	entry->offsets[2] = assetPackWrite(writer, mesh->edgeIndices, mesh->edgeIndexCount * sizeof(unsigned int));
+	entry->offsets[3] = assetPackWrite(writer, mesh->polygons, mesh->polygonCount * sizeof(MeshPolygon));
+
+	return !writer->isFailed;
+}
+
+/************************************************************************
+
+	Function:		assetPackAddImage
+
+	Description:	Writes an image's pixels as they are, rows one after
+					another with no padding.
+
+*************************************************************************/
+int assetPackAddImage(AssetPackWriter *writer, const char *name, const unsigned char *pixels, int width, int height, int bytesPerPixel) {
+	AssetPackEntry *entry = assetPackAddEntry(writer, name, ASSET_PACK_IMAGE);
+
+	if(entry == NULL) {
+		return 0;
+	}
+	entry->counts[0] = width;
+	entry->counts[1] = height;
+	entry->counts[2] = bytesPerPixel;
+	entry->offsets[0] = assetPackWrite(writer, pixels, (size_t)width * height * bytesPerPixel);
+
+	return !writer->isFailed;
+}
+
+/************************************************************************
+
+	Function:		assetPackEnd
+
+	Description:	Pads the file to the alignment, writes the header and
+					table of contents over the space kept for them and closes
+					the file. Returns 0 if any write failed, the pack is then
+					left with a bad header so it is never opened.
+
+*************************************************************************/
+int assetPackEnd(AssetPackWriter *writer) {
+	assetPackWrite(writer, NULL, 0);
+	writer->header.fileBytes = writer->offset;
+	if(writer->isFailed) {
+		writer->header.magic = 0;
+	}
+
+	if(fseek(writer->file, 0, SEEK_SET) != 0 ||
+		fwrite(&writer->header, sizeof(AssetPackHeader), 1, writer->file) != 1 ||
+		fwrite(writer->entries, sizeof(writer->entries), 1, writer->file) != 1) {
+		writer->isFailed = 1;
+	}
+	if(fclose(writer->file) != 0) {
+		writer->isFailed = 1;
+	}
+	writer->file = NULL;
+
+	return !writer->isFailed;
+}
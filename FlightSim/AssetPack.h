@@ -0,0 +1,99 @@
+/*
+ * AssetPack.h
+ * Mike Northorp
+ * One file holding the models and images already in the form the program
+ * uses them, each array at an aligned offset listed in a table of contents
+ * at the front. The program maps the file and uses the arrays where they
+ * lie instead of reading and parsing the loose files. Written by running
+ * FlightSim with -pack.
+ */
+
+#ifndef ASSETPACK_H_
+#define ASSETPACK_H_
+
+// File mapping
+#include <windows.h>
+// Writing the pack
+#include <stdio.h>
+// Meshes the models are stored as
+#include "Mesh.h"
+
+/* Defines */
+
+// Pack the program looks for next to the loose files
+#define ASSET_PACK_FILE "assets.pak"
+// "FSPK" read as a little endian number, and the format version
+#define ASSET_PACK_MAGIC 0x4B505346
+#define ASSET_PACK_VERSION 1
+// Every array starts on this many bytes, enough for any load or copy
+#define ASSET_PACK_ALIGNMENT 64
+// Longest entry name with its terminator and the most entries in a pack
+#define ASSET_PACK_NAME_SIZE 64
+#define ASSET_PACK_MAX_ENTRIES 32
+// Added to a model's name for its low detail copy
+#define ASSET_PACK_LOW_SUFFIX " low"
+
+// Kinds of entry
+#define ASSET_PACK_MESH 1
+#define ASSET_PACK_IMAGE 2
+
+/* Typedefs and structs */
+
+// Start of the file. The sizes of the stored structs are kept so a pack
+// written by a build with a different layout is turned down
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int entryCount;
+	unsigned int vertexBytes;
+	unsigned int polygonBytes;
+	unsigned int fileBytes;
+} AssetPackHeader;
+
+// One model or image, the name is the loose file it was made from
+typedef struct {
+	char name[ASSET_PACK_NAME_SIZE];
+	unsigned int type;
+	// Meshes: vertex, triangle index, edge index and polygon counts.
+	// Images: width, height and bytes per pixel
+	unsigned int counts[4];
+	// Offset of each array from the start of the file, images use the first
+	unsigned int offsets[4];
+} AssetPackEntry;
+
+// A pack mapped for reading
+typedef struct {
+	HANDLE file;
+	HANDLE mapping;
+	const unsigned char *data;
+	size_t size;
+	const AssetPackHeader *header;
+	const AssetPackEntry *entries;
+} AssetPack;
+
+// A pack being written. The table of contents is filled in as entries are
+// added and written over the space kept for it at the end
+typedef struct {
+	FILE *file;
+	AssetPackHeader header;
+	AssetPackEntry entries[ASSET_PACK_MAX_ENTRIES];
+	unsigned int offset;
+	int isFailed;
+} AssetPackWriter;
+
+/* Function list */
+
+// Reading
+int assetPackOpen(AssetPack *pack, const char *fileName);
+void assetPackClose(AssetPack *pack);
+const AssetPackEntry *assetPackFind(const AssetPack *pack, const char *name, unsigned int type);
+int assetPackGetMesh(const AssetPack *pack, const char *name, Mesh *mesh);
+const unsigned char *assetPackGetImage(const AssetPack *pack, const char *name, int *width, int *height);
+
+// Writing
+int assetPackBegin(AssetPackWriter *writer, const char *fileName);
+int assetPackAddMesh(AssetPackWriter *writer, const char *name, const Mesh *mesh);
+int assetPackAddImage(AssetPackWriter *writer, const char *name, const unsigned char *pixels, int width, int height, int bytesPerPixel);
+int assetPackEnd(AssetPackWriter *writer);
+
+#endif /* ASSETPACK_H_ */
@@ -0,0 +1,227 @@
+
+/************************************************************************************
+
+	File: 			AssetWatcher.c
+
+	Description:	Watches a folder with overlapped ReadDirectoryChangesW calls
+					on a thread of its own. File names from the change records
+					are collected until no change has come in for
+					ASSET_WATCHER_SETTLE_MS, then each one is handed to the
+					callback once, still on the watcher thread.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for asset watcher types and functions
+#include "AssetWatcher.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// String functions
+#include <string.h>
+
+/************************************************************************
+
+	Function:		assetWatcherTime
+
+	Description:	Seconds from the performance counter, the same clock
+					getTime reads so the times can be compared.
+
+*************************************************************************/
+static double assetWatcherTime() {
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+/************************************************************************
+
+	Function:		assetWatcherAddPending
+
+	Description:	Holds a changed file until the folder is quiet. A file
+					that is already held keeps the time of its first change.
+
+*************************************************************************/
+static void assetWatcherAddPending(AssetWatcher *watcher, const char *fileName, double changeTime) {
+	int i = 0;
+
+	for(i = 0; i < watcher->pendingCount; i++) {
+		if(_stricmp(watcher->pending[i], fileName) == 0) {
+			return;
+		}
+	}
+
+	if(watcher->pendingCount < ASSET_WATCHER_MAX_PENDING) {
+		strcpy(watcher->pending[watcher->pendingCount], fileName);
+		watcher->pendingTimes[watcher->pendingCount] = changeTime;
+		watcher->pendingCount++;
+	}
+}
+
+/************************************************************************
+
+	Function:		assetWatcherReadRecords
+
+	Description:	Walks the change records of a finished read and holds
+					every file that was written, made or renamed into place.
+					Zero bytes means the records did not fit and were lost.
+
+*************************************************************************/
+static void assetWatcherReadRecords(AssetWatcher *watcher, DWORD bytes) {
+	FILE_NOTIFY_INFORMATION *record = (FILE_NOTIFY_INFORMATION*)watcher->buffer;
+	char fileName[MAX_PATH];
+	double now = assetWatcherTime();
+	int length = 0;
+
+	if(bytes == 0) {
+		return;
+	}
+
+	for(;;) {
+		if(record->Action == FILE_ACTION_MODIFIED || record->Action == FILE_ACTION_ADDED || record->Action == FILE_ACTION_RENAMED_NEW_NAME) {
+			length = WideCharToMultiByte(CP_ACP, 0, record->FileName, record->FileNameLength / sizeof(WCHAR), fileName, MAX_PATH - 1, NULL, NULL);
+			if(length > 0) {
+				fileName[length] = '\0';
+				assetWatcherAddPending(watcher, fileName, now);
+			}
+		}
+		if(record->NextEntryOffset == 0) {
+			break;
+		}
+		record = (FILE_NOTIFY_INFORMATION*)((char*)record + record->NextEntryOffset);
+	}
+}
+
+/************************************************************************
+
+	Function:		assetWatcherMain
+
+	Description:	Main loop of the watcher thread. Keeps one read of the
+					folder going and waits on it and the stop event. While
+					files are held the wait times out once the folder has
+					been quiet long enough and they are reported.
+
+*************************************************************************/
+static DWORD WINAPI assetWatcherMain(LPVOID parameter) {
+	AssetWatcher *watcher = (AssetWatcher*)parameter;
+	HANDLE events[2];
+	DWORD bytes = 0;
+	DWORD result = 0;
+	int isReading = 0;
+	int i = 0;
+
+	events[0] = watcher->overlapped.hEvent;
+	events[1] = watcher->stopEvent;
+
+	for(;;) {
+		// Ask for the next changes
+		if(!isReading) {
+			ResetEvent(watcher->overlapped.hEvent);
+			if(!ReadDirectoryChangesW(watcher->directory, watcher->buffer, sizeof(watcher->buffer), FALSE,
+				FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE,
+				NULL, &watcher->overlapped, NULL)) {
+				break;
+			}
+			isReading = 1;
+		}
+
+		result = WaitForMultipleObjects(2, events, FALSE, watcher->pendingCount > 0 ? ASSET_WATCHER_SETTLE_MS : INFINITE);
+		if(result == WAIT_OBJECT_0 + 1) {
+			break;
+		}
+
+		// Quiet long enough, report what changed
+		if(result == WAIT_TIMEOUT) {
+			for(i = 0; i < watcher->pendingCount; i++) {
+				watcher->changed(watcher->pending[i], watcher->pendingTimes[i], watcher->context);
+			}
+			watcher->pendingCount = 0;
+			continue;
+		}
+
+		isReading = 0;
+		if(!GetOverlappedResult(watcher->directory, &watcher->overlapped, &bytes, FALSE)) {
+			break;
+		}
+		assetWatcherReadRecords(watcher, bytes);
+	}
+
+	// The buffer has to outlive a read that is still going
+	if(isReading) {
+		CancelIo(watcher->directory);
+		GetOverlappedResult(watcher->directory, &watcher->overlapped, &bytes, TRUE);
+	}
+
+	return 0;
+}
+
+/************************************************************************
+
+	Function:		assetWatcherCreate
+
+	Description:	Opens the folder for change notifications and starts the
+					watcher thread. Returns NULL if the folder can not be
+					watched.
+
+*************************************************************************/
+AssetWatcher *assetWatcherCreate(const char *folder, AssetChangedFunction changed, void *context) {
+	AssetWatcher *watcher;
+
+	watcher = (AssetWatcher*)memoryAllocZeroed(MEMORY_ASSETS, sizeof(AssetWatcher));
+	if(watcher == NULL) {
+		return NULL;
+	}
+	watcher->changed = changed;
+	watcher->context = context;
+
+	watcher->directory = CreateFileA(folder, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if(watcher->directory == INVALID_HANDLE_VALUE) {
+		memoryFree(watcher);
+		return NULL;
+	}
+
+	watcher->overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	watcher->stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(watcher->overlapped.hEvent != NULL && watcher->stopEvent != NULL) {
+		watcher->thread = CreateThread(NULL, 0, assetWatcherMain, watcher, 0, NULL);
+	}
+	if(watcher->thread == NULL) {
+		assetWatcherDestroy(watcher);
+		return NULL;
+	}
+
+	return watcher;
+}
+
+/************************************************************************
+
+	Function:		assetWatcherDestroy
+
+	Description:	Stops the watcher thread and closes the folder. Files
+					still waiting for the folder to go quiet are dropped.
+
+*************************************************************************/
+void assetWatcherDestroy(AssetWatcher *watcher) {
+	if(watcher == NULL) {
+		return;
+	}
+
+	if(watcher->thread != NULL) {
+		SetEvent(watcher->stopEvent);
+		WaitForSingleObject(watcher->thread, INFINITE);
+		CloseHandle(watcher->thread);
+	}
+	if(watcher->stopEvent != NULL) {
+		CloseHandle(watcher->stopEvent);
+	}
+	if(watcher->overlapped.hEvent != NULL) {
+		CloseHandle(watcher->overlapped.hEvent);
+	}
+	CloseHandle(watcher->directory);
+	memoryFree(watcher);
+}
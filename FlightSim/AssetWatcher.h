@@ -0,0 +1,53 @@
+/*
+ * AssetWatcher.h
+ * Mike Northorp
+ * Watches a folder on its own thread and reports the files written to it.
+ * Changes are held until the folder has been quiet for a moment so a file
+ * that is saved in pieces is only reported once, after the last write.
+ */
+
+#ifndef ASSETWATCHER_H_
+#define ASSETWATCHER_H_
+
+// Windows directory change notifications and threads
+#include <windows.h>
+
+/* Defines */
+
+// Quiet time after the last change before files are reported
+#define ASSET_WATCHER_SETTLE_MS 100
+// Different files held at once, more than this in one burst are dropped
+#define ASSET_WATCHER_MAX_PENDING 16
+// Bytes of change records read at a time
+#define ASSET_WATCHER_BUFFER_SIZE 4096
+
+/* Typedefs and structs */
+
+// Called on the watcher thread with the changed file name relative to the
+// folder and the getTime style time of its first change
+typedef void (*AssetChangedFunction)(const char *fileName, double changeTime, void *context);
+
+typedef struct {
+	HANDLE directory;
+	HANDLE thread;
+	// Set to tell the thread to stop
+	HANDLE stopEvent;
+	OVERLAPPED overlapped;
+	// Change records, DWORD aligned like ReadDirectoryChangesW wants
+	DWORD buffer[ASSET_WATCHER_BUFFER_SIZE / sizeof(DWORD)];
+
+	AssetChangedFunction changed;
+	void *context;
+
+	// Files changed since the folder was last quiet, only touched by the thread
+	char pending[ASSET_WATCHER_MAX_PENDING][MAX_PATH];
+	double pendingTimes[ASSET_WATCHER_MAX_PENDING];
+	int pendingCount;
+} AssetWatcher;
+
+/* Function list */
+
+AssetWatcher *assetWatcherCreate(const char *folder, AssetChangedFunction changed, void *context);
+void assetWatcherDestroy(AssetWatcher *watcher);
+
+#endif /* ASSETWATCHER_H_ */
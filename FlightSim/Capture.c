@@ -0,0 +1,265 @@
+
+/************************************************************************************
+
+	File: 			Capture.c
+
+	Description:	Video writer for frame capture. The renderer reads each
+					frame back without waiting and hands the pixels over by
+					slot. A thread of its own turns them into a Y4M 4:2:0
+					frame or flips them into a raw BGRA frame and writes them
+					out, then frees the slot, so the main thread only pays
+					for handing the frame over.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for capture types and functions
+#include "Capture.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+// String functions
+#include <string.h>
+
+/************************************************************************
+
+	Function:		captureTime
+
+	Description:	Seconds from the performance counter, for the time
+					spent writing frames.
+
+*************************************************************************/
+static double captureTime() {
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+/************************************************************************
+
+	Function:		captureConvertY4M
+
+	Description:	Turns BGRA pixels, bottom row first, into BT.601 studio
+					range Y, U and V planes, top row first. Each U and V is
+					the average of a 2 by 2 block.
+
+*************************************************************************/
+static void captureConvertY4M(CaptureEncoder *encoder, const unsigned char *pixels) {
+	int width = encoder->width;
+	int height = encoder->height;
+	int stride = width * 4;
+	unsigned char *planeY = encoder->frame;
+	unsigned char *planeU = planeY + width * height;
+	unsigned char *planeV = planeU + (width / 2) * (height / 2);
+	const unsigned char *top;
+	const unsigned char *bottom;
+	int blue = 0;
+	int green = 0;
+	int red = 0;
+	int x = 0;
+	int y = 0;
+
+	// Two rows at a time, the first going out is the last one read back
+	for(y = 0; y < height; y += 2) {
+		top = pixels + (height - 1 - y) * stride;
+		bottom = top - stride;
+		for(x = 0; x < width; x += 2) {
+			planeY[y * width + x] = (unsigned char)(((66 * top[2] + 129 * top[1] + 25 * top[0] + 128) >> 8) + 16);
+			planeY[y * width + x + 1] = (unsigned char)(((66 * top[6] + 129 * top[5] + 25 * top[4] + 128) >> 8) + 16);
+			planeY[(y + 1) * width + x] = (unsigned char)(((66 * bottom[2] + 129 * bottom[1] + 25 * bottom[0] + 128) >> 8) + 16);
+			planeY[(y + 1) * width + x + 1] = (unsigned char)(((66 * bottom[6] + 129 * bottom[5] + 25 * bottom[4] + 128) >> 8) + 16);
+
+			blue = (top[0] + top[4] + bottom[0] + bottom[4] + 2) >> 2;
+			green = (top[1] + top[5] + bottom[1] + bottom[5] + 2) >> 2;
+			red = (top[2] + top[6] + bottom[2] + bottom[6] + 2) >> 2;
+			*planeU++ = (unsigned char)(((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128);
+			*planeV++ = (unsigned char)(((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128);
+
+			top += 8;
+			bottom += 8;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		captureConvertRaw
+
+	Description:	Copies BGRA pixels, bottom row first, top row first.
+
+*************************************************************************/
+static void captureConvertRaw(CaptureEncoder *encoder, const unsigned char *pixels) {
+	int stride = encoder->width * 4;
+	int y = 0;
+
+	for(y = 0; y < encoder->height; y++) {
+		memcpy(encoder->frame + y * stride, pixels + (encoder->height - 1 - y) * stride, stride);
+	}
+}
+
+/************************************************************************
+
+	Function:		captureThreadMain
+
+	Description:	Writes the frames in slot order as they are handed
+					over, freeing each slot once its frame is out. A slot
+					handed over without pixels is a frame that was lost
+					and is only freed. Writes what is left before stopping.
+
+*************************************************************************/
+static DWORD WINAPI captureThreadMain(LPVOID parameter) {
+	CaptureEncoder *encoder = (CaptureEncoder*)parameter;
+	double startTime = 0.0;
+	int slot = 0;
+
+	for(;;) {
+		if(encoder->isBusy[slot]) {
+			startTime = captureTime();
+			if(encoder->pixels[slot] != NULL && !encoder->isWriteFailed) {
+				if(encoder->isY4M) {
+					captureConvertY4M(encoder, encoder->pixels[slot]);
+				} else {
+					captureConvertRaw(encoder, encoder->pixels[slot]);
+				}
+				// Slot is free as soon as the pixels are converted
+				InterlockedExchange(&encoder->isBusy[slot], 0);
+
+				if((encoder->isY4M && fputs("FRAME\n", encoder->file) == EOF) ||
+					fwrite(encoder->frame, 1, encoder->frameBytes, encoder->file) != encoder->frameBytes) {
+					InterlockedExchange(&encoder->isWriteFailed, 1);
+				} else {
+					InterlockedIncrement(&encoder->framesWritten);
+				}
+			} else {
+				InterlockedExchange(&encoder->isBusy[slot], 0);
+			}
+			encoder->encodeTime += captureTime() - startTime;
+			slot = (slot + 1) % CAPTURE_SLOTS;
+			continue;
+		}
+
+		if(encoder->isStopping) {
+			break;
+		}
+		WaitForSingleObject(encoder->wakeEvent, INFINITE);
+	}
+
+	return 0;
+}
+
+/************************************************************************
+
+	Function:		captureCreate
+
+	Description:	Opens the video file, writes the Y4M header when it is
+					one and starts the writing thread. The size is rounded
+					down to even. Returns NULL when the file, the thread or
+					its event can not be made or out of memory.
+
+*************************************************************************/
+CaptureEncoder *captureCreate(const char *fileName, int width, int height) {
+	CaptureEncoder *encoder;
+	size_t nameLength = strlen(fileName);
+
+	width &= ~1;
+	height &= ~1;
+	if(width <= 0 || height <= 0) {
+		return NULL;
+	}
+
+	encoder = (CaptureEncoder*)memoryAllocZeroed(MEMORY_CAPTURE, sizeof(CaptureEncoder));
+	if(encoder == NULL) {
+		return NULL;
+	}
+	encoder->width = width;
+	encoder->height = height;
+	encoder->isY4M = nameLength >= 4 && _stricmp(fileName + nameLength - 4, ".y4m") == 0;
+	encoder->frameBytes = encoder->isY4M ? (size_t)width * height * 3 / 2 : (size_t)width * height * 4;
+	encoder->frame = (unsigned char*)memoryAlloc(MEMORY_CAPTURE, encoder->frameBytes);
+	encoder->file = fopen(fileName, "wb");
+	if(encoder->frame == NULL || encoder->file == NULL) {
+		if(encoder->file != NULL) {
+			fclose(encoder->file);
+		}
+		memoryFree(encoder->frame);
+		memoryFree(encoder);
+		return NULL;
+	}
+	if(encoder->isY4M) {
+		fprintf(encoder->file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, CAPTURE_FRAME_RATE);
+	}
+
+	encoder->wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if(encoder->wakeEvent != NULL) {
+		encoder->thread = CreateThread(NULL, 0, captureThreadMain, encoder, 0, NULL);
+	}
+	if(encoder->thread == NULL) {
+		if(encoder->wakeEvent != NULL) {
+			CloseHandle(encoder->wakeEvent);
+		}
+		fclose(encoder->file);
+		memoryFree(encoder->frame);
+		memoryFree(encoder);
+		return NULL;
+	}
+
+	return encoder;
+}
+
+/************************************************************************
+
+	Function:		captureSubmit
+
+	Description:	Hands over the pixels of the next frame in the given
+					slot, which has to be the one after the last and not
+					busy. The pixels have to stay put while it is busy.
+					NULL pixels hand over a lost frame so the thread moves
+					past its slot.
+
+*************************************************************************/
+void captureSubmit(CaptureEncoder *encoder, int slot, const unsigned char *pixels) {
+	encoder->pixels[slot] = pixels;
+	InterlockedExchange(&encoder->isBusy[slot], 1);
+	SetEvent(encoder->wakeEvent);
+}
+
+/************************************************************************
+
+	Function:		captureIsBusy
+
+	Description:	Returns whether a slot's pixels are still being used.
+
+*************************************************************************/
+int captureIsBusy(CaptureEncoder *encoder, int slot) {
+	return encoder->isBusy[slot] != 0;
+}
+
+/************************************************************************
+
+	Function:		captureDestroy
+
+	Description:	Writes the frames still handed over, stops the thread
+					and closes the file.
+
+*************************************************************************/
+void captureDestroy(CaptureEncoder *encoder) {
+	if(encoder == NULL) {
+		return;
+	}
+
+	InterlockedExchange(&encoder->isStopping, 1);
+	SetEvent(encoder->wakeEvent);
+	WaitForSingleObject(encoder->thread, INFINITE);
+	CloseHandle(encoder->thread);
+	CloseHandle(encoder->wakeEvent);
+
+	fclose(encoder->file);
+	memoryFree(encoder->frame);
+	memoryFree(encoder);
+}
@@ -0,0 +1,63 @@
+/*
+ * Capture.h
+ * Mike Northorp
+ * Writes captured frames to a Y4M or raw video file on a thread of its
+ * own. Frames are handed over by slot and the slot stays busy until the
+ * thread has copied the frame out, so the pixels can be read straight
+ * from where the renderer left them.
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+// Windows threads, events and interlocked functions
+#include <windows.h>
+// File writing
+#include <stdio.h>
+
+/* Defines */
+
+// Frames that can be on their way to the file at once
+#define CAPTURE_SLOTS 4
+// Frames a second written in the Y4M header
+#define CAPTURE_FRAME_RATE 60
+
+/* Typedefs and structs */
+
+typedef struct {
+	FILE *file;
+	// Y4M 4:2:0 when the file name ends in .y4m, otherwise raw BGRA
+	int isY4M;
+	// Frame size, made even for the Y4M chroma
+	int width;
+	int height;
+
+	HANDLE thread;
+	// Set when a frame is handed over or the thread should stop
+	HANDLE wakeEvent;
+	volatile LONG isStopping;
+
+	// Frames are handed over and written in slot order. A slot is busy
+	// from when its BGRA pixels, bottom row first, are handed over until
+	// the thread has converted them. Lost frames are handed over as NULL
+	const unsigned char *pixels[CAPTURE_SLOTS];
+	volatile LONG isBusy[CAPTURE_SLOTS];
+
+	// Frame as it goes in the file, only touched by the thread
+	unsigned char *frame;
+	size_t frameBytes;
+
+	// Written by the thread, read for the report
+	volatile LONG framesWritten;
+	volatile LONG isWriteFailed;
+	volatile double encodeTime;
+} CaptureEncoder;
+
+/* Function list */
+
+CaptureEncoder *captureCreate(const char *fileName, int width, int height);
+void captureSubmit(CaptureEncoder *encoder, int slot, const unsigned char *pixels);
+int captureIsBusy(CaptureEncoder *encoder, int slot);
+void captureDestroy(CaptureEncoder *encoder);
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,448 @@
+
+/************************************************************************************
+
+	File: 			ClusterLights.c
+
+	Description:	Bins point lights into the clusters of the view frustum.
+					First every light is moved into eye space and the tiles
+					and slices the box around it covers are worked out, four
+					lights at a time with SSE. The box is projected from its
+					near side, or its far side where that is wider, so the
+					tiles always cover the whole light. Then each slice
+					counts the lights in its clusters, the counts are added
+					up into offsets, and each slice writes its light
+					indices. Each slice is one task so no two threads ever
+					write the same cluster.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for cluster types and functions
+#include "ClusterLights.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+// memcpy
+#include <string.h>
+// Math header
+#include <math.h>
+// SSE intrinsics
+#include <xmmintrin.h>
+
+// Lights reaching nearer than this to the camera cover the whole screen
+#define CLUSTER_MIN_DEPTH 0.01f
+
+/************************************************************************
+
+	Function:		clusterRun
+
+	Description:	Runs a task over the thread pool, or on this thread when
+					there is no pool.
+
+*************************************************************************/
+static void clusterRun(ClusterGrid *grid, ThreadPoolTask task, int taskCount) {
+	int i = 0;
+
+	if(grid->pool != NULL) {
+		threadPoolRun(grid->pool, task, grid, taskCount);
+	} else {
+		for(i = 0; i < taskCount; i++) {
+			task(grid, i);
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		clusterCreate
+
+	Description:	Makes an empty cluster grid with log slices from the
+					near to the far depth. At most maxIndices light indices
+					are kept, the limit on what the shaders can read. The
+					pool can be NULL to bin on the calling thread.
+
+*************************************************************************/
+ClusterGrid *clusterCreate(float nearDepth, float farDepth, int maxIndices, ThreadPool *pool) {
+	ClusterGrid *grid = (ClusterGrid*)memoryAllocZeroed(MEMORY_LIGHTS, sizeof(ClusterGrid));
+	int i = 0;
+
+	if(grid == NULL) {
+		return NULL;
+	}
+	grid->clusters = (unsigned int*)memoryAllocZeroed(MEMORY_LIGHTS, 2 * CLUSTER_COUNT * sizeof(unsigned int));
+	if(grid->clusters == NULL) {
+		clusterDestroy(grid);
+		return NULL;
+	}
+
+	grid->pool = pool;
+	grid->nearDepth = nearDepth;
+	grid->farDepth = farDepth;
+	grid->maxIndices = maxIndices;
+
+	// Slice k from 1 on starts where log(depth / near) * scale reaches k - 1
+	grid->sliceScale = (CLUSTER_SLICES - 1) / (float)log(farDepth / nearDepth);
+	grid->sliceDepths[0] = 0.0f;
+	for(i = 1; i < CLUSTER_SLICES; i++) {
+		grid->sliceDepths[i] = nearDepth * (float)exp((i - 1) / grid->sliceScale);
+	}
+
+	return grid;
+}
+
+/************************************************************************
+
+	Function:		clusterDestroy
+
+	Description:	Frees a cluster grid. Does nothing for NULL.
+
+*************************************************************************/
+void clusterDestroy(ClusterGrid *grid) {
+	if(grid == NULL) {
+		return;
+	}
+
+	memoryFree(grid->lightData);
+	memoryFree(grid->lightRanges);
+	memoryFree(grid->clusters);
+	memoryFree(grid->indices);
+	memoryFree(grid);
+}
+
+/************************************************************************
+
+	Function:		clusterBoundTask
+
+	Description:	Moves one chunk of lights into eye space and works out
+					the first and last tile across, tile down and slice
+					each one reaches, four lights at a time. Lights behind
+					the camera, past the far depth or off the screen are
+					marked out of view.
+
+*************************************************************************/
+static void clusterBoundTask(void *context, int index) {
+	ClusterGrid *grid = (ClusterGrid*)context;
+	const ClusterLight *lights = grid->lights;
+	const float *m = grid->view;
+	int first = index * CLUSTER_LIGHT_CHUNK;
+	int last = first + CLUSTER_LIGHT_CHUNK;
+	// Lanes hold four lights, the last light fills in past the end
+	int light[4];
+	__m128 position[3];
+	__m128 eye[3];
+	__m128 radius;
+	__m128 nearest;
+	__m128 farthest;
+	__m128 nearClamped;
+	__m128 isCrossing;
+	__m128 isOutside;
+	__m128 low;
+	__m128 high;
+	__m128 lowDepth;
+	__m128 highDepth;
+	__m128 lowEdge;
+	__m128 highEdge;
+	__m128 isPositive;
+	__m128 sliceFirst;
+	__m128 sliceLast;
+	__m128 tileMin[2];
+	__m128 tileMax[2];
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 minusOne = _mm_set1_ps(-1.0f);
+	__m128 minDepth = _mm_set1_ps(CLUSTER_MIN_DEPTH);
+	__m128 tileCounts[2];
+	__m128 tanHalf[2];
+	// Lanes written out for the scalar stores
+	float eyeOut[3][4];
+	float tileOut[4][4];
+	float sliceOut[2][4];
+	float outsideOut[4];
+	float *data;
+	int *range;
+	int axis = 0;
+	int i = 0;
+	int k = 0;
+
+	if(last > grid->lightCount) {
+		last = grid->lightCount;
+	}
+	tileCounts[0] = _mm_set1_ps((float)CLUSTER_TILES_X);
+	tileCounts[1] = _mm_set1_ps((float)CLUSTER_TILES_Y);
+	tanHalf[0] = _mm_set1_ps(grid->tanHalfX);
+	tanHalf[1] = _mm_set1_ps(grid->tanHalfY);
+
+	for(i = first; i < last; i += 4) {
+		for(k = 0; k < 4; k++) {
+			light[k] = i + k < last ? i + k : last - 1;
+		}
+		for(k = 0; k < 3; k++) {
+			position[k] = _mm_set_ps(lights[light[3]].position[k], lights[light[2]].position[k], lights[light[1]].position[k], lights[light[0]].position[k]);
+		}
+		radius = _mm_set_ps(lights[light[3]].radius, lights[light[2]].radius, lights[light[1]].radius, lights[light[0]].radius);
+
+		// Into eye space, the camera looks down -z
+		for(k = 0; k < 3; k++) {
+			eye[k] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[k]), position[0]), _mm_mul_ps(_mm_set1_ps(m[4 + k]), position[1])),
+				_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[8 + k]), position[2]), _mm_set1_ps(m[12 + k])));
+		}
+
+		// Depth range of the box around the light
+		nearest = _mm_sub_ps(_mm_sub_ps(zero, eye[2]), radius);
+		farthest = _mm_add_ps(_mm_sub_ps(zero, eye[2]), radius);
+		nearClamped = _mm_max_ps(nearest, minDepth);
+		isCrossing = _mm_cmplt_ps(nearest, minDepth);
+		isOutside = _mm_or_ps(_mm_cmple_ps(farthest, zero), _mm_cmpgt_ps(nearest, _mm_set1_ps(grid->farDepth)));
+
+		// Screen range across then down. A side with a positive edge is
+		// widest at the near depth, a negative one at the far depth
+		for(axis = 0; axis < 2; axis++) {
+			low = _mm_sub_ps(eye[axis], radius);
+			high = _mm_add_ps(eye[axis], radius);
+			isPositive = _mm_cmpge_ps(low, zero);
+			lowDepth = _mm_or_ps(_mm_and_ps(isPositive, farthest), _mm_andnot_ps(isPositive, nearClamped));
+			isPositive = _mm_cmpge_ps(high, zero);
+			highDepth = _mm_or_ps(_mm_and_ps(isPositive, nearClamped), _mm_andnot_ps(isPositive, farthest));
+			lowEdge = _mm_div_ps(low, _mm_mul_ps(lowDepth, tanHalf[axis]));
+			highEdge = _mm_div_ps(high, _mm_mul_ps(highDepth, tanHalf[axis]));
+			isOutside = _mm_or_ps(isOutside, _mm_andnot_ps(isCrossing, _mm_or_ps(_mm_cmplt_ps(highEdge, minusOne), _mm_cmpgt_ps(lowEdge, one))));
+
+			// Clamped to the screen, lights reaching past the camera cover all of it
+			lowEdge = _mm_andnot_ps(isCrossing, _mm_min_ps(_mm_max_ps(lowEdge, minusOne), one));
+			lowEdge = _mm_or_ps(lowEdge, _mm_and_ps(isCrossing, minusOne));
+			highEdge = _mm_andnot_ps(isCrossing, _mm_min_ps(_mm_max_ps(highEdge, minusOne), one));
+			highEdge = _mm_or_ps(highEdge, _mm_and_ps(isCrossing, one));
+			tileMin[axis] = _mm_mul_ps(_mm_add_ps(lowEdge, one), _mm_mul_ps(_mm_set1_ps(0.5f), tileCounts[axis]));
+			tileMax[axis] = _mm_mul_ps(_mm_add_ps(highEdge, one), _mm_mul_ps(_mm_set1_ps(0.5f), tileCounts[axis]));
+		}
+
+		// Slice of a depth is how many slice starts after the first it has passed
+		sliceFirst = zero;
+		sliceLast = zero;
+		for(k = 1; k < CLUSTER_SLICES; k++) {
+			sliceFirst = _mm_add_ps(sliceFirst, _mm_and_ps(_mm_cmpge_ps(nearest, _mm_set1_ps(grid->sliceDepths[k])), one));
+			sliceLast = _mm_add_ps(sliceLast, _mm_and_ps(_mm_cmpge_ps(farthest, _mm_set1_ps(grid->sliceDepths[k])), one));
+		}
+
+		for(k = 0; k < 3; k++) {
+			_mm_storeu_ps(eyeOut[k], eye[k]);
+		}
+		_mm_storeu_ps(tileOut[0], tileMin[0]);
+		_mm_storeu_ps(tileOut[1], tileMax[0]);
+		_mm_storeu_ps(tileOut[2], tileMin[1]);
+		_mm_storeu_ps(tileOut[3], tileMax[1]);
+		_mm_storeu_ps(sliceOut[0], sliceFirst);
+		_mm_storeu_ps(sliceOut[1], sliceLast);
+		_mm_storeu_ps(outsideOut, _mm_and_ps(isOutside, one));
+
+		for(k = 0; k < 4 && i + k < last; k++) {
+			data = grid->lightData + (i + k) * CLUSTER_LIGHT_FLOATS;
+			data[0] = eyeOut[0][k];
+			data[1] = eyeOut[1][k];
+			data[2] = eyeOut[2][k];
+			data[3] = lights[i + k].radius;
+			data[4] = lights[i + k].color[0];
+			data[5] = lights[i + k].color[1];
+			data[6] = lights[i + k].color[2];
+			data[7] = 0.0f;
+
+			range = grid->lightRanges + (i + k) * 6;
+			range[0] = (int)tileOut[0][k];
+			range[1] = (int)tileOut[1][k];
+			range[2] = (int)tileOut[2][k];
+			range[3] = (int)tileOut[3][k];
+			range[4] = outsideOut[k] != 0.0f ? CLUSTER_SLICES : (int)sliceOut[0][k];
+			range[5] = (int)sliceOut[1][k];
+			// The far edge of the screen is in the last tile
+			if(range[1] >= CLUSTER_TILES_X) {
+				range[1] = CLUSTER_TILES_X - 1;
+			}
+			if(range[3] >= CLUSTER_TILES_Y) {
+				range[3] = CLUSTER_TILES_Y - 1;
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		clusterCountTask
+
+	Description:	Counts the lights in each cluster of one slice and how
+					many indices the slice needs.
+
+*************************************************************************/
+static void clusterCountTask(void *context, int slice) {
+	ClusterGrid *grid = (ClusterGrid*)context;
+	unsigned int *clusters = grid->clusters + 2 * slice * CLUSTER_TILES_X * CLUSTER_TILES_Y;
+	const int *range;
+	int total = 0;
+	int i = 0;
+	int x = 0;
+	int y = 0;
+
+	for(i = 0; i < CLUSTER_TILES_X * CLUSTER_TILES_Y; i++) {
+		clusters[2 * i + 1] = 0;
+	}
+
+	for(i = 0; i < grid->lightCount; i++) {
+		range = grid->lightRanges + i * 6;
+		if(slice < range[4] || slice > range[5]) {
+			continue;
+		}
+		for(y = range[2]; y <= range[3]; y++) {
+			for(x = range[0]; x <= range[1]; x++) {
+				clusters[2 * (y * CLUSTER_TILES_X + x) + 1]++;
+			}
+		}
+		total += (range[1] - range[0] + 1) * (range[3] - range[2] + 1);
+	}
+
+	grid->sliceIndexCounts[slice] = total;
+}
+
+/************************************************************************
+
+	Function:		clusterFillTask
+
+	Description:	Gives each cluster of one slice its place in the
+					indices and writes its lights there in light order.
+					Clusters past the index limit keep only the lights that
+					fit.
+
+*************************************************************************/
+static void clusterFillTask(void *context, int slice) {
+	ClusterGrid *grid = (ClusterGrid*)context;
+	unsigned int *clusters = grid->clusters + 2 * slice * CLUSTER_TILES_X * CLUSTER_TILES_Y;
+	// Lights written to each cluster so far
+	unsigned int written[CLUSTER_TILES_X * CLUSTER_TILES_Y];
+	const int *range;
+	int offset = grid->sliceOffsets[slice];
+	int count = 0;
+	int cluster = 0;
+	int i = 0;
+	int x = 0;
+	int y = 0;
+
+	for(i = 0; i < CLUSTER_TILES_X * CLUSTER_TILES_Y; i++) {
+		count = (int)clusters[2 * i + 1];
+		if(offset + count > grid->maxIndices) {
+			count = offset < grid->maxIndices ? grid->maxIndices - offset : 0;
+		}
+		clusters[2 * i] = offset;
+		clusters[2 * i + 1] = count;
+		written[i] = 0;
+		offset += count;
+	}
+
+	for(i = 0; i < grid->lightCount; i++) {
+		range = grid->lightRanges + i * 6;
+		if(slice < range[4] || slice > range[5]) {
+			continue;
+		}
+		for(y = range[2]; y <= range[3]; y++) {
+			for(x = range[0]; x <= range[1]; x++) {
+				cluster = y * CLUSTER_TILES_X + x;
+				if(written[cluster] < clusters[2 * cluster + 1]) {
+					grid->indices[clusters[2 * cluster] + written[cluster]] = (unsigned short)i;
+					written[cluster]++;
+				}
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		clusterBin
+
+	Description:	Bins the lights for a camera. The view is the world to
+					eye matrix and the projection a symmetric perspective,
+					both column major like OpenGL. Fills in the light data,
+					cluster offsets and counts and the light indices for
+					the shaders. Returns 0 if there was no memory for them.
+
+*************************************************************************/
+int clusterBin(ClusterGrid *grid, const float *view, const float *projection, const ClusterLight *lights, int lightCount) {
+	float *lightData;
+	int *lightRanges;
+	unsigned short *indices;
+	int capacity = 0;
+	int offset = 0;
+	int count = 0;
+	int i = 0;
+
+	if(lightCount > CLUSTER_MAX_LIGHTS) {
+		lightCount = CLUSTER_MAX_LIGHTS;
+	}
+
+	// Room for every light, kept for the next frame
+	if(lightCount > grid->lightCapacity) {
+		capacity = (lightCount + CLUSTER_LIGHT_CHUNK - 1) / CLUSTER_LIGHT_CHUNK * CLUSTER_LIGHT_CHUNK;
+		lightData = (float*)memoryRealloc(MEMORY_LIGHTS, grid->lightData, capacity * CLUSTER_LIGHT_FLOATS * sizeof(float));
+		if(lightData == NULL) {
+			return 0;
+		}
+		grid->lightData = lightData;
+		lightRanges = (int*)memoryRealloc(MEMORY_LIGHTS, grid->lightRanges, capacity * 6 * sizeof(int));
+		if(lightRanges == NULL) {
+			return 0;
+		}
+		grid->lightRanges = lightRanges;
+		grid->lightCapacity = capacity;
+	}
+
+	memcpy(grid->view, view, sizeof(grid->view));
+	grid->tanHalfX = 1.0f / projection[0];
+	grid->tanHalfY = 1.0f / projection[5];
+	grid->lights = lights;
+	grid->lightCount = lightCount;
+
+	// Bounds of every light, then the clusters they fall in
+	clusterRun(grid, clusterBoundTask, (lightCount + CLUSTER_LIGHT_CHUNK - 1) / CLUSTER_LIGHT_CHUNK);
+	clusterRun(grid, clusterCountTask, CLUSTER_SLICES);
+
+	// Slices take their indices in turn, nearest first
+	for(i = 0; i < CLUSTER_SLICES; i++) {
+		grid->sliceOffsets[i] = offset;
+		offset += grid->sliceIndexCounts[i];
+	}
+	grid->droppedIndices = offset > grid->maxIndices ? offset - grid->maxIndices : 0;
+	grid->indexCount = offset - grid->droppedIndices;
+	if(grid->indexCount > grid->indexCapacity) {
+		capacity = grid->indexCount + grid->indexCount / 2;
+		indices = (unsigned short*)memoryRealloc(MEMORY_LIGHTS, grid->indices, capacity * sizeof(unsigned short));
+		if(indices == NULL) {
+			// Nothing binned, the shaders should not read the old clusters
+			grid->lightCount = 0;
+			grid->indexCount = 0;
+			return 0;
+		}
+		grid->indices = indices;
+		grid->indexCapacity = capacity;
+	}
+	clusterRun(grid, clusterFillTask, CLUSTER_SLICES);
+
+	// Numbers for the frame report
+	grid->visibleCount = 0;
+	for(i = 0; i < lightCount; i++) {
+		if(grid->lightRanges[i * 6 + 4] < CLUSTER_SLICES) {
+			grid->visibleCount++;
+		}
+	}
+	grid->litClusterCount = 0;
+	grid->maxClusterLights = 0;
+	for(i = 0; i < CLUSTER_COUNT; i++) {
+		count = (int)grid->clusters[2 * i + 1];
+		if(count > 0) {
+			grid->litClusterCount++;
+		}
+		if(count > grid->maxClusterLights) {
+			grid->maxClusterLights = count;
+		}
+	}
+
+	return 1;
+}
@@ -0,0 +1,96 @@
+/*
+ * ClusterLights.h
+ * Mike Northorp
+ * Clustered point lights. The view frustum is cut into screen tiles and
+ * depth slices and each light is binned into the clusters it can reach,
+ * so shading only loops over the lights of the cluster it is in. Binning
+ * runs four lights at a time with SSE across a thread pool. Does not
+ * depend on OpenGL so it can run without a window.
+ */
+
+#ifndef CLUSTERLIGHTS_H_
+#define CLUSTERLIGHTS_H_
+
+// Worker threads
+#include "ThreadPool.h"
+
+/* Defines */
+
+// Screen tiles across and down and depth slices. Slice 0 is everything
+// nearer than the near depth, the rest split the near to far depth evenly
+// in log depth so clusters stay about as deep as they are wide
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 16
+#define CLUSTER_SLICES 24
+#define CLUSTER_COUNT (CLUSTER_TILES_X * CLUSTER_TILES_Y * CLUSTER_SLICES)
+// Most lights, the light indices are 16 bits
+#define CLUSTER_MAX_LIGHTS 65535
+// Lights given to a thread at a time, a multiple of 4
+#define CLUSTER_LIGHT_CHUNK 512
+// Floats kept for each light for the shaders: eye space position and
+// radius, then the color
+#define CLUSTER_LIGHT_FLOATS 8
+
+/* Typedefs and structs */
+
+// A point light in world space. It lights everything within its radius,
+// fading out to nothing at the edge
+typedef struct {
+	float position[3];
+	float radius;
+	float color[3];
+} ClusterLight;
+
+// Clusters and the lights binned into them, reused every frame
+typedef struct {
+	// NULL to bin on the calling thread only
+	ThreadPool *pool;
+
+	// Depth of the first log slice, lights past the far depth are left out
+	float nearDepth;
+	float farDepth;
+	// Log slices per unit of log depth
+	float sliceScale;
+	// Depth each slice starts at, slice 0 starts at the camera
+	float sliceDepths[CLUSTER_SLICES];
+
+	// Current frame
+	const ClusterLight *lights;
+	int lightCount;
+	float view[16];
+	// Tangent of half the field of view across and down
+	float tanHalfX;
+	float tanHalfY;
+
+	// Per light: the values the shaders read and the first and last tile
+	// across, tile down and slice it reaches. Lights out of view get a
+	// first slice past the last one
+	int lightCapacity;
+	float *lightData;
+	int *lightRanges;
+
+	// Offset into the indices and number of lights for each cluster
+	unsigned int *clusters;
+	// Lights of each cluster in turn, nearest slice first
+	unsigned short *indices;
+	int indexCount;
+	int indexCapacity;
+	// Indices past this are dropped, from the farthest clusters first
+	int maxIndices;
+	int sliceIndexCounts[CLUSTER_SLICES];
+	int sliceOffsets[CLUSTER_SLICES];
+
+	// Results of the last bin
+	int visibleCount;
+	int litClusterCount;
+	int maxClusterLights;
+	int droppedIndices;
+} ClusterGrid;
+
+/* Function list */
+
+ClusterGrid *clusterCreate(float nearDepth, float farDepth, int maxIndices, ThreadPool *pool);
+void clusterDestroy(ClusterGrid *grid);
+int clusterBin(ClusterGrid *grid, const float *view, const float *projection, const ClusterLight *lights, int lightCount);
+
+#endif /* CLUSTERLIGHTS_H_ */
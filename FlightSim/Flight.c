@@ -0,0 +1,426 @@
+
+/************************************************************************************
+
+	File: 			Flight.c
+
+	Description:	Steps a flight from its controls, reads control scripts
+					and writes flight traces. The step is the same one the
+					simulation thread takes, so a script flown here matches
+					the same controls flown in the window.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for flight types and functions
+#include "Flight.h"
+// Tracked allocation for the script events
+#include "MemoryTracker.h"
+// Include math for the heading
+#include <math.h>
+// String functions
+#include <string.h>
+
+/* Defines */
+
+// Ratio of the circumference to the diameter of a circle
+#define FLIGHT_PI 3.14159265f
+// Longest script line read
+#define FLIGHT_LINE_SIZE 256
+
+// Names of the controls in scripts, in control order
+static const char *flightControlNames[FLIGHT_CONTROLS] = {
+	"tilt", "climb", "dive", "faster", "slower", "roll", "crazyroll", "end"
+};
+
+/************************************************************************
+
+	Function:		flightInit
+
+	Description:	Puts the plane at the start, level, heading away and at
+					the slowest speed.
+
+*************************************************************************/
+void flightInit(FlightState *state) {
+	memset(state, 0, sizeof(FlightState));
+	state->position[1] = 2.0f;
+	state->position[2] = 10.0f;
+	state->speed = 0.05f;
+}
+
+/************************************************************************
+
+	Function:		flightStep
+
+	Description:	Takes one simulation step: starts or stops the rolls,
+					spins the propellers, moves the rolls along, turns by
+					the tilt, climbs or dives, speeds up or slows down,
+					moves the plane along its heading and moves the
+					origin tile with it when it has left it.
+
+*************************************************************************/
+void flightStep(FlightState *state, const FlightControls *controls) {
+	// Heading, the move uses it
+	float headingSin = 0.0f;
+	float headingCos = 0.0f;
+	float turnSpeed = 0.0f;
+	// Whole tiles the plane has left the origin tile by
+	int shiftX = 0;
+	int shiftZ = 0;
+
+	// Start or stop a roll when its key was pressed
+	if(controls->isRollPressed) {
+		state->isRolling = !state->isRolling;
+		// Reset the roll amount each time
+		state->rollAmount = 0.0f;
+	}
+	if(controls->isCrazyRollPressed) {
+		state->isCrazyRolling = !state->isCrazyRolling;
+		// Reset the roll amount each time
+		state->rollAmount = 0.0f;
+	}
+
+	// Rotation speed of the propellers
+	if(state->propSpin >= 1.0) {
+		state->propSpin = 0;
+	} else {
+		state->propSpin += FLIGHT_PROP_SPIN_STEP;
+	}
+
+	// Plane trick interp
+	if(state->isRolling || state->isCrazyRolling) {
+		if(state->rollAmount >= 360) {
+			// Resets all roll variables if hits 360
+			state->isRolling = 0;
+			state->isCrazyRolling = 0;
+			state->rollAmount = 0;
+			state->rollHeight = 0;
+		} else {
+			// Increases the height to start the roll
+			if(state->rollHeight <= 1.0) {
+				state->rollHeight += 0.1;
+			} else {
+				// Increases the roll angle
+				state->rollAmount += 4;
+			}
+		}
+	}
+
+	// Bank by the tilt and turn at double the ratio of the tilt
+	state->sideTilt = FLIGHT_MAX_TILT * controls->tilt;
+	turnSpeed += controls->tilt * 2;
+	state->turnAngle += turnSpeed;
+
+	// Reset turn angle if goes over 360
+	if(state->turnAngle > 360) {
+		state->turnAngle = 0;
+	}
+
+	// Plane goes up or down
+	if(controls->isClimbing) {
+		state->position[1] += 0.05;
+	}
+	if(controls->isDiving) {
+		state->position[1] -= 0.05;
+	}
+
+	// Plane goes faster
+	if(controls->isSpeedingUp) {
+		state->speed += 0.005;
+	}
+
+	// Plane goes slower
+	if(controls->isSlowingDown) {
+		// Limit how slow you can go
+		if(state->speed >= 0.05) {
+			state->speed -= 0.005;
+		}
+	}
+
+	// Move the plane along its heading
+	headingSin = (float)sin(state->turnAngle * (FLIGHT_PI/180.0f));
+	headingCos = (float)cos(state->turnAngle * (FLIGHT_PI/180.0f));
+	state->position[0] += headingSin * state->speed;
+	state->position[2] -= headingCos * state->speed;
+
+	// Keep the plane on the origin tile. Whole tiles are a round number
+	// of units so the plane does not move at all in the world
+	shiftX = (int)floor(state->position[0] / FLIGHT_TILE_SIZE);
+	shiftZ = (int)floor(state->position[2] / FLIGHT_TILE_SIZE);
+	if(shiftX != 0 || shiftZ != 0) {
+		state->position[0] -= shiftX * FLIGHT_TILE_SIZE;
+		state->position[2] -= shiftZ * FLIGHT_TILE_SIZE;
+		state->originTile[0] += shiftX;
+		state->originTile[1] += shiftZ;
+	}
+}
+
+/************************************************************************
+
+	Function:		flightWorldPosition
+
+	Description:	Works out where the plane is in the whole world, the
+					corner of the origin tile plus its position on it.
+
+*************************************************************************/
+void flightWorldPosition(const FlightState *state, double *position) {
+	position[0] = state->originTile[0] * (double)FLIGHT_TILE_SIZE + state->position[0];
+	position[1] = state->position[1];
+	position[2] = state->originTile[1] * (double)FLIGHT_TILE_SIZE + state->position[2];
+}
+
+/************************************************************************
+
+	Function:		flightLoadScript
+
+	Description:	Reads a control script. Each line is the time in
+					seconds, a control and for all but the rolls and the
+					end its value, such as "2.5 tilt -0.4" or "10 climb 1".
+					Blank lines and lines starting with # are skipped.
+					Events are put in time order. Returns 0 and prints the
+					line at fault if the file can not be read.
+
+*************************************************************************/
+int flightLoadScript(FlightScript *script, const char *fileName) {
+	FILE *file;
+	FlightEvent *events;
+	FlightEvent event;
+	char line[FLIGHT_LINE_SIZE];
+	char name[32];
+	double seconds = 0.0;
+	float value = 0.0f;
+	int capacity = 0;
+	int lineNumber = 0;
+	int fields = 0;
+	int i = 0;
+
+	memset(script, 0, sizeof(FlightScript));
+	file = fopen(fileName, "r");
+	if(file == NULL) {
+		printf("Could not read the script %s\n", fileName);
+		return 0;
+	}
+
+	while(fgets(line, sizeof(line), file) != NULL) {
+		lineNumber++;
+		fields = sscanf(line, "%lf %31s %f", &seconds, name, &value);
+		if(fields <= 0 || line[strspn(line, " \t")] == '#') {
+			continue;
+		}
+
+		event.control = -1;
+		for(i = 0; i < FLIGHT_CONTROLS; i++) {
+			if(fields >= 2 && strcmp(name, flightControlNames[i]) == 0) {
+				event.control = i;
+			}
+		}
+		if(event.control < 0 || seconds < 0.0 ||
+			(fields < 3 && event.control < FLIGHT_CONTROL_ROLL)) {
+			printf("%s line %d: expected a time, a control and its value\n", fileName, lineNumber);
+			flightFreeScript(script);
+			fclose(file);
+			return 0;
+		}
+		event.step = (unsigned long)(seconds * FLIGHT_STEP_RATE + 0.5);
+		event.value = fields >= 3 ? value : 0.0f;
+
+		if(event.control == FLIGHT_CONTROL_END) {
+			if(script->endStep == 0 || event.step < script->endStep) {
+				script->endStep = event.step;
+			}
+			continue;
+		}
+
+		// Room for more events
+		if(script->eventCount == capacity) {
+			capacity = capacity == 0 ? 64 : capacity * 2;
+			events = (FlightEvent*)memoryRealloc(MEMORY_FLIGHT, script->events, capacity * sizeof(FlightEvent));
+			if(events == NULL) {
+				printf("Out of memory for the script %s\n", fileName);
+				flightFreeScript(script);
+				fclose(file);
+				return 0;
+			}
+			script->events = events;
+		}
+
+		// Into time order, events at the same time keep their order
+		i = script->eventCount++;
+		while(i > 0 && script->events[i - 1].step > event.step) {
+			script->events[i] = script->events[i - 1];
+			i--;
+		}
+		script->events[i] = event;
+	}
+
+	fclose(file);
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		flightFreeScript
+
+	Description:	Frees a script's events.
+
+*************************************************************************/
+void flightFreeScript(FlightScript *script) {
+	memoryFree(script->events);
+	memset(script, 0, sizeof(FlightScript));
+}
+
+/************************************************************************
+
+	Function:		flightRestartScript
+
+	Description:	Goes back to the first event to fly the script again.
+
+*************************************************************************/
+void flightRestartScript(FlightScript *script) {
+	script->nextEvent = 0;
+}
+
+/************************************************************************
+
+	Function:		flightApplyScript
+
+	Description:	Sets the controls for a step from the events due by
+					then. Steps have to be asked for in order. The roll
+					presses only last the step they are in.
+
+*************************************************************************/
+void flightApplyScript(FlightScript *script, unsigned long step, FlightControls *controls) {
+	const FlightEvent *event;
+
+	controls->isRollPressed = 0;
+	controls->isCrazyRollPressed = 0;
+
+	while(script->nextEvent < script->eventCount && script->events[script->nextEvent].step <= step) {
+		event = &script->events[script->nextEvent++];
+		switch(event->control) {
+			case FLIGHT_CONTROL_TILT:
+				controls->tilt = event->value < -1.0f ? -1.0f : (event->value > 1.0f ? 1.0f : event->value);
+				break;
+			case FLIGHT_CONTROL_CLIMB:
+				controls->isClimbing = event->value != 0.0f;
+				break;
+			case FLIGHT_CONTROL_DIVE:
+				controls->isDiving = event->value != 0.0f;
+				break;
+			case FLIGHT_CONTROL_FASTER:
+				controls->isSpeedingUp = event->value != 0.0f;
+				break;
+			case FLIGHT_CONTROL_SLOWER:
+				controls->isSlowingDown = event->value != 0.0f;
+				break;
+			case FLIGHT_CONTROL_ROLL:
+				controls->isRollPressed = !controls->isRollPressed;
+				break;
+			case FLIGHT_CONTROL_CRAZY_ROLL:
+				controls->isCrazyRollPressed = !controls->isCrazyRollPressed;
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		flightWriteControls
+
+	Description:	Writes a script line for each control that changed
+					since the last step, so a flight flown by hand can be
+					flown again as a script. The tilt is written with every
+					digit a float needs so it reads back the very same.
+
+*************************************************************************/
+void flightWriteControls(FILE *file, unsigned long step, const FlightControls *previous, const FlightControls *controls) {
+	double seconds = (double)step / FLIGHT_STEP_RATE;
+
+	if(controls->tilt != previous->tilt) {
+		fprintf(file, "%.4f tilt %.9g\n", seconds, (double)controls->tilt);
+	}
+	if(controls->isClimbing != previous->isClimbing) {
+		fprintf(file, "%.4f climb %d\n", seconds, controls->isClimbing);
+	}
+	if(controls->isDiving != previous->isDiving) {
+		fprintf(file, "%.4f dive %d\n", seconds, controls->isDiving);
+	}
+	if(controls->isSpeedingUp != previous->isSpeedingUp) {
+		fprintf(file, "%.4f faster %d\n", seconds, controls->isSpeedingUp);
+	}
+	if(controls->isSlowingDown != previous->isSlowingDown) {
+		fprintf(file, "%.4f slower %d\n", seconds, controls->isSlowingDown);
+	}
+	if(controls->isRollPressed) {
+		fprintf(file, "%.4f roll\n", seconds);
+	}
+	if(controls->isCrazyRollPressed) {
+		fprintf(file, "%.4f crazyroll\n", seconds);
+	}
+}
+
+/************************************************************************
+
+	Function:		flightTraceOpen
+
+	Description:	Starts a trace file with a header to be filled in when
+					it is closed. Returns 0 if the file can not be written.
+
+*************************************************************************/
+int flightTraceOpen(FlightTrace *trace, const char *fileName) {
+	memset(trace, 0, sizeof(FlightTrace));
+	trace->file = fopen(fileName, "wb");
+	if(trace->file == NULL) {
+		return 0;
+	}
+
+	trace->header.magic = FLIGHT_TRACE_MAGIC;
+	trace->header.version = FLIGHT_TRACE_VERSION;
+	trace->header.stateBytes = sizeof(FlightState);
+	trace->header.stepRate = FLIGHT_STEP_RATE;
+	if(fwrite(&trace->header, sizeof(FlightTraceHeader), 1, trace->file) != 1) {
+		fclose(trace->file);
+		trace->file = NULL;
+		return 0;
+	}
+
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		flightTraceWrite
+
+	Description:	Adds a step record to the trace.
+
+*************************************************************************/
+void flightTraceWrite(FlightTrace *trace, unsigned int step, const FlightState *state) {
+	fwrite(&step, sizeof(step), 1, trace->file);
+	fwrite(state, sizeof(FlightState), 1, trace->file);
+	trace->header.stepCount++;
+}
+
+/************************************************************************
+
+	Function:		flightTraceClose
+
+	Description:	Fills in the header with the step count and the final
+					state and closes the file. Returns 0 if any of the trace
+					could not be written.
+
+*************************************************************************/
+int flightTraceClose(FlightTrace *trace, const FlightState *finalState) {
+	int isWritten = 0;
+
+	trace->header.finalState = *finalState;
+	isWritten = !ferror(trace->file) && fseek(trace->file, 0, SEEK_SET) == 0 &&
+		fwrite(&trace->header, sizeof(FlightTraceHeader), 1, trace->file) == 1;
+	if(fclose(trace->file) != 0) {
+		isWritten = 0;
+	}
+	trace->file = NULL;
+
+	return isWritten;
+}
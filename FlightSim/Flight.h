@@ -0,0 +1,134 @@
+/*
+ * Flight.h
+ * Mike Northorp
+ * The plane's flight: turning, climbing, speeding up and the rolls, one
+ * simulation step at a time from the controls held that step. Keeps no
+ * state of its own so any number of flights can be stepped at once, and
+ * does not depend on OpenGL so flights can run without a window. Also
+ * reads control scripts and writes flight traces for batch runs.
+ */
+
+#ifndef FLIGHT_H_
+#define FLIGHT_H_
+
+// Traces are written with stdio
+#include <stdio.h>
+
+/* Defines */
+
+// Steps each second the flight is tuned for
+#define FLIGHT_STEP_RATE 60
+// Bank at full tilt in degrees
+#define FLIGHT_MAX_TILT 45.0f
+// Turn of the propellers each step, as a fraction of a circle
+#define FLIGHT_PROP_SPIN_STEP 0.05f
+// Width of the tile the position is measured on, the world's tiles are
+// the same. A whole number of units so moving by tiles is exact
+#define FLIGHT_TILE_SIZE 100.0f
+
+// Controls a script can set
+#define FLIGHT_CONTROL_TILT 0
+#define FLIGHT_CONTROL_CLIMB 1
+#define FLIGHT_CONTROL_DIVE 2
+#define FLIGHT_CONTROL_FASTER 3
+#define FLIGHT_CONTROL_SLOWER 4
+#define FLIGHT_CONTROL_ROLL 5
+#define FLIGHT_CONTROL_CRAZY_ROLL 6
+#define FLIGHT_CONTROL_END 7
+#define FLIGHT_CONTROLS 8
+
+// "FSTR" read as a little endian number, and the trace format version
+#define FLIGHT_TRACE_MAGIC 0x52545346
+#define FLIGHT_TRACE_VERSION 2
+
+/* Typedefs and structs */
+
+// Controls held during one step
+typedef struct {
+	// Bank from -1, full left, to 1, full right
+	float tilt;
+	int isClimbing;
+	int isDiving;
+	int isSpeedingUp;
+	int isSlowingDown;
+	// Start or stop a roll this step
+	int isRollPressed;
+	int isCrazyRollPressed;
+} FlightControls;
+
+// Everything about a flight that carries from one step to the next
+typedef struct {
+	// Position from the corner of the origin tile, kept between 0 and one
+	// tile across so the floats stay small however far the plane flies
+	float position[3];
+	// Tile the position is measured from, moved along whole tiles when
+	// the plane leaves it
+	int originTile[2];
+	// Heading and bank in degrees
+	float turnAngle;
+	float sideTilt;
+	// Distance moved each step
+	float speed;
+	// Roll under way, the climb into it from 0 to 1.1 and the roll from
+	// 0 to 360 degrees
+	int isRolling;
+	int isCrazyRolling;
+	float rollHeight;
+	float rollAmount;
+	// How far round the propellers are, 0 to 1
+	float propSpin;
+} FlightState;
+
+// One line of a control script: from this step on the control has this
+// value. Rolls and the end only happen, their value is not used
+typedef struct {
+	unsigned long step;
+	int control;
+	float value;
+} FlightEvent;
+
+// Control script read from a file, its events in step order
+typedef struct {
+	FlightEvent *events;
+	int eventCount;
+	// Step the script ends at, 0 when it has no end line
+	unsigned long endStep;
+	// Next event to apply
+	int nextEvent;
+} FlightScript;
+
+// Start of a trace file. The step count and final state are filled in
+// when the trace is closed. A step record follows for every step: its
+// number as an unsigned int then the flight state after it
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int stateBytes;
+	unsigned int stepRate;
+	unsigned int stepCount;
+	FlightState finalState;
+} FlightTraceHeader;
+
+// A trace being written
+typedef struct {
+	FILE *file;
+	FlightTraceHeader header;
+} FlightTrace;
+
+/* Function list */
+
+void flightInit(FlightState *state);
+void flightStep(FlightState *state, const FlightControls *controls);
+void flightWorldPosition(const FlightState *state, double *position);
+
+int flightLoadScript(FlightScript *script, const char *fileName);
+void flightFreeScript(FlightScript *script);
+void flightRestartScript(FlightScript *script);
+void flightApplyScript(FlightScript *script, unsigned long step, FlightControls *controls);
+void flightWriteControls(FILE *file, unsigned long step, const FlightControls *previous, const FlightControls *controls);
+
+int flightTraceOpen(FlightTrace *trace, const char *fileName);
+void flightTraceWrite(FlightTrace *trace, unsigned int step, const FlightState *state);
+int flightTraceClose(FlightTrace *trace, const FlightState *finalState);
+
+#endif /* FLIGHT_H_ */
@@ -25,17 +25,77 @@
 					set to double buffering, and idle function and keyboard
 					event listeners are set up. glut depth display mode is set.
 					Also set up mouse listener and resize function.
+					With -software the scene is drawn by the software renderer
+					instead, without opening a window.
 
 *************************************************************************/
 void main(int argc, char** argv)
 {
-	// Load the images in for sea and sky and mountains
-	// Load sea
-	loadSea();
-	// Load sky
-	loadSky();
-	// Load mountains
-	loadMountain();
+	// Whether the telemetry ring could be made
+	int result = 0;
+
+	// Start the clock for the time to the first frame
+	programStartTime = getTime();
+	// Check for software renderer options
+	parseCommandLine(argc, argv);
+	// Plane at the start
+	flightInit(&flight);
+	// Fly a script without a window and quit
+	if(headlessScriptName != NULL) {
+		runHeadless();
+		return;
+	}
+	// Fly a script many times over on every core and quit
+	if(monteCarloScriptName != NULL) {
+		runMonteCarlo();
+		return;
+	}
+	// Size the scene from its config and make its storage
+	loadSceneConfig(sceneConfigName);
+	setUpSceneStorage();
+
+	// Write the asset pack from the loose files and quit
+	if(isPackRun) {
+		writeAssetPack();
+		return;
+	}
+	// Time the light binning and quit
+	if(isLightBenchRun) {
+		runLightBenchmark();
+		return;
+	}
+	// Time the ground queries and quit
+	if(isGroundBenchRun) {
+		runGroundBenchmark();
+		return;
+	}
+	// Time the particles of many aircraft and quit
+	if(isParticleBenchRun) {
+		runParticleBenchmark();
+		return;
+	}
+	// Pass planes between the simulators until closed
+	if(isRelayRun) {
+		runRelay();
+		return;
+	}
+	// Time the network with many players and quit
+	if(isNetBenchRun) {
+		runNetBenchmark();
+		return;
+	}
+	// Map the asset pack so the loads below can use it
+	openAssetPack();
+
+	// Software renderer runs on its own and quits
+	if(isSoftwareRun) {
+		// It draws every image from the first frame so load them all now
+		loadSea();
+		loadSky();
+		loadMountain();
+		runSoftwareRenderer();
+		return;
+	}
 
 	// initialize the toolkit
 	glutInit(&argc, argv);
@@ -45,10 +105,55 @@ void main(int argc, char** argv)
 	glutInitWindowSize(windowHeight, windowWidth);
 	// open the screen window
 	glutCreateWindow("Flight Sim");
+	// Load the gl extensions, buffer objects are optional so keep going on failure
+	if(glewInit() != GLEW_OK) {
+		printf("Could not initialize GLEW, using plain texture uploads\n");
+	}
 	//initialize the rendering context
 	init();
-	// Set up texture
+	// Set up pixel buffers for streaming textures
+	setUpTextureStreaming();
+	// Set up the offscreen framebuffer for drawing at a lower resolution
+	setUpSceneFramebuffer();
+	// Set up the textures with placeholders, the images load on first use
 	setUpTexture();
+	// Set up the skybox, its faces come with the sky image
+	setUpSkybox();
+	// Print out memory use at startup
+	printStartupReport();
+	// Share the sky with the simulators joined to the relay
+	if(isNetJoin) {
+		netClient = netClientCreate(NET_DEFAULT_PORT);
+		if(netClient == NULL) {
+			printf("Could not open a socket to join the relay, flying alone\n");
+		}
+	}
+	// Publish the flight state for other programs
+	result = telemetryCreate(&telemetryRing, TELEMETRY_NAME);
+	if(result == TELEMETRY_TAKEN) {
+		printf("Telemetry: another simulator publishes to %s, not publishing\n", TELEMETRY_NAME);
+	} else if(result) {
+		printf("Telemetry: publishing %d samples to %s, read them with TelemetryMonitor\n", TELEMETRY_CAPACITY, TELEMETRY_NAME);
+	} else {
+		printf("Telemetry: could not make the shared memory, not publishing\n");
+	}
+	// Write the controls out as a script to fly again with -headless
+	if(recordFileName != NULL) {
+		recordFile = fopen(recordFileName, "w");
+		if(recordFile == NULL) {
+			printf("Could not write %s, not recording the controls\n", recordFileName);
+		} else {
+			fprintf(recordFile, "# Controls recorded by FlightSim, fly them again with -headless\n");
+		}
+	}
+	// Stream the world in around the plane on loader threads
+	startWorld(WORLD_LOADER_THREADS);
+	// Step the simulation on its own thread from here on
+	startSimulationThread();
+	// Cull the snapshots on another thread before they are drawn
+	startCullingThread();
+	// Reload assets when their files change
+	startAssetWatcher();
 	// register the idle function
 	glutIdleFunc(myIdle);
 	// This handles keyboard input for normal keys
@@ -67,38 +172,6 @@ void main(int argc, char** argv)
 	glutMainLoop();
 }
 
-/************************************************************************
-
-	Function:		planeTricks
-
-	Description:	Causes the plane to do tricks for bonus
-
-*************************************************************************/
-void planeTricks() {
-	// This causes a basic roll
-	if(rollEnabled) {
-		if(rollHeight < 1.0) {
-		 	glTranslatef(0.0, rollHeight, 0.0);
-			glRotatef(20.0f, 1.0f, 0.0f, 0.0f);
-		} else {
-			glRotatef(rollAmount, 0.0f, 0.0f, 1.0f);
-			glTranslatef(0.0f, (1-rollAmount/360) * 1.0, 0.0f);
-		}
-	}
-
-	// Does a crazy roll
-	if(crazyRollEnabled) {
-		if(rollHeight < 1.0) {
-		 	glTranslatef(0.0, rollHeight, 0.0);
-			glRotatef(20.0f, 1.0f, 0.0f, 0.0f);
-		} else {
-			glRotatef(rollAmount, 0.0f, 0.0f, 1.0f);
-			glRotatef(rollAmount, 1.0f, 0.0f, 0.0f);
-			glTranslatef(0.0f, (1-rollAmount/360) * 1.0, 0.0f);
-		}
-	}
-}
-
 /************************************************************************
 
 	Function:		fullScreen
@@ -136,6 +209,9 @@ void myResize(int newWidth, int newHeight)
 	// Update the viewport to still be all of the window
 	glViewport (0, 0, windowWidth, windowHeight);
 
+	// Frame times from before the resize say nothing about the new size
+	governorReset(&governor);
+
 	// Change camera properties
     glMatrixMode(GL_PROJECTION);
 
@@ -143,7 +219,7 @@ void myResize(int newWidth, int newHeight)
     glLoadIdentity();
 
     // Modify the gluPerspective (fovy, aspect, near, far)
-    gluPerspective(45, windowWidth/windowHeight, 0.1, 40000);
+    gluPerspective(45, windowWidth/windowHeight, VIEW_NEAR, VIEW_FAR);
 
     // Back into modelview
 	glMatrixMode(GL_MODELVIEW);
@@ -195,77 +271,285 @@ void mousePosition(int x, int y) {
 		ratioOfTilt = distanceFromCenter/maxMouseMove;
 	}
 
-	// Translate the plane to the left or right depending on ratio, with max tilt being 45 degrees
-	sideTilt = 45 * ratioOfTilt;
+	// Hand the new tilt to the simulation
+	publishControls();
+}
+
+/************************************************************************
+
+	Function:		publishControls
+
+	Description:	Hands the tilt and the keys held to the simulation
+					through the controls triple buffer, so a step never
+					sees half of a change. Runs on the main thread.
+
+*************************************************************************/
+void publishControls() {
+	FlightControls *controls = &heldControls[tripleBufferWriteIndex(&controlsBuffer)];
+
+	memset(controls, 0, sizeof(FlightControls));
+	controls->tilt = ratioOfTilt;
+	controls->isClimbing = upPressed;
+	controls->isDiving = downPressed;
+	controls->isSpeedingUp = forwardPressed;
+	controls->isSlowingDown = backwardPressed;
+	tripleBufferPublish(&controlsBuffer);
 }
 
 /************************************************************************
 
 	Function:		drawProps
 
-	Description:	Draws the left and right propellers for the plane
+	Description:	Draws the left and right propellers for the plane, each
+					with its transform from the snapshot. Propellers drawn
+					as impostors are left for drawPropImpostors.
 
 *************************************************************************/
 void drawProps() {
-	// Draw first propeller (left)
-	glPushMatrix();
-		// Position it in front of plane
-		glTranslatef(-0.35, -0.1, -0.05);
-		// Rotate so it is facing away
-		glRotatef(-90, 0.0f, 1.0f, 0.0f);
-		// Rotate propeller
-		glRotatef(propInterp*360, 1.0f, 0.0f, 0.0f);
-		// Translate to origin
-		glTranslatef(0, 0.15f, -0.35f);
-
-		// Draw propeller
-		glCallList(theProp);
-	glPopMatrix();
+	// Full or low detail propeller
+	GLuint displayList = theProp;
+	int listCalls = propListCalls;
+	Mesh *mesh = &propMesh;
+	GpuMesh *gpuMesh = &propGpuMesh;
+
+	if(isPropImpostorUsed()) {
+		return;
+	}
+
+	if(qualityLowDetailPlane[qualityLevel]) {
+		displayList = thePropLow;
+		listCalls = propLowListCalls;
+		mesh = &propLowMesh;
+		gpuMesh = &propLowGpuMesh;
+	}
 
+	// Draw first propeller (left)
+	drawModel(displayList, listCalls, mesh, gpuMesh, TRANSFORM_PROP_LEFT);
 	// Draw second propeller (right)
-	glPushMatrix();
-		// Position it in front of plane
-		glTranslatef(+0.35, -0.1, -0.05);
-		// Rotate so it is facing away
-		glRotatef(-90, 0.0f, 1.0f, 0.0f);
-		// Rotate propeller
-		glRotatef(propInterp*360, 1.0f, 0.0f, 0.0f);
-		// Translate to origin
-		glTranslatef(0, 0.15f, -0.35f);
-
-		// Draw propeller
-		glCallList(theProp);
-	glPopMatrix();
+	drawModel(displayList, listCalls, mesh, gpuMesh, TRANSFORM_PROP_RIGHT);
+}
+
+/************************************************************************
+
+	Function:		isPropImpostorUsed
+
+	Description:	Returns 1 when the propellers are drawn as discs this
+					frame, because they turn too far between frames for the
+					blades to be seen or because they are only a few pixels
+					across. Wireframe always shows the blades.
+
+*************************************************************************/
+int isPropImpostorUsed() {
+	// Hub in the mesh's own coordinates and in the world
+	GLfloat hub[4];
+	GLfloat worldHub[4];
+	GLfloat *camera = renderSnapshot->cameraPosition;
+	GLfloat distance = 0.0f;
+	GLfloat pixelsAcross = 0.0f;
+
+	if(!isPropImpostorOn || isWireRendering || thePropImpostor == 0) {
+		return 0;
+	}
+	if(propSpinPerFrame > PROP_IMPOSTOR_SPIN) {
+		return 1;
+	}
+
+	// Size on screen with the 90 degree field of view, where a unit at
+	// distance d is half the drawn height over d pixels
+	memcpy(hub, propImpostorCenter, sizeof(propImpostorCenter));
+	hub[3] = 1.0f;
+	matrixTransform(renderSnapshot->objectMatrices[TRANSFORM_PROP_LEFT], hub, worldHub);
+	distance = (GLfloat)sqrt((worldHub[0] - camera[0]) * (worldHub[0] - camera[0]) +
+		(worldHub[1] - camera[1]) * (worldHub[1] - camera[1]) +
+		(worldHub[2] - camera[2]) * (worldHub[2] - camera[2]));
+	if(distance <= 0.0f) {
+		return 0;
+	}
+	pixelsAcross = propImpostorRadius * windowHeight * qualityRenderScale[qualityLevel] / distance;
+
+	return pixelsAcross < PROP_IMPOSTOR_MIN_PIXELS;
+}
+
+/************************************************************************
+
+	Function:		drawPropImpostors
+
+	Description:	Draws both propellers as their textured disc, blended
+					over what is behind them. Drawn after everything else
+					and without writing depth so the skybox does not cover
+					the see through parts.
+
+*************************************************************************/
+void drawPropImpostors() {
+	int i = 0;
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+
+	if(isShaderPath) {
+		// Skybox may have left its own program on
+		glUseProgram(shaderProgram);
+		for(i = 0; i < 2; i++) {
+			drawGpuMeshObject(&propImpostorGpuMesh, TRANSFORM_PROP_LEFT + i, -1, propImpostorTextureID, 0);
+			frameModelTriangles += propImpostorMesh.triangleIndexCount / 3;
+		}
+		frameDriverCalls++;
+	} else {
+		glEnable(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, propImpostorTextureID);
+		for(i = 0; i < 2; i++) {
+			drawModel(thePropImpostor, propImpostorListCalls, &propImpostorMesh, &propImpostorGpuMesh, TRANSFORM_PROP_LEFT + i);
+		}
+		glDisable(GL_TEXTURE_2D);
+		frameDriverCalls += 3;
+	}
+
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+	frameDriverCalls += 5;
+	reportPropImpostorFrames++;
+}
+
+/************************************************************************
+
+	Function:		loadSceneConfig
+
+	Description:	Reads the scene config. Each line is a name and a value,
+					mountains and grid set the most mountains drawn at once
+					and the grid size, worldcache and worldseed the world
+					tile cache in kilobytes and the world's seed, plane and
+					prop the model files. Lines starting with # are
+					comments. Without the file the defaults are kept.
+
+*************************************************************************/
+void loadSceneConfig(const char *fileName) {
+	// Char array to store each line
+	char string[MAX_PATH + 64];
+	char name[64];
+	char value[MAX_PATH];
+	FILE *fileStream;
+
+	fileStream = fopen(fileName, "rt");
+	if(fileStream == NULL) {
+		return;
+	}
+
+	// Read each file line while it is not null
+	while(fgets(string, sizeof(string), fileStream) != NULL) {
+		if(string[0] == '#' || sscanf(string, "%63s %259s", name, value) != 2) {
+			continue;
+		}
+
+		if(strcmp(name, "mountains") == 0) {
+			sceneConfig.mountainCount = atoi(value);
+		} else if(strcmp(name, "grid") == 0) {
+			sceneConfig.gridSize = atoi(value);
+		} else if(strcmp(name, "lights") == 0) {
+			sceneConfig.lightCount = atoi(value);
+		} else if(strcmp(name, "worldcache") == 0) {
+			sceneConfig.worldCacheKB = atoi(value);
+		} else if(strcmp(name, "worldseed") == 0) {
+			sceneConfig.worldSeed = (unsigned int)strtoul(value, NULL, 10);
+		} else if(strcmp(name, "plane") == 0) {
+			strcpy(sceneConfig.planeFile, value);
+		} else if(strcmp(name, "prop") == 0) {
+			strcpy(sceneConfig.propFile, value);
+		} else {
+			printf("Unknown scene config setting %s in %s\n", name, fileName);
+		}
+	}
+
+	fclose(fileStream);
+
+	// Keep the sizes sensible
+	if(sceneConfig.mountainCount < 0) {
+		sceneConfig.mountainCount = 0;
+	}
+	if(sceneConfig.mountainCount > MAX_NUM_MOUNTAINS) {
+		sceneConfig.mountainCount = MAX_NUM_MOUNTAINS;
+	}
+	if(sceneConfig.gridSize < 1) {
+		sceneConfig.gridSize = 1;
+	}
+	if(sceneConfig.gridSize > MAX_GRID_SIZE) {
+		sceneConfig.gridSize = MAX_GRID_SIZE;
+	}
+	if(sceneConfig.lightCount < 0) {
+		sceneConfig.lightCount = 0;
+	}
+	if(sceneConfig.lightCount > MAX_NUM_LIGHTS) {
+		sceneConfig.lightCount = MAX_NUM_LIGHTS;
+	}
+	if(sceneConfig.worldCacheKB < 0) {
+		sceneConfig.worldCacheKB = 0;
+	}
+	if(sceneConfig.worldCacheKB > MAX_WORLD_CACHE_KB) {
+		sceneConfig.worldCacheKB = MAX_WORLD_CACHE_KB;
+	}
+}
+
+/************************************************************************
+
+	Function:		setUpSceneStorage
+
+	Description:	Sets up the arenas and takes every array sized by the
+					scene config from the scene arena. The models are set up
+					to load into their own arenas.
+
+*************************************************************************/
+void setUpSceneStorage() {
+	int count = sceneConfig.mountainCount;
+	int i = 0;
+
+	arenaInit(&sceneArena, "Scene", ARENA_BLOCK_SIZE);
+	arenaInit(&planeArena, "Plane", ARENA_BLOCK_SIZE);
+	arenaInit(&propArena, "Propeller", ARENA_BLOCK_SIZE);
+	arenaInit(&sceneMeshArena, "Scene meshes", ARENA_BLOCK_SIZE);
+	arenaInit(&imageArena, "Images", ARENA_BLOCK_SIZE);
+
+	// Mountains
+	quadricCone = (GLUquadricObj**)arenaAllocZeroed(&sceneArena, count * sizeof(GLUquadricObj*));
+
+	// Mountains, visibility and terrain for every snapshot slot
+	for(i = 0; i < 3; i++) {
+		simSnapshots[i].mountains = (WorldMountain*)arenaAlloc(&sceneArena, count * sizeof(WorldMountain));
+		culledSnapshots[i].mountains = (WorldMountain*)arenaAlloc(&sceneArena, count * sizeof(WorldMountain));
+		simSnapshots[i].isMountainVisible = (GLubyte*)arenaAlloc(&sceneArena, count);
+		culledSnapshots[i].isMountainVisible = (GLubyte*)arenaAlloc(&sceneArena, count);
+		simSnapshots[i].terrainHeights = (float*)arenaAlloc(&sceneArena, WORLD_VIEW_TILES * WORLD_TILE_CORNERS * WORLD_TILE_CORNERS * sizeof(float));
+		culledSnapshots[i].terrainHeights = (float*)arenaAlloc(&sceneArena, WORLD_VIEW_TILES * WORLD_TILE_CORNERS * WORLD_TILE_CORNERS * sizeof(float));
+	}
+	cullOrder = (int*)arenaAlloc(&sceneArena, count * sizeof(int));
+	cullDistances = (float*)arenaAlloc(&sceneArena, count * sizeof(float));
+
+	// Every mountain can be a software draw
+	softwareDraws = (SoftDraw*)arenaAlloc(&sceneArena, (count + SOFTWARE_EXTRA_DRAWS) * sizeof(SoftDraw));
+
+	// Plane and propeller
+	meshInitArena(&planeMesh, &planeArena);
+	meshInitArena(&propMesh, &propArena);
+	meshInitArena(&planeLowMesh, &planeArena);
+	meshInitArena(&propLowMesh, &propArena);
 }
 
 /************************************************************************
 
 	Function:		setUpMountains
 
-	Description:	Sets up random values for mountains
+	Description:	Sets up a cone for each mountain that can be drawn at
+					once. Where the mountains are and their sizes come
+					with the world tiles in each snapshot.
 
 *************************************************************************/
 void setUpMountains() {
 	int i = 0;
 
-	// Set a new random seed value
-	srand (time(0));
-
-	// Set up heights for mountains
-	for(i=0; i<NUM_MOUNTAINS;i++) {
+	for(i=0; i<sceneConfig.mountainCount;i++) {
 
 		// Set up cone
 		quadricCone[i] = gluNewQuadric();
-
-		// Generate a random height
-		randHeightList[i] = (rand()%(20-2))+2;
-		// Generate a random base width
-		baseWidthList[i] = (rand()%(7-1))+1;
-
-		// Generate a random x
-		randXList[i] = (rand()%(150+150))-150;
-		// Generate a random y
-		randZList[i] = (rand()%(150+150))-150;
+		quadricCount++;
 	}
 }
 
@@ -275,10 +559,12 @@ void setUpMountains() {
 
 	Description:	Draws some simple mountains. (not fully random looking
 					but random height and width and size set.. textures
-					also work)
+					also work) They are the mountains of the tiles in view,
+					standing on the ground.
 
 *************************************************************************/
 void drawMountains() {
+	WorldMountain *mountain;
 	int i = 0;
 
 	if(mountainTextureEnabled) {
@@ -286,7 +572,13 @@ void drawMountains() {
 		glEnable(GL_TEXTURE_2D);
 	}
 	// Draw all mountains
-	for(i=0; i<NUM_MOUNTAINS;i++) {
+	for(i=0; i<renderSnapshot->mountainCount;i++) {
+		mountain = &renderSnapshot->mountains[i];
+		// Skip mountains past the draw distance or hidden behind others
+		if(!isMountainInRange(mountain, renderSnapshot->cameraPosition) || !renderSnapshot->isMountainVisible[i]) {
+			continue;
+		}
+
 		// Enable or disable wirerendering based on button press
 		wireRenderingCheck();
 		// Set up normals
@@ -308,7 +600,7 @@ void drawMountains() {
 
 		// Draw cone for mountain
 		glPushMatrix();
-			glTranslatef(randXList[i], 0.0f, randZList[i]);
+			glTranslatef(mountain->x, mountain->base, mountain->z);
 			glRotatef(-90, 1.0f, 0.0f, 0.0f);
 			// Set line width
 			glLineWidth(1);
@@ -323,8 +615,11 @@ void drawMountains() {
 			glMaterialf(GL_FRONT, GL_SHININESS, 200.0f);
 			glMaterialfv(GL_FRONT, GL_SPECULAR, blue);
 			// Set the size (obj, inner, outer, height, slices, stacks)
-			gluCylinder(quadricCone[i], baseWidthList[i], 0, randHeightList[i], 20, 20);
+			gluCylinder(quadricCone[i], mountain->width, 0, mountain->height, 20, 20);
 		glPopMatrix();
+
+		// Count driver calls for the frame report
+		frameDriverCalls += 14 + quadricDriverCalls(20, 20);
 	}
 
 	if(mountainTextureEnabled) {
@@ -337,420 +632,838 @@ void drawMountains() {
 
 /************************************************************************
 
-	Function:		moveAllPlane
+	Function:		buildTerrainMeshes
 
-	Description:	This moves the plane and propellers when tilting or moving
-					in the world.
+	Description:	Remakes the land and sea meshes from the tiles in a
+					snapshot when they changed. Each tile is a grid over its
+					corners with land where a cell rises above the sea and a
+					flat sea patch where it dips below, so the two overlap
+					along the coast and the land hides the sea under it.
+					Tiles are placed against the snapshot's origin tile.
+					Uploaded again on the shader path.
 
 *************************************************************************/
-void moveAllPlane() {
-		// Move the plane to planes position
-		glTranslatef(planePosition[0], planePosition[1], planePosition[2]);
-
-		// Check if we should rotate a certain way depending on where the plane is moving
-
-		// Always check for the planes tilt and rotation
-		// Add planes rotation
-		glRotatef(-turnAngle, 0.0f, 1.0f, 0.0f);
-		// Adds tilt
-		glRotatef(sideTilt*-1, 0.0f, 0.0f, 1.0f);
-
-				// Plane goes up
-		if(upPressed) {
-			// Update camera position and plane position
-			planePosition[1] += 0.05;
-
-			// Add tilt to plane
-			glRotatef(8, 1.0f, 0.0f, 0.0f);
+void buildTerrainMeshes(const SimSnapshot *snapshot) {
+	MeshVertex vertex;
+	const float *heights;
+	float cellSize = WORLD_TILE_SIZE / WORLD_TILE_CELLS;
+	float cornerX = 0.0f;
+	float cornerZ = 0.0f;
+	float lowest = 0.0f;
+	float highest = 0.0f;
+	float length = 0.0f;
+	int firstLand = 0;
+	int firstSea = 0;
+	int left = 0;
+	int right = 0;
+	int up = 0;
+	int down = 0;
+	int tile = 0;
+	int seaStep = 1;
+	int row = 0;
+	int column = 0;
+	int corner = 0;
+
+	if(snapshot->terrainVersion == terrainMeshVersion) {
+		return;
+	}
+	terrainMeshVersion = snapshot->terrainVersion;
+
+	meshFree(&terrainMesh);
+	meshFree(&terrainSeaMesh);
+	memset(&vertex, 0, sizeof(vertex));
+	for(tile = 0; tile < snapshot->terrainTileCount; tile++) {
+		heights = snapshot->terrainHeights + tile * WORLD_TILE_CORNERS * WORLD_TILE_CORNERS;
+		cornerX = (snapshot->terrainTiles[tile][0] - snapshot->originTile[0]) * WORLD_TILE_SIZE;
+		cornerZ = (snapshot->terrainTiles[tile][1] - snapshot->originTile[1]) * WORLD_TILE_SIZE;
+		lowest = heights[0];
+		highest = heights[0];
+		for(corner = 1; corner < WORLD_TILE_CORNERS * WORLD_TILE_CORNERS; corner++) {
+			lowest = heights[corner] < lowest ? heights[corner] : lowest;
+			highest = heights[corner] > highest ? heights[corner] : highest;
 		}
 
-		// Plane goes down
-		if(downPressed) {
-			// Update camera position and plane position
-			planePosition[1] -= 0.05;
-
-			// Add tilt to plane
-			glRotatef(-8, 1.0f, 0.0f, 0.0f);
+		// Corners of the sea patches, flat at sea level with the sea
+		// texture across each tile, mirrored on every other one so the
+		// edges of the image always meet themselves. A tile that is all
+		// sea only needs its four corners
+		firstSea = terrainSeaMesh.vertexCount;
+		seaStep = highest <= 0.0f ? WORLD_TILE_CELLS : 1;
+		if(lowest <= 0.0f) {
+			vertex.position[1] = 0.0f;
+			vertex.normal[0] = 0.0f;
+			vertex.normal[1] = 1.0f;
+			vertex.normal[2] = 0.0f;
+			memcpy(vertex.faceNormal, vertex.normal, sizeof(vertex.faceNormal));
+			vertex.material = MATERIAL_SEA;
+			for(row = 0; row < WORLD_TILE_CORNERS; row += seaStep) {
+				for(column = 0; column < WORLD_TILE_CORNERS; column += seaStep) {
+					vertex.position[0] = cornerX + column * cellSize;
+					vertex.position[2] = cornerZ + row * cellSize;
+					vertex.texCoord[0] = (float)column / WORLD_TILE_CELLS;
+					vertex.texCoord[1] = (float)row / WORLD_TILE_CELLS;
+					if(snapshot->terrainTiles[tile][0] & 1) {
+						vertex.texCoord[0] = 1.0f - vertex.texCoord[0];
+					}
+					if(snapshot->terrainTiles[tile][1] & 1) {
+						vertex.texCoord[1] = 1.0f - vertex.texCoord[1];
+					}
+					vertex.texCoord[0] = SEA_TEXTURE_INSET + vertex.texCoord[0] * (1.0f - 2.0f * SEA_TEXTURE_INSET);
+					vertex.texCoord[1] = SEA_TEXTURE_INSET + vertex.texCoord[1] * (1.0f - 2.0f * SEA_TEXTURE_INSET);
+					meshAddVertex(&terrainSeaMesh, &vertex);
+				}
+			}
 		}
 
-		// Plane goes faster
-		if(forwardPressed) {
-			// Make plane speed faster
-			planeSpeed += 0.005;
+		// Corners of the land, lit by the slope either side of them
+		firstLand = terrainMesh.vertexCount;
+		if(highest > 0.0f) {
+			vertex.material = MATERIAL_TERRAIN;
+			for(row = 0; row < WORLD_TILE_CORNERS; row++) {
+				for(column = 0; column < WORLD_TILE_CORNERS; column++) {
+					corner = row * WORLD_TILE_CORNERS + column;
+					left = column > 0 ? column - 1 : column;
+					right = column < WORLD_TILE_CELLS ? column + 1 : column;
+					up = row > 0 ? row - 1 : row;
+					down = row < WORLD_TILE_CELLS ? row + 1 : row;
+
+					vertex.position[0] = cornerX + column * cellSize;
+					vertex.position[1] = heights[corner];
+					vertex.position[2] = cornerZ + row * cellSize;
+					vertex.normal[0] = -(heights[row * WORLD_TILE_CORNERS + right] - heights[row * WORLD_TILE_CORNERS + left]) / ((right - left) * cellSize);
+					vertex.normal[1] = 1.0f;
+					vertex.normal[2] = -(heights[down * WORLD_TILE_CORNERS + column] - heights[up * WORLD_TILE_CORNERS + column]) / ((down - up) * cellSize);
+					length = (float)sqrt(vertex.normal[0] * vertex.normal[0] + 1.0f + vertex.normal[2] * vertex.normal[2]);
+					vertex.normal[0] /= length;
+					vertex.normal[1] /= length;
+					vertex.normal[2] /= length;
+					memcpy(vertex.faceNormal, vertex.normal, sizeof(vertex.faceNormal));
+					vertex.texCoord[0] = (float)column / WORLD_TILE_CELLS;
+					vertex.texCoord[1] = (float)row / WORLD_TILE_CELLS;
+					meshAddVertex(&terrainMesh, &vertex);
+				}
+			}
+		}
 
-			// Add tilt to plane
-			glRotatef(-5, 1.0f, 0.0f, 0.0f);
+		if(seaStep == WORLD_TILE_CELLS) {
+			addTerrainCell(&terrainSeaMesh, firstSea, 2);
+			continue;
 		}
 
-		// Plane goes slower
-		if(backwardPressed) {
-			// Make plane speed slower
-			// Limit how slow you can go
-			if(planeSpeed >= 0.05) {
-				planeSpeed -= 0.005;
+		// Two triangles and the outline of each cell on whichever meshes it is in
+		for(row = 0; row < WORLD_TILE_CELLS; row++) {
+			for(column = 0; column < WORLD_TILE_CELLS; column++) {
+				corner = row * WORLD_TILE_CORNERS + column;
+				if(heights[corner] > 0.0f || heights[corner + 1] > 0.0f ||
+					heights[corner + WORLD_TILE_CORNERS] > 0.0f || heights[corner + WORLD_TILE_CORNERS + 1] > 0.0f) {
+					addTerrainCell(&terrainMesh, firstLand + corner, WORLD_TILE_CORNERS);
+				}
+				if(heights[corner] <= 0.0f || heights[corner + 1] <= 0.0f ||
+					heights[corner + WORLD_TILE_CORNERS] <= 0.0f || heights[corner + WORLD_TILE_CORNERS + 1] <= 0.0f) {
+					addTerrainCell(&terrainSeaMesh, firstSea + corner, WORLD_TILE_CORNERS);
+				}
 			}
-
-			// Add tilt to plane
-			glRotatef(5, 1.0f, 0.0f, 0.0f);
 		}
+	}
 
-		// Do plane tricks
-		planeTricks();
+	if(isShaderPath) {
+		if(terrainGpuMesh.vertexArray != 0) {
+			deleteGpuMesh(&terrainGpuMesh);
+		}
+		if(terrainSeaGpuMesh.vertexArray != 0) {
+			deleteGpuMesh(&terrainSeaGpuMesh);
+		}
+		uploadMesh(&terrainGpuMesh, &terrainMesh);
+		uploadMesh(&terrainSeaGpuMesh, &terrainSeaMesh);
+	}
 }
 
 /************************************************************************
 
-	Function:		enableFog
+	Function:		addTerrainCell
 
-	Description:	This sets up the fog by enabling it and setting all the
-					fog stuff up.
+	Description:	Adds a heightmap cell to a terrain mesh as two triangles
+					facing up and its four sides for wireframe. Width is
+					the corners in a row of the tile's grid.
 
 *************************************************************************/
-void enableFog() {
-	// define the color of the fog, pink
-	GLfloat fogColor[4] = {0.737255, 0.560784, 0.560784, 1.0};
-	// Enable the fog
-	glEnable(GL_FOG);
-	// set the color of the fog
-	glFogfv(GL_FOG_COLOR, fogColor);
-	// Set the fog mode to exponential
-	glFogf(GL_FOG_MODE, GL_EXP);
-	// Set the fog density
-	glFogf(GL_FOG_DENSITY, 0.005);
+void addTerrainCell(Mesh *mesh, int corner, int width) {
+	meshAddTriangle(mesh, corner, corner + width, corner + 1);
+	meshAddTriangle(mesh, corner + 1, corner + width, corner + width + 1);
+	meshAddEdge(mesh, corner, corner + 1);
+	meshAddEdge(mesh, corner + 1, corner + width + 1);
+	meshAddEdge(mesh, corner + width + 1, corner + width);
+	meshAddEdge(mesh, corner + width, corner);
 }
 
 /************************************************************************
 
-	Function:		setUpProp
+	Function:		drawMeshArrays
 
-	Description:	This reads in the propeller objects from a file and
-					sets them up to be drawn in a display list.
+	Description:	Draws a mesh straight from its arrays on the fixed
+					function path, its outlines when wireframe is on.
 
 *************************************************************************/
-void setUpProp() {
-	// Variables to keep track of file stuff
-	int i = 0;
-	int j = 0;
-	int objectCount = -1;
-	int isFace = 0;
-	char firstChar;
-	char *token;
-
-	// Set up a file
-	FILE * fileStream;
-	// Char array to store
-	char string[100];
-	fileStream = fopen("prop.txt", "rt");
-
-	// Make sure the file stream is not null
-	if (fileStream != NULL)
-	{
-		// Puts the propeller in a display list
-		theProp = glGenLists(1);
-	  	glNewList(theProp, GL_COMPILE);
+void drawMeshArrays(Mesh *mesh) {
+	if(mesh->vertexCount == 0) {
+		return;
+	}
 
-		// Read each file line while it is not null, store in char array
-		while(fgets(string, 100, fileStream) != NULL)
-		{
-			firstChar = ' ';
-			// Store the plane vertices as it reads the file
-			if(sscanf(string, "v %f %f %f ", &propVertices[i][0], &propVertices[i][1], &propVertices[i][2]) == 3) {
-				// Above stores vertices in the plane vertices array
-				// Increase i for reading in vertices
-				i++;
-			} else if(sscanf(string, "n %f %f %f ", &propNormals[j][0], &propNormals[j][1], &propNormals[j][2]) == 3) {
-				// Above stores  the normals in the planenormals array
-				j++;
-			} else if(sscanf(string, "%c", &firstChar) == 1) { // Check if it is a face and tokenize it
-				if(firstChar == 'f') {
-					// Check for faces
-					token = strtok(string, " ");
-					// Get next token
-					token = strtok(NULL, " ");
-
-					// Draw polygon for this face
-					glBegin(GL_POLYGON);
-						glLineWidth(1);
-						while(token != NULL ) {
-							// Draw the normal and point
-							glMaterialf(GL_FRONT, GL_SHININESS, 100.0f);
-
-							// Set the colors depending on the object
-							if(objectCount <= 0) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, orange);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, orange);
-							} else if(objectCount <= 1) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, red);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, red);
-							} else {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, yellow);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, yellow);
-							}
-							// Get normal and draw color
-							glNormal3f(propNormals[atoi(token)-1][0], propNormals[atoi(token)-1][1], propNormals[atoi(token)-1][2]);
-							glVertex3f(propVertices[atoi(token)-1][0], propVertices[atoi(token)-1][1], propVertices[atoi(token)-1][2]);
-							// Get next token
-							token = strtok(NULL, " ");
-						}
-					glEnd(); // End drawing of polygon
-				} else if (firstChar == 'g') {
-					// Increase object count
-					objectCount++;
-				}
-			}
-		}
-		// End the display list
-		glEndList();
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), mesh->vertices[0].position);
+	glNormalPointer(GL_FLOAT, sizeof(MeshVertex), mesh->vertices[0].normal);
+	glTexCoordPointer(2, GL_FLOAT, sizeof(MeshVertex), mesh->vertices[0].texCoord);
+	if(isWireRendering) {
+		glDrawElements(GL_LINES, mesh->edgeIndexCount, GL_UNSIGNED_INT, mesh->edgeIndices);
+	} else {
+		glDrawElements(GL_TRIANGLES, mesh->triangleIndexCount, GL_UNSIGNED_INT, mesh->triangleIndices);
 	}
-	fclose (fileStream);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+	// Count driver calls for the frame report
+	frameDriverCalls += 10;
 }
 
 /************************************************************************
 
-	Function:		setUpPlane()
+	Function:		drawTerrain
 
-	Description:	This sets up the plane by reading it in from a file and
-					drawing it in a display list.
+	Description:	Draws the sea patches with the sea texture and fog,
+					then the land, on the fixed function path.
 
 *************************************************************************/
-void setUpPlane() {
-	int i = 0;
-	int j = 0;
-	int objectCount = -1;
-	int isFace = 0;
-	char firstChar;
-	char *token;
-
-	// Set up a file
-	FILE * fileStream;
-	// Char array to store
-	char string[100];
-	fileStream = fopen("plane.txt", "rt");
-
-	// Make sure the file stream is not null
-	if (fileStream != NULL)
-	{
-		// Puts the ship in a display list
-		thePlane = glGenLists(1);
-	  	glNewList(thePlane, GL_COMPILE);
-
-		// Read each file line while it is not null, store in char array
-		while(fgets(string, 100, fileStream) != NULL)
-		{
-			firstChar = ' ';
-			// Store the plane vertices as it reads the file
-			if(sscanf(string, "v %f %f %f ", &planeVertices[i][0], &planeVertices[i][1], &planeVertices[i][2]) == 3) {
-				// Above stores vertices in the plane vertices array
-				// Increase i for reading in vertices
-				i++;
-			} else if(sscanf(string, "n %f %f %f ", &planeNormals[j][0], &planeNormals[j][1], &planeNormals[j][2]) == 3) {
-				// Above stores  the normals in the planenormals array
-				j++;
-			} else if(sscanf(string, "%c", &firstChar) == 1) { // Check if it is a face and tokenize it
-				if(firstChar == 'f') {
-					// Check for faces
-					token = strtok(string, " ");
-					// Get next token
-					token = strtok(NULL, " ");
-
-					// Draw polygon for this face
-					glBegin(GL_POLYGON);
-						glLineWidth(1);
-						while(token != NULL ) {
-							// Draw the normal and point
-							glMaterialf(GL_FRONT, GL_SHININESS, 10.0f);
-
-							// Colors depend on which object it is
-							if(objectCount <= 3) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, yellow);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							} else if(objectCount <= 5) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, black);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							} else if(objectCount <= 6) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, lightPurple);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							} else if(objectCount <= 7) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, blue);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							} else if(objectCount <= 10) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, yellow);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							} else if(objectCount <= 11) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, black);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							} else if(objectCount <= 13) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, yellow);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							} else if(objectCount <= 25) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, blue);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							} else if(objectCount <= 32) {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, yellow);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							} else {
-								glMaterialfv(GL_FRONT, GL_DIFFUSE, blue);
-								glMaterialfv(GL_FRONT, GL_AMBIENT, grey);
-								glMaterialfv(GL_FRONT, GL_SPECULAR, white);
-							}
-							// Get normal and draw color
-							glNormal3f(planeNormals[atoi(token)-1][0], planeNormals[atoi(token)-1][1], planeNormals[atoi(token)-1][2]);
-							glVertex3f(planeVertices[atoi(token)-1][0], planeVertices[atoi(token)-1][1], planeVertices[atoi(token)-1][2]);
-							// Get next token
-							token = strtok(NULL, " ");
-						}
-					glEnd(); // End drawing of polygon
-				} else if (firstChar == 'g') {
-					// Increase object count
-					objectCount++;
-				}
-			}
-		}
-		// End the display list
-		glEndList();
+void drawTerrain() {
+	// Set up texture for the sea patches
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, seaTextureID);
+	// Enable fog for sea only
+	if(isFog) {
+		enableFog();
 	}
-	fclose (fileStream);
+	// Line width is 1
+	glLineWidth(1);
+	// Set up colors
+	glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, seaBlue);
+	glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, grey);
+	drawMeshArrays(&terrainSeaMesh);
+
+	// Disable the texture and the fog after drawing the sea
+	glDisable(GL_TEXTURE_2D);
+	glDisable(GL_FOG);
+
+	// Land is dull green
+	glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, landGreen);
+	glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, grey);
+	glMaterialfv(GL_FRONT, GL_SPECULAR, black);
+	drawMeshArrays(&terrainMesh);
 }
 
 /************************************************************************
 
-	Function:		drawPlane
+	Function:		placeSceneLight
 
-	Description:	This draws the plane and accounts for movment by user.
+	Description:	Puts the light at its height over the camera so the
+					world is lit the same however far the plane flies.
 
 *************************************************************************/
-void drawPlane() {
-
-	// Draw plane
-	glPushMatrix();
-		// Move plane and propellers depending on buttons pressed and
-		// mouse position
-		moveAllPlane();
-
-		// Draw propellers
-		drawProps();
-
-		// Rotate the ship so it is facing away
-		glRotatef(-90, 0.0f, 1.0f, 0.0f);
-
-		// Draw the plane from display list
-		glCallList(thePlane);
-	glPopMatrix();
+void placeSceneLight(const GLfloat *camera, GLfloat *position) {
+	position[0] = lightPosition[0] + camera[0];
+	position[1] = lightPosition[1];
+	position[2] = lightPosition[2] + camera[2];
+	position[3] = lightPosition[3];
 }
 
 /************************************************************************
 
-	Function:		wireRenderingCheck
+	Function:		buildObjectTransforms
 
-	Description:	This checks to see which rendering is enabled and enables
-					it
+	Description:	Works out the model matrix of the plane and both
+					propellers from the plane's position, turn, tilt and
+					tricks. The chain is built with quaternions and each
+					object's matrix is made once at the end. The simulation
+					puts the results in each snapshot for every render path.
 
 *************************************************************************/
-void wireRenderingCheck() {
-	// Enable or disable wirerendering based on button press
-	if(isWireRendering) {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	} else {
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+void buildObjectTransforms(GLfloat (*matrices)[16]) {
+	Transform plane;
+
+	// Position, turn and tilt
+	transformIdentity(&plane);
+	transformTranslate(&plane, flight.position[0], flight.position[1], flight.position[2]);
+	transformRotate(&plane, -flight.turnAngle, 0.0f, 1.0f, 0.0f);
+	transformRotate(&plane, flight.sideTilt*-1, 0.0f, 0.0f, 1.0f);
+
+	// Tilt for the keys held down the last step
+	if(stepControls.isClimbing) {
+		transformRotate(&plane, 8, 1.0f, 0.0f, 0.0f);
+	}
+	if(stepControls.isDiving) {
+		transformRotate(&plane, -8, 1.0f, 0.0f, 0.0f);
 	}
+	if(stepControls.isSpeedingUp) {
+		transformRotate(&plane, -5, 1.0f, 0.0f, 0.0f);
+	}
+	if(stepControls.isSlowingDown) {
+		transformRotate(&plane, 5, 1.0f, 0.0f, 0.0f);
+	}
+
+	// Barrel roll or crazy roll
+	applyPlaneRoll(&plane, flight.isRolling, flight.isCrazyRolling, flight.rollHeight, flight.rollAmount);
+
+	finishPlaneTransforms(&plane, flight.propSpin, matrices);
 }
 
 /************************************************************************
 
-	Function:		drawSkyAndSea
+	Function:		applyPlaneRoll
 
-	Description:	This draws the quadric objects for the sky and sea
-					as well as maps the textures to them.
+	Description:	Adds a barrel roll and crazy roll to the plane's chain.
+					The plane climbs to the roll height nose up, then rolls
+					through the roll amount in degrees. Shared by the plane
+					and the planes of other simulators.
 
 *************************************************************************/
-void drawSkyAndSea() {
-	// Set up disk and cylinder
-	quadricCylinder = gluNewQuadric();
-	quadricDisk = gluNewQuadric();
-
-	// Enable or disable wirerendering based on button press
-	wireRenderingCheck();
-
-	// Set up normals
-	glShadeModel(GL_SMOOTH);
-
-	gluQuadricDrawStyle(quadricDisk, GLU_SMOOTH);
-	gluQuadricDrawStyle(quadricCylinder, GLU_SMOOTH);
+void applyPlaneRoll(Transform *plane, int isRolling, int isCrazyRolling, GLfloat height, GLfloat amount) {
+	// Basic roll
+	if(isRolling) {
+		if(height < 1.0) {
+			transformTranslate(plane, 0.0, height, 0.0);
+			transformRotate(plane, 20.0f, 1.0f, 0.0f, 0.0f);
+		} else {
+			transformRotate(plane, amount, 0.0f, 0.0f, 1.0f);
+			transformTranslate(plane, 0.0f, (1-amount/360) * 1.0, 0.0f);
+		}
+	}
 
-	// Set up textures
-	gluQuadricTexture(quadricCylinder, GL_TRUE);
-	gluQuadricTexture(quadricDisk, GL_TRUE);
+	// Crazy roll
+	if(isCrazyRolling) {
+		if(height < 1.0) {
+			transformTranslate(plane, 0.0, height, 0.0);
+			transformRotate(plane, 20.0f, 1.0f, 0.0f, 0.0f);
+		} else {
+			transformRotate(plane, amount, 0.0f, 0.0f, 1.0f);
+			transformRotate(plane, amount, 1.0f, 0.0f, 0.0f);
+			transformTranslate(plane, 0.0f, (1-amount/360) * 1.0, 0.0f);
+		}
+	}
+}
 
-	// Set up the quadric normals
-	gluQuadricNormals(quadricDisk, GLU_SMOOTH);
-	gluQuadricNormals(quadricCylinder, GLU_SMOOTH);
+/************************************************************************
 
-	// Bind the texture to the quadric
+	Function:		finishPlaneTransforms
 
-	// Set up texture for disk base (sea)
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, skyTextureID);
-	gluQuadricTexture(quadricCylinder, skyTextureID);
+	Description:	Makes the propeller and plane matrices from the plane's
+					chain. Spin is how far round the propellers are, 0 to 1.
 
-	// Draw cylinder
-	glPushMatrix();
-		// Set line width
-		glLineWidth(1);
-		// Rotate it to correct position
-		glRotatef(-90, 1.0f, 0.0f, 0.0f);
-		// Set the colors
-		glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, orange);
-		glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, grey);
-		// Set the size (obj, inner, outer, height, slices, stacks)
-		gluCylinder(quadricCylinder, 200, 200, 100, 100, 100);
-	glPopMatrix();
+*************************************************************************/
+void finishPlaneTransforms(Transform *plane, GLfloat spin, GLfloat (*matrices)[16]) {
+	Transform prop;
+	int i = 0;
 
-	glDisable(GL_TEXTURE_2D);
+	// Propellers in front of the plane, turned to face away and spinning
+	for(i = 0; i < 2; i++) {
+		prop = *plane;
+		transformTranslate(&prop, i == 0 ? -0.35f : 0.35f, -0.1f, -0.05f);
+		transformRotate(&prop, -90, 0.0f, 1.0f, 0.0f);
+		transformRotate(&prop, spin*360, 1.0f, 0.0f, 0.0f);
+		transformTranslate(&prop, 0, 0.15f, -0.35f);
+		transformToMatrix(&prop, matrices[TRANSFORM_PROP_LEFT + i]);
+	}
 
-	// Set up texture for disk base (sea)
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, seaTextureID);
-	gluQuadricTexture(quadricDisk, seaTextureID);
+	// Rotate the ship so it is facing away
+	transformRotate(plane, -90, 0.0f, 1.0f, 0.0f);
+	transformToMatrix(plane, matrices[TRANSFORM_PLANE]);
+}
 
-	glPushMatrix();
-		// Enable fog for sea only
-		if(isFog) {
-			enableFog();
-		}
-		// Line width is 1
-		glLineWidth(1);
-		// Move it to correct position
-		glRotatef(-90, 1.0f, 0.0f, 0.0f);
-		// Set up colors
-		glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, seaBlue);
-		glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, grey);
-		// Set up the size (obj, inner, outer, slices, stacks)
-		gluDisk(quadricDisk, 0, 201, 100, 100);
-	glPopMatrix();
+/************************************************************************
 
-	// Disable the texture
-	glDisable(GL_TEXTURE_2D);
+	Function:		buildRemoteTransforms
 
-	// Disable the fog after drawing the disk base
-	glDisable(GL_FOG);
+	Description:	Works out the model matrices of a plane from another
+					simulator the same way as the plane's own. Only what
+					was sent is known, so there is no tilt for the keys
+					held down and the propellers spin with the step. The
+					plane comes placed in the whole world and is moved
+					against the origin tile before it is made a float.
 
-	drawMountains();
+*************************************************************************/
+void buildRemoteTransforms(const NetPlane *remote, GLfloat (*matrices)[16]) {
+	Transform plane;
+	GLfloat spin = (GLfloat)fmod(remote->step * FLIGHT_PROP_SPIN_STEP, 1.0);
+
+	transformIdentity(&plane);
+	transformTranslate(&plane, (GLfloat)(remote->position[0] - flight.originTile[0] * (double)WORLD_TILE_SIZE),
+		(GLfloat)remote->position[1], (GLfloat)(remote->position[2] - flight.originTile[1] * (double)WORLD_TILE_SIZE));
+	transformRotate(&plane, -remote->turnAngle, 0.0f, 1.0f, 0.0f);
+	transformRotate(&plane, -remote->sideTilt, 0.0f, 0.0f, 1.0f);
+	applyPlaneRoll(&plane, remote->isRolling, remote->isCrazyRolling, remote->rollHeight, remote->rollAmount);
+
+	finishPlaneTransforms(&plane, spin, matrices);
 }
 
 /************************************************************************
 
-	Function:		drawFrameReferenceGrid
+	Function:		enableFog
 
-	Description:	This draws the initial frame of reference and the axis
+	Description:	This sets up the fog by enabling it and setting all the
+					fog stuff up.
+
+*************************************************************************/
+void enableFog() {
+	// Enable the fog
+	glEnable(GL_FOG);
+	// set the color of the fog
+	glFogfv(GL_FOG_COLOR, fogColor);
+	// Set the fog mode to exponential
+	glFogf(GL_FOG_MODE, GL_EXP);
+	// Set the fog density
+	glFogf(GL_FOG_DENSITY, fogDensity);
+}
+
+/************************************************************************
+
+	Function:		setUpProp
+
+	Description:	This reads in the propeller objects from a file and
+					sets them up to be drawn in a display list, along with
+					a low detail copy.
+
+*************************************************************************/
+void setUpProp() {
+	// Read the propeller into its mesh
+	loadModel(sceneConfig.propFile, &propMesh, &propLowMesh, propMaterialIndex, PROP_LOW_DETAIL_CELLS);
+
+	// Puts the propeller in a display list
+	theProp = compileModelList(&propMesh, 0, &propListCalls);
+	thePropLow = compileModelList(&propLowMesh, 0, &propLowListCalls);
+
+	// Disc drawn instead when the propellers spin fast or are small
+	setUpPropImpostor();
+}
+
+/************************************************************************
+
+	Function:		setUpPropImpostor
+
+	Description:	Makes the disc a spinning propeller is drawn as instead
+					of its blades. The disc covers the circle the blades
+					sweep around the hub and its texture is the blades
+					averaged over a turn. Needs the propeller mesh and the
+					material table, and is made again when the propeller
+					is reloaded.
+
+*************************************************************************/
+void setUpPropImpostor() {
+	// Corners of the disc, on the circle's y and z in the order they are drawn
+	GLfloat sides[4][2] = {{-1.0f, 1.0f}, {-1.0f, -1.0f}, {1.0f, -1.0f}, {1.0f, 1.0f}};
+	MeshVertex corners[4];
+	MeshVertex *vertex;
+	Material *material = &materialTable[MATERIAL_PROP_IMPOSTOR];
+	// Blades averaged over a turn
+	GLubyte *pixels;
+	GLfloat minX = 0.0f;
+	GLfloat maxX = 0.0f;
+	GLfloat y = 0.0f;
+	GLfloat z = 0.0f;
+	GLfloat radius = 0.0f;
+	int startCalls = propImpostorListCalls;
+	int i = 0;
+
+	// Hub the propellers spin around, buildObjectTransforms moves them by
+	// the opposite before the spin, and the blade tip farthest from it
+	propImpostorCenter[1] = -0.15f;
+	propImpostorCenter[2] = 0.35f;
+	propImpostorRadius = 0.0f;
+	for(i = 0; i < propMesh.vertexCount; i++) {
+		vertex = &propMesh.vertices[i];
+		if(i == 0 || vertex->position[0] < minX) {
+			minX = vertex->position[0];
+		}
+		if(i == 0 || vertex->position[0] > maxX) {
+			maxX = vertex->position[0];
+		}
+		y = vertex->position[1] - propImpostorCenter[1];
+		z = vertex->position[2] - propImpostorCenter[2];
+		radius = (GLfloat)sqrt(y*y + z*z);
+		if(radius > propImpostorRadius) {
+			propImpostorRadius = radius;
+		}
+	}
+	propImpostorCenter[0] = (minX + maxX) / 2.0f;
+
+	// One quad across the circle, facing along the spin axis. The texture
+	// is seen from the front, the side the camera follows from
+	meshInitArena(&propImpostorMesh, &propArena);
+	memset(corners, 0, sizeof(corners));
+	for(i = 0; i < 4; i++) {
+		corners[i].position[0] = propImpostorCenter[0];
+		corners[i].position[1] = propImpostorCenter[1] + sides[i][0] * propImpostorRadius;
+		corners[i].position[2] = propImpostorCenter[2] + sides[i][1] * propImpostorRadius;
+		corners[i].normal[0] = 1.0f;
+		corners[i].texCoord[0] = (1.0f - sides[i][1]) / 2.0f;
+		corners[i].texCoord[1] = (1.0f + sides[i][0]) / 2.0f;
+		corners[i].material = MATERIAL_PROP_IMPOSTOR;
+	}
+	meshAddPolygon(&propImpostorMesh, corners, 4);
+
+	// Average the blades into the texture
+	pixels = (GLubyte*)memoryAlloc(MEMORY_SOFT_RASTER, PROP_IMPOSTOR_SIZE * PROP_IMPOSTOR_SIZE * 4);
+	if(pixels == NULL || !bakePropImpostor(pixels)) {
+		printf("Could not make the propeller impostor, propellers are always drawn in full\n");
+		memoryFree(pixels);
+		return;
+	}
+	if(propImpostorTextureID == 0) {
+		glGenTextures(1, &propImpostorTextureID);
+	}
+	glBindTexture(GL_TEXTURE_2D, propImpostorTextureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	gluBuild2DMipmaps(GL_TEXTURE_2D, GL_RGBA, PROP_IMPOSTOR_SIZE, PROP_IMPOSTOR_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	propImpostorTextureBytes = estimateTextureBytes(GL_TEXTURE_2D, 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	memoryFree(pixels);
+
+	// Display list for the fixed function path, lit like the blades but
+	// without the highlight so the texture gives the color
+	if(thePropImpostor != 0) {
+		glDeleteLists(thePropImpostor, 1);
+		displayListCallCount -= propImpostorListCalls;
+		propImpostorListCalls = 0;
+		startCalls = 0;
+	}
+	thePropImpostor = glGenLists(1);
+	glNewList(thePropImpostor, GL_COMPILE);
+		glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, material->shininess[0]);
+		glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, material->diffuse);
+		glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, material->ambient);
+		glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, material->specular);
+		glBegin(GL_QUADS);
+			for(i = 0; i < 4; i++) {
+				vertex = &propImpostorMesh.vertices[i];
+				glTexCoord2fv(vertex->texCoord);
+				glNormal3fv(vertex->normal);
+				glVertex3fv(vertex->position);
+			}
+		glEnd();
+	glEndList();
+	propImpostorListCalls += 4 + 2 + 4 * 3;
+	displayListCallCount += propImpostorListCalls - startCalls;
+
+	// Shader path mesh, once the shader path is set up
+	if(propImpostorGpuMesh.vertexArray != 0) {
+		deleteGpuMesh(&propImpostorGpuMesh);
+		uploadMesh(&propImpostorGpuMesh, &propImpostorMesh);
+	}
+}
+
+/************************************************************************
+
+	Function:		bakePropImpostor
+
+	Description:	Draws the propeller at evenly spaced angles through a
+					turn with the software renderer, looking down the spin
+					axis, and averages them into RGBA pixels. Alpha is how
+					often a blade covers the pixel, the color is the blades'
+					unlit material color. Returns 0 if the renderer could
+					not be made.
+
+*************************************************************************/
+int bakePropImpostor(GLubyte *pixels) {
+	SoftRaster *raster;
+	SoftFrame frame;
+	SoftDraw draw;
+	// Blade color times coverage and the coverage, added over every angle
+	float *sums;
+	const unsigned char *pixel;
+	float coverage = 0.0f;
+	int pixelCount = PROP_IMPOSTOR_SIZE * PROP_IMPOSTOR_SIZE;
+	int angle = 0;
+	int x = 0;
+	int y = 0;
+	int k = 0;
+
+	raster = softRasterCreate(PROP_IMPOSTOR_SIZE, PROP_IMPOSTOR_SIZE, NULL);
+	sums = (float*)memoryAllocZeroed(MEMORY_SOFT_RASTER, pixelCount * 4 * sizeof(float));
+	if(raster == NULL || sums == NULL) {
+		softRasterDestroy(raster);
+		memoryFree(sums);
+		return 0;
+	}
+
+	// Square around the circle, lit only by a full ambient so each blade
+	// keeps its material's ambient color, which the propeller materials
+	// set to the diffuse
+	memset(&frame, 0, sizeof(frame));
+	matrixOrtho(frame.projection, -propImpostorRadius, propImpostorRadius, -propImpostorRadius, propImpostorRadius,
+		-propImpostorRadius - 1.0f, propImpostorRadius + 1.0f);
+	frame.lightPosition[2] = 1.0f;
+	for(k = 0; k < 4; k++) {
+		frame.globalAmbient[k] = 1.0f;
+	}
+	frame.materials = materialTable;
+
+	memset(&draw, 0, sizeof(draw));
+	draw.mesh = &propMesh;
+	draw.material = -1;
+	draw.lineWidth = 1;
+
+	for(angle = 0; angle < PROP_IMPOSTOR_ANGLES; angle++) {
+		// Look down the spin axis from the front with the hub in the middle
+		matrixIdentity(draw.modelView);
+		matrixRotate(draw.modelView, -90.0f, 0.0f, 1.0f, 0.0f);
+		matrixRotate(draw.modelView, 360.0f * angle / PROP_IMPOSTOR_ANGLES, 1.0f, 0.0f, 0.0f);
+		matrixTranslate(draw.modelView, -propImpostorCenter[0], -propImpostorCenter[1], -propImpostorCenter[2]);
+		softRasterDraw(raster, &frame, &draw, 1);
+
+		for(y = 0; y < PROP_IMPOSTOR_SIZE; y++) {
+			for(x = 0; x < PROP_IMPOSTOR_SIZE; x++) {
+				pixel = raster->colorBuffer + (y * raster->stride + x) * 4;
+				coverage = pixel[3] / 255.0f;
+				for(k = 0; k < 3; k++) {
+					sums[(y * PROP_IMPOSTOR_SIZE + x) * 4 + k] += pixel[k] * coverage;
+				}
+				sums[(y * PROP_IMPOSTOR_SIZE + x) * 4 + 3] += coverage;
+			}
+		}
+	}
+
+	// Rows are from the bottom up, the same as the texture
+	for(k = 0; k < pixelCount; k++) {
+		coverage = sums[k * 4 + 3];
+		for(x = 0; x < 3; x++) {
+			pixels[k * 4 + x] = (GLubyte)(coverage > 0.0f ? sums[k * 4 + x] / coverage + 0.5f : 0.0f);
+		}
+		pixels[k * 4 + 3] = (GLubyte)(coverage * 255.0f / PROP_IMPOSTOR_ANGLES + 0.5f);
+	}
+
+	softRasterDestroy(raster);
+	memoryFree(sums);
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		setUpPlane()
+
+	Description:	This sets up the plane by reading it in from a file and
+					drawing it in a display list, along with a low detail
+					copy.
+
+*************************************************************************/
+void setUpPlane() {
+	// Read the plane into its mesh
+	loadModel(sceneConfig.planeFile, &planeMesh, &planeLowMesh, planeMaterialIndex, PLANE_LOW_DETAIL_CELLS);
+
+	// Puts the ship in a display list
+	thePlane = compileModelList(&planeMesh, 1, &planeListCalls);
+	thePlaneLow = compileModelList(&planeLowMesh, 1, &planeLowListCalls);
+}
+
+/************************************************************************
+
+	Function:		compileModelList
+
+	Description:	Puts the polygons of a model into a display list, setting
+					the front material at every corner. The plane sets its
+					specular color too, the propeller does not. Counts the
+					driver calls recorded into the list.
+
+*************************************************************************/
+GLuint compileModelList(Mesh *mesh, int isSpecularSet, int *listCalls) {
+	GLuint displayList = glGenLists(1);
+	MeshVertex *vertex;
+	Material *material;
+	int startCalls = *listCalls;
+	int i = 0;
+	int j = 0;
+
+	glNewList(displayList, GL_COMPILE);
+	for(i = 0; i < mesh->polygonCount; i++) {
+		// Draw polygon for this face
+		glBegin(GL_POLYGON);
+			glLineWidth(1);
+			for(j = 0; j < mesh->polygons[i].cornerCount; j++) {
+				vertex = &mesh->vertices[mesh->polygons[i].firstVertex + j];
+				material = &materialTable[(int)vertex->material];
+
+				// Set the colors depending on the object
+				glMaterialf(GL_FRONT, GL_SHININESS, material->shininess[0]);
+				glMaterialfv(GL_FRONT, GL_DIFFUSE, material->diffuse);
+				glMaterialfv(GL_FRONT, GL_AMBIENT, material->ambient);
+				if(isSpecularSet) {
+					glMaterialfv(GL_FRONT, GL_SPECULAR, material->specular);
+				}
+
+				// Draw the normal and point
+				glNormal3fv(vertex->normal);
+				glVertex3fv(vertex->position);
+				*listCalls += 5 + isSpecularSet;
+			}
+		glEnd(); // End drawing of polygon
+		*listCalls += 3;
+	}
+	// End the display list
+	glEndList();
+	displayListCallCount += *listCalls - startCalls;
+
+	return displayList;
+}
+
+/************************************************************************
+
+	Function:		drawPlane
+
+	Description:	This draws the plane and accounts for movment by user.
+
+*************************************************************************/
+void drawPlane() {
+	// Full or low detail plane
+	GLuint displayList = thePlane;
+	int listCalls = planeListCalls;
+	Mesh *mesh = &planeMesh;
+	GpuMesh *gpuMesh = &planeGpuMesh;
+
+	if(qualityLowDetailPlane[qualityLevel]) {
+		displayList = thePlaneLow;
+		listCalls = planeLowListCalls;
+		mesh = &planeLowMesh;
+		gpuMesh = &planeLowGpuMesh;
+	}
+
+	// Draw the plane from display list, moved by the buttons pressed
+	// and mouse position
+	drawModel(displayList, listCalls, mesh, gpuMesh, TRANSFORM_PLANE);
+
+	// Draw propellers
+	drawProps();
+}
+
+/************************************************************************
+
+	Function:		drawRemotePlanes
+
+	Description:	Draws the planes of the other simulators sharing the sky
+					and their propellers, always in low detail, with the
+					matrices in the snapshot.
+
+*************************************************************************/
+void drawRemotePlanes() {
+	int i = 0;
+	int k = 0;
+
+	for(i = 0; i < renderSnapshot->remoteCount; i++) {
+		for(k = 0; k < OBJECT_TRANSFORMS; k++) {
+			glPushMatrix();
+				glMultMatrixf(renderSnapshot->remoteMatrices[i][k]);
+				if(isShaderPath) {
+					// Materials come from the mesh
+					drawGpuMesh(k == TRANSFORM_PLANE ? &planeLowGpuMesh : &propLowGpuMesh, -1, 0, 0);
+				} else {
+					glCallList(k == TRANSFORM_PLANE ? thePlaneLow : thePropLow);
+					frameDriverCalls += k == TRANSFORM_PLANE ? planeLowListCalls : propLowListCalls;
+				}
+			glPopMatrix();
+			frameDriverCalls += 3;
+			frameModelTriangles += (k == TRANSFORM_PLANE ? planeLowMesh.triangleIndexCount : propLowMesh.triangleIndexCount) / 3;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		wireRenderingCheck
+
+	Description:	This checks to see which rendering is enabled and enables
+					it
+
+*************************************************************************/
+void wireRenderingCheck() {
+	// Enable or disable wirerendering based on button press
+	if(isWireRendering) {
+		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	} else {
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	}
+}
+
+/************************************************************************
+
+	Function:		drawSkyAndSea
+
+	Description:	This draws the quadric object for the sky and the land
+					and sea of the tiles in view as well as maps the
+					textures to them. The sky goes along with the camera.
+
+*************************************************************************/
+void drawSkyAndSea() {
+	// Enable or disable wirerendering based on button press
+	wireRenderingCheck();
+
+	// Set up normals
+	glShadeModel(GL_SMOOTH);
+
+	gluQuadricDrawStyle(quadricCylinder, GLU_SMOOTH);
+
+	// Set up textures
+	gluQuadricTexture(quadricCylinder, GL_TRUE);
+
+	// Set up the quadric normals
+	gluQuadricNormals(quadricCylinder, GLU_SMOOTH);
+
+	// Bind the texture to the quadric
+
+	// The skybox is drawn after everything else instead
+	if(!isSkyboxOn) {
+		// Set up texture for disk base (sea)
+		glEnable(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, skyTextureID);
+		gluQuadricTexture(quadricCylinder, skyTextureID);
+
+		beginSkyQuery();
+
+		// Draw cylinder
+		glPushMatrix();
+			// Set line width
+			glLineWidth(1);
+			// Keep it around the camera and rotate it to correct position
+			glTranslatef(renderSnapshot->cameraPosition[0], 0.0f, renderSnapshot->cameraPosition[2]);
+			glRotatef(-90, 1.0f, 0.0f, 0.0f);
+			// Set the colors
+			glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, orange);
+			glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, grey);
+			// Set the size (obj, inner, outer, height, slices, stacks)
+			gluCylinder(quadricCylinder, SKY_RADIUS, SKY_RADIUS, SKY_HEIGHT, qualitySkySeaDetail[qualityLevel], qualitySkySeaDetail[qualityLevel]);
+		glPopMatrix();
+
+		endSkyQuery();
+
+		glDisable(GL_TEXTURE_2D);
+
+		// glu draws a strip of two vertices per slice edge for each stack
+		frameSkyVertices += qualitySkySeaDetail[qualityLevel] * (qualitySkySeaDetail[qualityLevel] + 1) * 2;
+	}
+
+	// Land and sea of the tiles in view
+	drawTerrain();
+
+	// Count driver calls for the frame report
+	frameDriverCalls += 20 + (isSkyboxOn ? 0 : quadricDriverCalls(qualitySkySeaDetail[qualityLevel], qualitySkySeaDetail[qualityLevel]));
+
+	drawMountains();
+}
+
+/************************************************************************
+
+	Function:		drawFrameReferenceGrid
+
+	Description:	This draws the initial frame of reference and the axis
 					for debugging purposes.
 
 *************************************************************************/
@@ -767,17 +1480,17 @@ void drawFrameReferenceGrid() {
 		glLineWidth(1);
 
 		// Draw the grid of size grid size and translate it to the origin
-		glTranslatef(GRID_SIZE/2, 0.0, -GRID_SIZE/2);
+		glTranslatef(sceneConfig.gridSize/2.0f, 0.0, -sceneConfig.gridSize/2.0f);
 		// Enable or disable wirerendering based on button press
 		wireRenderingCheck();
 
 		// Draw a row in the grid
-		for(i = 0;i<GRID_SIZE;i++) {
+		for(i = 0;i<sceneConfig.gridSize;i++) {
 			// Offset the column drawn
-			glTranslatef(-GRID_SIZE, 0.0, 0.0f);
+			glTranslatef(-sceneConfig.gridSize, 0.0, 0.0f);
 			glTranslatef(0.0, 0.0, 1.0);
 			// Draw column
-			for(j = 0;j<GRID_SIZE;j++) {
+			for(j = 0;j<sceneConfig.gridSize;j++) {
 				glTranslatef(1.0, 0.0, 0.0);
 				// Draw the grid
 				glBegin(GL_QUADS);
@@ -856,6 +1569,9 @@ void drawFrameReferenceGrid() {
 		glutSolidSphere(0.2, 20, 20);
 		glLineWidth(1);
 	glPopMatrix();
+
+	// Count driver calls for the frame report, 13 for each grid square
+	frameDriverCalls += sceneConfig.gridSize * (2 + sceneConfig.gridSize * 13) + 40 + quadricDriverCalls(20, 20);
 }
 
 /************************************************************************
@@ -867,6 +1583,8 @@ void drawFrameReferenceGrid() {
 
 *************************************************************************/
 void normalKeys(unsigned char key, int x, int y) {
+	int i = 0;
+
 	switch(key) {
 		// Toggle full screen
 		case 'f':
@@ -889,23 +1607,87 @@ void normalKeys(unsigned char key, int x, int y) {
 			isFog = !isFog;
 			break;
 		case 'r':
-			// Rotate for normal roll
-			rollEnabled = !rollEnabled;
-			// Reset the roll amount each time
-			rollAmount = 0.0f;
+			// Rotate for normal roll, the simulation thread starts it
+			InterlockedExchange(&rollRequest, 1);
 			break;
 		case 'c':
-			// Rotate for a crazy roll
-			crazyRollEnabled = !crazyRollEnabled;
-			// Reset the roll amount each time
-			rollAmount = 0.0f;
+			// Rotate for a crazy roll, the simulation thread starts it
+			InterlockedExchange(&crazyRollRequest, 1);
 			break;
 		case 't':
 			// Turn mountain textures on or off
 			mountainTextureEnabled = !mountainTextureEnabled;
 			break;
+		case 'g':
+			// Switch between the shader and fixed function paths
+			if(shaderProgram != 0) {
+				isShaderPath = !isShaderPath;
+			} else {
+				printf("Shader path is not available\n");
+			}
+			break;
+		case 'p':
+			// Turn the spinning propeller discs on or off
+			isPropImpostorOn = !isPropImpostorOn;
+			break;
+		case 'l':
+			// Step through the light counts
+			stepSceneLights();
+			break;
+		case 'e':
+			// Turn the exhaust, contrails and spray on or off
+			isParticlesOn = !isParticlesOn;
+			if(!isParticlesOn && particleThreads != NULL) {
+				for(i = 0; i < PARTICLE_TYPES; i++) {
+					particleClear(particlePools[i]);
+				}
+			}
+			break;
+		case 'i':
+			// Turn the frame report on or off
+			isFrameReport = !isFrameReport;
+			break;
+		case 'a':
+			// Turn the quality governor on or off, off goes back to full quality
+			isGovernorOn = !isGovernorOn;
+			governorReset(&governor);
+			if(isGovernorOn) {
+				printQualityLevel("turned on");
+			} else {
+				governor.level = 0;
+				qualityLevel = 0;
+				printQualityLevel("turned off");
+			}
+			break;
+		case 'k':
+			// Switch between the skybox and the sky cylinder
+			if(isSkyboxAvailable) {
+				isSkyboxOn = !isSkyboxOn;
+			} else {
+				printf("Skybox is not available\n");
+			}
+			break;
+		case 'o':
+			// Turn occlusion culling on or off
+			isOcclusionCulling = !isOcclusionCulling;
+			break;
+		case 'm':
+			// Print where the memory is going
+			printMemoryReport();
+			break;
 		// Quit the program gracefully
 		case 'q':
+			stopAssetWatcher();
+			stopCullingThread();
+			stopSimulationThread();
+			worldDestroy(streamWorld);
+			netClientDestroy(netClient);
+			telemetryDestroy(&telemetryRing);
+			finishCapture();
+			if(recordFile != NULL) {
+				fprintf(recordFile, "%.4f end\n", (double)simulationStep / SIMULATION_RATE);
+				fclose(recordFile);
+			}
 			exit(0);
 			break;
 		default:
@@ -942,6 +1724,8 @@ void specialKeys(int key, int x, int y) {
 			// Set the key to be pressed
 			backwardPressed = 1;
 		}
+		// Hand the keys to the simulation
+		publishControls();
 }
 
 /************************************************************************
@@ -971,6 +1755,8 @@ void specialKeysReleased(int key, int x, int y) {
 			// Set the key to be depressed
 			backwardPressed = 0;
 		}
+		// Hand the keys to the simulation
+		publishControls();
 }
 
 /************************************************************************
@@ -987,6 +1773,15 @@ void printOutControls() {
 	printf("s: Toggle between sea and sky and frame reference grid\n");
 	printf("b: Toggle between fog on and off when in sea and sky mode\n");
 	printf("t: Toggle between mountain textures on or off\n");
+	printf("g: Toggle between shader and fixed function rendering\n");
+	printf("i: Toggle the frame report\n");
+	printf("a: Toggle the quality governor\n");
+	printf("k: Toggle between the skybox and the sky cylinder\n");
+	printf("o: Toggle occlusion culling of the mountains\n");
+	printf("p: Toggle drawing spinning propellers as discs\n");
+	printf("l: Step the lights over the sea from 0 to 10000\n");
+	printf("e: Toggle the exhaust, contrails and spray\n");
+	printf("m: Print the memory report\n");
 	printf("q: Quit the program\n");
 	printf("\nPlane Controls\n--------------\n");
 	printf("Up Arrow: Go up in height\n");
@@ -1001,73 +1796,229 @@ void printOutControls() {
 
 /************************************************************************
 
-	Function:		lightingSetUp
+	Function:		getResidentSetSize
 
-	Description:	This sets up all the lighting and light sources
+	Description:	Returns the resident set size (working set) of the program
+					in bytes, or 0 if it can not be read.
 
 *************************************************************************/
-void lightingSetUp() {
-	// Enable lighting
-	glEnable(GL_LIGHTING);
+SIZE_T getResidentSetSize() {
+	// Memory counters for this process
+	PROCESS_MEMORY_COUNTERS memoryCounters;
 
-	// Enable light source
-	glEnable(GL_LIGHT0);
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters))) {
+		return memoryCounters.WorkingSetSize;
+	}
 
-	// Enable smooth shading
-	glShadeModel(GL_SMOOTH);
+	return 0;
+}
 
-	// Enable normalization
-	glEnable(GL_NORMALIZE);
+/************************************************************************
 
-	// Set up light colors
-	glLightfv(GL_LIGHT0, GL_AMBIENT, ambient);
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuse);
-	glLightfv(GL_LIGHT0, GL_SPECULAR, specular);
+	Function:		printStartupReport
 
-	// Global ambient
-	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, globalAmbient);
+	Description:	Prints how textures are uploaded, then the scene size
+					and what each arena holds. The images load on first
+					use, so the resident set size before and after their
+					CPU copies are freed is printed by applyAssetReloads.
 
-	// Shade both sides
-	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+*************************************************************************/
+void printStartupReport() {
+	printf("\nStartup Report\n--------------\n");
+	if(isAssetPackOpen) {
+		printf("Assets: %u models and images mapped from %s, %lu KB\n", assetPack.header->entryCount, ASSET_PACK_FILE, (unsigned long)(assetPack.size / 1024));
+	} else {
+		printf("Assets: read from the loose files\n");
+	}
+	printf("Texture uploads: %s\n", isPBOUpload ? "streamed through pixel buffer objects" : "plain gluBuild2DMipmaps");
+	if(shaderProgram != 0) {
+		printf("Frame uniforms: %d slot ring %s\n", FRAME_UNIFORM_SLOTS,
+			frameUniformMapping != NULL ? "mapped for good and written with memcpy" : "written with glBufferSubData");
+	}
+	printf("Textures: sea, sky and mountain start as placeholders and load in the background when first drawn\n");
+	printSceneReport();
 }
 
 /************************************************************************
 
-	Function:		init
+	Function:		printSceneReport
 
-	Description:	This performs the main setup for openGl, it sets the
-					projection mod to gl_projection and modelview. It also sets
-					the perspective and performs a number of setup functions.
-					Lighting is enabled here too.
+	Description:	Prints the scene size from the config and the memory
+					each arena holds.
 
 *************************************************************************/
-void init(void)
-{
-	// Set initial window position and size
-	glutReshapeWindow(windowWidth, windowHeight);
-	glutPositionWindow(0, 0);
+void printSceneReport() {
+	printf("Scene: up to %d mountains drawn, %d x %d grid, %d lights, %d KB of world tiles from seed %u\n", sceneConfig.mountainCount,
+		sceneConfig.gridSize, sceneConfig.gridSize, sceneConfig.lightCount, sceneConfig.worldCacheKB, sceneConfig.worldSeed);
+	printArenaReport(&sceneArena);
+	printArenaReport(&planeArena);
+	printArenaReport(&propArena);
+	printArenaReport(&sceneMeshArena);
+	printArenaReport(&imageArena);
+}
 
-	// Enable the depth test
-	glEnable(GL_DEPTH_TEST);
+/************************************************************************
 
-	// Set the background to be black
-	glClearColor(0, 0, 0, 1.0);
+	Function:		printArenaReport
 
-	// Set to projection mode so we can use camera functions
-    glMatrixMode(GL_PROJECTION);
+	Description:	Prints the bytes an arena has handed out and holds, and
+					the most it ever handed out.
 
-	// Load identity matrix onto projection matrix
-    glLoadIdentity();
+*************************************************************************/
+void printArenaReport(const Arena *arena) {
+	printf("Arena %s: %lu KB used in %d allocations, %lu KB reserved, %lu KB peak\n",
+		arena->name,
+		(unsigned long)(arena->bytesUsed / 1024),
+		arena->allocationCount,
+		(unsigned long)(arena->bytesReserved / 1024),
+		(unsigned long)(arena->peakBytesUsed / 1024));
+}
 
-    // gluPerspective(fovy, aspect, near, far)
-    gluPerspective(90, windowWidth/windowHeight, 0.1, 40000);
+/************************************************************************
 
-    // Set up lighting
-    lightingSetUp();
+	Function:		printMemoryReport
 
-    // change into model-view mode so that we can change the object positions
+	Description:	Prints the heap each part of the program holds, the
+					arenas, and an estimate of the memory on the card for
+					textures, buffers and display lists. The card is left
+					out of software runs.
+
+*************************************************************************/
+void printMemoryReport() {
+	MemoryStats stats;
+	size_t heapBytes = 0;
+	size_t textureBytes = seaTextureBytes + skyTextureBytes + mountainTextureBytes + skyboxTextureBytes + propImpostorTextureBytes;
+	size_t listBytes = (size_t)displayListCallCount * DISPLAY_LIST_BYTES_PER_CALL;
+	int i = 0;
+
+	printf("\nMemory Report\n-------------\n");
+	for(i = 0; i < MEMORY_CATEGORIES; i++) {
+		memoryGetStats(i, &stats);
+		heapBytes += stats.bytes;
+		printf("Heap %s: %lu KB, %lu KB peak, %d allocations\n",
+			stats.name, (unsigned long)(stats.bytes / 1024), (unsigned long)(stats.peakBytes / 1024), stats.allocations);
+	}
+	printf("Heap tracked in total: %lu KB\n", (unsigned long)(heapBytes / 1024));
+	if(isAssetPackOpen) {
+		printf("Asset pack mapped, off the heap: %lu KB\n", (unsigned long)(assetPack.size / 1024));
+	}
+	printSceneReport();
+
+	if(!isSoftwareRun) {
+		printf("Textures on the card (estimated): %lu KB, sea %lu KB, sky %lu KB, mountain %lu KB, skybox %lu KB, propeller disc %lu KB\n",
+			(unsigned long)(textureBytes / 1024), (unsigned long)(seaTextureBytes / 1024), (unsigned long)(skyTextureBytes / 1024),
+			(unsigned long)(mountainTextureBytes / 1024), (unsigned long)(skyboxTextureBytes / 1024), (unsigned long)(propImpostorTextureBytes / 1024));
+		printf("Buffers on the card: %lu KB vertex, index and uniform, %lu KB texture streaming, %lu KB offscreen framebuffer, %lu KB clustered lights, %lu KB particles\n",
+			(unsigned long)(gpuBufferBytes / 1024), (unsigned long)((gpuPixelBufferBytes[0] + gpuPixelBufferBytes[1]) / 1024),
+			(unsigned long)(gpuFramebufferBytes / 1024), (unsigned long)(gpuLightBufferBytes / 1024), (unsigned long)(gpuParticleBufferBytes / 1024));
+		printf("Display lists (estimated): %lu KB for %d recorded calls\n", (unsigned long)(listBytes / 1024), displayListCallCount);
+		printf("Card in total (estimated): %lu KB\n",
+			(unsigned long)((textureBytes + gpuBufferBytes + gpuPixelBufferBytes[0] + gpuPixelBufferBytes[1] + gpuFramebufferBytes + gpuLightBufferBytes + gpuParticleBufferBytes + listBytes) / 1024));
+		printf("GLU quadrics: %d\n", quadricCount);
+	}
+	printf("Resident set size: %lu KB\n", (unsigned long)(getResidentSetSize() / 1024));
+}
+
+/************************************************************************
+
+	Function:		estimateTextureBytes
+
+	Description:	Guesses the bytes the card holds for level 0 of the bound
+					texture target from the size it was actually given, plus
+					a third more for a full set of mipmaps.
+
+*************************************************************************/
+size_t estimateTextureBytes(GLenum target, int isMipmapped) {
+	GLint width = 0;
+	GLint height = 0;
+	size_t bytes = 0;
+
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_WIDTH, &width);
+	glGetTexLevelParameteriv(target, 0, GL_TEXTURE_HEIGHT, &height);
+	bytes = (size_t)width * height * GPU_BYTES_PER_TEXEL;
+	if(isMipmapped) {
+		bytes += bytes / 3;
+	}
+
+	return bytes;
+}
+
+/************************************************************************
+
+	Function:		lightingSetUp
+
+	Description:	This sets up all the lighting and light sources
+
+*************************************************************************/
+void lightingSetUp() {
+	// Enable lighting
+	glEnable(GL_LIGHTING);
+
+	// Enable light source
+	glEnable(GL_LIGHT0);
+
+	// Enable smooth shading
+	glShadeModel(GL_SMOOTH);
+
+	// Enable normalization
+	glEnable(GL_NORMALIZE);
+
+	// Set up light colors
+	glLightfv(GL_LIGHT0, GL_AMBIENT, ambient);
+	glLightfv(GL_LIGHT0, GL_DIFFUSE, diffuse);
+	glLightfv(GL_LIGHT0, GL_SPECULAR, specular);
+
+	// Global ambient
+	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, globalAmbient);
+
+	// Shade both sides
+	glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+}
+
+/************************************************************************
+
+	Function:		init
+
+	Description:	This performs the main setup for openGl, it sets the
+					projection mod to gl_projection and modelview. It also sets
+					the perspective and performs a number of setup functions.
+					Lighting is enabled here too.
+
+*************************************************************************/
+void init(void)
+{
+	// Set initial window position and size
+	glutReshapeWindow(windowWidth, windowHeight);
+	glutPositionWindow(0, 0);
+
+	// Enable the depth test
+	glEnable(GL_DEPTH_TEST);
+
+	// Set the background to be black
+	glClearColor(0, 0, 0, 1.0);
+
+	// Set to projection mode so we can use camera functions
+    glMatrixMode(GL_PROJECTION);
+
+	// Load identity matrix onto projection matrix
+    glLoadIdentity();
+
+    // gluPerspective(fovy, aspect, near, far)
+    gluPerspective(90, windowWidth/windowHeight, VIEW_NEAR, VIEW_FAR);
+
+    // Set up lighting
+    lightingSetUp();
+
+    // change into model-view mode so that we can change the object positions
 	glMatrixMode(GL_MODELVIEW);
 
+	// Set up the sky quadric once for every frame to share
+	quadricCylinder = gluNewQuadric();
+	quadricCount++;
+
+	// Set up the materials the plane and propeller use
+	setUpMaterials();
+
 	// Setup plane
 	setUpPlane();
 
@@ -1077,6 +2028,9 @@ void init(void)
 	// Set up mountains
 	setUpMountains();
 
+	// Set up the shader path if the card supports it
+	setUpShaderPath();
+
 	// Print out the controls
 	printOutControls();
 }
@@ -1085,525 +2039,5330 @@ void init(void)
 
 	Function:		myIdle
 
-	Description:	This runs whenever the program is idle. It handles most
-					of the dynamic functionality of the program.
-					This helps for turning, tilting and spinning propellers.
+	Description:	This runs whenever the program is idle and asks for a
+					redraw. The simulation runs on its own thread, unless it
+					could not be started and is stepped here instead.
 
 *************************************************************************/
 void myIdle(void)
 {
-	// Rotation speed of the plane
-	if(propInterp >= 1.0) {
-		propInterp = 0;
-	} else {
-		propInterp += 0.05;
+	// Turn, tilt and spin the propellers without the thread
+	if(simulationThread == NULL) {
+		stepSimulation();
+		publishSnapshot();
 	}
 
-	// Plane trick interp
-	if(rollEnabled || crazyRollEnabled) {
-		if(rollAmount >= 360) {
-			// Resets all roll variables if hits 360
-			rollEnabled = 0;
-			crazyRollEnabled = 0;
-			rollAmount = 0;
-			rollHeight = 0;
-		} else {
-			// Increases the height to start the roll
-			if(rollHeight <= 1.0) {
-				rollHeight += 0.1;
-			} else {
-				// Increases the roll angle
-				rollAmount += 4;
-			}
-		}
-	}
+	// Force a redraw in OpenGL
+	glutPostRedisplay();
+}
 
-	// Make sure turn speed starts at 0
-	turnSpeed = 0.0;
+/************************************************************************
 
-	// Calculate the rotation speed of turning to be double the ratio of
-	// the tilt
-	turnSpeed += ratioOfTilt * 2;
+	Function:		stepSimulation
 
-	// Increase the angle of turning by the turn speed
-	turnAngle += turnSpeed;
+	Description:	It handles most of the dynamic functionality of the program.
+					Steps the flight with the controls held, which turns,
+					tilts, moves and spins the propellers, moves the origin
+					along with it, then asks for the world tiles around it,
+					trades planes and publishes the telemetry. Runs on the
+					simulation thread.
 
-	// Reset turn angle if goes over 360
-	if(turnAngle > 360) {
-		turnAngle = 0;
+*************************************************************************/
+void stepSimulation()
+{
+	FlightControls controls;
+	// For the step time in the telemetry
+	double stepStartTime = getTime();
+
+	// Scene for this step, switched with 's' on the main thread
+	isWorldShown = isSeaAndSky;
+
+	// Controls held this step, the roll keys count once per press
+	controls = heldControls[tripleBufferRead(&controlsBuffer)];
+	controls.isRollPressed = InterlockedExchange(&rollRequest, 0) != 0;
+	controls.isCrazyRollPressed = InterlockedExchange(&crazyRollRequest, 0) != 0;
+
+	// Keep the controls for flying again as a script
+	if(recordFile != NULL) {
+		flightWriteControls(recordFile, simulationStep, &recordControls, &controls);
+		recordControls = controls;
 	}
 
-	// Force a redraw in OpenGL
-	glutPostRedisplay();
+	// Turn, tilt, climb, speed up, roll and move the plane, keeping it
+	// on the origin tile
+	flightStep(&flight, &controls);
+	stepControls = controls;
+
+	// Have the camera follow
+	positionScene();
+
+	// Stream in the tiles around the plane and ahead of it
+	if(isWorldShown) {
+		updateWorld();
+	}
+
+	simulationStep++;
+
+	// Trade planes with the other simulators
+	updateNetwork();
+
+	// Let other programs see the flight
+	publishTelemetry(stepStartTime);
 }
 
 /************************************************************************
 
-	Function:		positionScene
+	Function:		fillSnapshot
 
-	Description:	This positions the plane and the camera to trail behinde
-					it.
+	Description:	Copies what the renderer needs from the current
+					simulation state into a snapshot.
 
 *************************************************************************/
-void positionScene() {
-	// Update plane position and account for the turn angle and plane speed
-	planePosition[0] += sin(turnAngle * (PI/180.0f)) * planeSpeed;
-	planePosition[2] -= cos(turnAngle * (PI/180.0f)) * planeSpeed;
-
+void fillSnapshot(SimSnapshot *snapshot) {
+	NetPlane remotes[NET_MAX_PLAYERS];
+	int i = 0;
 
-	// Set up the camera position to trail behinde the plane
-	// Based off the plane position
-	cameraPosition[0] = planePosition[0] + sin(turnAngle * (PI/180.0f)) * -4;
-	cameraPosition[1] = 1.2 + planePosition[1];
-	cameraPosition[2] = planePosition[2] - cos(turnAngle * (PI/180.0f)) * -4;
+	buildObjectTransforms(snapshot->objectMatrices);
+	memcpy(snapshot->cameraPosition, cameraPosition, sizeof(snapshot->cameraPosition));
 
-	// Set where to look at (the plane)
-	cameraPosition[3] = planePosition[0];
-	cameraPosition[4] = planePosition[1];
-	cameraPosition[5] = planePosition[2];
+	// Planes of the other simulators as they were a little while ago
+	snapshot->remoteCount = 0;
+	memset(&snapshot->netStats, 0, sizeof(snapshot->netStats));
+	if(netClient != NULL) {
+		snapshot->remoteCount = netClientRemotes(netClient, getTime(), remotes, NET_MAX_PLAYERS);
+		for(i = 0; i < snapshot->remoteCount; i++) {
+			buildRemoteTransforms(&remotes[i], snapshot->remoteMatrices[i]);
+		}
+		snapshot->netStats = netClient->stats;
+	}
+	snapshot->telemetrySamples = telemetrySamples;
+	snapshot->telemetryTime = telemetryTime;
+	snapshot->step = simulationStep;
+	snapshot->publishTime = getTime();
+
+	// Terrain and mountains of the tiles in view
+	fillSnapshotWorld(snapshot);
+
+	// Nothing is culled until the culling thread looks at it
+	memset(snapshot->isMountainVisible, 1, snapshot->mountainCount);
+	snapshot->cullOccluders = 0;
+	snapshot->cullOccluded = 0;
+	snapshot->cullOutside = 0;
+	snapshot->cullTime = 0.0;
 }
 
 /************************************************************************
 
-	Function:		loadSea
+	Function:		copySnapshot
 
-	Description:	Loads in the PPM image for sea, this code is from the animation
-					slides for loading in an image.
+	Description:	Copies a snapshot into another slot. The slot keeps its
+					own mountain, visibility and terrain arrays and the
+					values are copied into them.
 
 *************************************************************************/
-void loadSea()
-{
-	// the ID of the image file
-	FILE *fileID;
+void copySnapshot(SimSnapshot *destination, const SimSnapshot *source) {
+	WorldMountain *mountains = destination->mountains;
+	GLubyte *isMountainVisible = destination->isMountainVisible;
+	float *terrainHeights = destination->terrainHeights;
+
+	*destination = *source;
+	destination->mountains = mountains;
+	destination->isMountainVisible = isMountainVisible;
+	destination->terrainHeights = terrainHeights;
+	memcpy(mountains, source->mountains, source->mountainCount * sizeof(WorldMountain));
+	memcpy(isMountainVisible, source->isMountainVisible, source->mountainCount);
+	memcpy(terrainHeights, source->terrainHeights, source->terrainTileCount * WORLD_TILE_CORNERS * WORLD_TILE_CORNERS * sizeof(float));
+}
 
-	// maxValue
-	int  maxValue;
+/************************************************************************
 
-	// total number of pixels in the image
-	int  totalPixels;
+	Function:		publishSnapshot
 
-	// temporary character
-	char tempChar;
+	Description:	Fills the simulation's free snapshot and hands it to the
+					renderer. Never waits on the renderer.
 
-	// counter variable for the current pixel in the image
-	int i;
+*************************************************************************/
+void publishSnapshot() {
+	fillSnapshot(&simSnapshots[tripleBufferWriteIndex(&snapshotBuffer)]);
+	tripleBufferPublish(&snapshotBuffer);
 
-	// array for reading in header information
-	char headerLine[100];
+	// Wake the culling thread
+	if(snapshotEvent != NULL) {
+		SetEvent(snapshotEvent);
+	}
+}
 
-	float RGBScaling;
+/************************************************************************
 
-	// temporary variables for reading in the red, green and blue data of each pixel
-	int red, green, blue;
+	Function:		simulationThreadMain
 
-	// Read in the sea
-	fileID = fopen("sea02.ppm", "r");
+	Description:	Steps the simulation SIMULATION_RATE times a second and
+					publishes a snapshot after each batch of steps. When it
+					falls too far behind it skips ahead rather than running
+					fast to catch up.
 
-	// read in the first header line
-	fscanf(fileID,"%[^\n] ", headerLine);
+*************************************************************************/
+DWORD WINAPI simulationThreadMain(LPVOID parameter) {
+	double stepTime = 1.0 / SIMULATION_RATE;
+	double nextStepTime = getTime() + stepTime;
+	double now = 0.0;
+	double waitTime = 0.0;
+	int steps = 0;
+
+	while(!isSimulationStopping) {
+		now = getTime();
+
+		// Take every step that is due
+		steps = 0;
+		while(now >= nextStepTime && steps < SIMULATION_MAX_CATCH_UP) {
+			stepSimulation();
+			nextStepTime += stepTime;
+			steps++;
+		}
+		if(now >= nextStepTime) {
+			nextStepTime = now + stepTime;
+		}
 
-	// make sure that the image begins with 'P3', which signifies a PPM file
-	if ((headerLine[0] != 'P') || (headerLine[1] != '3'))
-	{
-		// printf("This is not a PPM file!\n");
-		exit(0);
+		if(steps > 0) {
+			publishSnapshot();
+		}
+
+		// Sleep until the next step is due
+		waitTime = nextStepTime - getTime();
+		if(waitTime > 0.0) {
+			Sleep((DWORD)(waitTime * 1000.0));
+		}
 	}
 
-	// we have a PPM file
-	printf("Loading textures please wait...\n");
+	return 0;
+}
 
-	// read in the first character of the next line
-	fscanf(fileID, "%c", &tempChar);
+/************************************************************************
 
-	// while we still have comment lines (which begin with #)
-	while(tempChar == '#')
-	{
-		// read in the comment
-		fscanf(fileID, "%[^\n] ", headerLine);
+	Function:		startSimulationThread
 
-		// // print the comment
-		// printf("%s\n", headerLine);
+	Description:	Publishes the starting snapshot so there is always one to
+					draw, then starts the simulation thread. If the thread
+					can not be made the idle function steps the simulation.
 
-		// read in the first character of the next line
-		fscanf(fileID, "%c",&tempChar);
-	}
+*************************************************************************/
+void startSimulationThread() {
+	tripleBufferInit(&snapshotBuffer);
 
-	// the last one was not a comment character '#', so we nee dto put it back into the file stream (undo)
-	ungetc(tempChar, fileID);
+	// First snapshot before anything moves
+	positionScene();
+	publishSnapshot();
+	renderSnapshot = &simSnapshots[tripleBufferRead(&snapshotBuffer)];
 
-	// read in the image hieght, width and the maximum value
-	fscanf(fileID, "%d %d %d", &imageWidthSea, &imageHeightSea, &maxValue);
+	isSimulationStopping = 0;
+	simulationThread = CreateThread(NULL, 0, simulationThreadMain, NULL, 0, NULL);
+	if(simulationThread == NULL) {
+		printf("Could not start the simulation thread, stepping it with each frame\n");
+	}
+}
 
-	// // print out the information about the image file
-	// printf("%d rows  %d columns  max value= %d\n", imageHeight, imageWidth, maxValue);
+/************************************************************************
 
-	// compute the total number of pixels in the image
-	totalPixels = imageWidthSea * imageHeightSea;
+	Function:		stopSimulationThread
 
-	// allocate enough memory for the image  (3*) because of the RGB data
-	imageDataSea = (GLubyte*)malloc(3 * sizeof(GLuint) * totalPixels);
+	Description:	Tells the simulation thread to stop and waits for it.
 
-	// determine the scaling for RGB values
-	RGBScaling = 255.0 / maxValue;
+*************************************************************************/
+void stopSimulationThread() {
+	if(simulationThread != NULL) {
+		InterlockedExchange(&isSimulationStopping, 1);
+		WaitForSingleObject(simulationThread, INFINITE);
+		CloseHandle(simulationThread);
+		simulationThread = NULL;
+	}
+}
 
+/************************************************************************
 
-	// if the maxValue is 255 then we do not need to scale the
-	//    image data values to be in the range or 0 to 255
-	if (maxValue == 255)
-	{
-		for(i = 0; i < totalPixels; i++)
-		{
-			// read in the current pixel from the file
-			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+	Function:		startWorld
 
-			// store the red, green and blue data of the current pixel in the data array
-			imageDataSea[3*totalPixels - 3*i - 3] = red;
-			imageDataSea[3*totalPixels - 3*i - 2] = green;
-			imageDataSea[3*totalPixels - 3*i - 1] = blue;
-		}
-	}
-	else  // need to scale up the data values
-	{
-		for(i = 0; i < totalPixels; i++)
-		{
-			// read in the current pixel from the file
-			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+	Description:	Makes the world from the scene config and loads the
+					tiles around the start so they are there for the first
+					frame. With no loader threads tiles are made as they
+					are asked for, which keeps runs that step the
+					simulation themselves the same every time.
 
-			// store the red, green and blue data of the current pixel in the data array
-			imageDataSea[3*totalPixels - 3*i - 3] = red   * RGBScaling;
-			imageDataSea[3*totalPixels - 3*i - 2] = green * RGBScaling;
-			imageDataSea[3*totalPixels - 3*i - 1] = blue  * RGBScaling;
-		}
+*************************************************************************/
+void startWorld(int loaderCount) {
+	streamWorld = worldCreate(sceneConfig.worldSeed, (size_t)sceneConfig.worldCacheKB * 1024, loaderCount);
+	if(streamWorld == NULL) {
+		printf("Could not make the world tiles, there is nothing to fly over\n");
+		return;
 	}
 
-	// close the image file
-	fclose(fileID);
+	updateWorld();
+	worldWaitForLoads(streamWorld);
+	printf("World: seed %u, %d tiles of %.0f units in a %d KB cache, %d loader threads\n",
+		streamWorld->seed, streamWorld->tileCount, WORLD_TILE_SIZE,
+		(int)(streamWorld->tileCount * sizeof(WorldTile) / 1024), streamWorld->loaderCount);
 }
 
 /************************************************************************
 
-	Function:		loadSky
+	Function:		updateWorld
 
-	Description:	Loads in the PPM image for sky, this code is from the animation
-					slides for loading in an image.
+	Description:	Asks for the tiles around the plane and ahead of it
+					along its heading. Runs on the simulation thread.
 
 *************************************************************************/
-void loadSky()
-{
-	// the ID of the image file
-	FILE *fileID;
+void updateWorld() {
+	double position[3];
 
-	// maxValue
-	int  maxValue;
+	if(streamWorld == NULL) {
+		return;
+	}
 
-	// total number of pixels in the image
-	int  totalPixels;
+	getWorldPosition(position);
+	worldUpdate(streamWorld, position[0], position[2],
+		(float)sin(flight.turnAngle * DEG_TO_RAD), -(float)cos(flight.turnAngle * DEG_TO_RAD));
+}
 
-	// temporary character
-	char tempChar;
+/************************************************************************
 
-	// counter variable for the current pixel in the image
-	int i;
+	Function:		getWorldPosition
 
-	// array for reading in header information
-	char headerLine[100];
+	Description:	Works out where the plane is in the whole world, the
+					corner of the origin tile plus its position on it.
+					Runs on the simulation thread.
 
-	float RGBScaling;
+*************************************************************************/
+void getWorldPosition(double *position) {
+	flightWorldPosition(&flight, position);
+}
 
-	// temporary variables for reading in the red, green and blue data of each pixel
-	int red, green, blue;
+/************************************************************************
 
-	// Read in the sea
-	fileID = fopen("sky08.ppm", "r");
+	Function:		rebaseRenderState
 
-	// read in the first header line
-	fscanf(fileID,"%[^\n] ", headerLine);
+	Description:	Moves what the renderer keeps from frame to frame in
+					the world, the particles, where the emitters were
+					last frame and the scattered lights, when a snapshot
+					comes in against another origin tile. The terrain is
+					remade from the snapshot anyway.
 
-	// make sure that the image begins with 'P3', which signifies a PPM file
-	if ((headerLine[0] != 'P') || (headerLine[1] != '3'))
-	{
-		// printf("This is not a PPM file!\n");
-		exit(0);
+*************************************************************************/
+void rebaseRenderState(const int *origin) {
+	GLfloat shiftX = 0.0f;
+	GLfloat shiftZ = 0.0f;
+	int i = 0;
+
+	if(origin[0] == renderOriginTile[0] && origin[1] == renderOriginTile[1]) {
+		return;
+	}
+	shiftX = (origin[0] - renderOriginTile[0]) * -WORLD_TILE_SIZE;
+	shiftZ = (origin[1] - renderOriginTile[1]) * -WORLD_TILE_SIZE;
+	renderOriginTile[0] = origin[0];
+	renderOriginTile[1] = origin[1];
+
+	for(i = 0; i < PARTICLE_TYPES; i++) {
+		if(particlePools[i] != NULL) {
+			particleShift(particlePools[i], shiftX, 0.0f, shiftZ);
+		}
+	}
+	for(i = 0; i < PARTICLE_EMITTERS; i++) {
+		particleEmitterLast[i][0] += shiftX;
+		particleEmitterLast[i][2] += shiftZ;
+	}
+
+	// The navigation lights are put on the plane every frame
+	for(i = NAV_LIGHT_COUNT; i < sceneLightCount; i++) {
+		sceneLights[i].position[0] += shiftX;
+		sceneLights[i].position[2] += shiftZ;
+	}
+}
+
+/************************************************************************
+
+	Function:		fillSnapshotWorld
+
+	Description:	Copies the heights of the loaded tiles in view into a
+					snapshot, nearest tiles first, and their mountains
+					placed against the origin tile up to the most that can
+					be drawn. The terrain version goes up whenever the
+					tiles or the origin change. Also asks how high the
+					plane is over the ground and how far the ground is
+					along its heading.
+
+*************************************************************************/
+void fillSnapshotWorld(SimSnapshot *snapshot) {
+	const WorldTile *tile;
+	WorldMountain *mountain;
+	WorldRay ahead;
+	double startTime = 0.0;
+	int tileX = 0;
+	int tileZ = 0;
+	int ring = 0;
+	int dx = 0;
+	int dz = 0;
+	int i = 0;
+
+	snapshot->mountainCount = 0;
+	snapshot->terrainTileCount = 0;
+	snapshot->originTile[0] = flight.originTile[0];
+	snapshot->originTile[1] = flight.originTile[1];
+	snapshot->groundClearance = flight.position[1];
+	snapshot->groundAhead = -1.0f;
+	snapshot->groundTime = 0.0;
+	if(streamWorld == NULL) {
+		snapshot->terrainVersion = simTerrainVersion;
+		memset(&snapshot->worldStats, 0, sizeof(snapshot->worldStats));
+		return;
+	}
+
+	startTime = getTime();
+	memcpy(ahead.position, flight.position, sizeof(ahead.position));
+	ahead.direction[0] = (float)sin(flight.turnAngle * DEG_TO_RAD);
+	ahead.direction[1] = 0.0f;
+	ahead.direction[2] = -(float)cos(flight.turnAngle * DEG_TO_RAD);
+	ahead.length = GROUND_LOOK_AHEAD;
+	snapshot->groundClearance = flight.position[1] - worldGroundHeight(streamWorld, flight.originTile, flight.position[0], flight.position[2]);
+	snapshot->groundAhead = worldCastRay(streamWorld, flight.originTile, &ahead);
+	snapshot->groundTime = getTime() - startTime;
+
+	for(ring = 0; ring <= WORLD_VIEW_RADIUS; ring++) {
+		for(dz = -ring; dz <= ring; dz++) {
+			for(dx = -ring; dx <= ring; dx++) {
+				if(abs(dx) != ring && abs(dz) != ring) {
+					continue;
+				}
+				tileX = streamWorld->centerX + dx;
+				tileZ = streamWorld->centerZ + dz;
+				tile = worldFindTile(streamWorld, tileX, tileZ);
+				if(tile == NULL) {
+					continue;
+				}
+
+				memcpy(snapshot->terrainHeights + snapshot->terrainTileCount * WORLD_TILE_CORNERS * WORLD_TILE_CORNERS,
+					tile->heights, sizeof(tile->heights));
+				snapshot->terrainTiles[snapshot->terrainTileCount][0] = tileX;
+				snapshot->terrainTiles[snapshot->terrainTileCount][1] = tileZ;
+				snapshot->terrainTileCount++;
+
+				for(i = 0; i < tile->mountainCount && snapshot->mountainCount < sceneConfig.mountainCount; i++) {
+					mountain = &snapshot->mountains[snapshot->mountainCount++];
+					*mountain = tile->mountains[i];
+					mountain->x += (tileX - flight.originTile[0]) * WORLD_TILE_SIZE;
+					mountain->z += (tileZ - flight.originTile[1]) * WORLD_TILE_SIZE;
+				}
+			}
+		}
+	}
+
+	// The same tiles in the same order against the same origin keep the
+	// terrain the renderer has
+	if(snapshot->terrainTileCount != simTerrainTileCount ||
+		memcmp(snapshot->terrainTiles, simTerrainTiles, snapshot->terrainTileCount * sizeof(simTerrainTiles[0])) != 0 ||
+		flight.originTile[0] != simTerrainOrigin[0] || flight.originTile[1] != simTerrainOrigin[1]) {
+		memcpy(simTerrainTiles, snapshot->terrainTiles, snapshot->terrainTileCount * sizeof(simTerrainTiles[0]));
+		simTerrainTileCount = snapshot->terrainTileCount;
+		simTerrainOrigin[0] = flight.originTile[0];
+		simTerrainOrigin[1] = flight.originTile[1];
+		simTerrainVersion++;
+	}
+	snapshot->terrainVersion = simTerrainVersion;
+
+	worldGetStats(streamWorld, &snapshot->worldStats);
+}
+
+/************************************************************************
+
+	Function:		runGroundBenchmark
+
+	Description:	Times the ground queries over the tiles around a tile
+					away from the start, without opening a window. Heights
+					under random points are asked for one at a time and
+					four at a time, random rays are cast one at a time and
+					together, and some of the rays are marched in small
+					steps of height queries as well. Prints the time for
+					each and how far the answers were apart.
+
+*************************************************************************/
+void runGroundBenchmark() {
+	WorldRay *rays;
+	WorldRay *ray;
+	float *x;
+	float *z;
+	float *heights;
+	float *batched;
+	float *distances;
+	float *cast;
+	float low = -WORLD_VIEW_RADIUS * WORLD_TILE_SIZE;
+	float span = (2 * WORLD_VIEW_RADIUS + 1) * WORLD_TILE_SIZE;
+	float marched = 0.0f;
+	float above = 0.0f;
+	float below = 0.0f;
+	float t = 0.0f;
+	float angle = 0.0f;
+	float size = 0.0f;
+	float difference = 0.0f;
+	float largest = 0.0f;
+	double startTime = 0.0;
+	double singleTime = 0.0;
+	double batchedTime = 0.0;
+	double marchTime = 0.0;
+	int land = 0;
+	int hits = 0;
+	int disagreements = 0;
+	int i = 0;
+	int k = 0;
+
+	// Load the tiles around the bench tile, made as they are asked for
+	flightInit(&flight);
+	flight.position[0] = WORLD_TILE_SIZE / 2.0f;
+	flight.position[2] = WORLD_TILE_SIZE / 2.0f;
+	flight.originTile[0] = GROUND_BENCH_TILE;
+	flight.originTile[1] = GROUND_BENCH_TILE;
+	startWorld(0);
+
+	x = (float*)memoryAlloc(MEMORY_WORLD, GROUND_BENCH_POINTS * sizeof(float));
+	z = (float*)memoryAlloc(MEMORY_WORLD, GROUND_BENCH_POINTS * sizeof(float));
+	heights = (float*)memoryAlloc(MEMORY_WORLD, GROUND_BENCH_POINTS * sizeof(float));
+	batched = (float*)memoryAlloc(MEMORY_WORLD, GROUND_BENCH_POINTS * sizeof(float));
+	rays = (WorldRay*)memoryAlloc(MEMORY_WORLD, GROUND_BENCH_RAYS * sizeof(WorldRay));
+	distances = (float*)memoryAlloc(MEMORY_WORLD, GROUND_BENCH_RAYS * sizeof(float));
+	cast = (float*)memoryAlloc(MEMORY_WORLD, GROUND_BENCH_RAYS * sizeof(float));
+	if(streamWorld == NULL || x == NULL || z == NULL || heights == NULL || batched == NULL ||
+		rays == NULL || distances == NULL || cast == NULL) {
+		printf("Out of memory for the ground benchmark\n");
+		worldDestroy(streamWorld);
+		exit(1);
+	}
+
+	printf("\nGround Benchmark\n----------------\n");
+	printf("%d x %d tiles around tile %d, %d, %d heights, %d rays, %d rays also marched in steps of %.2f\n",
+		2 * WORLD_VIEW_RADIUS + 1, 2 * WORLD_VIEW_RADIUS + 1, GROUND_BENCH_TILE, GROUND_BENCH_TILE,
+		GROUND_BENCH_POINTS, GROUND_BENCH_RAYS, GROUND_BENCH_MARCHED, GROUND_BENCH_MARCH_STEP);
+
+	// Points over the tiles in view, the same every run
+	srand(1);
+	for(i = 0; i < GROUND_BENCH_POINTS; i++) {
+		x[i] = low + span * rand() / (float)RAND_MAX;
+		z[i] = low + span * rand() / (float)RAND_MAX;
+	}
+
+	startTime = getTime();
+	for(i = 0; i < GROUND_BENCH_POINTS; i++) {
+		heights[i] = worldGroundHeight(streamWorld, flight.originTile, x[i], z[i]);
+	}
+	singleTime = getTime() - startTime;
+	startTime = getTime();
+	worldGroundHeights(streamWorld, flight.originTile, x, z, batched, GROUND_BENCH_POINTS);
+	batchedTime = getTime() - startTime;
+
+	for(i = 0; i < GROUND_BENCH_POINTS; i++) {
+		difference = (float)fabs(heights[i] - batched[i]);
+		largest = difference > largest ? difference : largest;
+		land += heights[i] > 0.0f ? 1 : 0;
+	}
+	printf("Heights: %.1f ns each one at a time, %.1f ns four at a time, %.0f%% over land, largest difference %g\n",
+		singleTime * 1000000000.0 / GROUND_BENCH_POINTS, batchedTime * 1000000000.0 / GROUND_BENCH_POINTS,
+		land * 100.0 / GROUND_BENCH_POINTS, largest);
+
+	// Rays from a little above the ground, level to looking well down
+	for(i = 0; i < GROUND_BENCH_RAYS; i++) {
+		ray = &rays[i];
+		ray->position[0] = x[i];
+		ray->position[2] = z[i];
+		ray->position[1] = heights[i] + 0.5f + 20.0f * rand() / (float)RAND_MAX;
+		angle = 2.0f * PI * rand() / (float)RAND_MAX;
+		ray->direction[0] = (float)sin(angle);
+		ray->direction[1] = -0.35f + 0.4f * rand() / (float)RAND_MAX;
+		ray->direction[2] = (float)cos(angle);
+		size = (float)sqrt(ray->direction[0] * ray->direction[0] + ray->direction[1] * ray->direction[1] + ray->direction[2] * ray->direction[2]);
+		for(k = 0; k < 3; k++) {
+			ray->direction[k] /= size;
+		}
+		ray->length = 2.0f * WORLD_TILE_SIZE;
+	}
+
+	startTime = getTime();
+	for(i = 0; i < GROUND_BENCH_RAYS; i++) {
+		distances[i] = worldCastRay(streamWorld, flight.originTile, &rays[i]);
+	}
+	singleTime = getTime() - startTime;
+	startTime = getTime();
+	worldCastRays(streamWorld, flight.originTile, rays, cast, GROUND_BENCH_RAYS);
+	batchedTime = getTime() - startTime;
+
+	largest = 0.0f;
+	for(i = 0; i < GROUND_BENCH_RAYS; i++) {
+		difference = (float)fabs(distances[i] - cast[i]);
+		largest = difference > largest ? difference : largest;
+		hits += distances[i] >= 0.0f ? 1 : 0;
+	}
+	printf("Rays: %.2f us each one at a time, %.2f us together, %.0f%% hit within %.0f, largest difference %g\n",
+		singleTime * 1000000.0 / GROUND_BENCH_RAYS, batchedTime * 1000000.0 / GROUND_BENCH_RAYS,
+		hits * 100.0 / GROUND_BENCH_RAYS, 2.0f * WORLD_TILE_SIZE, largest);
+
+	// Step along until under the ground, then halve the last step down
+	largest = 0.0f;
+	startTime = getTime();
+	for(i = 0; i < GROUND_BENCH_MARCHED; i++) {
+		ray = &rays[i];
+		marched = -1.0f;
+		for(t = 0.0f; t <= ray->length; t += GROUND_BENCH_MARCH_STEP) {
+			if(ray->position[1] + ray->direction[1] * t <= worldGroundHeight(streamWorld, flight.originTile,
+				ray->position[0] + ray->direction[0] * t, ray->position[2] + ray->direction[2] * t)) {
+				above = t > GROUND_BENCH_MARCH_STEP ? t - GROUND_BENCH_MARCH_STEP : 0.0f;
+				below = t;
+				for(k = 0; k < 20 && t > 0.0f; k++) {
+					marched = (above + below) / 2.0f;
+					if(ray->position[1] + ray->direction[1] * marched <= worldGroundHeight(streamWorld, flight.originTile,
+						ray->position[0] + ray->direction[0] * marched, ray->position[2] + ray->direction[2] * marched)) {
+						below = marched;
+					} else {
+						above = marched;
+					}
+				}
+				marched = below;
+				break;
+			}
+		}
+		difference = (float)fabs(marched - distances[i]);
+		if((marched < 0.0f) != (distances[i] < 0.0f) || difference > GROUND_BENCH_MARCH_STEP) {
+			disagreements++;
+		} else {
+			largest = difference > largest ? difference : largest;
+		}
+	}
+	marchTime = getTime() - startTime;
+	printf("Marched: %.2f us a ray, %d of %d rays hit further than a step from the cast, largest difference of the rest %g\n",
+		marchTime * 1000000.0 / GROUND_BENCH_MARCHED, disagreements, GROUND_BENCH_MARCHED, largest);
+
+	memoryFree(x);
+	memoryFree(z);
+	memoryFree(heights);
+	memoryFree(batched);
+	memoryFree(rays);
+	memoryFree(distances);
+	memoryFree(cast);
+	worldDestroy(streamWorld);
+	streamWorld = NULL;
+}
+
+/************************************************************************
+
+	Function:		cullMountains
+
+	Description:	Marks the mountains in a snapshot that are hidden behind
+					nearer ones or off the screen. The nearest mountains are
+					drawn into the occlusion buffer as eight sided cones that
+					fit inside the drawn ones, then a pyramid around every
+					mountain is tested against the depth pyramid. Only solid sea
+					and sky is culled, the grid has no mountains and the
+					wireframe shows what is behind them. Follows the settings
+					the main thread handed over rather than its globals.
+
+*************************************************************************/
+void cullMountains(SimSnapshot *snapshot, const CullSettings *settings) {
+	GLfloat *camera = snapshot->cameraPosition;
+	float up[3] = {0.0f, 1.0f, 0.0f};
+	float view[16];
+	float projection[16];
+	float viewProjection[16];
+	// Square based pyramid around a mountain, the base corners then the peak
+	float hull[5 * 3];
+	// Occluder cone, the peak then the base
+	float positions[(OCCLUDER_SLICES + 1) * 3];
+	int indices[OCCLUDER_SLICES * 3];
+	// Mountains nearest first
+	int *order = cullOrder;
+	float *distances = cullDistances;
+	WorldMountain *mountain;
+	float dx, dz, radius, angle;
+	double startTime = getTime();
+	int i, k, result;
+
+	// Everything is drawn unless culling says otherwise
+	memset(snapshot->isMountainVisible, 1, snapshot->mountainCount);
+	snapshot->cullOccluders = 0;
+	snapshot->cullOccluded = 0;
+	snapshot->cullOutside = 0;
+	snapshot->cullTime = 0.0;
+	if(!settings->isCulling) {
+		return;
+	}
+
+	// Same camera as display and myResize
+	matrixIdentity(view);
+	matrixLookAt(view, camera, camera + 3, up);
+	matrixPerspective(projection, 90.0f, settings->aspect, VIEW_NEAR, VIEW_FAR);
+	matrixMultiply(viewProjection, projection, view);
+
+	// Sort by distance from the camera
+	for(i = 0; i < snapshot->mountainCount; i++) {
+		dx = snapshot->mountains[i].x - camera[0];
+		dz = snapshot->mountains[i].z - camera[2];
+		distances[i] = dx * dx + dz * dz;
+		for(k = i; k > 0 && distances[order[k - 1]] > distances[i]; k--) {
+			order[k] = order[k - 1];
+		}
+		order[k] = i;
+	}
+
+	// Triangles from the peak around the base
+	for(k = 0; k < OCCLUDER_SLICES; k++) {
+		indices[k * 3] = 0;
+		indices[k * 3 + 1] = 1 + k;
+		indices[k * 3 + 2] = 1 + (k + 1) % OCCLUDER_SLICES;
+	}
+
+	occlusionClear(occlusionBuffer);
+	for(i = 0; i < snapshot->mountainCount && i < OCCLUSION_MAX_OCCLUDERS; i++) {
+		mountain = &snapshot->mountains[order[i]];
+		// Base corners on the inside of the 20 sided cone that is drawn
+		radius = mountain->width * (float)cos(PI / 20.0f);
+		positions[0] = mountain->x;
+		positions[1] = mountain->base + mountain->height;
+		positions[2] = mountain->z;
+		for(k = 0; k < OCCLUDER_SLICES; k++) {
+			angle = 2.0f * PI * k / OCCLUDER_SLICES;
+			positions[(k + 1) * 3] = mountain->x + radius * (float)cos(angle);
+			positions[(k + 1) * 3 + 1] = mountain->base;
+			positions[(k + 1) * 3 + 2] = mountain->z + radius * (float)sin(angle);
+		}
+		occlusionDrawTriangles(occlusionBuffer, viewProjection, positions, indices, OCCLUDER_SLICES);
+		snapshot->cullOccluders++;
+	}
+	occlusionBuildPyramid(occlusionBuffer);
+
+	// Test each cone by the pyramid around it, much tighter than its box
+	for(i = 0; i < snapshot->mountainCount; i++) {
+		mountain = &snapshot->mountains[i];
+		for(k = 0; k < 4; k++) {
+			hull[k * 3] = (k & 1) ? mountain->x + mountain->width : mountain->x - mountain->width;
+			hull[k * 3 + 1] = mountain->base;
+			hull[k * 3 + 2] = (k & 2) ? mountain->z + mountain->width : mountain->z - mountain->width;
+		}
+		hull[12] = mountain->x;
+		hull[13] = mountain->base + mountain->height;
+		hull[14] = mountain->z;
+
+		result = occlusionTestPoints(occlusionBuffer, viewProjection, hull, 5);
+		if(result == OCCLUSION_OCCLUDED) {
+			snapshot->isMountainVisible[i] = 0;
+			snapshot->cullOccluded++;
+		} else if(result == OCCLUSION_OUTSIDE) {
+			snapshot->isMountainVisible[i] = 0;
+			snapshot->cullOutside++;
+		}
+	}
+
+	snapshot->cullTime = getTime() - startTime;
+}
+
+/************************************************************************
+
+	Function:		fillCullSettings
+
+	Description:	Fills in the settings a cull follows from the toggles
+					and the window. Runs on the main thread.
+
+*************************************************************************/
+void fillCullSettings(CullSettings *settings) {
+	settings->isCulling = isOcclusionCulling && isSeaAndSky && !isWireRendering;
+	settings->aspect = windowWidth / windowHeight;
+}
+
+/************************************************************************
+
+	Function:		publishCullSettings
+
+	Description:	Hands the culling thread this frame's settings through
+					the settings triple buffer. Runs on the main thread.
+
+*************************************************************************/
+void publishCullSettings() {
+	fillCullSettings(&cullSettings[tripleBufferWriteIndex(&cullSettingsBuffer)]);
+	tripleBufferPublish(&cullSettingsBuffer);
+}
+
+/************************************************************************
+
+	Function:		cullingThreadMain
+
+	Description:	Culls each new snapshot from the simulation with the
+					newest settings from the main thread and passes it on to
+					the renderer, running alongside both of them.
+
+*************************************************************************/
+DWORD WINAPI cullingThreadMain(LPVOID parameter) {
+	SimSnapshot *source;
+	SimSnapshot *snapshot;
+	const CullSettings *settings;
+	unsigned long lastStep = renderSnapshot->step;
+
+	while(!isCullingStopping) {
+		// Woken by each published snapshot, the timeout only checks for stopping
+		WaitForSingleObject(snapshotEvent, 100);
+
+		source = &simSnapshots[tripleBufferRead(&snapshotBuffer)];
+		if(source->step == lastStep) {
+			continue;
+		}
+		lastStep = source->step;
+
+		snapshot = &culledSnapshots[tripleBufferWriteIndex(&culledBuffer)];
+		copySnapshot(snapshot, source);
+		settings = &cullSettings[tripleBufferRead(&cullSettingsBuffer)];
+		cullMountains(snapshot, settings);
+		tripleBufferPublish(&culledBuffer);
+	}
+
+	return 0;
+}
+
+/************************************************************************
+
+	Function:		startCullingThread
+
+	Description:	Starts the culling thread. From here on the renderer
+					takes its snapshots from the culling thread instead of
+					straight from the simulation.
+
+*************************************************************************/
+void startCullingThread() {
+	CullSettings settings;
+
+	occlusionBuffer = occlusionCreate(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+	snapshotEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if(occlusionBuffer == NULL || snapshotEvent == NULL) {
+		printf("Could not set up occlusion culling, drawing every mountain\n");
+		return;
+	}
+
+	// Settings are there before the thread looks for them
+	tripleBufferInit(&cullSettingsBuffer);
+	publishCullSettings();
+
+	// First culled snapshot is the one the renderer has now
+	tripleBufferInit(&culledBuffer);
+	fillCullSettings(&settings);
+	copySnapshot(&culledSnapshots[tripleBufferWriteIndex(&culledBuffer)], renderSnapshot);
+	cullMountains(&culledSnapshots[tripleBufferWriteIndex(&culledBuffer)], &settings);
+	tripleBufferPublish(&culledBuffer);
+
+	isCullingStopping = 0;
+	cullingThread = CreateThread(NULL, 0, cullingThreadMain, NULL, 0, NULL);
+	if(cullingThread == NULL) {
+		printf("Could not start the culling thread, drawing every mountain\n");
+		return;
+	}
+	renderSnapshot = &culledSnapshots[tripleBufferRead(&culledBuffer)];
+}
+
+/************************************************************************
+
+	Function:		stopCullingThread
+
+	Description:	Tells the culling thread to stop and waits for it.
+
+*************************************************************************/
+void stopCullingThread() {
+	if(cullingThread != NULL) {
+		InterlockedExchange(&isCullingStopping, 1);
+		SetEvent(snapshotEvent);
+		WaitForSingleObject(cullingThread, INFINITE);
+		CloseHandle(cullingThread);
+		cullingThread = NULL;
+	}
+}
+
+/************************************************************************
+
+	Function:		startAssetWatcher
+
+	Description:	Starts watching the asset folder. Changed assets are read
+					in on the watcher thread and swapped in between frames.
+
+*************************************************************************/
+void startAssetWatcher() {
+	assetWatcher = assetWatcherCreate(ASSET_FOLDER, assetChanged, NULL);
+	if(assetWatcher == NULL) {
+		printf("Could not watch the asset folder, assets will not reload\n");
+	}
+}
+
+/************************************************************************
+
+	Function:		stopAssetWatcher
+
+	Description:	Stops the watcher thread, waits for textures still
+					loading and frees reads that were never swapped in.
+
+*************************************************************************/
+void stopAssetWatcher() {
+	int i = 0;
+
+	assetWatcherDestroy(assetWatcher);
+	assetWatcher = NULL;
+	waitForAssetLoads();
+
+	for(i = 0; i < ASSET_COUNT; i++) {
+		freeAssetReload((AssetReload*)InterlockedExchangePointer((PVOID volatile*)&pendingReloads[i], NULL));
+	}
+}
+
+/************************************************************************
+
+	Function:		assetChanged
+
+	Description:	Called on the watcher thread for each file that changed.
+					Reads the file if it is one of the assets and leaves it
+					for the renderer, in place of an older read it has not
+					taken yet.
+
+*************************************************************************/
+void assetChanged(const char *fileName, double changeTime, void *context) {
+	AssetReload *reload;
+	int asset = -1;
+	int i = 0;
+
+	for(i = 0; i < ASSET_COUNT; i++) {
+		if(_stricmp(fileName, assetFileName(i)) == 0) {
+			asset = i;
+		}
+	}
+	// Textures not drawn yet are read as they are now on their first use
+	if(asset < 0 || assetStates[asset] != ASSET_STATE_READY) {
+		return;
+	}
+
+	reload = readAssetReload(asset, fileName, changeTime);
+	if(reload == NULL) {
+		printf("Could not reload %s, keeping the one already loaded\n", fileName);
+		return;
+	}
+
+	freeAssetReload((AssetReload*)InterlockedExchangePointer((PVOID volatile*)&pendingReloads[asset], reload));
+}
+
+/************************************************************************
+
+	Function:		readAssetReload
+
+	Description:	Reads a changed asset into a new reload. Models get a
+					fresh arena and their low detail copy, images are put in
+					the same order loadSea uses and a new sky also remakes
+					the skybox faces. Returns NULL if the file could not be
+					read, it may still be half written.
+
+*************************************************************************/
+AssetReload *readAssetReload(int asset, const char *fileName, double changeTime) {
+	AssetReload *reload;
+	GLubyte swap[3];
+	int total = 0;
+	int i = 0;
+	int k = 0;
+
+	reload = (AssetReload*)memoryAllocZeroed(MEMORY_ASSETS, sizeof(AssetReload));
+	if(reload == NULL) {
+		return NULL;
+	}
+	reload->asset = asset;
+	strcpy(reload->fileName, fileName);
+	reload->changeTime = changeTime;
+	reload->readStartTime = getTime();
+
+	if(asset == ASSET_PLANE || asset == ASSET_PROP) {
+		arenaInit(&reload->arena, asset == ASSET_PLANE ? planeArena.name : propArena.name, ARENA_BLOCK_SIZE);
+		meshInitArena(&reload->mesh, &reload->arena);
+		meshInitArena(&reload->lowMesh, &reload->arena);
+		if(!meshLoadObject(&reload->mesh, fileName, asset == ASSET_PLANE ? planeMaterialIndex : propMaterialIndex) || reload->mesh.polygonCount == 0) {
+			freeAssetReload(reload);
+			return NULL;
+		}
+		meshSimplify(&reload->lowMesh, &reload->mesh, asset == ASSET_PLANE ? PLANE_LOW_DETAIL_CELLS : PROP_LOW_DETAIL_CELLS);
+	} else {
+		reload->pixels = skyboxReadImage(fileName, &reload->width, &reload->height);
+		if(reload->pixels == NULL) {
+			freeAssetReload(reload);
+			return NULL;
+		}
+
+		// The load functions store the pixels last to first
+		total = reload->width * reload->height;
+		for(i = 0; i < total / 2; i++) {
+			for(k = 0; k < 3; k++) {
+				swap[k] = reload->pixels[3 * i + k];
+				reload->pixels[3 * i + k] = reload->pixels[3 * (total - 1 - i) + k];
+				reload->pixels[3 * (total - 1 - i) + k] = swap[k];
+			}
+		}
+
+		// Skybox faces were made from the old sky
+		if(asset == ASSET_SKY && isSkyboxFromSky) {
+			if(!makeSkyboxFaces(reload->skyboxFaces, reload->pixels, reload->width, reload->height)) {
+				freeAssetReload(reload);
+				return NULL;
+			}
+			reload->skyboxFaceSize = SKYBOX_FACE_SIZE;
+			reload->isSkyboxFromSky = 1;
+		}
+	}
+
+	reload->readTime = getTime() - reload->readStartTime;
+	return reload;
+}
+
+/************************************************************************
+
+	Function:		freeAssetReload
+
+	Description:	Frees a reload and whatever it still holds. Does nothing
+					for NULL.
+
+*************************************************************************/
+void freeAssetReload(AssetReload *reload) {
+	int i = 0;
+
+	if(reload == NULL) {
+		return;
+	}
+
+	arenaRelease(&reload->arena);
+	if(!reload->isMapped) {
+		memoryFree(reload->pixels);
+	}
+	for(i = 0; i < SKYBOX_FACES; i++) {
+		memoryFree(reload->skyboxFaces[i]);
+	}
+	memoryFree(reload);
+}
+
+/************************************************************************
+
+	Function:		assetFileName
+
+	Description:	Returns the file an asset is read from.
+
+*************************************************************************/
+const char *assetFileName(int asset) {
+	switch(asset) {
+		case ASSET_PLANE:
+			return sceneConfig.planeFile;
+		case ASSET_PROP:
+			return sceneConfig.propFile;
+		case ASSET_SEA:
+			return SEA_IMAGE_FILE;
+		case ASSET_SKY:
+			return SKY_IMAGE_FILE;
+		case ASSET_MOUNTAIN:
+			return MOUNTAIN_IMAGE_FILE;
+		default:
+			return "";
+	}
+}
+
+/************************************************************************
+
+	Function:		requestAsset
+
+	Description:	Called by the draw path for each texture it is about to
+					use. The first call starts a thread that reads the image
+					and leaves it for applyAssetReloads, the texture stays a
+					placeholder until then. Later calls do nothing. Reads on
+					this thread if the loading thread cannot be started.
+
+*************************************************************************/
+void requestAsset(int asset) {
+	if(assetStates[asset] != ASSET_STATE_NOT_LOADED) {
+		return;
+	}
+	assetStates[asset] = ASSET_STATE_LOADING;
+	assetRequestTimes[asset] = getTime();
+
+	assetLoadThreads[asset] = CreateThread(NULL, 0, assetLoadThreadMain, (LPVOID)(INT_PTR)asset, 0, NULL);
+	if(assetLoadThreads[asset] == NULL) {
+		printf("Could not start loading %s in the background, loading it now\n", assetFileName(asset));
+		assetLoadThreadMain((LPVOID)(INT_PTR)asset);
+	}
+}
+
+/************************************************************************
+
+	Function:		assetLoadThreadMain
+
+	Description:	Reads a texture on its first use. The image is used from
+					the asset pack as it is when the pack has it, otherwise
+					it is read from its file like a reload. The sky also
+					reads or makes the skybox faces. The result is left in
+					pendingReloads for the renderer to swap in.
+
+*************************************************************************/
+DWORD WINAPI assetLoadThreadMain(LPVOID parameter) {
+	int asset = (int)(INT_PTR)parameter;
+	const char *fileName = assetFileName(asset);
+	const unsigned char *packPixels;
+	AssetReload *reload = NULL;
+	double startTime = getTime();
+	int width = 0;
+	int height = 0;
+
+	// Pack images are already in the order the load functions use
+	packPixels = assetPackGetImage(&assetPack, fileName, &width, &height);
+	if(packPixels != NULL) {
+		reload = (AssetReload*)memoryAllocZeroed(MEMORY_ASSETS, sizeof(AssetReload));
+		if(reload != NULL) {
+			reload->asset = asset;
+			strcpy(reload->fileName, fileName);
+			reload->changeTime = assetRequestTimes[asset];
+			reload->readStartTime = startTime;
+			reload->pixels = (GLubyte*)packPixels;
+			reload->width = width;
+			reload->height = height;
+			reload->isMapped = 1;
+		}
+	} else {
+		reload = readAssetReload(asset, fileName, assetRequestTimes[asset]);
+	}
+
+	// Skybox faces only when there is a cube map to put them in
+	if(reload != NULL && asset == ASSET_SKY && skyboxTextureID != 0 && !readSkyboxFaces(reload)) {
+		printf("Out of memory for the skybox, using the sky cylinder\n");
+	}
+	if(reload == NULL) {
+		printf("Could not load %s, keeping the placeholder\n", fileName);
+		return 0;
+	}
+	reload->readTime = getTime() - startTime;
+
+	freeAssetReload((AssetReload*)InterlockedExchangePointer((PVOID volatile*)&pendingReloads[asset], reload));
+	return 0;
+}
+
+/************************************************************************
+
+	Function:		readSkyboxFaces
+
+	Description:	Fills in the skybox faces of the first sky reload. The
+					faces written by SkyboxTool are used when they are next
+					to the other images, otherwise they are made from the
+					sky image. Returns 0 if there was no memory for them.
+
+*************************************************************************/
+int readSkyboxFaces(AssetReload *reload) {
+	char fileName[64];
+	int width = 0;
+	int height = 0;
+	int size = 0;
+	int isLoaded = 1;
+	int i = 0;
+
+	// Faces from SkyboxTool, they all have to be the same square size
+	for(i = 0; i < SKYBOX_FACES; i++) {
+		skyboxFaceFileName(fileName, "skybox", i);
+		reload->skyboxFaces[i] = skyboxReadImage(fileName, &width, &height);
+		if(i == 0) {
+			size = width;
+		}
+		if(reload->skyboxFaces[i] == NULL || width != size || height != size) {
+			isLoaded = 0;
+		}
+	}
+	if(isLoaded) {
+		reload->skyboxFaceSize = size;
+		reload->isSkyboxFromSky = 0;
+		return 1;
+	}
+
+	// Otherwise make them from the sky image
+	for(i = 0; i < SKYBOX_FACES; i++) {
+		memoryFree(reload->skyboxFaces[i]);
+		reload->skyboxFaces[i] = NULL;
+	}
+	if(!makeSkyboxFaces(reload->skyboxFaces, reload->pixels, reload->width, reload->height)) {
+		return 0;
+	}
+	reload->skyboxFaceSize = SKYBOX_FACE_SIZE;
+	reload->isSkyboxFromSky = 1;
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		waitForAssetLoads
+
+	Description:	Waits for any texture still being read on its first use,
+					so its reload is in pendingReloads before they are freed.
+
+*************************************************************************/
+void waitForAssetLoads() {
+	int i = 0;
+
+	for(i = 0; i < ASSET_COUNT; i++) {
+		if(assetLoadThreads[i] != NULL) {
+			WaitForSingleObject(assetLoadThreads[i], INFINITE);
+			CloseHandle(assetLoadThreads[i]);
+			assetLoadThreads[i] = NULL;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		swapModel
+
+	Description:	Puts a reloaded model in place of the old one. The old
+					meshes go with the model's arena, which takes over the
+					reload's blocks. Buffers are only uploaded again when
+					the shader path uploaded them in the first place.
+
+*************************************************************************/
+void swapModel(AssetReload *reload, Mesh *mesh, Mesh *lowMesh, Arena *arena, GpuMesh *gpuMesh, GpuMesh *lowGpuMesh) {
+	arenaRelease(arena);
+	*arena = reload->arena;
+	arenaInit(&reload->arena, arena->name, ARENA_BLOCK_SIZE);
+
+	*mesh = reload->mesh;
+	*lowMesh = reload->lowMesh;
+	mesh->arena = arena;
+	lowMesh->arena = arena;
+
+	if(gpuMesh->vertexArray != 0) {
+		deleteGpuMesh(gpuMesh);
+		deleteGpuMesh(lowGpuMesh);
+		uploadMesh(gpuMesh, mesh);
+		uploadMesh(lowGpuMesh, lowMesh);
+	}
+}
+
+/************************************************************************
+
+	Function:		openAssetPack
+
+	Description:	Maps the asset pack if there is one and -loose was not
+					given. Models and images it does not have are still read
+					from their loose files.
+
+*************************************************************************/
+void openAssetPack() {
+	if(isLooseAssets) {
+		return;
+	}
+	isAssetPackOpen = assetPackOpen(&assetPack, ASSET_PACK_FILE);
+}
+
+/************************************************************************
+
+	Function:		writeAssetPack
+
+	Description:	Reads the models and images from their loose files the
+					same way the program does, makes the low detail copies
+					and writes them all to the asset pack. Run with -pack,
+					again whenever a loose file changes.
+
+*************************************************************************/
+void writeAssetPack() {
+	AssetPackWriter writer;
+	// Model file names and the names of their low detail copies
+	const char *modelNames[2];
+	char lowName[MAX_PATH + sizeof(ASSET_PACK_LOW_SUFFIX)];
+	Mesh *meshes[2] = {&planeMesh, &propMesh};
+	Mesh *lowMeshes[2] = {&planeLowMesh, &propLowMesh};
+	double startTime = getTime();
+	int isWritten = 0;
+	int i = 0;
+
+	modelNames[0] = sceneConfig.planeFile;
+	modelNames[1] = sceneConfig.propFile;
+
+	// Everything from the loose files
+	loadSea();
+	loadSky();
+	loadMountain();
+	loadModel(modelNames[0], meshes[0], lowMeshes[0], planeMaterialIndex, PLANE_LOW_DETAIL_CELLS);
+	loadModel(modelNames[1], meshes[1], lowMeshes[1], propMaterialIndex, PROP_LOW_DETAIL_CELLS);
+
+	if(assetPackBegin(&writer, ASSET_PACK_FILE)) {
+		for(i = 0; i < 2; i++) {
+			sprintf(lowName, "%s%s", modelNames[i], ASSET_PACK_LOW_SUFFIX);
+			assetPackAddMesh(&writer, modelNames[i], meshes[i]);
+			assetPackAddMesh(&writer, lowName, lowMeshes[i]);
+		}
+		// Images in the reversed order the load functions leave them in
+		assetPackAddImage(&writer, SEA_IMAGE_FILE, imageDataSea, imageWidthSea, imageHeightSea, 3);
+		assetPackAddImage(&writer, SKY_IMAGE_FILE, imageDataSky, imageWidthSky, imageHeightSky, 3);
+		assetPackAddImage(&writer, MOUNTAIN_IMAGE_FILE, imageDataMountain, imageWidthMountain, imageHeightMountain, 3);
+		isWritten = assetPackEnd(&writer);
+	}
+
+	if(isWritten) {
+		printf("Wrote %s in %.1f ms: %u models and images, %u KB\n", ASSET_PACK_FILE, (getTime() - startTime) * 1000.0,
+			writer.header.entryCount, writer.header.fileBytes / 1024);
+	} else {
+		printf("Could not write %s\n", ASSET_PACK_FILE);
+	}
+}
+
+/************************************************************************
+
+	Function:		loadPackImage
+
+	Description:	Points at an image in the asset pack. The pixels are read
+					only and already in the order the load functions leave
+					them in, so they go straight to the texture upload.
+					Returns 0 if there is no pack or it does not have the
+					image.
+
+*************************************************************************/
+int loadPackImage(const char *fileName, GLubyte **pixels, int *width, int *height) {
+	const unsigned char *packPixels = assetPackGetImage(&assetPack, fileName, width, height);
+
+	if(packPixels == NULL) {
+		return 0;
+	}
+	*pixels = (GLubyte*)packPixels;
+
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		loadPackModel
+
+	Description:	Points a model's mesh and its low detail copy at the
+					asset pack. Returns 0 and leaves both alone if the pack
+					does not have them both.
+
+*************************************************************************/
+int loadPackModel(const char *fileName, Mesh *mesh, Mesh *lowMesh) {
+	char lowName[MAX_PATH + sizeof(ASSET_PACK_LOW_SUFFIX)];
+
+	sprintf(lowName, "%s%s", fileName, ASSET_PACK_LOW_SUFFIX);
+	if(assetPackFind(&assetPack, fileName, ASSET_PACK_MESH) == NULL || assetPackFind(&assetPack, lowName, ASSET_PACK_MESH) == NULL) {
+		return 0;
+	}
+
+	return assetPackGetMesh(&assetPack, fileName, mesh) && assetPackGetMesh(&assetPack, lowName, lowMesh);
+}
+
+/************************************************************************
+
+	Function:		loadModel
+
+	Description:	Gets a model and its low detail copy from the asset pack,
+					or reads the loose file and simplifies it when the pack
+					does not have them.
+
+*************************************************************************/
+void loadModel(const char *fileName, Mesh *mesh, Mesh *lowMesh, MeshMaterialFunction materialForObject, int lowDetailCells) {
+	if(loadPackModel(fileName, mesh, lowMesh)) {
+		return;
+	}
+	meshLoadObject(mesh, fileName, materialForObject);
+	meshSimplify(lowMesh, mesh, lowDetailCells);
+}
+
+/************************************************************************
+
+	Function:		applyAssetReloads
+
+	Description:	Called between frames. Takes every asset the watcher has
+					read since the last frame, and every texture loaded on
+					its first use, and swaps it in, uploading only that
+					asset: new display lists and buffers for a model, or one
+					texture for an image. The first sky also brings the
+					skybox faces. Prints how long the reload took from the
+					first change to the file, or the load from when the
+					texture was first drawn. A texture's first load also
+					prints the resident set size before and after its CPU
+					image copy is freed.
+
+*************************************************************************/
+void applyAssetReloads() {
+	AssetReload *reload;
+	GLint isFirstLoad = 0;
+	double swapStartTime = 0.0;
+	double now = 0.0;
+	SIZE_T residentSizeBeforeFree = 0;
+	SIZE_T residentSizeAfterFree = 0;
+	int isMapped = 0;
+	int isTextureUploaded = 0;
+	int i = 0;
+
+	for(i = 0; i < ASSET_COUNT; i++) {
+		if(pendingReloads[i] == NULL) {
+			continue;
+		}
+		reload = (AssetReload*)InterlockedExchangePointer((PVOID volatile*)&pendingReloads[i], NULL);
+		if(reload == NULL) {
+			continue;
+		}
+		swapStartTime = getTime();
+		isFirstLoad = assetStates[reload->asset] != ASSET_STATE_READY;
+
+		switch(reload->asset) {
+			case ASSET_PLANE:
+				swapModel(reload, &planeMesh, &planeLowMesh, &planeArena, &planeGpuMesh, &planeLowGpuMesh);
+				glDeleteLists(thePlane, 1);
+				glDeleteLists(thePlaneLow, 1);
+				displayListCallCount -= planeListCalls + planeLowListCalls;
+				planeListCalls = 0;
+				planeLowListCalls = 0;
+				thePlane = compileModelList(&planeMesh, 1, &planeListCalls);
+				thePlaneLow = compileModelList(&planeLowMesh, 1, &planeLowListCalls);
+				break;
+			case ASSET_PROP:
+				swapModel(reload, &propMesh, &propLowMesh, &propArena, &propGpuMesh, &propLowGpuMesh);
+				glDeleteLists(theProp, 1);
+				glDeleteLists(thePropLow, 1);
+				displayListCallCount -= propListCalls + propLowListCalls;
+				propListCalls = 0;
+				propLowListCalls = 0;
+				theProp = compileModelList(&propMesh, 0, &propListCalls);
+				thePropLow = compileModelList(&propLowMesh, 0, &propLowListCalls);
+				// Old disc went with the old arena
+				setUpPropImpostor();
+				break;
+			case ASSET_SEA:
+				imageWidthSea = reload->width;
+				imageHeightSea = reload->height;
+				streamTexture(seaTextureID, reload->width, reload->height, reload->pixels);
+				seaTextureBytes = estimateTextureBytes(GL_TEXTURE_2D, 1);
+				break;
+			case ASSET_SKY:
+				imageWidthSky = reload->width;
+				imageHeightSky = reload->height;
+				streamTexture(skyTextureID, reload->width, reload->height, reload->pixels);
+				skyTextureBytes = estimateTextureBytes(GL_TEXTURE_2D, 1);
+				if(reload->skyboxFaces[0] != NULL) {
+					uploadSkyboxFaces(reload->skyboxFaces, reload->skyboxFaceSize);
+					// First faces make the skybox usable, so switch to it
+					if(!isSkyboxAvailable) {
+						isSkyboxFromSky = reload->isSkyboxFromSky;
+						isSkyboxAvailable = 1;
+						isSkyboxOn = 1;
+						printf("Skybox: six %d by %d faces %s\n", reload->skyboxFaceSize, reload->skyboxFaceSize,
+							isSkyboxFromSky ? "made from " SKY_IMAGE_FILE : "loaded from skybox_*.ppm");
+					}
+				}
+				break;
+			case ASSET_MOUNTAIN:
+				imageWidthMountain = reload->width;
+				imageHeightMountain = reload->height;
+				streamTexture(mountainTextureID, reload->width, reload->height, reload->pixels);
+				mountainTextureBytes = estimateTextureBytes(GL_TEXTURE_2D, 1);
+				break;
+			default:
+				break;
+		}
+		if(reload->pixels != NULL) {
+			isTextureUploaded = 1;
+		}
+
+		now = getTime();
+		if(isFirstLoad) {
+			assetStates[reload->asset] = ASSET_STATE_READY;
+			printf("Loaded %s %.1f ms after it was first drawn: %.1f ms reading %s, %.1f ms swapping in\n",
+				reload->fileName, (now - reload->changeTime) * 1000.0, reload->readTime * 1000.0,
+				reload->isMapped ? "from the asset pack" : "in the background", (now - swapStartTime) * 1000.0);
+		} else {
+			printf("Reloaded %s in %.1f ms: %.1f ms for writes to settle, %.1f ms reading on the watcher thread, %.1f ms swapping in\n",
+				reload->fileName, (now - reload->changeTime) * 1000.0, (reload->readStartTime - reload->changeTime) * 1000.0,
+				reload->readTime * 1000.0, (now - swapStartTime) * 1000.0);
+		}
+
+		// The copy is on the card now, see what freeing it gives back
+		if(isFirstLoad && reload->pixels != NULL) {
+			isMapped = reload->isMapped;
+			residentSizeBeforeFree = getResidentSetSize();
+			freeAssetReload(reload);
+			residentSizeAfterFree = getResidentSetSize();
+			printf("Resident set size before free: %lu KB, after free: %lu KB, for the CPU copy of %s%s\n",
+				(unsigned long)(residentSizeBeforeFree / 1024), (unsigned long)(residentSizeAfterFree / 1024),
+				assetFileName(i), isMapped ? ", only mapped from the asset pack so there is little to free" : "");
+		} else {
+			freeAssetReload(reload);
+		}
+	}
+
+	// Texture uploads are done with their pixel buffers
+	if(isTextureUploaded) {
+		releasePixelBuffers();
+	}
+}
+
+/************************************************************************
+
+	Function:		positionScene
+
+	Description:	This positions the camera to trail behinde the plane
+					along its heading, kept above the ground and mountains
+					it trails over when they are drawn.
+
+*************************************************************************/
+void positionScene() {
+	// Heading, the camera trails along it
+	float headingSin = (float)sin(flight.turnAngle * (PI/180.0f));
+	float headingCos = (float)cos(flight.turnAngle * (PI/180.0f));
+	float ground = 0.0f;
+
+	// Set up the camera position to trail behinde the plane
+	// Based off the plane position
+	cameraPosition[0] = flight.position[0] + headingSin * -4;
+	cameraPosition[1] = 1.2 + flight.position[1];
+	cameraPosition[2] = flight.position[2] - headingCos * -4;
+
+	// Lift it out of any hill the plane has just flown past
+	if(streamWorld != NULL && isWorldShown) {
+		ground = worldGroundHeight(streamWorld, flight.originTile, cameraPosition[0], cameraPosition[2]) + CAMERA_GROUND_CLEARANCE;
+		if(cameraPosition[1] < ground) {
+			cameraPosition[1] = ground;
+		}
+	}
+
+	// Set where to look at (the plane)
+	cameraPosition[3] = flight.position[0];
+	cameraPosition[4] = flight.position[1];
+	cameraPosition[5] = flight.position[2];
+}
+
+/************************************************************************
+
+	Function:		loadSea
+
+	Description:	Loads in the PPM image for sea, this code is from the animation
+					slides for loading in an image.
+
+*************************************************************************/
+void loadSea()
+{
+	// the ID of the image file
+	FILE *fileID;
+
+	// maxValue
+	int  maxValue;
+
+	// total number of pixels in the image
+	int  totalPixels;
+
+	// temporary character
+	char tempChar;
+
+	// counter variable for the current pixel in the image
+	int i;
+
+	// array for reading in header information
+	char headerLine[100];
+
+	float RGBScaling;
+
+	// temporary variables for reading in the red, green and blue data of each pixel
+	int red, green, blue;
+
+	// Use the image from the asset pack as it is when it has one
+	if(loadPackImage(SEA_IMAGE_FILE, &imageDataSea, &imageWidthSea, &imageHeightSea)) {
+		return;
+	}
+
+	// Read in the sea
+	fileID = fopen(SEA_IMAGE_FILE, "r");
+
+	// read in the first header line
+	fscanf(fileID,"%[^\n] ", headerLine);
+
+	// make sure that the image begins with 'P3', which signifies a PPM file
+	if ((headerLine[0] != 'P') || (headerLine[1] != '3'))
+	{
+		// printf("This is not a PPM file!\n");
+		exit(0);
+	}
+
+	// we have a PPM file
+	printf("Loading textures please wait...\n");
+
+	// read in the first character of the next line
+	fscanf(fileID, "%c", &tempChar);
+
+	// while we still have comment lines (which begin with #)
+	while(tempChar == '#')
+	{
+		// read in the comment
+		fscanf(fileID, "%[^\n] ", headerLine);
+
+		// // print the comment
+		// printf("%s\n", headerLine);
+
+		// read in the first character of the next line
+		fscanf(fileID, "%c",&tempChar);
+	}
+
+	// the last one was not a comment character '#', so we nee dto put it back into the file stream (undo)
+	ungetc(tempChar, fileID);
+
+	// read in the image hieght, width and the maximum value
+	fscanf(fileID, "%d %d %d", &imageWidthSea, &imageHeightSea, &maxValue);
+
+	// // print out the information about the image file
+	// printf("%d rows  %d columns  max value= %d\n", imageHeight, imageWidth, maxValue);
+
+	// compute the total number of pixels in the image
+	totalPixels = imageWidthSea * imageHeightSea;
+
+	// allocate enough memory for the image  (3*) because of the RGB data
+	imageDataSea = (GLubyte*)arenaAlloc(&imageArena, 3 * sizeof(GLubyte) * totalPixels);
+
+	// determine the scaling for RGB values
+	RGBScaling = 255.0 / maxValue;
+
+
+	// if the maxValue is 255 then we do not need to scale the
+	//    image data values to be in the range or 0 to 255
+	if (maxValue == 255)
+	{
+		for(i = 0; i < totalPixels; i++)
+		{
+			// read in the current pixel from the file
+			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+
+			// store the red, green and blue data of the current pixel in the data array
+			imageDataSea[3*totalPixels - 3*i - 3] = red;
+			imageDataSea[3*totalPixels - 3*i - 2] = green;
+			imageDataSea[3*totalPixels - 3*i - 1] = blue;
+		}
+	}
+	else  // need to scale up the data values
+	{
+		for(i = 0; i < totalPixels; i++)
+		{
+			// read in the current pixel from the file
+			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+
+			// store the red, green and blue data of the current pixel in the data array
+			imageDataSea[3*totalPixels - 3*i - 3] = red   * RGBScaling;
+			imageDataSea[3*totalPixels - 3*i - 2] = green * RGBScaling;
+			imageDataSea[3*totalPixels - 3*i - 1] = blue  * RGBScaling;
+		}
+	}
+
+	// close the image file
+	fclose(fileID);
+}
+
+/************************************************************************
+
+	Function:		loadSky
+
+	Description:	Loads in the PPM image for sky, this code is from the animation
+					slides for loading in an image.
+
+*************************************************************************/
+void loadSky()
+{
+	// the ID of the image file
+	FILE *fileID;
+
+	// maxValue
+	int  maxValue;
+
+	// total number of pixels in the image
+	int  totalPixels;
+
+	// temporary character
+	char tempChar;
+
+	// counter variable for the current pixel in the image
+	int i;
+
+	// array for reading in header information
+	char headerLine[100];
+
+	float RGBScaling;
+
+	// temporary variables for reading in the red, green and blue data of each pixel
+	int red, green, blue;
+
+	// Use the image from the asset pack as it is when it has one
+	if(loadPackImage(SKY_IMAGE_FILE, &imageDataSky, &imageWidthSky, &imageHeightSky)) {
+		return;
+	}
+
+	// Read in the sea
+	fileID = fopen(SKY_IMAGE_FILE, "r");
+
+	// read in the first header line
+	fscanf(fileID,"%[^\n] ", headerLine);
+
+	// make sure that the image begins with 'P3', which signifies a PPM file
+	if ((headerLine[0] != 'P') || (headerLine[1] != '3'))
+	{
+		// printf("This is not a PPM file!\n");
+		exit(0);
+	}
+
+	// we have a PPM file
+	printf("Loading textures please wait...\n");
+
+	// read in the first character of the next line
+	fscanf(fileID, "%c", &tempChar);
+
+	// while we still have comment lines (which begin with #)
+	while(tempChar == '#')
+	{
+		// read in the comment
+		fscanf(fileID, "%[^\n] ", headerLine);
+
+		// // print the comment
+		// printf("%s\n", headerLine);
+
+		// read in the first character of the next line
+		fscanf(fileID, "%c",&tempChar);
+	}
+
+	// the last one was not a comment character '#', so we nee dto put it back into the file stream (undo)
+	ungetc(tempChar, fileID);
+
+	// read in the image hieght, width and the maximum value
+	fscanf(fileID, "%d %d %d", &imageWidthSky, &imageHeightSky, &maxValue);
+
+	// // print out the information about the image file
+	// printf("%d rows  %d columns  max value= %d\n", imageHeight, imageWidth, maxValue);
+
+	// compute the total number of pixels in the image
+	totalPixels = imageWidthSky * imageHeightSky;
+
+	// allocate enough memory for the image  (3*) because of the RGB data
+	imageDataSky = (GLubyte*)arenaAlloc(&imageArena, 3 * sizeof(GLubyte) * totalPixels);
+
+	// determine the scaling for RGB values
+	RGBScaling = 255.0 / maxValue;
+
+
+	// if the maxValue is 255 then we do not need to scale the
+	//    image data values to be in the range or 0 to 255
+	if (maxValue == 255)
+	{
+		for(i = 0; i < totalPixels; i++)
+		{
+			// read in the current pixel from the file
+			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+
+			// store the red, green and blue data of the current pixel in the data array
+			imageDataSky[3*totalPixels - 3*i - 3] = red;
+			imageDataSky[3*totalPixels - 3*i - 2] = green;
+			imageDataSky[3*totalPixels - 3*i - 1] = blue;
+		}
+	}
+	else  // need to scale up the data values
+	{
+		for(i = 0; i < totalPixels; i++)
+		{
+			// read in the current pixel from the file
+			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+
+			// store the red, green and blue data of the current pixel in the data array
+			imageDataSky[3*totalPixels - 3*i - 3] = red   * RGBScaling;
+			imageDataSky[3*totalPixels - 3*i - 2] = green * RGBScaling;
+			imageDataSky[3*totalPixels - 3*i - 1] = blue  * RGBScaling;
+		}
+	}
+
+	// close the image file
+	fclose(fileID);
+}
+
+/************************************************************************
+
+	Function:		loadMountain
+
+	Description:	Loads in the PPM image for mountain, this code is from the animation
+					slides for loading in an image.
+
+*************************************************************************/
+void loadMountain()
+{
+	// the ID of the image file
+	FILE *fileID;
+
+	// maxValue
+	int  maxValue;
+
+	// total number of pixels in the image
+	int  totalPixels;
+
+	// temporary character
+	char tempChar;
+
+	// counter variable for the current pixel in the image
+	int i;
+
+	// array for reading in header information
+	char headerLine[100];
+
+	float RGBScaling;
+
+	// temporary variables for reading in the red, green and blue data of each pixel
+	int red, green, blue;
+
+	// Use the image from the asset pack as it is when it has one
+	if(loadPackImage(MOUNTAIN_IMAGE_FILE, &imageDataMountain, &imageWidthMountain, &imageHeightMountain)) {
+		return;
+	}
+
+	// Read in the sea
+	fileID = fopen(MOUNTAIN_IMAGE_FILE, "r");
+
+	// read in the first header line
+	fscanf(fileID,"%[^\n] ", headerLine);
+
+	// make sure that the image begins with 'P3', which signifies a PPM file
+	if ((headerLine[0] != 'P') || (headerLine[1] != '3'))
+	{
+		// printf("This is not a PPM file!\n");
+		exit(0);
+	}
+
+	// we have a PPM file
+	printf("Loading textures please wait...\n");
+
+	// read in the first character of the next line
+	fscanf(fileID, "%c", &tempChar);
+
+	// while we still have comment lines (which begin with #)
+	while(tempChar == '#')
+	{
+		// read in the comment
+		fscanf(fileID, "%[^\n] ", headerLine);
+
+		// // print the comment
+		// printf("%s\n", headerLine);
+
+		// read in the first character of the next line
+		fscanf(fileID, "%c",&tempChar);
+	}
+
+	// the last one was not a comment character '#', so we nee dto put it back into the file stream (undo)
+	ungetc(tempChar, fileID);
+
+	// read in the image hieght, width and the maximum value
+	fscanf(fileID, "%d %d %d", &imageWidthMountain, &imageHeightMountain, &maxValue);
+
+	// compute the total number of pixels in the image
+	totalPixels = imageWidthMountain * imageHeightMountain;
+
+	// allocate enough memory for the image  (3*) because of the RGB data
+	imageDataMountain = (GLubyte*)arenaAlloc(&imageArena, 3 * sizeof(GLubyte) * totalPixels);
+
+	// determine the scaling for RGB values
+	RGBScaling = 255.0 / maxValue;
+
+
+	// if the maxValue is 255 then we do not need to scale the
+	//    image data values to be in the range or 0 to 255
+	if (maxValue == 255)
+	{
+		for(i = 0; i < totalPixels; i++)
+		{
+			// read in the current pixel from the file
+			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+
+			// store the red, green and blue data of the current pixel in the data array
+			imageDataMountain[3*totalPixels - 3*i - 3] = red;
+			imageDataMountain[3*totalPixels - 3*i - 2] = green;
+			imageDataMountain[3*totalPixels - 3*i - 1] = blue;
+		}
+	}
+	else  // need to scale up the data values
+	{
+		for(i = 0; i < totalPixels; i++)
+		{
+			// read in the current pixel from the file
+			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+
+			// store the red, green and blue data of the current pixel in the data array
+			imageDataMountain[3*totalPixels - 3*i - 3] = red   * RGBScaling;
+			imageDataMountain[3*totalPixels - 3*i - 2] = green * RGBScaling;
+			imageDataMountain[3*totalPixels - 3*i - 1] = blue  * RGBScaling;
+		}
+	}
+
+	// close the image file
+	fclose(fileID);
+}
+
+/************************************************************************
+
+	Function:		setUpTexture
+
+	Description:	This sets up the textures for binding to sea and sky.
+					Each starts as a single white texel, so the material
+					color shows until its image is loaded on first use.
+
+*************************************************************************/
+void setUpTexture() {
+	// Stands in for every image until it is loaded
+	GLubyte placeholder[3] = {255, 255, 255};
+
+	// Bind the texture for the sea
+	glGenTextures(1, &seaTextureID);
+
+	// Bind texture to id
+	glBindTexture(GL_TEXTURE_2D, seaTextureID);
+
+	// Set up texture with various settings to wrapping
+	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+
+	// Placeholder until the sea is first drawn
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+	seaTextureBytes = estimateTextureBytes(GL_TEXTURE_2D, 1);
+
+	// Bind the for the sky
+	glGenTextures(1, &skyTextureID);
+
+	// Bind texture to id
+	glBindTexture(GL_TEXTURE_2D, skyTextureID);
+
+	// Set up texture with various settings to wrapping
+	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+
+	// Placeholder until the sky is first drawn
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+	skyTextureBytes = estimateTextureBytes(GL_TEXTURE_2D, 1);
+
+	// Bind the for the mountain
+	glGenTextures(1, &mountainTextureID);
+
+	// Bind texture to id
+	glBindTexture(GL_TEXTURE_2D, mountainTextureID);
+
+	// Set up texture with various settings to wrapping
+	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+
+	// Placeholder until the mountain texture is first drawn
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+	mountainTextureBytes = estimateTextureBytes(GL_TEXTURE_2D, 1);
+}
+
+/************************************************************************
+
+	Function:		setUpTextureStreaming
+
+	Description:	Sets up two pixel buffer objects that texture uploads are
+					streamed through. Uploads from a pixel buffer return right
+					away and the copy to the card happens while we keep rendering.
+					Needs non power of two textures and automatic mipmaps since
+					gluBuild2DMipmaps can not read from a pixel buffer.
+
+*************************************************************************/
+void setUpTextureStreaming() {
+	// Check the card can do everything the streaming path needs
+	if(GLEW_ARB_pixel_buffer_object && GLEW_VERSION_1_4 && (GLEW_VERSION_2_0 || GLEW_ARB_texture_non_power_of_two)) {
+		// Make the pixel buffers, storage is given out on each upload
+		glGenBuffers(2, texturePBO);
+		isPBOUpload = 1;
+	} else {
+		printf("Pixel buffer objects not supported, using plain texture uploads\n");
+	}
+}
+
+/************************************************************************
+
+	Function:		streamTexture
+
+	Description:	Uploads RGB image data to a texture and builds its mipmaps.
+					Goes through the next pixel buffer object when supported,
+					otherwise falls back to gluBuild2DMipmaps. The image data
+					is copied so the caller is free to release it afterwards.
+
+*************************************************************************/
+void streamTexture(GLuint textureID, int width, int height, GLubyte *imageData) {
+	// Size of the RGB image in bytes
+	int imageSize = width * height * 3;
+	// Pointer to the mapped pixel buffer
+	GLubyte *mappedBuffer;
+
+	// Bind texture to id
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	// Rows are tightly packed RGB
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if(isPBOUpload) {
+		// Swap pixel buffers so we never write one the driver is still reading
+		texturePBOIndex = (texturePBOIndex + 1) % 2;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texturePBO[texturePBOIndex]);
+
+		// Give the buffer new storage so mapping does not wait on an old upload
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, imageSize, NULL, GL_STREAM_DRAW);
+		gpuPixelBufferBytes[texturePBOIndex] = imageSize;
+		mappedBuffer = (GLubyte*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+
+		if(mappedBuffer != NULL) {
+			// Copy the image in and hand it to the card
+			memcpy(mappedBuffer, imageData, imageSize);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+			// Mipmaps are built on the card once the upload lands
+			glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+			// Pixel data comes from offset 0 of the bound pixel buffer
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return;
+		}
+
+		// Mapping failed so fall through to the plain upload
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	// Build the mipmaps
+	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, width, height, GL_RGB, GL_UNSIGNED_BYTE, imageData);
+}
+
+/************************************************************************
+
+	Function:		releasePixelBuffers
+
+	Description:	Gives back the storage of the texture streaming pixel
+					buffers, the next upload gives them new storage anyway.
+
+*************************************************************************/
+void releasePixelBuffers() {
+	int i = 0;
+
+	if(isPBOUpload) {
+		for(i = 0; i < 2; i++) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texturePBO[i]);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, 0, NULL, GL_STREAM_DRAW);
+			gpuPixelBufferBytes[i] = 0;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+}
+
+/************************************************************************
+
+	Function:		setUpMaterials
+
+	Description:	Fills in the material table used by the plane and
+					propeller display lists and by the shader path.
+					Mountains ask for a shininess of 200 but the fixed function
+					path rejects anything over 128 and keeps the plane's 10,
+					so 10 is what goes in the table. Materials only set for
+					GL_FRONT leave the back faces with the default material,
+					the rest only set the back diffuse and ambient.
+
+*************************************************************************/
+void setUpMaterials() {
+	// Colors for each material, diffuse, ambient, specular
+	GLfloat *colors[NUM_MATERIALS][3] = {
+		{yellow, grey, white},			// MATERIAL_PLANE_YELLOW
+		{black, grey, white},			// MATERIAL_PLANE_BLACK
+		{lightPurple, grey, white},		// MATERIAL_PLANE_PURPLE
+		{blue, grey, white},			// MATERIAL_PLANE_BLUE
+		{orange, orange, white},		// MATERIAL_PROP_ORANGE
+		{red, red, white},				// MATERIAL_PROP_RED
+		{yellow, yellow, white},		// MATERIAL_PROP_YELLOW
+		{orange, grey, white},			// MATERIAL_SKY
+		{seaBlue, grey, white},			// MATERIAL_SEA
+		{green, grey, blue},			// MATERIAL_MOUNTAIN
+		{white, grey, blue},			// MATERIAL_MOUNTAIN_TEXTURED
+		{white, white, white},			// MATERIAL_GRID
+		{red, red, white},				// MATERIAL_AXIS_X
+		{green, green, white},			// MATERIAL_AXIS_Y
+		{blue, blue, white},			// MATERIAL_AXIS_Z
+		{grey, grey, white},			// MATERIAL_ORIGIN
+		{white, white, black},			// MATERIAL_PROP_IMPOSTOR
+		{landGreen, grey, black}		// MATERIAL_TERRAIN
+	};
+	// Shininess of each material
+	GLfloat shininess[NUM_MATERIALS] = {10, 10, 10, 10, 100, 100, 100, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10};
+	// If the material is only set for GL_FRONT
+	GLfloat isFrontOnly[NUM_MATERIALS] = {1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0};
+	int i = 0;
+
+	for(i = 0; i < NUM_MATERIALS; i++) {
+		memcpy(materialTable[i].diffuse, colors[i][0], sizeof(color4));
+		memcpy(materialTable[i].ambient, colors[i][1], sizeof(color4));
+		memcpy(materialTable[i].specular, colors[i][2], sizeof(color4));
+		materialTable[i].shininess[0] = shininess[i];
+		materialTable[i].shininess[1] = isFrontOnly[i];
+		materialTable[i].shininess[2] = 0.0f;
+		materialTable[i].shininess[3] = 0.0f;
+	}
+}
+
+/************************************************************************
+
+	Function:		planeMaterialIndex
+
+	Description:	Returns the material for an object (group) in plane.txt
+
+*************************************************************************/
+int planeMaterialIndex(int objectCount) {
+	// Colors depend on which object it is
+	if(objectCount <= 3) {
+		return MATERIAL_PLANE_YELLOW;
+	} else if(objectCount <= 5) {
+		return MATERIAL_PLANE_BLACK;
+	} else if(objectCount <= 6) {
+		return MATERIAL_PLANE_PURPLE;
+	} else if(objectCount <= 7) {
+		return MATERIAL_PLANE_BLUE;
+	} else if(objectCount <= 10) {
+		return MATERIAL_PLANE_YELLOW;
+	} else if(objectCount <= 11) {
+		return MATERIAL_PLANE_BLACK;
+	} else if(objectCount <= 13) {
+		return MATERIAL_PLANE_YELLOW;
+	} else if(objectCount <= 25) {
+		return MATERIAL_PLANE_BLUE;
+	} else if(objectCount <= 32) {
+		return MATERIAL_PLANE_YELLOW;
+	}
+	return MATERIAL_PLANE_BLUE;
+}
+
+/************************************************************************
+
+	Function:		propMaterialIndex
+
+	Description:	Returns the material for an object (group) in prop.txt
+
+*************************************************************************/
+int propMaterialIndex(int objectCount) {
+	// Set the colors depending on the object
+	if(objectCount <= 0) {
+		return MATERIAL_PROP_ORANGE;
+	} else if(objectCount <= 1) {
+		return MATERIAL_PROP_RED;
+	}
+	return MATERIAL_PROP_YELLOW;
+}
+
+/************************************************************************
+
+	Function:		compileShader
+
+	Description:	Compiles a shader and prints the log if it fails.
+					Returns 0 on failure.
+
+*************************************************************************/
+GLuint compileShader(GLenum type, const char *source) {
+	GLuint shader = glCreateShader(type);
+	GLint isCompiled = 0;
+	// Compile log
+	char log[1024];
+
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &isCompiled);
+
+	if(!isCompiled) {
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("Shader failed to compile:\n%s\n", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+/************************************************************************
+
+	Function:		uploadMesh
+
+	Description:	Puts a mesh into a vertex buffer and an index buffer
+					holding the triangles followed by the wireframe edges.
+
+*************************************************************************/
+void uploadMesh(GpuMesh *gpuMesh, Mesh *mesh) {
+	// Size of the triangle indices in bytes
+	GLsizeiptr triangleBytes = mesh->triangleIndexCount * sizeof(GLuint);
+
+	gpuMesh->triangleIndexCount = mesh->triangleIndexCount;
+	gpuMesh->edgeIndexCount = mesh->edgeIndexCount;
+	gpuMesh->bufferBytes = mesh->vertexCount * sizeof(MeshVertex) + triangleBytes + mesh->edgeIndexCount * sizeof(GLuint);
+
+	// Vertex array keeps the buffer bindings and attribute layout
+	glGenVertexArrays(1, &gpuMesh->vertexArray);
+	glBindVertexArray(gpuMesh->vertexArray);
+
+	// Vertices
+	glGenBuffers(1, &gpuMesh->vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, gpuMesh->vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh->vertexCount * sizeof(MeshVertex), mesh->vertices, GL_STATIC_DRAW);
+
+	// Triangles then edges
+	glGenBuffers(1, &gpuMesh->indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpuMesh->indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangleBytes + mesh->edgeIndexCount * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, triangleBytes, mesh->triangleIndices);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, triangleBytes, mesh->edgeIndexCount * sizeof(GLuint), mesh->edgeIndices);
+	gpuBufferBytes += gpuMesh->bufferBytes;
+
+	// Interleaved vertex layout
+	glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+	glVertexAttribPointer(ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
+	glEnableVertexAttribArray(ATTRIBUTE_NORMAL);
+	glVertexAttribPointer(ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, normal));
+	glEnableVertexAttribArray(ATTRIBUTE_TEXCOORD);
+	glVertexAttribPointer(ATTRIBUTE_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, texCoord));
+	glEnableVertexAttribArray(ATTRIBUTE_MATERIAL);
+	glVertexAttribPointer(ATTRIBUTE_MATERIAL, 1, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, material));
+	glEnableVertexAttribArray(ATTRIBUTE_FACE_NORMAL);
+	glVertexAttribPointer(ATTRIBUTE_FACE_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, faceNormal));
+
+	glBindVertexArray(0);
+}
+
+/************************************************************************
+
+	Function:		deleteGpuMesh
+
+	Description:	Deletes the buffers and vertex array of an uploaded mesh
+					and takes its bytes off the memory report.
+
+*************************************************************************/
+void deleteGpuMesh(GpuMesh *gpuMesh) {
+	glDeleteVertexArrays(1, &gpuMesh->vertexArray);
+	glDeleteBuffers(1, &gpuMesh->vertexBuffer);
+	glDeleteBuffers(1, &gpuMesh->indexBuffer);
+	gpuBufferBytes -= gpuMesh->bufferBytes;
+	memset(gpuMesh, 0, sizeof(GpuMesh));
+}
+
+/************************************************************************
+
+	Function:		setUpShaderPath
+
+	Description:	Builds the shader program, the uniform buffers and the
+					vertex buffers for everything in the scene. The shader
+					lights each vertex the same way GL_LIGHT0 does and applies
+					the same exponential fog. Lines have no facing so wireframe
+					picks the side from the face normal of their polygon.
+					Needs OpenGL 3.1, otherwise the fixed function path is used.
+
+*************************************************************************/
+void setUpShaderPath() {
+	// Per frame values and the material table, same in both shaders
+	const char *uniformBlocks =
+		"struct Material { vec4 diffuse; vec4 ambient; vec4 specular; vec4 shininess; };\n"
+		"layout(std140) uniform FrameUniforms {\n"
+		"	mat4 projection;\n"
+		"	vec4 lightPosition;\n"
+		"	vec4 lightAmbient;\n"
+		"	vec4 lightDiffuse;\n"
+		"	vec4 lightSpecular;\n"
+		"	vec4 globalAmbient;\n"
+		"	vec4 fogColor;\n"
+		"	vec4 fogParams;\n"
+		"	mat4 objectModelViews[3];\n"
+		"	mat4 objectNormalMatrices[3];\n"
+		"	vec4 clusterParams;\n"
+		"	vec4 clusterCounts;\n"
+		"};\n"
+		"layout(std140) uniform MaterialUniforms { Material materials[18]; };\n";
+	// Lights each vertex for the front and the back
+	const char *vertexSource =
+		"uniform mat4 modelView;\n"
+		"uniform mat3 normalMatrix;\n"
+		"uniform int drawMaterial;\n"
+		"uniform int drawObject;\n"
+		"const Material defaultMaterial = Material(vec4(0.8, 0.8, 0.8, 1.0), vec4(0.2, 0.2, 0.2, 1.0), vec4(0.0, 0.0, 0.0, 1.0), vec4(1.0));\n"
+		"in vec3 vertexPosition;\n"
+		"in vec3 vertexNormal;\n"
+		"in vec2 vertexTexCoord;\n"
+		"in float vertexMaterial;\n"
+		"in vec3 vertexFaceNormal;\n"
+		"out vec4 frontColor;\n"
+		"out vec4 backColor;\n"
+		"out vec2 texCoord;\n"
+		"out float eyeDistance;\n"
+		"out float viewFacing;\n"
+		"out vec3 surfacePosition;\n"
+		"out vec3 surfaceNormal;\n"
+		"out vec3 surfaceDiffuse;\n"
+		"Material backMaterial(Material material) {\n"
+		"	if(material.shininess.y > 0.5) {\n"
+		"		return defaultMaterial;\n"
+		"	}\n"
+		"	return Material(material.diffuse, material.ambient, defaultMaterial.specular, defaultMaterial.shininess);\n"
+		"}\n"
+		"vec4 lightVertex(vec3 normal, vec3 lightDirection, Material material) {\n"
+		"	float diffuseAmount = max(dot(normal, lightDirection), 0.0);\n"
+		"	vec3 halfVector = normalize(lightDirection + vec3(0.0, 0.0, 1.0));\n"
+		"	float specularAmount = diffuseAmount > 0.0 ? pow(max(dot(normal, halfVector), 0.0), material.shininess.x) : 0.0;\n"
+		"	vec3 color = material.ambient.rgb * (globalAmbient.rgb + lightAmbient.rgb)\n"
+		"		+ material.diffuse.rgb * lightDiffuse.rgb * diffuseAmount\n"
+		"		+ material.specular.rgb * lightSpecular.rgb * specularAmount;\n"
+		"	return vec4(clamp(color, 0.0, 1.0), material.diffuse.a);\n"
+		"}\n"
+		"void main() {\n"
+		"	mat4 drawModelView = drawObject >= 0 ? objectModelViews[drawObject] : modelView;\n"
+		"	mat3 drawNormalMatrix = drawObject >= 0 ? mat3(objectNormalMatrices[drawObject]) : normalMatrix;\n"
+		"	vec4 eyePosition = drawModelView * vec4(vertexPosition, 1.0);\n"
+		"	vec3 normal = normalize(drawNormalMatrix * vertexNormal);\n"
+		"	vec3 lightDirection = normalize(lightPosition.xyz - eyePosition.xyz * lightPosition.w);\n"
+		"	int index = drawMaterial >= 0 ? drawMaterial : int(vertexMaterial + 0.5);\n"
+		"	frontColor = lightVertex(normal, lightDirection, materials[index]);\n"
+		"	backColor = lightVertex(-normal, lightDirection, backMaterial(materials[index]));\n"
+		"	viewFacing = dot(drawNormalMatrix * vertexFaceNormal, -eyePosition.xyz);\n"
+		"	texCoord = vertexTexCoord;\n"
+		"	eyeDistance = abs(eyePosition.z);\n"
+		"	surfacePosition = eyePosition.xyz;\n"
+		"	surfaceNormal = normal;\n"
+		"	surfaceDiffuse = materials[index].diffuse.rgb;\n"
+		"	gl_Position = projection * eyePosition;\n"
+		"}\n";
+	// Picks the side, adds the clustered lights, modulates the texture and
+	// adds the fog
+	const char *fragmentSource =
+		"uniform sampler2D diffuseTexture;\n"
+		"uniform int useTexture;\n"
+		"uniform int useFog;\n"
+		"uniform int isLineDraw;\n"
+		"in vec4 frontColor;\n"
+		"in vec4 backColor;\n"
+		"in vec2 texCoord;\n"
+		"in float eyeDistance;\n"
+		"in float viewFacing;\n"
+		"in vec3 surfacePosition;\n"
+		"in vec3 surfaceNormal;\n"
+		"in vec3 surfaceDiffuse;\n"
+		"uniform samplerBuffer lightData;\n"
+		"uniform usamplerBuffer clusterData;\n"
+		"uniform usamplerBuffer lightIndices;\n"
+		"out vec4 fragmentColor;\n"
+		"vec3 clusterLighting(vec3 normal) {\n"
+		"	float depth = -surfacePosition.z;\n"
+		"	int slice = depth < clusterParams.w ? 0 : min(int(log(depth / clusterParams.w) * clusterParams.z) + 1, int(clusterCounts.w) - 1);\n"
+		"	ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterParams.xy), ivec2(clusterCounts.yz) - 1);\n"
+		"	uvec2 range = texelFetch(clusterData, (slice * int(clusterCounts.z) + tile.y) * int(clusterCounts.y) + tile.x).xy;\n"
+		"	vec3 total = vec3(0.0);\n"
+		"	for(uint i = 0u; i < range.y; i++) {\n"
+		"		int light = int(texelFetch(lightIndices, int(range.x + i)).x);\n"
+		"		vec4 positionRadius = texelFetch(lightData, 2 * light);\n"
+		"		vec3 toLight = positionRadius.xyz - surfacePosition;\n"
+		"		float lightDistance = length(toLight);\n"
+		"		float fade = clamp(1.0 - lightDistance / positionRadius.w, 0.0, 1.0);\n"
+		"		total += texelFetch(lightData, 2 * light + 1).rgb * max(dot(normal, toLight / max(lightDistance, 0.001)), 0.0) * fade * fade;\n"
+		"	}\n"
+		"	return surfaceDiffuse * total;\n"
+		"}\n"
+		"void main() {\n"
+		"	bool isFront = isLineDraw != 0 ? viewFacing >= 0.0 : gl_FrontFacing;\n"
+		"	vec4 color = isFront ? frontColor : backColor;\n"
+		"	if(clusterCounts.x > 0.0) {\n"
+		"		color.rgb += clusterLighting(normalize(isFront ? surfaceNormal : -surfaceNormal));\n"
+		"	}\n"
+		"	if(useTexture != 0) {\n"
+		"		color *= texture(diffuseTexture, texCoord);\n"
+		"	}\n"
+		"	if(useFog != 0) {\n"
+		"		float fogAmount = clamp(exp(-fogParams.x * eyeDistance), 0.0, 1.0);\n"
+		"		color.rgb = mix(fogColor.rgb, color.rgb, fogAmount);\n"
+		"	}\n"
+		"	fragmentColor = color;\n"
+		"}\n";
+	// Full shader sources with the version and uniform blocks in front
+	char fullSource[8192];
+	GLuint vertexShader = 0;
+	GLuint fragmentShader = 0;
+	GLint isLinked = 0;
+	// Link log
+	char log[1024];
+	int i = 0;
+
+	// Need uniform buffers and GLSL 1.40
+	if(!GLEW_VERSION_3_1) {
+		printf("OpenGL 3.1 not supported, using the fixed function path\n");
+		return;
+	}
+
+	// Compile both shaders
+	sprintf(fullSource, "#version 140\n%s%s", uniformBlocks, vertexSource);
+	vertexShader = compileShader(GL_VERTEX_SHADER, fullSource);
+	sprintf(fullSource, "#version 140\n%s%s", uniformBlocks, fragmentSource);
+	fragmentShader = compileShader(GL_FRAGMENT_SHADER, fullSource);
+	if(vertexShader == 0 || fragmentShader == 0) {
+		printf("Using the fixed function path\n");
+		return;
+	}
+
+	// Link with fixed attribute locations so every vertex array matches
+	shaderProgram = glCreateProgram();
+	glAttachShader(shaderProgram, vertexShader);
+	glAttachShader(shaderProgram, fragmentShader);
+	glBindAttribLocation(shaderProgram, ATTRIBUTE_POSITION, "vertexPosition");
+	glBindAttribLocation(shaderProgram, ATTRIBUTE_NORMAL, "vertexNormal");
+	glBindAttribLocation(shaderProgram, ATTRIBUTE_TEXCOORD, "vertexTexCoord");
+	glBindAttribLocation(shaderProgram, ATTRIBUTE_MATERIAL, "vertexMaterial");
+	glBindAttribLocation(shaderProgram, ATTRIBUTE_FACE_NORMAL, "vertexFaceNormal");
+	glLinkProgram(shaderProgram);
+	glGetProgramiv(shaderProgram, GL_LINK_STATUS, &isLinked);
+	if(!isLinked) {
+		glGetProgramInfoLog(shaderProgram, sizeof(log), NULL, log);
+		printf("Shader program failed to link, using the fixed function path:\n%s\n", log);
+		glDeleteProgram(shaderProgram);
+		shaderProgram = 0;
+		return;
+	}
+
+	// Per draw uniforms
+	modelViewLocation = glGetUniformLocation(shaderProgram, "modelView");
+	normalMatrixLocation = glGetUniformLocation(shaderProgram, "normalMatrix");
+	drawMaterialLocation = glGetUniformLocation(shaderProgram, "drawMaterial");
+	useTextureLocation = glGetUniformLocation(shaderProgram, "useTexture");
+	useFogLocation = glGetUniformLocation(shaderProgram, "useFog");
+	isLineDrawLocation = glGetUniformLocation(shaderProgram, "isLineDraw");
+	drawObjectLocation = glGetUniformLocation(shaderProgram, "drawObject");
+
+	// Textures always come from unit 0, the lights from the units after it
+	glUseProgram(shaderProgram);
+	glUniform1i(glGetUniformLocation(shaderProgram, "diffuseTexture"), 0);
+	glUniform1i(glGetUniformLocation(shaderProgram, "lightData"), TEXTURE_UNIT_LIGHTS);
+	glUniform1i(glGetUniformLocation(shaderProgram, "clusterData"), TEXTURE_UNIT_CLUSTERS);
+	glUniform1i(glGetUniformLocation(shaderProgram, "lightIndices"), TEXTURE_UNIT_LIGHT_INDICES);
+	glUseProgram(0);
+
+	// Point the uniform blocks at their binding points
+	glUniformBlockBinding(shaderProgram, glGetUniformBlockIndex(shaderProgram, "FrameUniforms"), BINDING_FRAME_UNIFORMS);
+	glUniformBlockBinding(shaderProgram, glGetUniformBlockIndex(shaderProgram, "MaterialUniforms"), BINDING_MATERIAL_UNIFORMS);
+
+	// Frame uniforms go round a ring of slots
+	setUpFrameUniformRing();
+
+	// Point lights binned into clusters every frame
+	setUpLightClusters();
+
+	// Materials never change so upload them once
+	glGenBuffers(1, &materialUniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, materialUniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(materialTable), materialTable, GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, BINDING_MATERIAL_UNIFORMS, materialUniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	gpuBufferBytes += sizeof(materialTable);
+
+	// Plane and propeller were read in with the display lists
+	uploadMesh(&planeGpuMesh, &planeMesh);
+	uploadMesh(&propGpuMesh, &propMesh);
+	uploadMesh(&planeLowGpuMesh, &planeLowMesh);
+	uploadMesh(&propLowGpuMesh, &propLowMesh);
+	uploadMesh(&propImpostorGpuMesh, &propImpostorMesh);
+
+	// Rest of the scene is only needed on the CPU until it is uploaded
+	buildSceneMeshes();
+	uploadMesh(&gridGpuMesh, &gridMesh);
+	uploadMesh(&axesGpuMesh, &axesMesh);
+	uploadMesh(&originGpuMesh, &originMesh);
+	for(i = 0; i < QUALITY_LEVELS; i++) {
+		uploadMesh(&skyGpuMeshes[i], &skyMeshes[i]);
+	}
+	uploadMesh(&coneGpuMesh, &coneMesh);
+	setUpSkyboxShader(uniformBlocks);
+	freeSceneMeshes();
+
+	// Exhaust, contrails and spray
+	setUpParticleShader(uniformBlocks);
+	setUpParticles();
+
+	// Shader path is ready so start with it
+	isShaderPath = 1;
+}
+
+/************************************************************************
+
+	Function:		buildSceneMeshes
+
+	Description:	Builds the meshes for the grid, axes, origin, sky and
+					mountains. The sky is built at the detail of each
+					quality level, the land and sea come with the tiles. The mountains share a unit cone that
+					is scaled to each one when drawn.
+
+*************************************************************************/
+void buildSceneMeshes() {
+	MeshVertex corners[4];
+	int i = 0;
+	int j = 0;
+	int k = 0;
+
+	// Grid squares laid out the same as the translations in drawFrameReferenceGrid,
+	// four corners, two triangles and four edges each
+	meshInitArena(&gridMesh, &sceneMeshArena);
+	meshReserve(&gridMesh, sceneConfig.gridSize * sceneConfig.gridSize * 4, sceneConfig.gridSize * sceneConfig.gridSize * 6,
+		sceneConfig.gridSize * sceneConfig.gridSize * 8, sceneConfig.gridSize * sceneConfig.gridSize);
+	memset(corners, 0, sizeof(corners));
+	for(k = 0; k < 4; k++) {
+		corners[k].normal[1] = 1.0f;
+		corners[k].material = MATERIAL_GRID;
+	}
+	for(i = 0; i < sceneConfig.gridSize; i++) {
+		for(j = 0; j < sceneConfig.gridSize; j++) {
+			corners[0].position[0] = j + 1 - sceneConfig.gridSize/2.0f;
+			corners[0].position[2] = i + 1 - sceneConfig.gridSize/2.0f;
+			corners[1].position[0] = corners[0].position[0];
+			corners[1].position[2] = corners[0].position[2] + 1.0f;
+			corners[2].position[0] = corners[0].position[0] + 1.0f;
+			corners[2].position[2] = corners[0].position[2] + 1.0f;
+			corners[3].position[0] = corners[0].position[0] + 1.0f;
+			corners[3].position[2] = corners[0].position[2];
+			meshAddPolygon(&gridMesh, corners, 4);
+		}
+	}
+
+	// One line for each axis
+	meshInitArena(&axesMesh, &sceneMeshArena);
+	memset(corners, 0, sizeof(corners));
+	for(k = 0; k < 3; k++) {
+		corners[0].normal[1] = 1.0f;
+		corners[0].material = MATERIAL_AXIS_X + k;
+		corners[1] = corners[0];
+		corners[1].position[k] = 2.0f;
+		meshAddPolygon(&axesMesh, corners, 2);
+	}
+
+	// Sphere at the origin
+	meshInitArena(&originMesh, &sceneMeshArena);
+	meshAddSphere(&originMesh, 0.2f, 20, 20, MATERIAL_ORIGIN);
+
+	// Sky cylinder for each quality level
+	for(i = 0; i < QUALITY_LEVELS; i++) {
+		meshInitArena(&skyMeshes[i], &sceneMeshArena);
+		meshAddCylinder(&skyMeshes[i], SKY_RADIUS, SKY_RADIUS, SKY_HEIGHT, qualitySkySeaDetail[i], qualitySkySeaDetail[i], MATERIAL_SKY);
+	}
+
+	// Unit cone, scaled to each mountain when drawn
+	meshInitArena(&coneMesh, &sceneMeshArena);
+	meshAddCylinder(&coneMesh, 1, 0, 1, 20, 20, MATERIAL_MOUNTAIN);
+
+	// Cube for the skybox, only the positions are used
+	meshInitArena(&skyboxMesh, &sceneMeshArena);
+	memset(corners, 0, sizeof(corners));
+	for(i = 0; i < SKYBOX_FACES; i++) {
+		for(k = 0; k < 4; k++) {
+			memcpy(corners[k].position, skyboxCorners[skyboxFaceCorners[i][k]], sizeof(corners[k].position));
+			corners[k].material = MATERIAL_SKY;
+		}
+		meshAddPolygon(&skyboxMesh, corners, 4);
+	}
+}
+
+/************************************************************************
+
+	Function:		freeSceneMeshes
+
+	Description:	Frees the meshes made by buildSceneMeshes. They all come
+					from the scene mesh arena so it is reset in one go.
+
+*************************************************************************/
+void freeSceneMeshes() {
+	int i = 0;
+
+	meshFree(&gridMesh);
+	meshFree(&axesMesh);
+	meshFree(&originMesh);
+	for(i = 0; i < QUALITY_LEVELS; i++) {
+		meshFree(&skyMeshes[i]);
+	}
+	meshFree(&coneMesh);
+	meshFree(&skyboxMesh);
+	arenaReset(&sceneMeshArena);
+}
+
+/************************************************************************
+
+	Function:		drawGpuMesh
+
+	Description:	Draws an uploaded mesh with the current modelview matrix.
+					A material of -1 uses the materials stored in the mesh.
+					Texture 0 means untextured.
+
+*************************************************************************/
+void drawGpuMesh(GpuMesh *gpuMesh, int material, GLuint textureID, int useFog) {
+	GLfloat modelView[16];
+	GLfloat normalMatrix[9];
+
+	// Transforms for this draw
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelView);
+	matrixNormal(modelView, normalMatrix);
+	glUniformMatrix4fv(modelViewLocation, 1, GL_FALSE, modelView);
+	glUniformMatrix3fv(normalMatrixLocation, 1, GL_FALSE, normalMatrix);
+	frameDriverCalls += 3;
+
+	drawGpuMeshObject(gpuMesh, -1, material, textureID, useFog);
+}
+
+/************************************************************************
+
+	Function:		drawGpuMeshObject
+
+	Description:	Draws an uploaded mesh with the transform of one of the
+					moving objects, already in the frame uniforms, or with
+					the modelView uniform when object is -1. Uniforms that
+					did not change since the last draw are not sent again.
+
+*************************************************************************/
+void drawGpuMeshObject(GpuMesh *gpuMesh, int object, int material, GLuint textureID, int useFog) {
+	// Use textures when one is given
+	GLint useTexture = (textureID != 0);
+	// Wireframe draws the polygon outlines, line only meshes always do
+	GLint isLineDraw = (isWireRendering || gpuMesh->triangleIndexCount == 0);
+
+	// Only send the per draw values that changed
+	if(object != lastDrawObject) {
+		glUniform1i(drawObjectLocation, object);
+		lastDrawObject = object;
+		frameDriverCalls++;
+	}
+	if(material != lastDrawMaterial) {
+		glUniform1i(drawMaterialLocation, material);
+		lastDrawMaterial = material;
+		frameDriverCalls++;
+	}
+	if(useTexture != lastUseTexture) {
+		glUniform1i(useTextureLocation, useTexture);
+		lastUseTexture = useTexture;
+		frameDriverCalls++;
+	}
+	if(useFog != lastUseFog) {
+		glUniform1i(useFogLocation, useFog);
+		lastUseFog = useFog;
+		frameDriverCalls++;
+	}
+	if(isLineDraw != lastIsLineDraw) {
+		glUniform1i(isLineDrawLocation, isLineDraw);
+		lastIsLineDraw = isLineDraw;
+		frameDriverCalls++;
+	}
+	if(useTexture) {
+		glBindTexture(GL_TEXTURE_2D, textureID);
+		frameDriverCalls++;
+	}
+
+	glBindVertexArray(gpuMesh->vertexArray);
+
+	if(isLineDraw) {
+		glDrawElements(GL_LINES, gpuMesh->edgeIndexCount, GL_UNSIGNED_INT, (void*)(gpuMesh->triangleIndexCount * sizeof(GLuint)));
+	} else {
+		glDrawElements(GL_TRIANGLES, gpuMesh->triangleIndexCount, GL_UNSIGNED_INT, 0);
+	}
+	frameDriverCalls += 2;
+}
+
+/************************************************************************
+
+	Function:		drawModel
+
+	Description:	Draws the plane or a propeller with its transform from
+					the snapshot, from its display list on the fixed function
+					path or its mesh on the shader path. The mesh is only used
+					to count the triangles.
+
+*************************************************************************/
+void drawModel(GLuint displayList, int listCalls, Mesh *mesh, GpuMesh *gpuMesh, int object) {
+	if(isShaderPath) {
+		// Materials come from the mesh
+		drawGpuMeshObject(gpuMesh, object, -1, 0, 0);
+	} else {
+		glPushMatrix();
+			glMultMatrixf(renderSnapshot->objectMatrices[object]);
+			glCallList(displayList);
+		glPopMatrix();
+		frameDriverCalls += 4 + listCalls;
+	}
+	frameModelTriangles += mesh->triangleIndexCount / 3;
+}
+
+/************************************************************************
+
+	Function:		updateFrameUniforms
+
+	Description:	Fills the frame uniform buffer with the projection, the
+					light and the fog. Called right after the camera is set
+					so the light can be moved into eye space.
+
+*************************************************************************/
+void updateFrameUniforms() {
+	FrameUniforms frameUniforms;
+	// Camera matrix, column major
+	GLfloat view[16];
+	GLfloat normalMatrix[9];
+	int i = 0;
+	int k = 0;
+
+	glGetFloatv(GL_PROJECTION_MATRIX, frameUniforms.projection);
+	glGetFloatv(GL_MODELVIEW_MATRIX, view);
+
+	// Move the light into eye space like glLightfv does
+	for(i = 0; i < 4; i++) {
+		frameUniforms.lightPosition[i] = view[i] * frameLightPosition[0] + view[4 + i] * frameLightPosition[1] + view[8 + i] * frameLightPosition[2] + view[12 + i] * frameLightPosition[3];
+	}
+
+	// Light colors and fog
+	memcpy(frameUniforms.lightAmbient, ambient, sizeof(frameUniforms.lightAmbient));
+	memcpy(frameUniforms.lightDiffuse, diffuse, sizeof(frameUniforms.lightDiffuse));
+	memcpy(frameUniforms.lightSpecular, specular, sizeof(frameUniforms.lightSpecular));
+	memcpy(frameUniforms.globalAmbient, globalAmbient, sizeof(frameUniforms.globalAmbient));
+	memcpy(frameUniforms.fogColor, fogColor, sizeof(frameUniforms.fogColor));
+	frameUniforms.fogParams[0] = fogDensity;
+	frameUniforms.fogParams[1] = 0.0f;
+	frameUniforms.fogParams[2] = 0.0f;
+	frameUniforms.fogParams[3] = 0.0f;
+
+	// Every moving object's model view in one go, uploaded with the rest
+	matrixMultiplyArray(frameUniforms.objectModelViews[0], view, renderSnapshot->objectMatrices[0], OBJECT_TRANSFORMS);
+	for(i = 0; i < OBJECT_TRANSFORMS; i++) {
+		matrixNormal(frameUniforms.objectModelViews[i], normalMatrix);
+		memset(frameUniforms.objectNormalMatrices[i], 0, sizeof(frameUniforms.objectNormalMatrices[i]));
+		for(k = 0; k < 3; k++) {
+			memcpy(&frameUniforms.objectNormalMatrices[i][k*4], &normalMatrix[k*3], 3 * sizeof(GLfloat));
+		}
+	}
+
+	// Clusters the lights were binned into, none when they could not be set up
+	memset(frameUniforms.clusterParams, 0, sizeof(frameUniforms.clusterParams));
+	memset(frameUniforms.clusterCounts, 0, sizeof(frameUniforms.clusterCounts));
+	if(lightClusters != NULL) {
+		frameUniforms.clusterParams[0] = CLUSTER_TILES_X / (isSceneScaled ? (GLfloat)sceneFramebufferWidth : windowWidth);
+		frameUniforms.clusterParams[1] = CLUSTER_TILES_Y / (isSceneScaled ? (GLfloat)sceneFramebufferHeight : windowHeight);
+		frameUniforms.clusterParams[2] = lightClusters->sliceScale;
+		frameUniforms.clusterParams[3] = lightClusters->nearDepth;
+		frameUniforms.clusterCounts[0] = (GLfloat)lightClusters->lightCount;
+		frameUniforms.clusterCounts[1] = CLUSTER_TILES_X;
+		frameUniforms.clusterCounts[2] = CLUSTER_TILES_Y;
+		frameUniforms.clusterCounts[3] = CLUSTER_SLICES;
+	}
+
+	// One write for the whole frame into the next slot of the ring
+	writeFrameUniforms(&frameUniforms);
+
+	// Force the per draw values to be sent on the first draw
+	lastDrawObject = -2;
+	lastDrawMaterial = -2;
+	lastUseTexture = -1;
+	lastUseFog = -1;
+	lastIsLineDraw = -1;
+}
+
+/************************************************************************
+
+	Function:		setUpFrameUniformRing
+
+	Description:	Makes the ring of frame uniform slots. With
+					ARB_buffer_storage the ring is mapped once and stays
+					mapped, frames write into it with memcpy and a fence on
+					each slot says when the card is done reading it.
+					Otherwise each frame's slot is written with
+					glBufferSubData, which still never touches the slot the
+					last frame is reading.
+
+*************************************************************************/
+void setUpFrameUniformRing() {
+	GLint alignment = 0;
+	GLsizeiptr ringBytes = 0;
+
+	// Slots start on the offset glBindBufferRange needs
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	if(alignment < 1) {
+		alignment = 1;
+	}
+	frameUniformSlotBytes = (sizeof(FrameUniforms) + alignment - 1) / alignment * alignment;
+	ringBytes = frameUniformSlotBytes * FRAME_UNIFORM_SLOTS;
+	frameUniformSlot = 0;
+	memset(frameUniformFences, 0, sizeof(frameUniformFences));
+
+	glGenBuffers(1, &frameUniformBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+	if(GLEW_ARB_buffer_storage && GLEW_ARB_sync) {
+		glBufferStorage(GL_UNIFORM_BUFFER, ringBytes, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+		frameUniformMapping = (GLubyte*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, ringBytes, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	}
+	if(frameUniformMapping == NULL) {
+		glBufferData(GL_UNIFORM_BUFFER, ringBytes, NULL, GL_DYNAMIC_DRAW);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	gpuBufferBytes += ringBytes;
+}
+
+/************************************************************************
+
+	Function:		writeFrameUniforms
+
+	Description:	Writes this frame's uniforms into the next slot of the
+					ring and points the frame uniform block at it. Only
+					waits if the card is still reading the slot from
+					FRAME_UNIFORM_SLOTS frames ago.
+
+*************************************************************************/
+void writeFrameUniforms(const FrameUniforms *frameUniforms) {
+	GLintptr offset = frameUniformSlot * frameUniformSlotBytes;
+	GLsync fence = frameUniformFences[frameUniformSlot];
+
+	if(frameUniformMapping != NULL) {
+		// Check without waiting first so the report only counts real stalls
+		if(fence != 0) {
+			if(glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+				reportFrameUniformWaits++;
+				glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FRAME_UNIFORM_WAIT_LIMIT);
+				frameDriverCalls++;
+			}
+			glDeleteSync(fence);
+			frameUniformFences[frameUniformSlot] = 0;
+			frameDriverCalls += 2;
+		}
+		memcpy(frameUniformMapping + offset, frameUniforms, sizeof(FrameUniforms));
+	} else {
+		glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(FrameUniforms), frameUniforms);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		frameDriverCalls += 3;
+	}
+
+	glBindBufferRange(GL_UNIFORM_BUFFER, BINDING_FRAME_UNIFORMS, frameUniformBuffer, offset, sizeof(FrameUniforms));
+	frameDriverCalls++;
+}
+
+/************************************************************************
+
+	Function:		fenceFrameUniforms
+
+	Description:	Called once the frame's draws are sent. Fences the slot
+					the frame read from and moves on to the next one.
+
+*************************************************************************/
+void fenceFrameUniforms() {
+	if(frameUniformMapping != NULL) {
+		frameUniformFences[frameUniformSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		frameDriverCalls++;
+	}
+	frameUniformSlot = (frameUniformSlot + 1) % FRAME_UNIFORM_SLOTS;
+}
+
+/************************************************************************
+
+	Function:		startCapture
+
+	Description:	Starts writing frames to the -capture file at the
+					window's size, with a pixel pack buffer for each slot
+					to read the frames back into. Needs pixel buffer
+					objects, fences and mapped ranges, capture is turned off
+					without them or if the file can not be made.
+
+*************************************************************************/
+void startCapture() {
+	int i = 0;
+
+	isCaptureStarted = 1;
+	if(!GLEW_ARB_pixel_buffer_object || !GLEW_ARB_sync || !GLEW_ARB_map_buffer_range) {
+		printf("Frame capture needs pixel buffer objects, fences and mapped buffer ranges, not capturing\n");
+		return;
+	}
+	captureEncoder = captureCreate(captureFileName, (int)windowWidth, (int)windowHeight);
+	if(captureEncoder == NULL) {
+		printf("Could not write %s, not capturing\n", captureFileName);
+		return;
+	}
+	captureWidth = captureEncoder->width;
+	captureHeight = captureEncoder->height;
+
+	glGenBuffers(CAPTURE_SLOTS, capturePBO);
+	for(i = 0; i < CAPTURE_SLOTS; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capturePBO[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, captureWidth * captureHeight * 4, NULL, GL_STREAM_READ);
+		captureSlotStates[i] = CAPTURE_SLOT_FREE;
+		captureFences[i] = 0;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	gpuBufferBytes += CAPTURE_SLOTS * captureWidth * captureHeight * 4;
+
+	printf("Capturing %d by %d frames to %s as %s\n", captureWidth, captureHeight, captureFileName,
+		captureEncoder->isY4M ? "Y4M 4:2:0" : "raw BGRA");
+}
+
+/************************************************************************
+
+	Function:		readCaptureFrame
+
+	Description:	Called once the frame is drawn, before the swap. Starts
+					reading the frame back into the next free pack buffer
+					and fences it, without waiting for the read. The frame
+					is dropped if every buffer is still on its way to the
+					file or the window is smaller than the video.
+
+*************************************************************************/
+void readCaptureFrame() {
+	double startTime = getTime();
+	int slot = captureNextSlot;
+
+	if(captureEncoder == NULL) {
+		if(captureFileName == NULL || isCaptureStarted) {
+			return;
+		}
+		startCapture();
+		if(captureEncoder == NULL) {
+			return;
+		}
+	}
+
+	if(captureSlotStates[slot] != CAPTURE_SLOT_FREE || (int)windowWidth < captureWidth || (int)windowHeight < captureHeight) {
+		captureDropped++;
+	} else {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capturePBO[slot]);
+		glReadPixels(0, 0, captureWidth, captureHeight, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		captureFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		captureSlotStates[slot] = CAPTURE_SLOT_READING;
+		captureNextSlot = (slot + 1) % CAPTURE_SLOTS;
+		captureFrames++;
+		frameDriverCalls += 4;
+	}
+
+	captureTime += getTime() - startTime;
+}
+
+/************************************************************************
+
+	Function:		collectCaptureFrames
+
+	Description:	Called after the swap. Maps the pack buffers whose
+					reads have finished and hands them to the writing
+					thread, then unmaps the ones it has finished with, all
+					in frame order. Only checks the fences unless finishing,
+					when it waits for them, giving up on a read that takes
+					longer than FRAME_UNIFORM_WAIT_LIMIT. Reads that failed
+					are handed over without pixels so the thread moves on.
+
+*************************************************************************/
+void collectCaptureFrames(int isFinishing) {
+	double startTime = getTime();
+	const unsigned char *pixels;
+	GLenum result;
+	int slot = 0;
+
+	if(captureEncoder == NULL) {
+		return;
+	}
+
+	// Hand over the frames that have been read back
+	while(captureSlotStates[captureMapSlot] == CAPTURE_SLOT_READING) {
+		slot = captureMapSlot;
+		result = glClientWaitSync(captureFences[slot], isFinishing ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+			isFinishing ? FRAME_UNIFORM_WAIT_LIMIT : 0);
+		if(result == GL_TIMEOUT_EXPIRED && !isFinishing) {
+			break;
+		}
+		glDeleteSync(captureFences[slot]);
+		captureFences[slot] = 0;
+
+		pixels = NULL;
+		if(result != GL_TIMEOUT_EXPIRED && result != GL_WAIT_FAILED) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, capturePBO[slot]);
+			pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, captureWidth * captureHeight * 4, GL_MAP_READ_BIT);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			frameDriverCalls += 3;
+		}
+		captureSubmit(captureEncoder, slot, pixels);
+		if(pixels != NULL) {
+			captureSlotStates[slot] = CAPTURE_SLOT_WRITING;
+		} else {
+			captureDropped++;
+			captureSlotStates[slot] = CAPTURE_SLOT_LOST;
+		}
+		captureMapSlot = (slot + 1) % CAPTURE_SLOTS;
+		frameDriverCalls += 2;
+	}
+
+	// Free the buffers the writing thread is done with
+	while(captureSlotStates[captureFreeSlot] == CAPTURE_SLOT_WRITING || captureSlotStates[captureFreeSlot] == CAPTURE_SLOT_LOST) {
+		slot = captureFreeSlot;
+		if(captureIsBusy(captureEncoder, slot)) {
+			if(!isFinishing) {
+				break;
+			}
+			Sleep(1);
+			continue;
+		}
+		if(captureSlotStates[slot] == CAPTURE_SLOT_WRITING) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, capturePBO[slot]);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			frameDriverCalls += 3;
+		}
+		captureSlotStates[slot] = CAPTURE_SLOT_FREE;
+		captureFreeSlot = (slot + 1) % CAPTURE_SLOTS;
+	}
+
+	captureTime += getTime() - startTime;
+}
+
+/************************************************************************
+
+	Function:		finishCapture
+
+	Description:	Writes the frames still on their way, closes the video
+					and says how many frames went in and how many were
+					dropped.
+
+*************************************************************************/
+void finishCapture() {
+	unsigned long written = 0;
+	int isWriteFailed = 0;
+
+	if(captureEncoder == NULL) {
+		return;
+	}
+
+	collectCaptureFrames(1);
+	written = captureEncoder->framesWritten;
+	isWriteFailed = captureEncoder->isWriteFailed;
+	captureDestroy(captureEncoder);
+	captureEncoder = NULL;
+	glDeleteBuffers(CAPTURE_SLOTS, capturePBO);
+
+	printf("Captured %lu frames to %s, %lu dropped%s, %.2f ms a frame on the main thread\n",
+		written, captureFileName, captureDropped, isWriteFailed ? ", stopped writing when the disk would not take more" : "",
+		captureFrames > 0 ? captureTime * 1000.0 / (captureFrames + captureDropped) : 0.0);
+}
+
+/************************************************************************
+
+	Function:		setUpLightClusters
+
+	Description:	Sets up the clustered lights for the shader path: the
+					cluster grid, the thread pool it bins on and a buffer
+					and buffer texture each for the light data, the cluster
+					offsets and counts and the light indices. The indices
+					are kept to what a buffer texture can hold. Then makes
+					the scene lights from the config.
+
+*************************************************************************/
+void setUpLightClusters() {
+	// Light data is two RGBA texels per light, clusters an offset and a
+	// count, indices 16 bits each
+	GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R16UI};
+	GLint maxTexels = 0;
+	int i = 0;
+
+	// Bin on every processor, the renderer helps out
+	lightPool = threadPoolCreate(threadPoolProcessorCount());
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	lightClusters = clusterCreate(LIGHT_CLUSTER_NEAR, LIGHT_CLUSTER_FAR, maxTexels, lightPool);
+	if(lightPool == NULL || lightClusters == NULL) {
+		printf("Out of memory for the light clusters, lighting with the sun only\n");
+		clusterDestroy(lightClusters);
+		lightClusters = NULL;
+		threadPoolDestroy(lightPool);
+		lightPool = NULL;
+		return;
+	}
+
+	// Each buffer is read through a buffer texture on a unit of its own
+	glGenBuffers(3, lightBuffers);
+	glGenTextures(3, lightTextures);
+	for(i = 0; i < 3; i++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, lightBuffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 0, NULL, GL_STREAM_DRAW);
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_LIGHTS + i);
+		glBindTexture(GL_TEXTURE_BUFFER, lightTextures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], lightBuffers[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	setUpSceneLights(sceneConfig.lightCount);
+}
+
+/************************************************************************
+
+	Function:		setUpSceneLights
+
+	Description:	Makes the navigation lights and count lights scattered
+					over the sea where the mountains are, like harbour and
+					runway lights low over the water in warm and cool
+					colors. The navigation lights are moved onto the plane
+					every frame.
+
+*************************************************************************/
+void setUpSceneLights(int count) {
+	// Colors the scattered lights pick from
+	const GLfloat colors[4][3] = {{1.0f, 0.75f, 0.4f}, {1.0f, 0.95f, 0.85f}, {0.4f, 0.6f, 1.0f}, {1.0f, 0.4f, 0.15f}};
+	ClusterLight *lights;
+	ClusterLight *light;
+	int i = 0;
+
+	lights = (ClusterLight*)memoryRealloc(MEMORY_LIGHTS, sceneLights, (NAV_LIGHT_COUNT + count) * sizeof(ClusterLight));
+	if(lights == NULL) {
+		printf("Out of memory for %d lights, keeping %d\n", count, sceneConfig.lightCount);
+		return;
+	}
+	sceneLights = lights;
+	sceneLightCount = NAV_LIGHT_COUNT + count;
+	sceneConfig.lightCount = count;
+
+	for(i = 0; i < NAV_LIGHT_COUNT; i++) {
+		memset(sceneLights[i].position, 0, sizeof(sceneLights[i].position));
+		sceneLights[i].radius = NAV_LIGHT_RADIUS;
+		memcpy(sceneLights[i].color, navLightColors[i], sizeof(sceneLights[i].color));
+	}
+
+	for(i = 0; i < count; i++) {
+		light = &sceneLights[NAV_LIGHT_COUNT + i];
+		light->position[0] = (rand() % 30000) / 100.0f - 150.0f;
+		light->position[1] = 0.3f + (rand() % 100) / 100.0f;
+		light->position[2] = (rand() % 30000) / 100.0f - 150.0f;
+		light->radius = 3.0f + (rand() % 400) / 100.0f;
+		memcpy(light->color, colors[rand() % 4], sizeof(light->color));
+	}
+}
+
+/************************************************************************
+
+	Function:		updateLightClusters
+
+	Description:	Moves the navigation lights onto the plane, bins every
+					light for this frame's camera and uploads the light
+					data, cluster offsets and counts and light indices for
+					the shader path. Called after the camera is set up.
+
+*************************************************************************/
+void updateLightClusters() {
+	GLfloat view[16];
+	GLfloat projection[16];
+	GLfloat navPosition[4];
+	GLfloat worldPosition[4];
+	// Size and contents of each buffer
+	size_t bytes[3];
+	const void *data[3];
+	double startTime = 0.0;
+	int i = 0;
+
+	if(lightClusters == NULL) {
+		return;
+	}
+
+	// Navigation lights ride on the plane
+	for(i = 0; i < NAV_LIGHT_COUNT; i++) {
+		memcpy(navPosition, navLightPositions[i], 3 * sizeof(GLfloat));
+		navPosition[3] = 1.0f;
+		matrixTransform(renderSnapshot->objectMatrices[TRANSFORM_PLANE], navPosition, worldPosition);
+		memcpy(sceneLights[i].position, worldPosition, sizeof(sceneLights[i].position));
+	}
+
+	glGetFloatv(GL_MODELVIEW_MATRIX, view);
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	startTime = getTime();
+	if(!clusterBin(lightClusters, view, projection, sceneLights, sceneLightCount)) {
+		printf("Out of memory binning %d lights, going back to none\n", sceneConfig.lightCount);
+		setUpSceneLights(0);
+		return;
+	}
+	reportLightBinTime += getTime() - startTime;
+	reportLightFrames++;
+	reportLightsVisible += lightClusters->visibleCount;
+	reportLightIndices += lightClusters->indexCount;
+	reportLitClusters += lightClusters->litClusterCount;
+	reportLightDropped += lightClusters->droppedIndices;
+	if(lightClusters->maxClusterLights > reportLightMax) {
+		reportLightMax = lightClusters->maxClusterLights;
+	}
+
+	// Orphan and refill all three, their sizes change from frame to frame
+	bytes[0] = lightClusters->lightCount * CLUSTER_LIGHT_FLOATS * sizeof(float);
+	data[0] = lightClusters->lightData;
+	bytes[1] = 2 * CLUSTER_COUNT * sizeof(unsigned int);
+	data[1] = lightClusters->clusters;
+	bytes[2] = lightClusters->indexCount * sizeof(unsigned short);
+	data[2] = lightClusters->indices;
+	gpuLightBufferBytes = 0;
+	for(i = 0; i < 3; i++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, lightBuffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, bytes[i], data[i], GL_STREAM_DRAW);
+		gpuLightBufferBytes += bytes[i];
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	frameDriverCalls += 9;
+}
+
+/************************************************************************
+
+	Function:		stepSceneLights
+
+	Description:	Goes to the next count of scattered lights, from none up
+					to 10000 and back to none.
+
+*************************************************************************/
+void stepSceneLights() {
+	int count = lightSteps[0];
+	int i = 0;
+
+	// Smallest step past the lights there are now
+	for(i = LIGHT_STEPS - 1; i >= 0; i--) {
+		if(lightSteps[i] > sceneConfig.lightCount) {
+			count = lightSteps[i];
+		}
+	}
+
+	setUpSceneLights(count);
+	printf("Lights: %d scattered over the sea and %d on the plane%s\n", sceneConfig.lightCount, NAV_LIGHT_COUNT,
+		lightClusters != NULL && isShaderPath ? "" : ", only the shader path draws them");
+}
+
+/************************************************************************
+
+	Function:		runLightBenchmark
+
+	Description:	Bins 1 to 10000 scattered lights for a camera behind the
+					plane's starting position, without opening a window.
+					Each count is binned on 1 thread, then twice as many
+					each time up to every processor, like the software
+					renderer. Prints the time per bin and how full the
+					clusters were.
+
+*************************************************************************/
+void runLightBenchmark() {
+	ClusterGrid *grid;
+	ThreadPool *pool;
+	float view[16];
+	float projection[16];
+	// Camera position and look at point, behind the plane where it starts
+	float camera[6] = {0.0f, 3.2f, 15.0f, 0.0f, 2.0f, 0.0f};
+	float up[3] = {0.0f, 1.0f, 0.0f};
+	int processorCount = threadPoolProcessorCount();
+	int threadCount = 1;
+	double startTime = 0.0;
+	double elapsed = 0.0;
+	int i = 0;
+	int k = 0;
+
+	matrixPerspective(projection, 45, 1.0f, VIEW_NEAR, VIEW_FAR);
+	matrixIdentity(view);
+	matrixLookAt(view, &camera[0], &camera[3], up);
+
+	printf("\nLight Benchmark\n---------------\n");
+	printf("%d x %d x %d clusters, %d bins for each light count, %d processors\n",
+		CLUSTER_TILES_X, CLUSTER_TILES_Y, CLUSTER_SLICES, LIGHT_BENCH_RUNS, processorCount);
+
+	for(;;) {
+		pool = threadPoolCreate(threadCount);
+		grid = clusterCreate(LIGHT_CLUSTER_NEAR, LIGHT_CLUSTER_FAR, 0x7fffffff, pool);
+		if(pool == NULL || grid == NULL) {
+			printf("Out of memory for the light benchmark\n");
+			exit(1);
+		}
+
+		printf("%d threads:\n", threadCount);
+		for(k = 1; k < LIGHT_STEPS; k++) {
+			// Same lights for every thread count
+			srand(k);
+			setUpSceneLights(lightSteps[k]);
+
+			startTime = getTime();
+			for(i = 0; i < LIGHT_BENCH_RUNS; i++) {
+				if(!clusterBin(grid, view, projection, sceneLights + NAV_LIGHT_COUNT, lightSteps[k])) {
+					printf("Out of memory for the light benchmark\n");
+					exit(1);
+				}
+			}
+			elapsed = getTime() - startTime;
+
+			printf("%6d lights: %.3f ms per bin, %d in view, %d clusters lit with %.1f lights on average and %d at most\n",
+				lightSteps[k], elapsed * 1000.0 / LIGHT_BENCH_RUNS, grid->visibleCount, grid->litClusterCount,
+				grid->litClusterCount > 0 ? (double)grid->indexCount / grid->litClusterCount : 0.0, grid->maxClusterLights);
+		}
+
+		clusterDestroy(grid);
+		threadPoolDestroy(pool);
+
+		// Double the threads until every processor is used
+		if(threadCount >= processorCount) {
+			break;
+		}
+		threadCount *= 2;
+		if(threadCount > processorCount) {
+			threadCount = processorCount;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		setUpParticleShader
+
+	Description:	Builds the particle program. Each particle is one
+					instance of a four corner strip, the vertex shader reads
+					its position, size and fade from buffer textures and
+					turns the strip to face the camera. The fragment shader
+					makes it a soft round puff that fades in and out over
+					its life.
+
+*************************************************************************/
+void setUpParticleShader(const char *uniformBlocks) {
+	const char *vertexSource =
+		"uniform mat4 modelView;\n"
+		"uniform vec4 particleColor;\n"
+		"uniform samplerBuffer particleData;\n"
+		"uniform samplerBuffer particleFades;\n"
+		"out vec2 corner;\n"
+		"out float alpha;\n"
+		"out float eyeDistance;\n"
+		"void main() {\n"
+		"	vec4 positionSize = texelFetch(particleData, gl_InstanceID);\n"
+		"	float fade = texelFetch(particleFades, gl_InstanceID).x;\n"
+		"	vec4 eyePosition = modelView * vec4(positionSize.xyz, 1.0);\n"
+		"	corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;\n"
+		"	eyePosition.xy += corner * positionSize.w;\n"
+		"	alpha = particleColor.a * (1.0 - fade) * min(fade * 10.0, 1.0);\n"
+		"	eyeDistance = abs(eyePosition.z);\n"
+		"	gl_Position = projection * eyePosition;\n"
+		"}\n";
+	const char *fragmentSource =
+		"uniform vec4 particleColor;\n"
+		"uniform int useFog;\n"
+		"in vec2 corner;\n"
+		"in float alpha;\n"
+		"in float eyeDistance;\n"
+		"out vec4 fragmentColor;\n"
+		"void main() {\n"
+		"	float falloff = 1.0 - dot(corner, corner);\n"
+		"	vec3 color = particleColor.rgb;\n"
+		"	if(falloff <= 0.0) {\n"
+		"		discard;\n"
+		"	}\n"
+		"	if(useFog != 0) {\n"
+		"		float fogAmount = clamp(exp(-fogParams.x * eyeDistance), 0.0, 1.0);\n"
+		"		color = mix(fogColor.rgb, color, fogAmount);\n"
+		"	}\n"
+		"	fragmentColor = vec4(color, alpha * falloff);\n"
+		"}\n";
+	char fullSource[4096];
+	GLuint vertexShader = 0;
+	GLuint fragmentShader = 0;
+	GLint isLinked = 0;
+	// Link log
+	char log[1024];
+
+	sprintf(fullSource, "#version 140\n%s%s", uniformBlocks, vertexSource);
+	vertexShader = compileShader(GL_VERTEX_SHADER, fullSource);
+	sprintf(fullSource, "#version 140\n%s%s", uniformBlocks, fragmentSource);
+	fragmentShader = compileShader(GL_FRAGMENT_SHADER, fullSource);
+	if(vertexShader == 0 || fragmentShader == 0) {
+		printf("Shader path will draw no particles\n");
+		return;
+	}
+
+	particleProgram = glCreateProgram();
+	glAttachShader(particleProgram, vertexShader);
+	glAttachShader(particleProgram, fragmentShader);
+	glLinkProgram(particleProgram);
+	glGetProgramiv(particleProgram, GL_LINK_STATUS, &isLinked);
+	if(!isLinked) {
+		glGetProgramInfoLog(particleProgram, sizeof(log), NULL, log);
+		printf("Particle program failed to link, the shader path will draw no particles:\n%s\n", log);
+		glDeleteProgram(particleProgram);
+		particleProgram = 0;
+		return;
+	}
+
+	particleModelViewLocation = glGetUniformLocation(particleProgram, "modelView");
+	particleColorLocation = glGetUniformLocation(particleProgram, "particleColor");
+	particleUseFogLocation = glGetUniformLocation(particleProgram, "useFog");
+
+	glUseProgram(particleProgram);
+	glUniform1i(glGetUniformLocation(particleProgram, "particleData"), TEXTURE_UNIT_PARTICLES);
+	glUniform1i(glGetUniformLocation(particleProgram, "particleFades"), TEXTURE_UNIT_PARTICLE_FADES);
+	glUseProgram(0);
+	glUniformBlockBinding(particleProgram, glGetUniformBlockIndex(particleProgram, "FrameUniforms"), BINDING_FRAME_UNIFORMS);
+
+	// Draws take everything from the instance and vertex numbers
+	glGenVertexArrays(1, &particleVertexArray);
+}
+
+/************************************************************************
+
+	Function:		setUpParticles
+
+	Description:	Makes the particle pools, the thread pool they are
+					updated on and a buffer and buffer texture for the
+					position and size and for the fade of each kind. Does
+					nothing without the particle program.
+
+*************************************************************************/
+void setUpParticles() {
+	// Position and size are four floats a particle, the fade one
+	GLenum formats[2] = {GL_RGBA32F, GL_R32F};
+	int i = 0;
+	int k = 0;
+
+	if(particleProgram == 0) {
+		return;
+	}
+
+	particleThreads = threadPoolCreate(threadPoolProcessorCount());
+	for(i = 0; i < PARTICLE_TYPES; i++) {
+		particlePools[i] = particleCreate(particleTypes[i].capacity, &particleTypes[i].motion, particleThreads);
+		if(particleThreads == NULL || particlePools[i] == NULL) {
+			printf("Out of memory for the particles, the shader path will draw none\n");
+			for(k = 0; k < PARTICLE_TYPES; k++) {
+				particleDestroy(particlePools[k]);
+				particlePools[k] = NULL;
+			}
+			threadPoolDestroy(particleThreads);
+			particleThreads = NULL;
+			return;
+		}
+	}
+
+	glGenBuffers(2 * PARTICLE_TYPES, particleBuffers[0]);
+	glGenTextures(2 * PARTICLE_TYPES, particleTextures[0]);
+	for(i = 0; i < PARTICLE_TYPES; i++) {
+		for(k = 0; k < 2; k++) {
+			glBindBuffer(GL_TEXTURE_BUFFER, particleBuffers[i][k]);
+			glBufferData(GL_TEXTURE_BUFFER, 0, NULL, GL_STREAM_DRAW);
+			glBindTexture(GL_TEXTURE_BUFFER, particleTextures[i][k]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[k], particleBuffers[i][k]);
+		}
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+/************************************************************************
+
+	Function:		updateParticles
+
+	Description:	Moves the particles on by the frame time, then has each
+					emitter on the plane add the particles it owes along
+					the line from where it was last frame, and uploads
+					what the particle program reads.
+
+*************************************************************************/
+void updateParticles(double frameTime) {
+	const GLfloat *plane = renderSnapshot->objectMatrices[TRANSFORM_PLANE];
+	const ParticleType *type;
+	GLfloat local[4];
+	GLfloat position[4];
+	GLfloat velocity[3];
+	// Back along the plane, the tail is on +x of the model
+	GLfloat back[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+	GLfloat backWorld[4];
+	ParticlePool *particles;
+	float timeStep = (float)frameTime;
+	float rate = 0.0f;
+	float amount = 0.0f;
+	double startTime = 0.0;
+	size_t bytes = 0;
+	int count = 0;
+	int i = 0;
+	int k = 0;
+
+	if(particleThreads == NULL) {
+		return;
+	}
+	if(timeStep > PARTICLE_MAX_STEP) {
+		timeStep = PARTICLE_MAX_STEP;
+	}
+
+	startTime = getTime();
+
+	// Move the ones there are first so the new ones start at the emitters
+	for(i = 0; i < PARTICLE_TYPES; i++) {
+		particleUpdate(particlePools[i], timeStep);
+	}
+
+	matrixTransform(plane, back, backWorld);
+	for(i = 0; i < PARTICLE_EMITTERS; i++) {
+		type = &particleTypes[particleEmitterTypes[i]];
+		memcpy(local, particleEmitterPositions[i], 3 * sizeof(GLfloat));
+		local[3] = 1.0f;
+		matrixTransform(plane, local, position);
+		rate = type->rate;
+		for(k = 0; k < 3; k++) {
+			velocity[k] = backWorld[k] * type->speed;
+		}
+
+		// Spray is thrown up off the sea under the plane, only when it is low
+		if(particleEmitterTypes[i] == PARTICLE_SPRAY) {
+			if(position[1] >= SPRAY_HEIGHT) {
+				rate = 0.0f;
+			} else if(position[1] > 0.0f) {
+				rate *= 1.0f - position[1] / SPRAY_HEIGHT;
+			}
+			position[1] = 0.0f;
+			velocity[0] = 0.0f;
+			velocity[1] = type->speed;
+			velocity[2] = 0.0f;
+		}
+
+		if(!isParticleEmitterPlaced) {
+			memcpy(particleEmitterLast[i], position, 3 * sizeof(GLfloat));
+			particleEmitterCarry[i] = 0.0f;
+		}
+		amount = rate * timeStep + particleEmitterCarry[i];
+		count = (int)amount;
+		particleEmitterCarry[i] = amount - count;
+		if(count > 0) {
+			reportParticleDropped += count - particleEmit(particlePools[particleEmitterTypes[i]], count, particleEmitterLast[i], position,
+				velocity, type->spread, type->life);
+		}
+		memcpy(particleEmitterLast[i], position, 3 * sizeof(GLfloat));
+	}
+	isParticleEmitterPlaced = 1;
+
+	reportParticleUpdateTime += getTime() - startTime;
+	reportParticleFrames++;
+
+	// Orphan and refill, the counts change every frame
+	gpuParticleBufferBytes = 0;
+	for(i = 0; i < PARTICLE_TYPES; i++) {
+		particles = particlePools[i];
+		reportParticleCount += particles->count;
+		bytes = particles->count * PARTICLE_DRAW_FLOATS * sizeof(float);
+		glBindBuffer(GL_TEXTURE_BUFFER, particleBuffers[i][0]);
+		glBufferData(GL_TEXTURE_BUFFER, bytes, particles->drawData, GL_STREAM_DRAW);
+		gpuParticleBufferBytes += bytes;
+		bytes = particles->count * sizeof(float);
+		glBindBuffer(GL_TEXTURE_BUFFER, particleBuffers[i][1]);
+		glBufferData(GL_TEXTURE_BUFFER, bytes, particles->drawFades, GL_STREAM_DRAW);
+		gpuParticleBufferBytes += bytes;
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	frameDriverCalls += 4 * PARTICLE_TYPES + 1;
+}
+
+/************************************************************************
+
+	Function:		drawParticles
+
+	Description:	Draws each kind of particle with one instanced draw.
+					They are see through and not sorted, so they go after
+					everything solid and leave the depth buffer alone.
+
+*************************************************************************/
+void drawParticles() {
+	GLfloat modelView[16];
+	int i = 0;
+
+	if(particleThreads == NULL) {
+		return;
+	}
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+
+	glUseProgram(particleProgram);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelView);
+	glUniformMatrix4fv(particleModelViewLocation, 1, GL_FALSE, modelView);
+	glUniform1i(particleUseFogLocation, isSeaAndSky && isFog);
+	glBindVertexArray(particleVertexArray);
+	frameDriverCalls += 9;
+
+	for(i = 0; i < PARTICLE_TYPES; i++) {
+		if(particlePools[i]->count == 0) {
+			continue;
+		}
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_PARTICLES);
+		glBindTexture(GL_TEXTURE_BUFFER, particleTextures[i][0]);
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT_PARTICLE_FADES);
+		glBindTexture(GL_TEXTURE_BUFFER, particleTextures[i][1]);
+		glUniform4fv(particleColorLocation, 1, particleTypes[i].color);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, particlePools[i]->count);
+		frameDriverCalls += 6;
+	}
+
+	// Back to the defaults and the scene program
+	glActiveTexture(GL_TEXTURE0);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+	glUseProgram(shaderProgram);
+	frameDriverCalls += 4;
+}
+
+/************************************************************************
+
+	Function:		runParticleBenchmark
+
+	Description:	Flies 1 to 1000 aircraft in rows low over the sea, each
+					with the exhaust, contrails and spray of the plane,
+					without opening a window. Every aircraft count is run
+					on 1 thread, then twice as many each time up to every
+					processor. Particles build up over the first half of
+					the frames and the second half is timed, emitting and
+					updating together. Prints the time per frame and how
+					many particles there were.
+
+*************************************************************************/
+void runParticleBenchmark() {
+	const int aircraftSteps[PARTICLE_BENCH_STEPS] = {1, 10, 100, 1000};
+	ParticlePool *pools[PARTICLE_TYPES];
+	ThreadPool *threads;
+	const ParticleType *type;
+	// Aircraft fly towards -z at the slowest plane speed, this high
+	float speed = SIMULATION_RATE * 0.05f;
+	float height = 1.0f;
+	float timeStep = 1.0f / SIMULATION_RATE;
+	float from[3];
+	float to[3];
+	float velocity[3];
+	// Emitters of each kind on an aircraft
+	int emitterCounts[PARTICLE_TYPES];
+	int processorCount = threadPoolProcessorCount();
+	int threadCount = 1;
+	unsigned long dropped = 0;
+	double startTime = 0.0;
+	double elapsed = 0.0;
+	int aircraft = 0;
+	int count = 0;
+	int frame = 0;
+	int a = 0;
+	int i = 0;
+	int k = 0;
+
+	memset(emitterCounts, 0, sizeof(emitterCounts));
+	for(i = 0; i < PARTICLE_EMITTERS; i++) {
+		emitterCounts[particleEmitterTypes[i]]++;
+	}
+
+	printf("\nParticle Benchmark\n------------------\n");
+	printf("%d frames for each aircraft count, the last %d timed, %d processors\n",
+		PARTICLE_BENCH_FRAMES, PARTICLE_BENCH_FRAMES / 2, processorCount);
+
+	for(;;) {
+		threads = threadPoolCreate(threadCount);
+		if(threads == NULL) {
+			printf("Out of memory for the particle benchmark\n");
+			exit(1);
+		}
+
+		printf("%d threads:\n", threadCount);
+		for(k = 0; k < PARTICLE_BENCH_STEPS; k++) {
+			aircraft = aircraftSteps[k];
+
+			// Room for everything every aircraft can have alive at once
+			for(i = 0; i < PARTICLE_TYPES; i++) {
+				pools[i] = particleCreate((int)(aircraft * emitterCounts[i] * particleTypes[i].rate * particleTypes[i].life) + PARTICLE_CHUNK,
+					&particleTypes[i].motion, threads);
+				if(pools[i] == NULL) {
+					printf("Out of memory for the particle benchmark\n");
+					exit(1);
+				}
+			}
+
+			for(frame = 0; frame < PARTICLE_BENCH_FRAMES; frame++) {
+				if(frame == PARTICLE_BENCH_FRAMES / 2) {
+					startTime = getTime();
+				}
+
+				for(i = 0; i < PARTICLE_TYPES; i++) {
+					particleUpdate(pools[i], timeStep);
+				}
+
+				for(a = 0; a < aircraft; a++) {
+					for(i = 0; i < PARTICLE_EMITTERS; i++) {
+						type = &particleTypes[particleEmitterTypes[i]];
+						// Model x is back along the aircraft and z across the wings
+						from[0] = (a % 32) * 8.0f - 128.0f - particleEmitterPositions[i][2];
+						from[1] = height + particleEmitterPositions[i][1];
+						from[2] = (a / 32) * 8.0f - 128.0f + particleEmitterPositions[i][0] - frame * timeStep * speed;
+						velocity[0] = 0.0f;
+						velocity[1] = 0.0f;
+						velocity[2] = type->speed;
+						count = (int)(type->rate * (frame + 1) * timeStep) - (int)(type->rate * frame * timeStep);
+						if(particleEmitterTypes[i] == PARTICLE_SPRAY) {
+							from[1] = 0.0f;
+							velocity[1] = type->speed;
+							velocity[2] = 0.0f;
+							count = (int)(count * (1.0f - height / SPRAY_HEIGHT));
+						}
+						memcpy(to, from, sizeof(to));
+						to[2] -= timeStep * speed;
+						dropped += count - particleEmit(pools[particleEmitterTypes[i]], count, from, to, velocity, type->spread, type->life);
+					}
+				}
+			}
+			elapsed = getTime() - startTime;
+
+			count = 0;
+			for(i = 0; i < PARTICLE_TYPES; i++) {
+				count += pools[i]->count;
+			}
+			printf("%5d aircraft: %.3f ms per frame, %d particles (%d exhaust, %d contrail, %d spray)\n",
+				aircraft, elapsed * 1000.0 / (PARTICLE_BENCH_FRAMES - PARTICLE_BENCH_FRAMES / 2), count,
+				pools[PARTICLE_EXHAUST]->count, pools[PARTICLE_CONTRAIL]->count, pools[PARTICLE_SPRAY]->count);
+
+			for(i = 0; i < PARTICLE_TYPES; i++) {
+				particleDestroy(pools[i]);
+			}
+		}
+		threadPoolDestroy(threads);
+
+		// Double the threads until every processor is used
+		if(threadCount >= processorCount) {
+			break;
+		}
+		threadCount *= 2;
+		if(threadCount > processorCount) {
+			threadCount = processorCount;
+		}
+	}
+
+	if(dropped > 0) {
+		printf("%lu particles were dropped at full pools\n", dropped);
+	}
+}
+
+/************************************************************************
+
+	Function:		updateNetwork
+
+	Description:	Reads what the relay sent every step and sends the
+					plane NET_SEND_RATE times a second. Runs on the
+					simulation thread so the plane needs no lock.
+
+*************************************************************************/
+void updateNetwork() {
+	NetPlane plane;
+
+	if(netClient == NULL) {
+		return;
+	}
+
+	netClientReceive(netClient, getTime());
+
+	if(simulationStep % (SIMULATION_RATE / NET_SEND_RATE) != 0) {
+		return;
+	}
+	getWorldPosition(plane.position);
+	plane.turnAngle = flight.turnAngle;
+	plane.sideTilt = flight.sideTilt;
+	plane.isRolling = flight.isRolling;
+	plane.isCrazyRolling = flight.isCrazyRolling;
+	plane.rollAmount = flight.rollAmount;
+	plane.rollHeight = flight.rollHeight;
+	plane.step = (unsigned int)simulationStep;
+	netClientSend(netClient, &plane);
+}
+
+/************************************************************************
+
+	Function:		publishTelemetry
+
+	Description:	Publishes the flight state after a step to the telemetry
+					ring and adds up how long it took. Runs on the
+					simulation thread. Does nothing when there is no ring.
+
+*************************************************************************/
+void publishTelemetry(double stepStartTime) {
+	TelemetrySample sample;
+	double position[3];
+	double startTime = getTime();
+
+	if(telemetryRing.header == NULL) {
+		return;
+	}
+
+	sample.time = startTime - programStartTime;
+	sample.step = (unsigned int)simulationStep;
+	getWorldPosition(position);
+	sample.position[0] = (float)position[0];
+	sample.position[1] = (float)position[1];
+	sample.position[2] = (float)position[2];
+	sample.heading = flight.turnAngle;
+	sample.sideTilt = flight.sideTilt;
+	sample.speed = flight.speed * SIMULATION_RATE;
+	sample.rollFlags = (flight.isRolling ? TELEMETRY_ROLLING : 0) | (flight.isCrazyRolling ? TELEMETRY_CRAZY_ROLLING : 0);
+	sample.rollHeight = flight.rollHeight;
+	sample.rollAmount = flight.rollAmount;
+	sample.frameTime = telemetryFrameTime;
+	sample.stepTime = (float)(startTime - stepStartTime);
+	telemetryPublish(&telemetryRing, &sample);
+
+	telemetrySamples++;
+	telemetryTime += getTime() - startTime;
+}
+
+/************************************************************************
+
+	Function:		runHeadless
+
+	Description:	Flies a control script without a window, as fast as
+					the steps can be taken, and quits. Flies until the
+					script's end line, or for -seconds. With -trace every
+					step is written to a trace file. Prints the final state
+					and how many simulated seconds were flown each second.
+
+*************************************************************************/
+void runHeadless() {
+	FlightScript script;
+	FlightControls controls;
+	FlightTrace trace;
+	FlightState state;
+	unsigned long steps = 0;
+	unsigned long step = 0;
+	double startTime = 0.0;
+	double elapsed = 0.0;
+	double position[3];
+
+	if(!flightLoadScript(&script, headlessScriptName)) {
+		exit(1);
+	}
+	if(traceFileName != NULL && !flightTraceOpen(&trace, traceFileName)) {
+		printf("Could not write the trace %s\n", traceFileName);
+		exit(1);
+	}
+
+	// The script's end unless the time was given
+	if(headlessSeconds > 0.0) {
+		steps = (unsigned long)(headlessSeconds * SIMULATION_RATE + 0.5);
+	} else if(script.endStep > 0) {
+		steps = script.endStep;
+	} else {
+		steps = HEADLESS_DEFAULT_SECONDS * SIMULATION_RATE;
+	}
+
+	flightInit(&state);
+	memset(&controls, 0, sizeof(controls));
+	startTime = getTime();
+	for(step = 0; step < steps; step++) {
+		flightApplyScript(&script, step, &controls);
+		flightStep(&state, &controls);
+		if(traceFileName != NULL) {
+			flightTraceWrite(&trace, (unsigned int)(step + 1), &state);
+		}
+	}
+	if(traceFileName != NULL && !flightTraceClose(&trace, &state)) {
+		printf("Could not write all of the trace %s\n", traceFileName);
+	}
+	elapsed = getTime() - startTime;
+	flightWorldPosition(&state, position);
+
+	printf("Flew %s: %.1f simulated seconds in %lu steps, %.3f ms of wall time, %.0f simulated seconds a second\n",
+		headlessScriptName, (double)steps / SIMULATION_RATE, steps, elapsed * 1000.0,
+		elapsed > 0.0 ? steps / (double)SIMULATION_RATE / elapsed : 0.0);
+	printf("Final state: at (%.3f, %.3f, %.3f), heading %.2f, tilt %.2f, speed %.2f a second%s%s\n",
+		position[0], position[1], position[2], state.turnAngle, state.sideTilt,
+		state.speed * SIMULATION_RATE, state.isRolling ? ", rolling" : "", state.isCrazyRolling ? ", crazy rolling" : "");
+	if(traceFileName != NULL) {
+		printf("Trace: %lu steps of %d bytes written to %s\n", steps, (int)(sizeof(unsigned int) + sizeof(FlightState)), traceFileName);
+	}
+
+	flightFreeScript(&script);
+}
+
+/************************************************************************
+
+	Function:		runMonteCarlo
+
+	Description:	Flies a control script many times from shaken up
+					starts with gusts and late controls, on pools of 1 up
+					to 64 threads, printing the flights a second each pool
+					managed and the steals it took to keep its threads
+					busy. Every pool flies the same flights, so the results
+					are checked to match, then summed up once: the crash
+					rate, altitude envelope and path deviation.
+
+*************************************************************************/
+void runMonteCarlo() {
+	MonteCarloConfig config;
+	MonteCarloSummary summary;
+	MonteCarloSummary firstSummary;
+	MonteCarloRun *run;
+	FlightScript script;
+	ThreadPool *pool;
+	int processorCount = threadPoolProcessorCount();
+	int threadCount = 1;
+	int isSame = 1;
+	double startTime = 0.0;
+	double elapsed = 0.0;
+	double firstElapsed = 0.0;
+
+	if(!flightLoadScript(&script, monteCarloScriptName)) {
+		exit(1);
+	}
+
+	// Shake up the script from the defaults, the length as for -headless
+	monteCarloDefaults(&config);
+	if(monteCarloFlights > 0) {
+		config.flightCount = monteCarloFlights;
+	}
+	config.seed = monteCarloSeed;
+	if(headlessSeconds > 0.0) {
+		config.steps = (unsigned long)(headlessSeconds * SIMULATION_RATE + 0.5);
+	} else if(script.endStep > 0) {
+		config.steps = script.endStep;
+	}
+	run = monteCarloCreate(&config, &script);
+	if(run == NULL) {
+		printf("Out of memory for the monte carlo run\n");
+		exit(1);
+	}
+
+	printf("\nMonte Carlo\n-----------\n");
+	printf("%d flights of %s, %.1f seconds each, seed %u, %d processors\n",
+		config.flightCount, monteCarloScriptName, (double)config.steps / SIMULATION_RATE, config.seed, processorCount);
+
+	for(threadCount = 1; threadCount <= THREAD_POOL_MAX_THREADS; threadCount *= 2) {
+		pool = threadPoolCreate(threadCount);
+		if(pool == NULL) {
+			printf("Out of memory for the monte carlo run\n");
+			exit(1);
+		}
+
+		startTime = getTime();
+		monteCarloFly(run, pool);
+		elapsed = getTime() - startTime;
+		if(threadCount == 1) {
+			firstElapsed = elapsed;
+		}
+
+		printf("%2d threads: %.1f ms, %.0f flights a second, %.2f times 1 thread, %ld steals\n",
+			threadCount, elapsed * 1000.0, config.flightCount / elapsed, firstElapsed / elapsed, (long)pool->stealCount);
+		threadPoolDestroy(pool);
+
+		// Every pool has to come out the same
+		monteCarloSummarize(run, &summary);
+		if(threadCount == 1) {
+			firstSummary = summary;
+		} else if(memcmp(&summary, &firstSummary, sizeof(MonteCarloSummary)) != 0) {
+			isSame = 0;
+		}
+	}
+	printf(isSame ? "Results match on every thread count\n" : "Results differ between thread counts\n");
+
+	printf("Crashes: %d of %d flights (%.1f%%), %.1f seconds in on average\n",
+		summary.crashCount, summary.flightCount, summary.crashRate * 100.0f, summary.meanCrashTime);
+	printf("Altitude: %.2f to %.2f, 90%% of flights within %.2f to %.2f\n",
+		summary.lowest, summary.highest, summary.lowestPercentile, summary.highestPercentile);
+	printf("Path deviation: %.2f on average, %.2f at most on average, 95%% of flights within %.2f, %.2f at most\n",
+		summary.meanDeviation, summary.meanLargestDeviation, summary.deviationPercentile, summary.largestDeviation);
+
+	monteCarloDestroy(run);
+	flightFreeScript(&script);
+}
+
+/************************************************************************
+
+	Function:		runRelay
+
+	Description:	Runs the relay the simulators started with -join send
+					their planes to, without opening a window, until it is
+					closed. Sends every simulator the others' planes
+					NET_SEND_RATE times a second and prints how many
+					players there are and the bytes and time they cost
+					once a second.
+
+*************************************************************************/
+void runRelay() {
+	NetRelay *relay = netRelayCreate(NET_DEFAULT_PORT);
+	// Totals at the last report
+	NetStats lastStats;
+	double sendTime = 1.0 / NET_SEND_RATE;
+	double nextSendTime = 0.0;
+	double reportStart = 0.0;
+	double elapsed = 0.0;
+	double now = 0.0;
+	unsigned long statesSent = 0;
+	int players = 0;
+
+	if(relay == NULL) {
+		printf("Could not open the relay on port %d, is another relay running?\n", NET_DEFAULT_PORT);
+		exit(1);
+	}
+	printf("Relay listening on 127.0.0.1:%d, start the simulators with -join\n", NET_DEFAULT_PORT);
+
+	lastStats = relay->stats;
+	reportStart = getTime();
+	nextSendTime = reportStart + sendTime;
+	for(;;) {
+		// Read states until it is time to send
+		now = getTime();
+		netRelayReceive(relay, now, nextSendTime > now ? nextSendTime - now : 0.0);
+
+		now = getTime();
+		if(now >= nextSendTime) {
+			netRelaySend(relay);
+			nextSendTime += sendTime;
+			// Skip ahead rather than send a burst after a stall
+			if(nextSendTime < now) {
+				nextSendTime = now + sendTime;
+			}
+		}
+
+		elapsed = now - reportStart;
+		if(elapsed >= RELAY_REPORT_TIME) {
+			players = relay->clientCount;
+			statesSent = relay->stats.statesSent - lastStats.statesSent;
+			printf("Relay: %d players, %.0f bytes a second up and %.0f down for each, %.1f bytes a state against %d raw, %.2f ms a second of CPU\n",
+				players,
+				players > 0 ? (relay->stats.bytesReceived - lastStats.bytesReceived) / elapsed / players : 0.0,
+				players > 0 ? (relay->stats.bytesSent - lastStats.bytesSent) / elapsed / players : 0.0,
+				statesSent > 0 ? (double)(relay->stats.stateBytes - lastStats.stateBytes) / statesSent : 0.0,
+				NET_RAW_STATE_BYTES,
+				(relay->stats.cpuTime - lastStats.cpuTime) * 1000.0 / elapsed);
+			if(relay->stats.packetsDropped > lastStats.packetsDropped || relay->clientsRefused > 0) {
+				printf("Relay: %lu packets dropped, %lu players turned away at %d\n",
+					relay->stats.packetsDropped - lastStats.packetsDropped, relay->clientsRefused, NET_MAX_PLAYERS);
+				relay->clientsRefused = 0;
+			}
+			lastStats = relay->stats;
+			reportStart = now;
+		}
 	}
+}
 
-	// we have a PPM file
-	printf("Loading textures please wait...\n");
+/************************************************************************
 
-	// read in the first character of the next line
-	fscanf(fileID, "%c", &tempChar);
+	Function:		runNetBenchmark
 
-	// while we still have comment lines (which begin with #)
-	while(tempChar == '#')
-	{
-		// read in the comment
-		fscanf(fileID, "%[^\n] ", headerLine);
+	Description:	Flies 1 to 32 players through a relay over loopback,
+					without opening a window. Each player circles, weaves
+					and rolls now and then. Everything runs on one thread
+					on a clock of its own, stepped as fast as it can, so
+					the bytes are per second of flying while the times are
+					the real time spent. Prints the bytes each player
+					sends and gets a second, the bytes a plane state took
+					and the time the relay and each player spent.
+
+*************************************************************************/
+void runNetBenchmark() {
+	const int playerSteps[NET_BENCH_STEPS] = {1, 2, 4, 8, 16, 32};
+	NetRelay *relay;
+	NetClient *clients[NET_MAX_PLAYERS];
+	NetPlane planes[NET_MAX_PLAYERS];
+	NetPlane remotes[NET_MAX_PLAYERS];
+	// Totals over every player
+	NetStats totals;
+	double seconds = NET_BENCH_SECONDS;
+	double now = 0.0;
+	int sendSteps = SIMULATION_RATE / NET_SEND_RATE;
+	int steps = NET_BENCH_SECONDS * SIMULATION_RATE;
+	int phase = 0;
+	int players = 0;
+	int remoteCount = 0;
+	int step = 0;
+	int i = 0;
+	int k = 0;
+
+	printf("\nNetwork Benchmark\n-----------------\n");
+	printf("%d seconds flown for each player count, states sent %d times a second, %d bytes a state before quantising\n",
+		NET_BENCH_SECONDS, NET_SEND_RATE, NET_RAW_STATE_BYTES);
+
+	for(k = 0; k < NET_BENCH_STEPS; k++) {
+		players = playerSteps[k];
+
+		// Relay on the next port so a running relay is left alone
+		relay = netRelayCreate(NET_DEFAULT_PORT + 1);
+		if(relay == NULL) {
+			printf("Could not open the relay for the network benchmark\n");
+			exit(1);
+		}
+		for(i = 0; i < players; i++) {
+			clients[i] = netClientCreate(NET_DEFAULT_PORT + 1);
+			if(clients[i] == NULL) {
+				printf("Could not open a player for the network benchmark\n");
+				exit(1);
+			}
+			memset(&planes[i], 0, sizeof(NetPlane));
+			planes[i].position[0] = i * 4.0f;
+			planes[i].position[2] = 10.0f;
+		}
+
+		remoteCount = 0;
+		for(step = 1; step <= steps; step++) {
+			now = (double)step / SIMULATION_RATE;
+
+			// Each player turns at its own rate, weaves up and down and
+			// rolls every ten seconds, a little after the one before
+			for(i = 0; i < players; i++) {
+				planes[i].turnAngle = (GLfloat)fmod(step * (0.4 + i * 0.02), 360.0);
+				planes[i].sideTilt = (GLfloat)(20.0 * sin(step * 0.01 + i));
+				planes[i].position[0] += (GLfloat)sin(planes[i].turnAngle * (PI/180.0f)) * 0.05f;
+				planes[i].position[1] = (GLfloat)(2.0 + 0.5 * sin(step * 0.02 + i));
+				planes[i].position[2] -= (GLfloat)cos(planes[i].turnAngle * (PI/180.0f)) * 0.05f;
+				phase = (step + i * 37) % (10 * SIMULATION_RATE);
+				planes[i].isRolling = phase < 100;
+				planes[i].rollHeight = planes[i].isRolling ? (phase < 11 ? phase * 0.1f : 1.1f) : 0.0f;
+				planes[i].rollAmount = planes[i].isRolling && phase >= 11 ? (phase - 11) * 4.0f : 0.0f;
+				planes[i].step = step;
+				netClientReceive(clients[i], now);
+				if(step % sendSteps == 0) {
+					netClientSend(clients[i], &planes[i]);
+				}
+			}
+
+			if(step % sendSteps == 0) {
+				netRelayReceive(relay, now, 0.0);
+				netRelaySend(relay);
+			}
+
+			// Every player works out where the others are each step
+			for(i = 0; i < players; i++) {
+				remoteCount = netClientRemotes(clients[i], now, remotes, NET_MAX_PLAYERS);
+			}
+		}
+
+		memset(&totals, 0, sizeof(totals));
+		for(i = 0; i < players; i++) {
+			totals.bytesSent += clients[i]->stats.bytesSent;
+			totals.bytesReceived += clients[i]->stats.bytesReceived;
+			totals.packetsDropped += clients[i]->stats.packetsDropped;
+			totals.statesSent += clients[i]->stats.statesSent;
+			totals.stateBytes += clients[i]->stats.stateBytes;
+			totals.cpuTime += clients[i]->stats.cpuTime;
+		}
+		printf("%2d players: %5.0f bytes a second up and %5.0f down for each, %.1f bytes a state up and %.1f down, relay %.3f ms and each player %.3f ms a second, %d planes seen\n",
+			players,
+			totals.bytesSent / seconds / players,
+			totals.bytesReceived / seconds / players,
+			totals.statesSent > 0 ? (double)totals.stateBytes / totals.statesSent : 0.0,
+			relay->stats.statesSent > 0 ? (double)relay->stats.stateBytes / relay->stats.statesSent : 0.0,
+			relay->stats.cpuTime * 1000.0 / seconds,
+			totals.cpuTime * 1000.0 / seconds / players,
+			remoteCount);
+		if(totals.packetsDropped > 0 || relay->stats.packetsDropped > 0) {
+			printf("%lu packets were dropped\n", totals.packetsDropped + relay->stats.packetsDropped);
+		}
+
+		for(i = 0; i < players; i++) {
+			netClientDestroy(clients[i]);
+		}
+		netRelayDestroy(relay);
+	}
+}
+
+/************************************************************************
+
+	Function:		drawSkyAndSeaShaderPath
+
+	Description:	Draws the sky, land, sea and mountains from their meshes
+					using the same transforms as drawSkyAndSea and
+					drawMountains.
+
+*************************************************************************/
+void drawSkyAndSeaShaderPath() {
+	WorldMountain *mountain;
+	int i = 0;
+
+	// Sky cylinder, unless the skybox is drawn after everything else
+	if(!isSkyboxOn || skyboxProgram == 0) {
+		beginSkyQuery();
+		glPushMatrix();
+			glTranslatef(renderSnapshot->cameraPosition[0], 0.0f, renderSnapshot->cameraPosition[2]);
+			glRotatef(-90, 1.0f, 0.0f, 0.0f);
+			drawGpuMesh(&skyGpuMeshes[qualityLevel], MATERIAL_SKY, skyTextureID, 0);
+		glPopMatrix();
+		endSkyQuery();
+		frameSkyVertices += isWireRendering ? skyGpuMeshes[qualityLevel].edgeIndexCount : skyGpuMeshes[qualityLevel].triangleIndexCount;
+	}
+
+	// Sea patches with fog, then the land
+	if(terrainSeaGpuMesh.triangleIndexCount > 0) {
+		drawGpuMesh(&terrainSeaGpuMesh, MATERIAL_SEA, seaTextureID, isFog);
+	}
+	if(terrainGpuMesh.triangleIndexCount > 0) {
+		drawGpuMesh(&terrainGpuMesh, MATERIAL_TERRAIN, 0, 0);
+	}
+
+	// Mountains are the unit cone scaled to each size
+	for(i = 0; i < renderSnapshot->mountainCount; i++) {
+		mountain = &renderSnapshot->mountains[i];
+		if(!isMountainInRange(mountain, renderSnapshot->cameraPosition) || !renderSnapshot->isMountainVisible[i]) {
+			continue;
+		}
+		glPushMatrix();
+			glTranslatef(mountain->x, mountain->base, mountain->z);
+			glRotatef(-90, 1.0f, 0.0f, 0.0f);
+			glScalef(mountain->width, mountain->width, mountain->height);
+			if(mountainTextureEnabled) {
+				drawGpuMesh(&coneGpuMesh, MATERIAL_MOUNTAIN_TEXTURED, mountainTextureID, 0);
+			} else {
+				drawGpuMesh(&coneGpuMesh, MATERIAL_MOUNTAIN, 0, 0);
+			}
+		glPopMatrix();
+	}
+}
+
+/************************************************************************
+
+	Function:		drawFrameReferenceGridShaderPath
+
+	Description:	Draws the grid, axes and origin from their meshes using
+					the same transforms as drawFrameReferenceGrid.
+
+*************************************************************************/
+void drawFrameReferenceGridShaderPath() {
+	// Whole grid in one draw
+	glPushMatrix();
+		glRotatef(-45, 0.0f, 1.0f, 0.0f);
+		drawGpuMesh(&gridGpuMesh, MATERIAL_GRID, 0, 0);
+	glPopMatrix();
+
+	// Axes and the sphere in the middle
+	glPushMatrix();
+		glRotatef(-45, 0.0f, 1.0f, 0.0f);
+		glTranslatef(0.0, 0.05, 0.0);
+		glLineWidth(5);
+		drawGpuMesh(&axesGpuMesh, -1, 0, 0);
+		glLineWidth(1);
+		drawGpuMesh(&originGpuMesh, MATERIAL_ORIGIN, 0, 0);
+	glPopMatrix();
+}
+
+/************************************************************************
+
+	Function:		quadricDriverCalls
+
+	Description:	Estimates the driver calls glu makes for a textured
+					cylinder or disk, one strip per stack with a normal,
+					two texture coordinates and two vertices per slice.
+
+*************************************************************************/
+int quadricDriverCalls(int slices, int stacks) {
+	return stacks * (2 + (slices + 1) * 5);
+}
+
+/************************************************************************
+
+	Function:		getTime
+
+	Description:	Returns a high resolution time in seconds.
+
+*************************************************************************/
+double getTime() {
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+/************************************************************************
+
+	Function:		updateFrameReport
+
+	Description:	Adds up the frame and prints a report once a second
+					when the report is turned on.
+
+*************************************************************************/
+void updateFrameReport() {
+	// Network totals of the snapshot drawn
+	const NetStats *netStats;
+	const WorldStats *worldStats;
+	double now = getTime();
+	double elapsed = now - reportStartTime;
+
+	// Add this frame to the totals
+	reportFrames++;
+	reportDriverCalls += frameDriverCalls;
+	frameDriverCalls = 0;
+	reportSkyVertices += frameSkyVertices;
+	frameSkyVertices = 0;
+	reportModelTriangles += frameModelTriangles;
+	frameModelTriangles = 0;
+
+	if(elapsed >= 1.0) {
+		if(isFrameReport) {
+			printf("Frame report: %.1f fps, %s, %d driver calls per frame, snapshots %.1f ms old on average and %.1f ms at most\n",
+				reportFrames / elapsed,
+				isShaderPath ? "shader path" : "fixed function path",
+				reportDriverCalls / reportFrames,
+				reportSnapshotAge * 1000.0 / reportFrames,
+				reportSnapshotAgeMax * 1000.0);
+			if(isShaderPath) {
+				printf("Frame uniforms: %s, waited for the card to free a slot in %d frames\n",
+					frameUniformMapping != NULL ? "mapped ring" : "glBufferSubData ring",
+					reportFrameUniformWaits);
+			}
+			if(reportSkyVertices > 0.0) {
+				if(reportSkyPixelFrames > 0) {
+					printf("Sky: %s, %.0f vertices and %.0f pixels shaded per frame\n",
+						isSkyboxOn ? "cube map skybox" : "textured cylinder",
+						reportSkyVertices / reportFrames,
+						reportSkyPixels / reportSkyPixelFrames);
+				} else {
+					printf("Sky: %s, %.0f vertices per frame\n",
+						isSkyboxOn ? "cube map skybox" : "textured cylinder",
+						reportSkyVertices / reportFrames);
+				}
+			}
+			printf("Plane and propellers: %.0f triangles per frame, propellers drawn as discs in %.0f%% of frames\n",
+				reportModelTriangles / reportFrames,
+				reportPropImpostorFrames * 100.0 / reportFrames);
+			if(reportLightFrames > 0) {
+				printf("Clustered lights: %.0f of %d in view, binned in %.2f ms on %d threads, %.0f clusters lit with %.1f lights on average and %d at most\n",
+					reportLightsVisible / reportLightFrames,
+					sceneLightCount,
+					reportLightBinTime * 1000.0 / reportLightFrames,
+					lightPool->threadCount,
+					reportLitClusters / reportLightFrames,
+					reportLitClusters > 0.0 ? reportLightIndices / reportLitClusters : 0.0,
+					reportLightMax);
+				if(reportLightDropped > 0) {
+					printf("Clustered lights: %d light indices past the buffer texture limit were dropped\n", reportLightDropped);
+				}
+			}
+			if(reportParticleFrames > 0) {
+				printf("Particles: %.0f alive (%d exhaust, %d contrail, %d spray), emitted and updated in %.2f ms on %d threads, drawn in %d instanced draws\n",
+					reportParticleCount / reportParticleFrames,
+					particlePools[PARTICLE_EXHAUST]->count,
+					particlePools[PARTICLE_CONTRAIL]->count,
+					particlePools[PARTICLE_SPRAY]->count,
+					reportParticleUpdateTime * 1000.0 / reportParticleFrames,
+					particleThreads->threadCount,
+					PARTICLE_TYPES);
+				if(reportParticleDropped > 0) {
+					printf("Particles: %lu dropped at full pools\n", reportParticleDropped);
+				}
+			}
+			if(netClient != NULL) {
+				netStats = &renderSnapshot->netStats;
+				printf("Network: %d remote planes, %.0f bytes a second up and %.0f down, %.1f bytes a state against %d raw, %.2f ms a second on the simulation thread\n",
+					renderSnapshot->remoteCount,
+					(netStats->bytesSent - reportNetStats.bytesSent) / elapsed,
+					(netStats->bytesReceived - reportNetStats.bytesReceived) / elapsed,
+					netStats->statesSent > reportNetStats.statesSent ?
+						(double)(netStats->stateBytes - reportNetStats.stateBytes) / (netStats->statesSent - reportNetStats.statesSent) : 0.0,
+					NET_RAW_STATE_BYTES,
+					(netStats->cpuTime - reportNetStats.cpuTime) * 1000.0 / elapsed);
+			}
+			if(streamWorld != NULL) {
+				worldStats = &renderSnapshot->worldStats;
+				printf("World: %d of %d tiles loaded (%d KB), %lu hits and %lu misses coming into view (%.0f%% hit), %lu loads at %.2f ms latency (%.2f ms most), %.3f ms to make, %lu prefetched, %lu evicted\n",
+					worldStats->residentCount,
+					worldStats->tileCount,
+					(int)(worldStats->cacheBytes / 1024),
+					worldStats->hits - reportWorldStats.hits,
+					worldStats->misses - reportWorldStats.misses,
+					worldStats->hits + worldStats->misses > reportWorldStats.hits + reportWorldStats.misses ?
+						(worldStats->hits - reportWorldStats.hits) * 100.0 / (worldStats->hits + worldStats->misses - reportWorldStats.hits - reportWorldStats.misses) : 100.0,
+					worldStats->loads - reportWorldStats.loads,
+					worldStats->loads > reportWorldStats.loads ?
+						(worldStats->loadLatency - reportWorldStats.loadLatency) * 1000.0 / (worldStats->loads - reportWorldStats.loads) : 0.0,
+					worldStats->loadLatencyMax * 1000.0,
+					worldStats->loads > reportWorldStats.loads ?
+						(worldStats->loadTime - reportWorldStats.loadTime) * 1000.0 / (worldStats->loads - reportWorldStats.loads) : 0.0,
+					worldStats->prefetches - reportWorldStats.prefetches,
+					worldStats->evictions - reportWorldStats.evictions);
+			}
+			printf("Origin: tile %d, %d, the plane is at %.2f, %.2f, %.2f in the world and %.2f, %.2f, %.2f from the origin\n",
+				renderSnapshot->originTile[0], renderSnapshot->originTile[1],
+				renderSnapshot->originTile[0] * (double)WORLD_TILE_SIZE + renderSnapshot->cameraPosition[3],
+				renderSnapshot->cameraPosition[4],
+				renderSnapshot->originTile[1] * (double)WORLD_TILE_SIZE + renderSnapshot->cameraPosition[5],
+				renderSnapshot->cameraPosition[3], renderSnapshot->cameraPosition[4], renderSnapshot->cameraPosition[5]);
+			if(renderSnapshot->groundAhead >= 0.0f) {
+				printf("Ground: the plane is %.2f above it and it is %.1f ahead, %.0f ns to ask\n",
+					renderSnapshot->groundClearance, renderSnapshot->groundAhead, renderSnapshot->groundTime * 1000000000.0);
+			} else {
+				printf("Ground: the plane is %.2f above it and there is none within %.0f ahead, %.0f ns to ask\n",
+					renderSnapshot->groundClearance, GROUND_LOOK_AHEAD, renderSnapshot->groundTime * 1000000000.0);
+			}
+			if(renderSnapshot->telemetrySamples > reportTelemetrySamples) {
+				printf("Telemetry: %lu samples published, %.0f ns a sample\n",
+					renderSnapshot->telemetrySamples - reportTelemetrySamples,
+					(renderSnapshot->telemetryTime - reportTelemetryTime) * 1000000000.0 / (renderSnapshot->telemetrySamples - reportTelemetrySamples));
+			}
+			if(captureEncoder != NULL) {
+				printf("Capture: %lu frames read back, %lu dropped, %.2f ms a frame on the main thread, %.2f ms a frame to write on its own thread\n",
+					captureFrames - reportCaptureFrames,
+					captureDropped - reportCaptureDropped,
+					captureFrames + captureDropped > reportCaptureFrames + reportCaptureDropped ?
+						(captureTime - reportCaptureTime) * 1000.0 / (captureFrames + captureDropped - reportCaptureFrames - reportCaptureDropped) : 0.0,
+					captureEncoder->framesWritten > reportCaptureWritten ?
+						(captureEncoder->encodeTime - reportCaptureEncodeTime) * 1000.0 / (captureEncoder->framesWritten - reportCaptureWritten) : 0.0);
+			}
+			if(reportCullFrames > 0 && reportCullMountains > 0.0) {
+				printf("Occlusion culling: %.0f occluders, %.1f of %.0f mountains occluded and %.1f off the screen (%.0f%% rejected), %.2f ms a snapshot on the culling thread\n",
+					reportCullOccluders / reportCullFrames,
+					reportCullOccluded / reportCullFrames,
+					reportCullMountains / reportCullFrames,
+					reportCullOutside / reportCullFrames,
+					(reportCullOccluded + reportCullOutside) * 100.0 / reportCullMountains,
+					reportCullTime * 1000.0 / reportCullFrames);
+			}
+		}
+
+		// Start the next second
+		reportFrames = 0;
+		reportDriverCalls = 0;
+		reportFrameUniformWaits = 0;
+		reportSnapshotAge = 0.0;
+		reportSnapshotAgeMax = 0.0;
+		reportSkyVertices = 0.0;
+		reportModelTriangles = 0.0;
+		reportPropImpostorFrames = 0;
+		reportLightFrames = 0;
+		reportLightBinTime = 0.0;
+		reportLightsVisible = 0.0;
+		reportLightIndices = 0.0;
+		reportLitClusters = 0.0;
+		reportLightMax = 0;
+		reportLightDropped = 0;
+		reportParticleFrames = 0;
+		reportParticleCount = 0.0;
+		reportParticleUpdateTime = 0.0;
+		reportParticleDropped = 0;
+		reportSkyPixels = 0.0;
+		reportSkyPixelFrames = 0;
+		reportCullFrames = 0;
+		reportCullMountains = 0.0;
+		reportCullOccluders = 0.0;
+		reportCullOccluded = 0.0;
+		reportCullOutside = 0.0;
+		reportCullTime = 0.0;
+		if(netClient != NULL) {
+			reportNetStats = renderSnapshot->netStats;
+		}
+		reportTelemetrySamples = renderSnapshot->telemetrySamples;
+		reportTelemetryTime = renderSnapshot->telemetryTime;
+		reportWorldStats = renderSnapshot->worldStats;
+		reportCaptureFrames = captureFrames;
+		reportCaptureDropped = captureDropped;
+		reportCaptureTime = captureTime;
+		if(captureEncoder != NULL) {
+			reportCaptureWritten = captureEncoder->framesWritten;
+			reportCaptureEncodeTime = captureEncoder->encodeTime;
+		}
+		reportStartTime = now;
+	}
+}
+
+/************************************************************************
+
+	Function:		updateQualityGovernor
+
+	Description:	Gives the governor the time of the last frame and moves
+					to the level it picks, logging every change.
+
+*************************************************************************/
+void updateQualityGovernor(double frameTime) {
+	int decision = 0;
+	char reason[128];
+
+	if(!isGovernorOn) {
+		return;
+	}
+
+	decision = governorAddFrame(&governor, frameTime);
+	if(decision == GOVERNOR_KEEP) {
+		return;
+	}
+
+	qualityLevel = governor.level;
+	sprintf(reason, "%s, frames took %.1f ms against a %.1f ms budget",
+		decision == GOVERNOR_DROP ? "dropped" : "raised",
+		governor.averageFrameTime * 1000.0, governor.budget * 1000.0);
+	printQualityLevel(reason);
+}
+
+/************************************************************************
+
+	Function:		printQualityLevel
+
+	Description:	Logs the quality level, what it sets and why it is in use.
+
+*************************************************************************/
+void printQualityLevel(const char *reason) {
+	printf("Quality governor %s: level %d, render scale %d%%, sky %d slices, ",
+		reason, qualityLevel, (int)(qualityRenderScale[qualityLevel] * 100.0f + 0.5f), qualitySkySeaDetail[qualityLevel]);
+	if(qualityMountainDistance[qualityLevel] > 0.0f) {
+		printf("mountains within %.0f, ", qualityMountainDistance[qualityLevel]);
+	} else {
+		printf("all mountains, ");
+	}
+	printf("%s plane\n", qualityLowDetailPlane[qualityLevel] ? "low detail" : "full detail");
+}
+
+/************************************************************************
+
+	Function:		isMountainInRange
+
+	Description:	Returns 1 if a mountain is within the draw distance of
+					the quality level, measured along the ground from the
+					camera.
+
+*************************************************************************/
+int isMountainInRange(const WorldMountain *mountain, const GLfloat *camera) {
+	float distance = qualityMountainDistance[qualityLevel];
+	float x = mountain->x - camera[0];
+	float z = mountain->z - camera[2];
+
+	// No limit
+	if(distance <= 0.0f) {
+		return 1;
+	}
+
+	return x * x + z * z <= distance * distance;
+}
+
+/************************************************************************
+
+	Function:		setUpSceneFramebuffer
+
+	Description:	Checks if framebuffer objects can be used to draw the
+					scene below full resolution. Without them the render
+					scale is ignored and the other settings still apply.
+
+*************************************************************************/
+void setUpSceneFramebuffer() {
+	if(GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) {
+		isFramebufferScaling = 1;
+		glGenFramebuffers(1, &sceneFramebuffer);
+		glGenRenderbuffers(1, &sceneColorBuffer);
+		glGenRenderbuffers(1, &sceneDepthBuffer);
+	} else {
+		printf("Framebuffer objects not supported, always drawing at full resolution\n");
+	}
+}
+
+/************************************************************************
+
+	Function:		beginSceneFramebuffer
+
+	Description:	When the quality level draws below full resolution, binds
+					the offscreen framebuffer at the scaled size, making it
+					again if the size changed.
+
+*************************************************************************/
+void beginSceneFramebuffer() {
+	int width = (int)(windowWidth * qualityRenderScale[qualityLevel]);
+	int height = (int)(windowHeight * qualityRenderScale[qualityLevel]);
+
+	isSceneScaled = isFramebufferScaling && qualityRenderScale[qualityLevel] < 1.0f && width > 0 && height > 0;
+	if(!isSceneScaled) {
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+	frameDriverCalls++;
+
+	// Storage only changes with the level or the window size
+	if(width != sceneFramebufferWidth || height != sceneFramebufferHeight) {
+		glBindRenderbuffer(GL_RENDERBUFFER, sceneColorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, sceneDepthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sceneColorBuffer);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sceneDepthBuffer);
+		sceneFramebufferWidth = width;
+		sceneFramebufferHeight = height;
+		// 24 bit depth is stored in 32 bits
+		gpuFramebufferBytes = (size_t)width * height * 8;
+		frameDriverCalls += 7;
+
+		// Give up on scaling if the card will not draw into it
+		if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			printf("Offscreen framebuffer is not complete, always drawing at full resolution\n");
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			isFramebufferScaling = 0;
+			isSceneScaled = 0;
+			return;
+		}
+	}
+
+	glViewport(0, 0, width, height);
+	frameDriverCalls++;
+}
+
+/************************************************************************
+
+	Function:		endSceneFramebuffer
+
+	Description:	Stretches the offscreen framebuffer over the window when
+					the scene was drawn below full resolution.
+
+*************************************************************************/
+void endSceneFramebuffer() {
+	if(!isSceneScaled) {
+		return;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, sceneFramebufferWidth, sceneFramebufferHeight,
+		0, 0, (GLint)windowWidth, (GLint)windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, windowWidth, windowHeight);
+	frameDriverCalls += 5;
+}
+
+/************************************************************************
+
+	Function:		setUpSkybox
+
+	Description:	Makes the cube map for the skybox, without faces. They
+					are read with the sky on its first use, see
+					readSkyboxFaces, and the skybox is turned on once they
+					are uploaded. Also sets up the occlusion query that
+					counts sky pixels.
+
+*************************************************************************/
+void setUpSkybox() {
+	// How much the cylinder wall faced the light at the eye height
+	float facing = 0.0f;
+	int k = 0;
+
+	// Counting pixels needs OpenGL 1.5, the report leaves them out otherwise
+	if(GLEW_VERSION_1_5) {
+		glGenQueries(1, &skyQuery);
+	}
+
+	// Cube maps need OpenGL 1.3
+	if(!GLEW_VERSION_1_3 && !GLEW_ARB_texture_cube_map) {
+		printf("Cube maps not supported, using the sky cylinder\n");
+		return;
+	}
+
+	// Faces go in when the sky loads, clamped so the seams do not show
+	glGenTextures(1, &skyboxTextureID);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTextureID);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	// The cylinder was lit from inside with the sky material, do the same once for the tint
+	facing = SKY_RADIUS / (float)sqrt(SKY_RADIUS * SKY_RADIUS + (lightPosition[1] - SKYBOX_EYE_HEIGHT) * (lightPosition[1] - SKYBOX_EYE_HEIGHT));
+	for(k = 0; k < 3; k++) {
+		skyboxTint[k] = grey[k] * (globalAmbient[k] + ambient[k]) + orange[k] * diffuse[k] * facing;
+		if(skyboxTint[k] > 1.0f) {
+			skyboxTint[k] = 1.0f;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		makeSkyboxFaces
+
+	Description:	Reprojects a sky image onto six new SKYBOX_FACE_SIZE
+					faces, free them with memoryFree. Only touches its
+					arguments so the asset watcher thread can call it too.
+					Returns 0 with nothing allocated when out of memory.
+
+*************************************************************************/
+int makeSkyboxFaces(unsigned char **faces, const GLubyte *pixels, int width, int height) {
+	// The cylinder the faces are made from, seen from the starting camera height
+	SkyboxCylinder cylinder = {SKY_RADIUS, SKY_HEIGHT, SKYBOX_EYE_HEIGHT};
+	int size = SKYBOX_FACE_SIZE;
+	int isAllocated = 1;
+	int i = 0;
+
+	for(i = 0; i < SKYBOX_FACES; i++) {
+		faces[i] = (unsigned char*)memoryAlloc(MEMORY_SKYBOX, size * size * 3);
+		if(faces[i] == NULL) {
+			isAllocated = 0;
+		}
+	}
+	if(!isAllocated) {
+		for(i = 0; i < SKYBOX_FACES; i++) {
+			memoryFree(faces[i]);
+			faces[i] = NULL;
+		}
+		return 0;
+	}
+
+	for(i = 0; i < SKYBOX_FACES; i++) {
+		skyboxReprojectFace(faces[i], size, i, &cylinder, pixels, width, height);
+	}
+
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		uploadSkyboxFaces
+
+	Description:	Uploads six square faces to the skybox cube map and frees
+					them. The cube map's bytes in the memory report are
+					counted again from the new faces.
+
+*************************************************************************/
+void uploadSkyboxFaces(unsigned char **faces, int size) {
+	int i = 0;
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTextureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	skyboxTextureBytes = 0;
+	for(i = 0; i < SKYBOX_FACES; i++) {
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, faces[i]);
+		memoryFree(faces[i]);
+		faces[i] = NULL;
+		skyboxTextureBytes += estimateTextureBytes(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+/************************************************************************
+
+	Function:		setUpSkyboxShader
+
+	Description:	Builds the program the shader path draws the skybox with.
+					It uses the projection from the frame uniforms and leaves
+					the translation out of the model view so the cube stays
+					around the camera.
+
+*************************************************************************/
+void setUpSkyboxShader(const char *uniformBlocks) {
+	// Direction into the cube map is the corner of the cube
+	const char *vertexSource =
+		"uniform mat4 modelView;\n"
+		"in vec3 vertexPosition;\n"
+		"out vec3 direction;\n"
+		"void main() {\n"
+		"	direction = vertexPosition;\n"
+		"	gl_Position = projection * vec4(mat3(modelView) * vertexPosition, 1.0);\n"
+		"}\n";
+	const char *fragmentSource =
+		"uniform samplerCube skyboxTexture;\n"
+		"uniform vec4 tint;\n"
+		"in vec3 direction;\n"
+		"out vec4 fragmentColor;\n"
+		"void main() {\n"
+		"	fragmentColor = texture(skyboxTexture, direction) * tint;\n"
+		"}\n";
+	char fullSource[4096];
+	GLuint vertexShader = 0;
+	GLuint fragmentShader = 0;
+	GLint isLinked = 0;
+	// Link log
+	char log[1024];
+
+	sprintf(fullSource, "#version 140\n%s%s", uniformBlocks, vertexSource);
+	vertexShader = compileShader(GL_VERTEX_SHADER, fullSource);
+	sprintf(fullSource, "#version 140\n%s%s", uniformBlocks, fragmentSource);
+	fragmentShader = compileShader(GL_FRAGMENT_SHADER, fullSource);
+	if(vertexShader == 0 || fragmentShader == 0) {
+		printf("Shader path will use the sky cylinder\n");
+		return;
+	}
+
+	skyboxProgram = glCreateProgram();
+	glAttachShader(skyboxProgram, vertexShader);
+	glAttachShader(skyboxProgram, fragmentShader);
+	glBindAttribLocation(skyboxProgram, ATTRIBUTE_POSITION, "vertexPosition");
+	glLinkProgram(skyboxProgram);
+	glGetProgramiv(skyboxProgram, GL_LINK_STATUS, &isLinked);
+	if(!isLinked) {
+		glGetProgramInfoLog(skyboxProgram, sizeof(log), NULL, log);
+		printf("Skybox program failed to link, the shader path will use the sky cylinder:\n%s\n", log);
+		glDeleteProgram(skyboxProgram);
+		skyboxProgram = 0;
+		return;
+	}
+
+	skyboxModelViewLocation = glGetUniformLocation(skyboxProgram, "modelView");
+	skyboxTintLocation = glGetUniformLocation(skyboxProgram, "tint");
+
+	// Cube map comes from unit 0 like the other textures
+	glUseProgram(skyboxProgram);
+	glUniform1i(glGetUniformLocation(skyboxProgram, "skyboxTexture"), 0);
+	glUseProgram(0);
+	glUniformBlockBinding(skyboxProgram, glGetUniformBlockIndex(skyboxProgram, "FrameUniforms"), BINDING_FRAME_UNIFORMS);
+
+	uploadMesh(&skyboxGpuMesh, &skyboxMesh);
+}
+
+/************************************************************************
+
+	Function:		drawSkybox
+
+	Description:	Draws the skybox around the camera with fixed function.
+					It goes last with every pixel at the far plane, so the
+					depth test only lets it shade the pixels nothing else
+					covered.
+
+*************************************************************************/
+void drawSkybox() {
+	GLfloat *camera = renderSnapshot->cameraPosition;
+	const GLfloat *corner;
+	int i = 0;
+	int k = 0;
+
+	beginSkyQuery();
+
+	// Far plane only, passing where the depth buffer is still clear
+	glDepthRange(1.0, 1.0);
+	glDepthFunc(GL_LEQUAL);
+	glDepthMask(GL_FALSE);
+
+	// Unlit, the tint stands in for the lighting
+	glDisable(GL_LIGHTING);
+	glEnable(GL_TEXTURE_CUBE_MAP);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTextureID);
+	glColor4fv(skyboxTint);
+
+	// Enable or disable wirerendering based on button press
+	wireRenderingCheck();
+
+	glPushMatrix();
+		// Keep the cube around the camera
+		glTranslatef(camera[0], camera[1], camera[2]);
+		glScalef(SKYBOX_CUBE_SIZE, SKYBOX_CUBE_SIZE, SKYBOX_CUBE_SIZE);
+		glBegin(GL_QUADS);
+		for(i = 0; i < SKYBOX_FACES; i++) {
+			for(k = 0; k < 4; k++) {
+				corner = skyboxCorners[skyboxFaceCorners[i][k]];
+				glTexCoord3fv(corner);
+				glVertex3fv(corner);
+			}
+		}
+		glEnd();
+	glPopMatrix();
 
-		// // print the comment
-		// printf("%s\n", headerLine);
+	// Back to the defaults
+	glDisable(GL_TEXTURE_CUBE_MAP);
+	glEnable(GL_LIGHTING);
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	glDepthRange(0.0, 1.0);
 
-		// read in the first character of the next line
-		fscanf(fileID, "%c",&tempChar);
-	}
+	endSkyQuery();
 
-	// the last one was not a comment character '#', so we nee dto put it back into the file stream (undo)
-	ungetc(tempChar, fileID);
+	// Count the vertices and driver calls for the frame report
+	frameSkyVertices += SKYBOX_FACES * 4;
+	frameDriverCalls += 18 + SKYBOX_FACES * 8;
+}
 
-	// read in the image hieght, width and the maximum value
-	fscanf(fileID, "%d %d %d", &imageWidthSky, &imageHeightSky, &maxValue);
+/************************************************************************
 
-	// // print out the information about the image file
-	// printf("%d rows  %d columns  max value= %d\n", imageHeight, imageWidth, maxValue);
+	Function:		drawSkyboxShaderPath
 
-	// compute the total number of pixels in the image
-	totalPixels = imageWidthSky * imageHeightSky;
+	Description:	Draws the skybox with its own program, last and at the
+					far plane the same as drawSkybox.
 
-	// allocate enough memory for the image  (3*) because of the RGB data
-	imageDataSky = (GLubyte*)malloc(3 * sizeof(GLuint) * totalPixels);
+*************************************************************************/
+void drawSkyboxShaderPath() {
+	GLfloat modelView[16];
 
-	// determine the scaling for RGB values
-	RGBScaling = 255.0 / maxValue;
+	beginSkyQuery();
 
+	// Far plane only, passing where the depth buffer is still clear
+	glDepthRange(1.0, 1.0);
+	glDepthFunc(GL_LEQUAL);
+	glDepthMask(GL_FALSE);
 
-	// if the maxValue is 255 then we do not need to scale the
-	//    image data values to be in the range or 0 to 255
-	if (maxValue == 255)
-	{
-		for(i = 0; i < totalPixels; i++)
-		{
-			// read in the current pixel from the file
-			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+	glUseProgram(skyboxProgram);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelView);
+	glUniformMatrix4fv(skyboxModelViewLocation, 1, GL_FALSE, modelView);
+	glUniform4fv(skyboxTintLocation, 1, skyboxTint);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTextureID);
+	glBindVertexArray(skyboxGpuMesh.vertexArray);
 
-			// store the red, green and blue data of the current pixel in the data array
-			imageDataSky[3*totalPixels - 3*i - 3] = red;
-			imageDataSky[3*totalPixels - 3*i - 2] = green;
-			imageDataSky[3*totalPixels - 3*i - 1] = blue;
-		}
+	if(isWireRendering) {
+		glDrawElements(GL_LINES, skyboxGpuMesh.edgeIndexCount, GL_UNSIGNED_INT, (void*)(skyboxGpuMesh.triangleIndexCount * sizeof(GLuint)));
+		frameSkyVertices += skyboxGpuMesh.edgeIndexCount;
+	} else {
+		glDrawElements(GL_TRIANGLES, skyboxGpuMesh.triangleIndexCount, GL_UNSIGNED_INT, 0);
+		frameSkyVertices += skyboxGpuMesh.triangleIndexCount;
 	}
-	else  // need to scale up the data values
-	{
-		for(i = 0; i < totalPixels; i++)
-		{
-			// read in the current pixel from the file
-			fscanf(fileID,"%d %d %d",&red, &green, &blue );
 
-			// store the red, green and blue data of the current pixel in the data array
-			imageDataSky[3*totalPixels - 3*i - 3] = red   * RGBScaling;
-			imageDataSky[3*totalPixels - 3*i - 2] = green * RGBScaling;
-			imageDataSky[3*totalPixels - 3*i - 1] = blue  * RGBScaling;
-		}
-	}
+	// Back to the defaults and the scene program
+	glDepthMask(GL_TRUE);
+	glDepthFunc(GL_LESS);
+	glDepthRange(0.0, 1.0);
+	glUseProgram(shaderProgram);
 
-	// close the image file
-	fclose(fileID);
+	endSkyQuery();
+
+	frameDriverCalls += 12;
 }
 
 /************************************************************************
 
-	Function:		loadMountain
+	Function:		beginSkyQuery
 
-	Description:	Loads in the PPM image for mountain, this code is from the animation
-					slides for loading in an image.
+	Description:	Starts counting the pixels the sky shades, unless the
+					last count has not come back yet.
 
 *************************************************************************/
-void loadMountain()
-{
-	// the ID of the image file
-	FILE *fileID;
+void beginSkyQuery() {
+	if(skyQuery == 0 || isSkyQueryPending) {
+		return;
+	}
 
-	// maxValue
-	int  maxValue;
+	glBeginQuery(GL_SAMPLES_PASSED, skyQuery);
+	isSkyQueryActive = 1;
+	frameDriverCalls++;
+}
 
-	// total number of pixels in the image
-	int  totalPixels;
+/************************************************************************
 
-	// temporary character
-	char tempChar;
+	Function:		endSkyQuery
 
-	// counter variable for the current pixel in the image
-	int i;
+	Description:	Stops counting sky pixels, the count is read in a later
+					frame by readSkyQuery.
 
-	// array for reading in header information
-	char headerLine[100];
+*************************************************************************/
+void endSkyQuery() {
+	if(!isSkyQueryActive) {
+		return;
+	}
 
-	float RGBScaling;
+	glEndQuery(GL_SAMPLES_PASSED);
+	isSkyQueryActive = 0;
+	isSkyQueryPending = 1;
+	frameDriverCalls++;
+}
 
-	// temporary variables for reading in the red, green and blue data of each pixel
-	int red, green, blue;
+/************************************************************************
 
-	// Read in the sea
-	fileID = fopen("mount03.ppm", "r");
+	Function:		readSkyQuery
 
-	// read in the first header line
-	fscanf(fileID,"%[^\n] ", headerLine);
+	Description:	Adds the sky pixel count to the frame report once the
+					card has it, without waiting for it.
 
-	// make sure that the image begins with 'P3', which signifies a PPM file
-	if ((headerLine[0] != 'P') || (headerLine[1] != '3'))
-	{
-		// printf("This is not a PPM file!\n");
-		exit(0);
+*************************************************************************/
+void readSkyQuery() {
+	GLint isAvailable = 0;
+	GLuint pixels = 0;
+
+	if(!isSkyQueryPending) {
+		return;
 	}
 
-	// we have a PPM file
-	printf("Loading textures please wait...\n");
+	glGetQueryObjectiv(skyQuery, GL_QUERY_RESULT_AVAILABLE, &isAvailable);
+	frameDriverCalls++;
+	if(isAvailable) {
+		glGetQueryObjectuiv(skyQuery, GL_QUERY_RESULT, &pixels);
+		reportSkyPixels += pixels;
+		reportSkyPixelFrames++;
+		isSkyQueryPending = 0;
+		frameDriverCalls++;
+	}
+}
 
-	// read in the first character of the next line
-	fscanf(fileID, "%c", &tempChar);
+/************************************************************************
 
-	// while we still have comment lines (which begin with #)
-	while(tempChar == '#')
-	{
-		// read in the comment
-		fscanf(fileID, "%[^\n] ", headerLine);
+	Function:		parseCommandLine
 
-		// // print the comment
-		// printf("%s\n", headerLine);
+	Description:	Reads the software renderer options.
+					-software runs the software renderer without a window,
+					-frames n sets the frames drawn for each thread count,
+					-size w h sets the frame size, -image file saves the last
+					frame as a PPM, and -sea, -solid and -textured start with
+					sea and sky, solid drawing and mountain textures on.
+					-budget ms sets the frame time the quality governor
+					aims for. -scene file reads the scene config from another
+					file. Anything else is left for glut.
 
-		// read in the first character of the next line
-		fscanf(fileID, "%c",&tempChar);
+*************************************************************************/
+void parseCommandLine(int argc, char **argv) {
+	int i = 0;
+
+	for(i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "-software") == 0) {
+			isSoftwareRun = 1;
+		} else if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+			softwareFrames = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-size") == 0 && i + 2 < argc) {
+			softwareWidth = atoi(argv[++i]);
+			softwareHeight = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-image") == 0 && i + 1 < argc) {
+			softwareImageName = argv[++i];
+		} else if(strcmp(argv[i], "-sea") == 0) {
+			isSeaAndSky = 1;
+		} else if(strcmp(argv[i], "-solid") == 0) {
+			isWireRendering = 0;
+		} else if(strcmp(argv[i], "-textured") == 0) {
+			mountainTextureEnabled = 1;
+		} else if(strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+			governorBudget = atof(argv[++i]) / 1000.0;
+		} else if(strcmp(argv[i], "-scene") == 0 && i + 1 < argc) {
+			sceneConfigName = argv[++i];
+		} else if(strcmp(argv[i], "-loose") == 0) {
+			isLooseAssets = 1;
+		} else if(strcmp(argv[i], "-pack") == 0) {
+			isPackRun = 1;
+		} else if(strcmp(argv[i], "-lightbench") == 0) {
+			isLightBenchRun = 1;
+		} else if(strcmp(argv[i], "-groundbench") == 0) {
+			isGroundBenchRun = 1;
+		} else if(strcmp(argv[i], "-particlebench") == 0) {
+			isParticleBenchRun = 1;
+		} else if(strcmp(argv[i], "-join") == 0) {
+			isNetJoin = 1;
+		} else if(strcmp(argv[i], "-relay") == 0) {
+			isRelayRun = 1;
+		} else if(strcmp(argv[i], "-netbench") == 0) {
+			isNetBenchRun = 1;
+		} else if(strcmp(argv[i], "-headless") == 0 && i + 1 < argc) {
+			headlessScriptName = argv[++i];
+		} else if(strcmp(argv[i], "-trace") == 0 && i + 1 < argc) {
+			traceFileName = argv[++i];
+		} else if(strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) {
+			headlessSeconds = atof(argv[++i]);
+		} else if(strcmp(argv[i], "-montecarlo") == 0 && i + 1 < argc) {
+			monteCarloScriptName = argv[++i];
+		} else if(strcmp(argv[i], "-flights") == 0 && i + 1 < argc) {
+			monteCarloFlights = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+			monteCarloSeed = (unsigned int)strtoul(argv[++i], NULL, 10);
+		} else if(strcmp(argv[i], "-record") == 0 && i + 1 < argc) {
+			recordFileName = argv[++i];
+		} else if(strcmp(argv[i], "-capture") == 0 && i + 1 < argc) {
+			captureFileName = argv[++i];
+		}
 	}
 
-	// the last one was not a comment character '#', so we nee dto put it back into the file stream (undo)
-	ungetc(tempChar, fileID);
+	// Keep the sizes sensible
+	if(softwareFrames < 1) {
+		softwareFrames = 1;
+	}
+	if(softwareWidth < 1 || softwareHeight < 1) {
+		softwareWidth = 640;
+		softwareHeight = 640;
+	}
+	if(governorBudget <= 0.0) {
+		governorBudget = 1.0 / 60.0;
+	}
 
-	// read in the image hieght, width and the maximum value
-	fscanf(fileID, "%d %d %d", &imageWidthMountain, &imageHeightMountain, &maxValue);
+	governorInit(&governor, QUALITY_LEVELS, governorBudget);
+}
 
-	// compute the total number of pixels in the image
-	totalPixels = imageWidthMountain * imageHeightMountain;
+/************************************************************************
 
-	// allocate enough memory for the image  (3*) because of the RGB data
-	imageDataMountain = (GLubyte*)malloc(3 * sizeof(GLuint) * totalPixels);
+	Function:		runSoftwareRenderer
 
-	// determine the scaling for RGB values
-	RGBScaling = 255.0 / maxValue;
+	Description:	Draws the scene with the software renderer and prints the
+					frames per second for 1, 2, 4 and so on threads up to one
+					per processor. Each thread count starts the flight from
+					the beginning so they all draw the same frames.
 
+*************************************************************************/
+void runSoftwareRenderer() {
+	SoftFrame frame;
+	// State drawn each frame, the simulation runs in step with the frames
+	SimSnapshot snapshot;
+	SoftRaster *raster;
+	ThreadPool *pool;
+	int processorCount = threadPoolProcessorCount();
+	int threadCount = 1;
+	int drawCount = 0;
+	int i = 0;
+	double startTime = 0.0;
+	double elapsed = 0.0;
 
-	// if the maxValue is 255 then we do not need to scale the
-	//    image data values to be in the range or 0 to 255
-	if (maxValue == 255)
-	{
-		for(i = 0; i < totalPixels; i++)
-		{
-			// read in the current pixel from the file
-			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+	// Same scene set up as the window, without the GL parts
+	setUpMaterials();
+	loadModel(sceneConfig.planeFile, &planeMesh, &planeLowMesh, planeMaterialIndex, PLANE_LOW_DETAIL_CELLS);
+	loadModel(sceneConfig.propFile, &propMesh, &propLowMesh, propMaterialIndex, PROP_LOW_DETAIL_CELLS);
+	setUpMountains();
+	buildSceneMeshes();
+	snapshot.mountains = (WorldMountain*)arenaAlloc(&sceneArena, sceneConfig.mountainCount * sizeof(WorldMountain));
+	snapshot.isMountainVisible = (GLubyte*)arenaAlloc(&sceneArena, sceneConfig.mountainCount);
+	snapshot.terrainHeights = (float*)arenaAlloc(&sceneArena, WORLD_VIEW_TILES * WORLD_TILE_CORNERS * WORLD_TILE_CORNERS * sizeof(float));
+	// Tiles are made as they are asked for so every run draws the same frames
+	startWorld(0);
+
+	// Textures read straight from the loaded images
+	seaSoftTexture.pixels = imageDataSea;
+	seaSoftTexture.width = imageWidthSea;
+	seaSoftTexture.height = imageHeightSea;
+	skySoftTexture.pixels = imageDataSky;
+	skySoftTexture.width = imageWidthSky;
+	skySoftTexture.height = imageHeightSky;
+	mountainSoftTexture.pixels = imageDataMountain;
+	mountainSoftTexture.width = imageWidthMountain;
+	mountainSoftTexture.height = imageHeightMountain;
+
+	printf("\nSoftware Renderer\n-----------------\n");
+	printf("%d x %d, %d frames for each thread count, %d processors\n", softwareWidth, softwareHeight, softwareFrames, processorCount);
+
+	for(;;) {
+		pool = threadPoolCreate(threadCount);
+		raster = softRasterCreate(softwareWidth, softwareHeight, pool);
+		if(pool == NULL || raster == NULL) {
+			printf("Out of memory for the software renderer\n");
+			exit(1);
+		}
 
-			// store the red, green and blue data of the current pixel in the data array
-			imageDataMountain[3*totalPixels - 3*i - 3] = red;
-			imageDataMountain[3*totalPixels - 3*i - 2] = green;
-			imageDataMountain[3*totalPixels - 3*i - 1] = blue;
+		// Start the flight over
+		flightInit(&flight);
+
+		startTime = getTime();
+		for(i = 0; i < softwareFrames; i++) {
+			stepSimulation();
+			fillSnapshot(&snapshot);
+			buildTerrainMeshes(&snapshot);
+			drawCount = buildSoftwareScene(&frame, softwareDraws, &snapshot);
+			softRasterDraw(raster, &frame, softwareDraws, drawCount);
 		}
-	}
-	else  // need to scale up the data values
-	{
-		for(i = 0; i < totalPixels; i++)
-		{
-			// read in the current pixel from the file
-			fscanf(fileID,"%d %d %d",&red, &green, &blue );
+		elapsed = getTime() - startTime;
 
-			// store the red, green and blue data of the current pixel in the data array
-			imageDataMountain[3*totalPixels - 3*i - 3] = red   * RGBScaling;
-			imageDataMountain[3*totalPixels - 3*i - 2] = green * RGBScaling;
-			imageDataMountain[3*totalPixels - 3*i - 1] = blue  * RGBScaling;
+		printf("%2d threads: %.1f fps, %.2f ms per frame, %d triangles and %d lines\n",
+			threadCount, softwareFrames / elapsed, elapsed * 1000.0 / softwareFrames,
+			raster->triangleCount, raster->lineCount);
+
+		// Save the last frame of the last run
+		if(threadCount == processorCount && softwareImageName != NULL) {
+			if(softRasterWriteImage(raster, softwareImageName)) {
+				printf("Saved the last frame to %s\n", softwareImageName);
+			} else {
+				printf("Could not save %s\n", softwareImageName);
+			}
+		}
+
+		softRasterDestroy(raster);
+		threadPoolDestroy(pool);
+
+		// Double the threads until every processor is used
+		if(threadCount >= processorCount) {
+			break;
+		}
+		threadCount *= 2;
+		if(threadCount > processorCount) {
+			threadCount = processorCount;
 		}
 	}
 
-	// close the image file
-	fclose(fileID);
+	// Memory at the end of the run, with the peaks the renderer reached
+	printMemoryReport();
+	freeSceneMeshes();
+	worldDestroy(streamWorld);
 }
 
 /************************************************************************
 
-	Function:		setUpTexture
+	Function:		setSoftwareDraw
 
-	Description:	This sets up the textures for binding to sea and sky.
+	Description:	Fills in one draw for the software renderer.
 
 *************************************************************************/
-void setUpTexture() {
-	// Bind the texture for the sea
-	glGenTextures(1, &seaTextureID);
-
-	// Bind texture to id
-	glBindTexture(GL_TEXTURE_2D, seaTextureID);
-
-	// Set up texture with various settings to wrapping
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-
-	// Build the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, imageWidthSea, imageHeightSea, GL_RGB, GL_UNSIGNED_BYTE, imageDataSea);
-
-	// Bind the for the sky
-	glGenTextures(1, &skyTextureID);
+void setSoftwareDraw(SoftDraw *draw, Mesh *mesh, float *modelView, int material, SoftTexture *texture, int useFog, int lineWidth) {
+	draw->mesh = mesh;
+	matrixCopy(draw->modelView, modelView);
+	draw->material = material;
+	draw->texture = texture;
+	draw->useFog = useFog;
+	draw->isLineDraw = isWireRendering;
+	draw->lineWidth = lineWidth;
+}
 
-	// Bind texture to id
-	glBindTexture(GL_TEXTURE_2D, skyTextureID);
+/************************************************************************
 
-	// Set up texture with various settings to wrapping
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	Function:		buildSoftwareScene
 
-	// Build the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, imageWidthSky, imageHeightSky, GL_RGB, GL_UNSIGNED_BYTE, imageDataSky);
+	Description:	Fills in the frame values and the draws for the software
+					renderer from a snapshot, with the same transforms,
+					materials and textures display uses on the shader path.
+					Returns the number of draws.
 
-	// Bind the for the mountain
-	glGenTextures(1, &mountainTextureID);
+*************************************************************************/
+int buildSoftwareScene(SoftFrame *frame, SoftDraw *draws, const SimSnapshot *snapshot) {
+	// Camera, moving object and other object matrices
+	float view[16];
+	float objectModelViews[OBJECT_TRANSFORMS][16];
+	float matrix[16];
+	float up[3] = {0.0f, 1.0f, 0.0f};
+	float light[4];
+	const WorldMountain *mountain;
+	int drawCount = 0;
+	int i = 0;
 
-	// Bind texture to id
-	glBindTexture(GL_TEXTURE_2D, mountainTextureID);
+	// Same camera as myResize and display
+	matrixPerspective(frame->projection, 45, (float)softwareWidth/softwareHeight, VIEW_NEAR, VIEW_FAR);
+	matrixIdentity(view);
+	matrixLookAt(view, &snapshot->cameraPosition[0], &snapshot->cameraPosition[3], up);
+
+	// Light in eye space, colors and fog
+	placeSceneLight(snapshot->cameraPosition, light);
+	matrixTransform(view, light, frame->lightPosition);
+	memcpy(frame->lightAmbient, ambient, sizeof(frame->lightAmbient));
+	memcpy(frame->lightDiffuse, diffuse, sizeof(frame->lightDiffuse));
+	memcpy(frame->lightSpecular, specular, sizeof(frame->lightSpecular));
+	memcpy(frame->globalAmbient, globalAmbient, sizeof(frame->globalAmbient));
+	memcpy(frame->fogColor, fogColor, sizeof(frame->fogColor));
+	frame->fogDensity = fogDensity;
+	memcpy(frame->clearColor, black, sizeof(frame->clearColor));
+	frame->materials = materialTable;
+
+	if(isSeaAndSky) {
+		// Sky around the camera, then the sea patches and the land
+		matrixCopy(matrix, view);
+		matrixTranslate(matrix, snapshot->cameraPosition[0], 0.0f, snapshot->cameraPosition[2]);
+		matrixRotate(matrix, -90, 1.0f, 0.0f, 0.0f);
+		setSoftwareDraw(&draws[drawCount++], &skyMeshes[qualityLevel], matrix, MATERIAL_SKY, &skySoftTexture, 0, 1);
+		setSoftwareDraw(&draws[drawCount++], &terrainSeaMesh, view, MATERIAL_SEA, &seaSoftTexture, isFog, 1);
+		setSoftwareDraw(&draws[drawCount++], &terrainMesh, view, MATERIAL_TERRAIN, NULL, 0, 1);
+
+		// Mountains
+		for(i = 0; i < snapshot->mountainCount; i++) {
+			mountain = &snapshot->mountains[i];
+			if(!isMountainInRange(mountain, snapshot->cameraPosition)) {
+				continue;
+			}
+			matrixCopy(matrix, view);
+			matrixTranslate(matrix, mountain->x, mountain->base, mountain->z);
+			matrixRotate(matrix, -90, 1.0f, 0.0f, 0.0f);
+			matrixScale(matrix, mountain->width, mountain->width, mountain->height);
+			if(mountainTextureEnabled) {
+				setSoftwareDraw(&draws[drawCount++], &coneMesh, matrix, MATERIAL_MOUNTAIN_TEXTURED, &mountainSoftTexture, 0, 1);
+			} else {
+				setSoftwareDraw(&draws[drawCount++], &coneMesh, matrix, MATERIAL_MOUNTAIN, NULL, 0, 1);
+			}
+		}
+	} else {
+		// Grid, at the middle of the world
+		matrixCopy(matrix, view);
+		matrixTranslate(matrix, snapshot->originTile[0] * -WORLD_TILE_SIZE, 0.0f, snapshot->originTile[1] * -WORLD_TILE_SIZE);
+		matrixRotate(matrix, -45, 0.0f, 1.0f, 0.0f);
+		setSoftwareDraw(&draws[drawCount++], &gridMesh, matrix, MATERIAL_GRID, NULL, 0, 1);
+
+		// Axes and the sphere in the middle
+		matrixTranslate(matrix, 0.0, 0.05, 0.0);
+		setSoftwareDraw(&draws[drawCount++], &axesMesh, matrix, -1, NULL, 0, 5);
+		setSoftwareDraw(&draws[drawCount++], &originMesh, matrix, MATERIAL_ORIGIN, NULL, 0, 1);
+	}
 
-	// Set up texture with various settings to wrapping
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	// Plane and propellers, the same transforms as drawPlane and drawProps
+	matrixMultiplyArray(objectModelViews[0], view, snapshot->objectMatrices[0], OBJECT_TRANSFORMS);
+	setSoftwareDraw(&draws[drawCount++], qualityLowDetailPlane[qualityLevel] ? &propLowMesh : &propMesh, objectModelViews[TRANSFORM_PROP_LEFT], -1, NULL, 0, 1);
+	setSoftwareDraw(&draws[drawCount++], qualityLowDetailPlane[qualityLevel] ? &propLowMesh : &propMesh, objectModelViews[TRANSFORM_PROP_RIGHT], -1, NULL, 0, 1);
+	setSoftwareDraw(&draws[drawCount++], qualityLowDetailPlane[qualityLevel] ? &planeLowMesh : &planeMesh, objectModelViews[TRANSFORM_PLANE], -1, NULL, 0, 1);
 
-	// Build the mipmaps
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, imageWidthMountain, imageHeightMountain, GL_RGB, GL_UNSIGNED_BYTE, imageDataMountain);
+	return drawCount;
 }
 
 /************************************************************************
 
 	Function:		display
 
-	Description:	Clears color and depth buffer. Sets up the camera position
-					and look at position as well as plane position. Draws world and plane.
+	Description:	Clears color and depth buffer. Takes the newest snapshot
+					from the simulation and sets up the camera position and
+					look at position from it. Draws world and plane.
 
 *************************************************************************/
 void display(void)
 {
+	// Camera position and look at point of the snapshot
+	GLfloat *camera;
+	// How long ago the snapshot was published
+	double snapshotAge = 0.0;
+	double frameTime = 0.0;
+	double now = 0.0;
+
+	// Time since the last frame started drives the quality governor
+	now = getTime();
+	if(lastFrameStartTime > 0.0) {
+		frameTime = now - lastFrameStartTime;
+		updateQualityGovernor(frameTime);
+		telemetryFrameTime = (float)frameTime;
+	}
+	lastFrameStartTime = now;
+
+	// Pick up the sky pixel count from an earlier frame if it is ready
+	readSkyQuery();
+
+	// Swap in assets that changed since the last frame
+	applyAssetReloads();
+
+	// Newest snapshot, or the last one again if nothing new came in
+	if(cullingThread != NULL) {
+		// Toggles and window size for the culls to come
+		publishCullSettings();
+		renderSnapshot = &culledSnapshots[tripleBufferRead(&culledBuffer)];
+	} else {
+		renderSnapshot = &simSnapshots[tripleBufferRead(&snapshotBuffer)];
+	}
+	camera = renderSnapshot->cameraPosition;
+	snapshotAge = now - renderSnapshot->publishTime;
+	reportSnapshotAge += snapshotAge;
+	if(snapshotAge > reportSnapshotAgeMax) {
+		reportSnapshotAgeMax = snapshotAge;
+	}
+	if(renderSnapshot->cullOccluders > 0) {
+		reportCullFrames++;
+		reportCullMountains += renderSnapshot->mountainCount;
+		reportCullOccluders += renderSnapshot->cullOccluders;
+		reportCullOccluded += renderSnapshot->cullOccluded;
+		reportCullOutside += renderSnapshot->cullOutside;
+		reportCullTime += renderSnapshot->cullTime;
+	}
+
+	// How far the propellers turned since the last frame, smoothed so
+	// the impostor does not flicker on and off with uneven frames
+	if(lastPropStep != 0) {
+		propSpinPerFrame += ((renderSnapshot->step - lastPropStep) * FLIGHT_PROP_SPIN_STEP * 360.0f - propSpinPerFrame) * 0.1f;
+	}
+	lastPropStep = renderSnapshot->step;
+
+	// Keep what the renderer holds in the world on the snapshot's origin
+	rebaseRenderState(renderSnapshot->originTile);
+
+	// Land and sea of the tiles in view when they changed
+	buildTerrainMeshes(renderSnapshot);
+
+	// Draw offscreen when the quality level lowers the resolution
+	beginSceneFramebuffer();
+
 	// Clear the screen and depth buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// Load the indentity matrix
 	glLoadIdentity();
 
-	// Sets up camera position and plane position
-	positionScene();
-
 	// Tell the camera where to position and lookat
-	gluLookAt(cameraPosition[0], cameraPosition[1], cameraPosition[2], cameraPosition[3], cameraPosition[4], cameraPosition[5], 0, 1, 0);
+	gluLookAt(camera[0], camera[1], camera[2], camera[3], camera[4], camera[5], 0, 1, 0);
+
+	// Set light position to whatever the lightPosition is, over the camera
+	placeSceneLight(camera, frameLightPosition);
+	glLightfv(GL_LIGHT0, GL_POSITION, frameLightPosition);
+
+	// Shader path gets the camera, light and fog from one uniform buffer
+	if(isShaderPath) {
+		glUseProgram(shaderProgram);
+		updateLightClusters();
+		updateFrameUniforms();
+	}
 
-	// Set light position to whatever the lightPosition is
-	glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
+	// Particles only move on while they are drawn
+	if(isShaderPath && isParticlesOn) {
+		updateParticles(frameTime);
+	} else {
+		isParticleEmitterPlaced = 0;
+	}
 
 	// Draw everything except plane so we can move world around the plane
 	glPushMatrix();
 		// Draw sea and sky or the frame reference grid
 		if(isSeaAndSky) {
+			// Load the textures this mode needs, placeholders show until then
+			requestAsset(ASSET_SEA);
+			requestAsset(ASSET_SKY);
+			if(mountainTextureEnabled) {
+				requestAsset(ASSET_MOUNTAIN);
+			}
 			// Draw sky and sea and enable the fog for sea
-			drawSkyAndSea();
+			if(isShaderPath) {
+				drawSkyAndSeaShaderPath();
+			} else {
+				drawSkyAndSea();
+			}
 		} else {
 			// Reset fog to be enabled when we switch back
 			isFog = 1;
-			// Draw frame and refercne grid
-			drawFrameReferenceGrid();
+			// Draw frame and refercne grid, it stays at the middle of the world
+			glTranslatef(renderSnapshot->originTile[0] * -WORLD_TILE_SIZE, 0.0f, renderSnapshot->originTile[1] * -WORLD_TILE_SIZE);
+			if(isShaderPath) {
+				drawFrameReferenceGridShaderPath();
+			} else {
+				drawFrameReferenceGrid();
+			}
 		}
 	glPopMatrix();
 
@@ -1613,6 +7372,60 @@ void display(void)
 		drawPlane();
 	glPopMatrix();
 
+	// Planes of the other simulators
+	drawRemotePlanes();
+
+	// Skybox goes last so it only shades the pixels left uncovered
+	if(isSeaAndSky && isSkyboxOn) {
+		if(!isShaderPath) {
+			drawSkybox();
+		} else if(skyboxProgram != 0) {
+			drawSkyboxShaderPath();
+		}
+	}
+
+	// Exhaust, contrails and spray over the solid scene
+	if(isShaderPath && isParticlesOn) {
+		drawParticles();
+	}
+
+	// See through propeller discs go over everything else
+	if(isPropImpostorUsed()) {
+		glPushMatrix();
+			drawPropImpostors();
+		glPopMatrix();
+	}
+
+	// Leave fixed function on between frames
+	if(isShaderPath) {
+		glBindVertexArray(0);
+		glUseProgram(0);
+		frameDriverCalls += 4;
+
+		// Frame uniform slot is free again once the card is past this frame
+		fenceFrameUniforms();
+	}
+
+	// Stretch the scene over the window if it was drawn offscreen
+	endSceneFramebuffer();
+
+	// Start reading the frame back for the video
+	readCaptureFrame();
+
 	// Swap the drawing buffers here
 	glutSwapBuffers();
+
+	// Pass the frames read back by now on to be written
+	collectCaptureFrames(0);
+
+	// Time from starting the program until the first frame is on screen
+	if(!isFirstFrameDrawn) {
+		glFinish();
+		isFirstFrameDrawn = 1;
+		printf("First frame presented %.1f ms after start, assets %s\n", (getTime() - programStartTime) * 1000.0,
+			isAssetPackOpen ? "mapped from " ASSET_PACK_FILE : "read from the loose files");
+	}
+
+	// Count the frame for the frame report
+	updateFrameReport();
 }
\ No newline at end of file
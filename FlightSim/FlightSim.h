@@ -8,10 +8,14 @@
 #ifndef FLIGHTSIM_H_
 #define FLIGHTSIM_H_
 /* Header files */
+// GLEW header for buffer objects, must come before any other gl header
+#include <GL\glew.h>
 // Freeglut header
 #include <GL\freeglut.h>
 #include <GL\Gl.h>
 #include <windows.h>
+// Process memory info for the startup report
+#include <psapi.h>
 // Math header
 #include <math.h>
 // File read in
@@ -20,6 +24,50 @@
 #include <time.h>
  // Include stdlib
  #include <stdlib.h>
+// String header for memcpy
+#include <string.h>
+// offsetof for vertex layouts
+#include <stddef.h>
+// Mesh building for the shader path
+#include "Mesh.h"
+// CPU matrices for the software renderer
+#include "Matrix.h"
+// Quaternion transforms for the moving objects
+#include "Transform.h"
+// Worker threads
+#include "ThreadPool.h"
+// Software renderer
+#include "SoftRaster.h"
+// Snapshots from the simulation thread
+#include "TripleBuffer.h"
+// Frame time budget
+#include "QualityGovernor.h"
+// Cube map faces for the skybox
+#include "Skybox.h"
+// Occlusion culling on the CPU
+#include "Occlusion.h"
+// Arenas for the scene storage
+#include "Arena.h"
+// Tracked heap allocation
+#include "MemoryTracker.h"
+// Folder change notifications for reloading assets
+#include "AssetWatcher.h"
+// Models and images mapped from one file
+#include "AssetPack.h"
+// Point lights binned into clusters of the view
+#include "ClusterLights.h"
+// Structure of arrays particle pools
+#include "Particles.h"
+// Planes of other simulators through a relay
+#include "Net.h"
+// Flight state published to shared memory
+#include "Telemetry.h"
+// Flight steps, control scripts and traces
+#include "Flight.h"
+#include "MonteCarlo.h"
+#include "Capture.h"
+// Tiled world streamed in around the plane
+#include "World.h"
 
 /* Defines */
 
@@ -27,11 +75,221 @@
 #define PI 3.14159265f
 // Conversion multiplier for converting from degrees to Radians for some calculations
 #define DEG_TO_RAD PI/180.0f
+// Scene config read at startup and the values used without it
+#define SCENE_CONFIG_FILE "scene.cfg"
 // Grid size X by X
-#define GRID_SIZE 100.0f
+#define DEFAULT_GRID_SIZE 100
+// Most mountains drawn at once, enough for every tile in view
+#define DEFAULT_NUM_MOUNTAINS (WORLD_VIEW_TILES * WORLD_TILE_MAX_MOUNTAINS)
+// Kilobytes of world tiles kept and the seed the world is made from
+#define DEFAULT_WORLD_CACHE_KB 1024
+#define DEFAULT_WORLD_SEED 1
+// Point lights scattered over the sea
+#define DEFAULT_NUM_LIGHTS 100
+// Most mountains, grid size and lights a scene config can ask for
+#define MAX_NUM_MOUNTAINS 100000
+#define MAX_GRID_SIZE 1000
+#define MAX_NUM_LIGHTS 10000
+#define MAX_WORLD_CACHE_KB (1024 * 1024)
 
-// Number of mountains
-#define NUM_MOUNTAINS 50
+// Size of each block the scene arenas take from the heap
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Texture images loaded the first time they are drawn and reloaded when
+// they change
+#define SEA_IMAGE_FILE "sea02.ppm"
+#define SKY_IMAGE_FILE "sky08.ppm"
+#define MOUNTAIN_IMAGE_FILE "mount03.ppm"
+// Assets the watcher reloads, folder it watches for them
+#define ASSET_PLANE 0
+#define ASSET_PROP 1
+#define ASSET_SEA 2
+#define ASSET_SKY 3
+#define ASSET_MOUNTAIN 4
+#define ASSET_COUNT 5
+#define ASSET_FOLDER "."
+// How far along each asset is. Textures start out as a placeholder and
+// are loaded in the background the first time they are drawn
+#define ASSET_STATE_NOT_LOADED 0
+#define ASSET_STATE_LOADING 1
+#define ASSET_STATE_READY 2
+
+// Bytes the card is guessed to use per texel, drivers pad RGB out to RGBA
+#define GPU_BYTES_PER_TEXEL 4
+// Bytes a display list is guessed to use for each recorded call
+#define DISPLAY_LIST_BYTES_PER_CALL 16
+
+// Material table indices used by the shader path
+#define MATERIAL_PLANE_YELLOW 0
+#define MATERIAL_PLANE_BLACK 1
+#define MATERIAL_PLANE_PURPLE 2
+#define MATERIAL_PLANE_BLUE 3
+#define MATERIAL_PROP_ORANGE 4
+#define MATERIAL_PROP_RED 5
+#define MATERIAL_PROP_YELLOW 6
+#define MATERIAL_SKY 7
+#define MATERIAL_SEA 8
+#define MATERIAL_MOUNTAIN 9
+#define MATERIAL_MOUNTAIN_TEXTURED 10
+#define MATERIAL_GRID 11
+#define MATERIAL_AXIS_X 12
+#define MATERIAL_AXIS_Y 13
+#define MATERIAL_AXIS_Z 14
+#define MATERIAL_ORIGIN 15
+#define MATERIAL_PROP_IMPOSTOR 16
+#define MATERIAL_TERRAIN 17
+// Number of materials, must match the size of the array in the shader
+#define NUM_MATERIALS 18
+
+// Vertex attribute locations for the shader path
+#define ATTRIBUTE_POSITION 0
+#define ATTRIBUTE_NORMAL 1
+#define ATTRIBUTE_TEXCOORD 2
+#define ATTRIBUTE_MATERIAL 3
+#define ATTRIBUTE_FACE_NORMAL 4
+
+// Uniform buffer binding points for the shader path
+#define BINDING_FRAME_UNIFORMS 0
+#define BINDING_MATERIAL_UNIFORMS 1
+// Texture units the shader path reads the light data, cluster offsets
+// and counts and light indices from, the scene textures use unit 0
+#define TEXTURE_UNIT_LIGHTS 1
+#define TEXTURE_UNIT_CLUSTERS 2
+#define TEXTURE_UNIT_LIGHT_INDICES 3
+// Texture units the particle program reads each particle's position and
+// size and how far through its life it is from
+#define TEXTURE_UNIT_PARTICLES 4
+#define TEXTURE_UNIT_PARTICLE_FADES 5
+
+// Clustered lights on the shader path. Depth where the log slices start
+// and past which lights are left out, the fog has hidden them by then
+#define LIGHT_CLUSTER_NEAR 1.0f
+#define LIGHT_CLUSTER_FAR 400.0f
+// Red and green wing tip lights and the white tail light on the plane,
+// and how far they reach
+#define NAV_LIGHT_COUNT 3
+#define NAV_LIGHT_RADIUS 1.5f
+// Light counts the l key steps through and the runs averaged for each in
+// the -lightbench benchmark
+#define LIGHT_STEPS 6
+#define LIGHT_BENCH_RUNS 50
+
+// Kinds of particle, each has a pool of its own drawn with one instanced draw
+#define PARTICLE_EXHAUST 0
+#define PARTICLE_CONTRAIL 1
+#define PARTICLE_SPRAY 2
+#define PARTICLE_TYPES 3
+// Places on the plane that make particles: the two engines, the two wing
+// tips and the sea under the plane
+#define PARTICLE_EMITTERS 5
+// Spray comes up off the sea when the plane is lower than this, more the
+// lower it goes
+#define SPRAY_HEIGHT 1.5f
+// Longest time the particles are moved on in one frame, in seconds
+#define PARTICLE_MAX_STEP 0.1f
+// Aircraft counts tried and frames flown for each in the -particlebench
+// benchmark, only the second half of the frames is timed
+#define PARTICLE_BENCH_STEPS 4
+#define PARTICLE_BENCH_FRAMES 360
+
+// Seconds between relay reports with -relay
+#define RELAY_REPORT_TIME 1.0
+// Player counts tried and seconds flown for each in the -netbench
+// benchmark, on a clock of its own so it runs as fast as it can
+#define NET_BENCH_STEPS 6
+#define NET_BENCH_SECONDS 10
+// Bytes of a plane state before quantising: nine 4 byte values
+#define NET_RAW_STATE_BYTES (NET_FIELDS * 4)
+
+// Seconds -headless flies a script with no end line for
+#define HEADLESS_DEFAULT_SECONDS 60
+
+// Least height the trailing camera keeps above the ground and mountains
+#define CAMERA_GROUND_CLEARANCE 0.5f
+// How far ahead of the plane the frame report looks for the ground
+#define GROUND_LOOK_AHEAD 100.0f
+// Ground heights and rays timed with -groundbench, the rays also marched
+// in steps of point queries to check them, and the step
+#define GROUND_BENCH_POINTS (1024 * 1024)
+#define GROUND_BENCH_RAYS (64 * 1024)
+#define GROUND_BENCH_MARCHED 2048
+#define GROUND_BENCH_MARCH_STEP 0.05f
+// Tile -groundbench is run around, well out of the open sea at the start
+#define GROUND_BENCH_TILE 30
+
+// Where each capture pack buffer is: free, being read back into, mapped
+// for the writing thread, or its read failed and it waits its turn to be
+// freed so the frames stay in order
+#define CAPTURE_SLOT_FREE 0
+#define CAPTURE_SLOT_READING 1
+#define CAPTURE_SLOT_WRITING 2
+#define CAPTURE_SLOT_LOST 3
+
+// Frames whose uniforms can be in flight at once. Each gets its own slot
+// of the frame uniform ring so a frame never writes what the card is
+// still reading
+#define FRAME_UNIFORM_SLOTS 3
+// Longest the CPU waits for the card to finish with a slot, in nanoseconds
+#define FRAME_UNIFORM_WAIT_LIMIT 1000000000
+
+// Draws the software renderer gets in a frame besides the mountains
+#define SOFTWARE_EXTRA_DRAWS 8
+
+// Simulation steps per second on the simulation thread
+#define SIMULATION_RATE 60
+// Most steps taken to catch up before the simulation skips ahead
+#define SIMULATION_MAX_CATCH_UP 10
+
+// Quality levels the governor can pick from, 0 is the best
+#define QUALITY_LEVELS 4
+// Grid cells across the low detail plane and propeller
+#define PLANE_LOW_DETAIL_CELLS 48
+#define PROP_LOW_DETAIL_CELLS 16
+
+// Size of the spinning propeller texture and the blade angles averaged into it
+#define PROP_IMPOSTOR_SIZE 64
+#define PROP_IMPOSTOR_ANGLES 48
+// Propellers are drawn as a blurred disc when they turn more than this
+// many degrees between frames, or are smaller than this many pixels across.
+// They turn a fixed amount every simulation step, so the spin is one and
+// a half steps' turn, which frames only reach below 40 a second
+#define PROP_IMPOSTOR_SPIN (FLIGHT_PROP_SPIN_STEP * 360.0f * 1.5f)
+#define PROP_IMPOSTOR_MIN_PIXELS 24.0f
+
+// Sea patches keep their texture coordinates this far inside the image
+// so the mirrored tiles never blend in the far edge where they meet
+#define SEA_TEXTURE_INSET 0.002f
+
+// Near and far planes of the view. Most of the depth buffer goes to just
+// past the near plane, so it is as far out as it can be without cutting
+// into the plane the camera trails by 4 units. Nothing is drawn past the
+// tiles in view, a few hundred units away
+#define VIEW_NEAR 0.5f
+#define VIEW_FAR 1000.0f
+
+// Sky cylinder size, gluCylinder(200, 200, 100) stood up on the sea
+#define SKY_RADIUS 200.0f
+#define SKY_HEIGHT 100.0f
+// Size of the skybox faces made from the sky image and the camera height
+// they are made for
+#define SKYBOX_FACE_SIZE 128
+#define SKYBOX_EYE_HEIGHT 3.2f
+// Half the size of the cube the skybox is drawn on, anything past the near plane works
+#define SKYBOX_CUBE_SIZE 10.0f
+
+// Moving objects, each gets a model matrix in every snapshot. The count
+// must match the size of the arrays in the shader
+#define TRANSFORM_PLANE 0
+#define TRANSFORM_PROP_LEFT 1
+#define TRANSFORM_PROP_RIGHT 2
+#define OBJECT_TRANSFORMS 3
+
+// Size of the occlusion culling depth buffer
+#define OCCLUSION_WIDTH 128
+#define OCCLUSION_HEIGHT 128
+// Nearest mountains drawn as occluders and the sides of each occluder cone
+#define OCCLUSION_MAX_OCCLUDERS 16
+#define OCCLUDER_SLICES 8
 
 /* Global variables */
 
@@ -42,6 +300,180 @@ typedef GLfloat point3[3];
 // Defines a RGB color
 typedef GLfloat color4[4];
 
+// What the scene is made of, read from the scene config
+typedef struct {
+	// Most mountains drawn at once
+	int mountainCount;
+	int gridSize;
+	// Point lights scattered over the sea
+	int lightCount;
+	// World tile cache size and the seed it is made from
+	int worldCacheKB;
+	unsigned int worldSeed;
+	// Model files for the plane and propeller
+	char planeFile[MAX_PATH];
+	char propFile[MAX_PATH];
+} SceneConfig;
+
+// Per frame camera, light and fog values shared by every draw (std140)
+typedef struct {
+	GLfloat projection[16];
+	// Light position in eye space
+	GLfloat lightPosition[4];
+	GLfloat lightAmbient[4];
+	GLfloat lightDiffuse[4];
+	GLfloat lightSpecular[4];
+	GLfloat globalAmbient[4];
+	GLfloat fogColor[4];
+	// x is the fog density
+	GLfloat fogParams[4];
+	// Model view of each moving object and its normal matrix, the normal
+	// matrices are 3x3 padded out to 4x4
+	GLfloat objectModelViews[OBJECT_TRANSFORMS][16];
+	GLfloat objectNormalMatrices[OBJECT_TRANSFORMS][16];
+	// Clustered lights: x and y turn window pixels into tiles, z is the
+	// slice scale and w the depth the log slices start at
+	GLfloat clusterParams[4];
+	// Lights binned, 0 skips them, then the tiles across and down and the
+	// slices
+	GLfloat clusterCounts[4];
+} FrameUniforms;
+
+// A mesh uploaded into vertex and index buffers
+typedef struct {
+	GLuint vertexArray;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	// Triangles come first in the index buffer, then the wireframe edges
+	GLsizei triangleIndexCount;
+	GLsizei edgeIndexCount;
+	// Bytes in both buffers, taken off the memory report when deleted
+	size_t bufferBytes;
+} GpuMesh;
+
+// One kind of particle: the most there can be, how they move, how many
+// each emitter makes a second, how long they live, how fast they leave
+// the emitter (back from the plane, or up off the sea for spray), how far
+// their velocity is spread and their color
+typedef struct {
+	const char *name;
+	int capacity;
+	ParticleMotion motion;
+	float rate;
+	float life;
+	float speed;
+	float spread;
+	GLfloat color[4];
+} ParticleType;
+
+// A changed asset read in on the watcher thread, or a texture read on its
+// first use, waiting to be swapped in between frames. Only the parts for
+// its kind of asset are filled in
+typedef struct {
+	int asset;
+	char fileName[MAX_PATH];
+	// When the file first changed, when the watcher started reading it
+	// and how long that took
+	double changeTime;
+	double readStartTime;
+	double readTime;
+	// Plane or propeller and its low detail copy, in an arena of their own
+	// that replaces the model's arena when swapped in
+	Arena arena;
+	Mesh mesh;
+	Mesh lowMesh;
+	// Image pixels in the reversed order the load functions use
+	GLubyte *pixels;
+	int width;
+	int height;
+	// Pixels point into the asset pack and are not freed
+	int isMapped;
+	// Skybox faces remade from a new sky image, NULL when not needed
+	unsigned char *skyboxFaces[SKYBOX_FACES];
+	int skyboxFaceSize;
+	// If the faces were made from the sky rather than read from skybox_*.ppm
+	int isSkyboxFromSky;
+} AssetReload;
+
+// Everything the renderer needs from one simulation step, never changed
+// after it is published
+typedef struct {
+	// Model matrix of each moving object, one after another so they can
+	// be multiplied and uploaded together
+	GLfloat objectMatrices[OBJECT_TRANSFORMS][16];
+	// Camera position then the point it looks at
+	GLfloat cameraPosition[6];
+	// Model matrices of the planes of other simulators, each with its
+	// propellers, and how many there are
+	GLfloat remoteMatrices[NET_MAX_PLAYERS][OBJECT_TRANSFORMS][16];
+	int remoteCount;
+	// Network totals so far, for the frame report
+	NetStats netStats;
+	// Telemetry samples published so far and the seconds it took
+	unsigned long telemetrySamples;
+	double telemetryTime;
+	// Tile the positions in the snapshot are measured from
+	int originTile[2];
+	// Mountains of the loaded tiles in view, nearest tiles first, placed
+	// against the origin tile. Owned by the snapshot slot, the values are
+	// copied into it
+	WorldMountain *mountains;
+	int mountainCount;
+	// Corner heights of the loaded tiles in view, a block for each tile,
+	// owned and copied the same way. The version changes whenever the
+	// tiles do so the renderer only remakes the terrain then
+	float *terrainHeights;
+	int terrainTiles[WORLD_VIEW_TILES][2];
+	int terrainTileCount;
+	unsigned long terrainVersion;
+	// World streaming totals so far, for the frame report
+	WorldStats worldStats;
+	// Height of the plane above the ground under it, how far along its
+	// heading the ground is or -1 if further than the look ahead, and the
+	// seconds the two queries took
+	float groundClearance;
+	float groundAhead;
+	double groundTime;
+	// Step it was taken after and when it was published
+	unsigned long step;
+	double publishTime;
+	// Mountains left to draw by occlusion culling, all of them without it.
+	// One for each mountain, owned by the snapshot slot and not copied with it
+	GLubyte *isMountainVisible;
+	// What the culling found and how long it took in seconds
+	int cullOccluders;
+	int cullOccluded;
+	int cullOutside;
+	double cullTime;
+} SimSnapshot;
+
+// Settings a cull follows, handed over whole from the main thread each
+// frame so one cull never mixes two of them
+typedef struct {
+	// Occlusion culling on, with the solid sea and sky drawn
+	GLint isCulling;
+	// Width over height of the window
+	float aspect;
+} CullSettings;
+
+/* Scene config and storage */
+
+// Scene config file, set with -scene
+const char *sceneConfigName = SCENE_CONFIG_FILE;
+// Scene sizes, the defaults unless the config changes them
+SceneConfig sceneConfig = {DEFAULT_NUM_MOUNTAINS, DEFAULT_GRID_SIZE, DEFAULT_NUM_LIGHTS, DEFAULT_WORLD_CACHE_KB, DEFAULT_WORLD_SEED, "plane.txt", "prop.txt"};
+
+// Snapshot mountains, visibility and other arrays sized by the config
+Arena sceneArena;
+// Plane and propeller meshes and their low detail copies, one arena each
+// so a reloaded model can let go of the old one
+Arena planeArena;
+Arena propArena;
+// Meshes from buildSceneMeshes, reset by freeSceneMeshes
+Arena sceneMeshArena;
+// Sea, sky and mountain images, released once they are uploaded
+Arena imageArena;
+
 /* Initial positions of camera, light and plane */
 
 // Keep track of current camera position and set the default
@@ -49,9 +481,8 @@ GLfloat cameraPosition[] = {0, 0, 0, 0, 0, 0};
 
 // Set light position
 GLfloat lightPosition[] = {0.0, 60.0, 0.0, 1.0};
-
-// Set initial plane position
-GLfloat planePosition[] = {0, 2.0, 10.0};
+// Light this frame, kept over the camera the same as the sky
+GLfloat frameLightPosition[4];
 
 // Window size parameters
 GLfloat windowWidth  = 640.0;
@@ -60,10 +491,9 @@ GLfloat windowHeight = 640.0;
 /* Quadric pointers */
 // Set up quadric objects
 GLUquadricObj* quadricCylinder;
-GLUquadricObj* quadricDisk;
 
 // Array of cones for mountains
-GLUquadricObj* quadricCone[NUM_MOUNTAINS];
+GLUquadricObj** quadricCone;
 
 /* Display list variables */
 // Set up display list for the plane
@@ -72,34 +502,63 @@ GLuint thePlane = 0;
 // Set up display list for propeller
 GLuint theProp = 0;
 
+// Low detail plane and propeller for the cheaper quality levels
+GLuint thePlaneLow = 0;
+GLuint thePropLow = 0;
+
 // Sets up the grid for frame reference
 GLuint theGrid = 0;
 
-/* Vertex and normal arrays for plane and propeller */
+/* Plane and propeller models */
 
-// This is an array of all the vertices for the plane
-point3 planeVertices[6763];
-// This is an array of all normals for the plane
-point3 planeNormals[6763];
+// Driver calls recorded into the plane and propeller display lists
+int planeListCalls = 0;
+int propListCalls = 0;
+int planeLowListCalls = 0;
+int propLowListCalls = 0;
 
-// This is an array of all the vertices for the plane
-point3 propVertices[6763];
-// This is an array of all normals for the plane
-point3 propNormals[6763];
+// Plane and propeller meshes for the shader path
+Mesh planeMesh;
+Mesh propMesh;
+Mesh planeLowMesh;
+Mesh propLowMesh;
 
-/* Interp and dynamic values */
+// Meshes for the rest of the scene, built for the shader path and the software renderer
+Mesh gridMesh;
+Mesh axesMesh;
+Mesh originMesh;
+// Sky at the detail of each quality level
+Mesh skyMeshes[QUALITY_LEVELS];
+Mesh coneMesh;
+// Land and sea of the tiles in view, remade on the render thread when
+// the snapshot's terrain version changes
+Mesh terrainMesh;
+Mesh terrainSeaMesh;
+unsigned long terrainMeshVersion = 0;
 
-// Interp for propeller spinning
-GLfloat propInterp = 0.0f;
+/* Interp and dynamic values */
 
-// Plane speed, this is the plane speed
-GLfloat planeSpeed = 0.05;
+// The plane's flight, stepped on the simulation thread. Position, turn,
+// tilt, speed, rolls and the propeller spin
+FlightState flight;
 
-// Get the amount to tilt the plane
-GLfloat sideTilt = 0.0;
+/* Propeller impostor */
 
-// Set the turnspeed to 0
-GLfloat turnSpeed = 0.0;
+// Draw spinning propellers as a textured disc, toggled with 'p'
+GLint isPropImpostorOn = 1;
+// Disc the blades sweep, made from the propeller mesh. Centre in the
+// mesh's own coordinates and the radius
+Mesh propImpostorMesh;
+GLfloat propImpostorCenter[3] = {0.0f, 0.0f, 0.0f};
+GLfloat propImpostorRadius = 0.0f;
+// Blades averaged over a turn, RGBA
+GLuint propImpostorTextureID = 0;
+GLuint thePropImpostor = 0;
+int propImpostorListCalls = 0;
+// Degrees the propellers turn between frames, smoothed, and the step
+// of the last frame drawn
+GLfloat propSpinPerFrame = 0.0f;
+unsigned long lastPropStep = 0;
 
 // Global mouse position of x
 float mouseX = 0.0;
@@ -110,21 +569,6 @@ GLfloat ratioOfTilt = 0.0;
 // Maximum distance from center mouse can move (this is also middle of screen)
 GLfloat maxMouseMove = 0.0;
 
-// This is the angle to turn the plane by based on mouse position
-GLfloat turnAngle = 0.0;
-
-// This is the the roll interp when doing a roll trick
-GLfloat rollAmount = 0.0;
-
-// Roll height to interp too
-GLfloat rollHeight = 0.0;
-
-// Random height, width and x and z position for mountains
-int randHeightList[NUM_MOUNTAINS];
-int baseWidthList[NUM_MOUNTAINS];
-int randXList[NUM_MOUNTAINS];
-int randZList[NUM_MOUNTAINS];
-
 /* Key checks to see if pressed or not */
 
 // Not full screen by default
@@ -135,19 +579,28 @@ GLint isWireRendering = 1;
 GLint isSeaAndSky = 0;
 // Fog enabled
 GLint isFog = 1;
-// If roll is enabled
-GLint rollEnabled = 0;
-// Crazy roll
-GLint crazyRollEnabled = 0;
 // Mountain textures on or off
 GLint mountainTextureEnabled = 0;
 
-// Toggles for directions key pressed and not pressed
+// Toggles for directions key pressed and not pressed, only touched on the
+// main thread, which hands them to the simulation with publishControls
 GLint upPressed = 0;
 GLint downPressed = 0;
 GLint forwardPressed = 0;
 GLint backwardPressed = 0;
 
+// Tilt and keys held, passed whole from the main thread to the
+// simulation so each step sees one set. Starts as if published with
+// tripleBufferInit, with every slot holding no controls
+FlightControls heldControls[3];
+TripleBuffer controlsBuffer = {0, 1, 2};
+// Controls of the last step, only touched on the simulation thread
+FlightControls stepControls;
+
+// Roll keys pressed since the simulation last looked
+volatile LONG rollRequest = 0;
+volatile LONG crazyRollRequest = 0;
+
 /* Set up colors for open gl */
 // Define colors for plane and propeller
 color4 yellow = {1.0, 1.0, 0.0, 1.0};
@@ -159,6 +612,7 @@ color4 green = {0.0, 1.0, 0.0, 1.0};
 color4 white = {1.0, 1.0, 1.0, 1.0};
 color4 grey = {0.05, 0.05, 0.05, 1.0};
 color4 seaBlue = {0.0, 0.3, 0.8, 1.0};
+color4 landGreen = {0.25, 0.5, 0.15, 1.0};
 color4 orange = {1.0, 0.5, 0.0, 1.0};
 color4 clear = {1.0, 1.0, 1.0, 0.0};
 
@@ -172,6 +626,334 @@ GLfloat specular[] = {1.0, 1.0, 1.0, 1.0};
 // Set global ambient
 GLfloat globalAmbient[] = {0.05, 0.05, 0.05, 1.0};
 
+// Fog color (pink) and density for the sea
+GLfloat fogColor[] = {0.737255, 0.560784, 0.560784, 1.0};
+GLfloat fogDensity = 0.005;
+
+/* Shader render path */
+
+// Materials shared by both render paths, uploaded once for the shader path
+Material materialTable[NUM_MATERIALS];
+
+// Use the shader path instead of fixed function
+GLint isShaderPath = 0;
+
+// Shader program and its uniform locations
+GLuint shaderProgram = 0;
+GLint modelViewLocation;
+GLint normalMatrixLocation;
+GLint drawMaterialLocation;
+GLint useTextureLocation;
+GLint useFogLocation;
+GLint isLineDrawLocation;
+GLint drawObjectLocation;
+
+// Last per draw uniform values so unchanged ones are not sent again
+GLint lastDrawMaterial;
+GLint lastUseTexture;
+GLint lastUseFog;
+GLint lastIsLineDraw;
+GLint lastDrawObject;
+
+// Uniform buffers for the per frame values and the material table
+GLuint frameUniformBuffer;
+GLuint materialUniformBuffer;
+
+// Frame uniform ring. Slots are sizeof(FrameUniforms) rounded up to the
+// card's uniform buffer offset alignment
+GLsizeiptr frameUniformSlotBytes = 0;
+int frameUniformSlot = 0;
+// Whole ring mapped for good with ARB_buffer_storage, NULL when frames are
+// written with glBufferSubData instead
+GLubyte *frameUniformMapping = NULL;
+// Fence after the last frame that read each slot, 0 once it is free
+GLsync frameUniformFences[FRAME_UNIFORM_SLOTS];
+
+// Meshes uploaded for the shader path
+GpuMesh planeGpuMesh;
+GpuMesh propGpuMesh;
+GpuMesh planeLowGpuMesh;
+GpuMesh propLowGpuMesh;
+GpuMesh propImpostorGpuMesh;
+GpuMesh gridGpuMesh;
+GpuMesh axesGpuMesh;
+GpuMesh originGpuMesh;
+GpuMesh skyGpuMeshes[QUALITY_LEVELS];
+GpuMesh coneGpuMesh;
+GpuMesh terrainGpuMesh;
+GpuMesh terrainSeaGpuMesh;
+
+/* Frame report */
+
+// Print a frame report every second
+GLint isFrameReport = 0;
+// Driver calls made so far this frame, fixed function quadrics are estimated
+int frameDriverCalls = 0;
+// Totals since the last report
+int reportFrames = 0;
+int reportDriverCalls = 0;
+// Frames that had to wait for the card to finish with a frame uniform slot
+int reportFrameUniformWaits = 0;
+// Plane and propeller triangles drawn this frame, the totals since the
+// last report and the frames the propellers were impostors in
+int frameModelTriangles = 0;
+double reportModelTriangles = 0.0;
+int reportPropImpostorFrames = 0;
+double reportStartTime = 0.0;
+// How old the drawn snapshots were, in seconds
+double reportSnapshotAge = 0.0;
+double reportSnapshotAgeMax = 0.0;
+
+/* Quality governor */
+
+// Settings for each quality level
+// Fraction of the window size the scene is drawn at
+GLfloat qualityRenderScale[QUALITY_LEVELS] = {1.0f, 0.85f, 0.7f, 0.5f};
+// Slices and stacks of the sky cylinder
+int qualitySkySeaDetail[QUALITY_LEVELS] = {100, 64, 40, 24};
+// Mountains farther than this from the camera are not drawn, 0 draws them all
+GLfloat qualityMountainDistance[QUALITY_LEVELS] = {0.0f, 160.0f, 110.0f, 70.0f};
+// Draw the low detail plane and propellers
+GLint qualityLowDetailPlane[QUALITY_LEVELS] = {0, 0, 1, 1};
+
+// Governor on by default, toggled with a
+GLint isGovernorOn = 1;
+QualityGovernor governor;
+// Frame time budget in seconds, set in milliseconds with -budget
+double governorBudget = 1.0 / 60.0;
+// Level in use
+int qualityLevel = 0;
+// When the last frame started
+double lastFrameStartTime = 0.0;
+
+// Offscreen framebuffer the scene is drawn into below full resolution
+GLuint sceneFramebuffer = 0;
+GLuint sceneColorBuffer = 0;
+GLuint sceneDepthBuffer = 0;
+int sceneFramebufferWidth = 0;
+int sceneFramebufferHeight = 0;
+// If framebuffer objects can be used for the render scale
+GLint isFramebufferScaling = 0;
+// If this frame is going into the offscreen framebuffer
+GLint isSceneScaled = 0;
+
+/* Skybox */
+
+// Draw the cube map skybox instead of the sky cylinder, toggled with k
+GLint isSkyboxOn = 0;
+// If the cube map has its faces, they come with the sky on its first use.
+// Cube maps need OpenGL 1.3, the texture is only made when they are there
+GLint isSkyboxAvailable = 0;
+// If the faces were made from the sky image, a reloaded sky remakes them
+GLint isSkyboxFromSky = 0;
+GLuint skyboxTextureID = 0;
+// Color the skybox is multiplied by, the lit sky material the cylinder had
+GLfloat skyboxTint[4] = {1.0, 1.0, 1.0, 1.0};
+
+/* Clustered lights */
+
+// Point lights, the navigation lights first and then the ones scattered
+// over the sea
+ClusterLight *sceneLights = NULL;
+int sceneLightCount = 0;
+// Where the navigation lights sit on the plane model and their colors
+const GLfloat navLightPositions[NAV_LIGHT_COUNT][3] = {{-0.28f, -0.15f, 1.0f}, {-0.34f, -0.15f, -1.0f}, {0.93f, 0.23f, 0.0f}};
+const GLfloat navLightColors[NAV_LIGHT_COUNT][3] = {{1.0f, 0.1f, 0.1f}, {0.1f, 1.0f, 0.2f}, {1.0f, 1.0f, 1.0f}};
+// Scattered light counts the l key steps through, and the benchmark runs
+const int lightSteps[LIGHT_STEPS] = {0, 1, 10, 100, 1000, 10000};
+// Bins the lights on the shader path every frame, on a pool of its own
+ClusterGrid *lightClusters = NULL;
+ThreadPool *lightPool = NULL;
+// Light data, cluster offsets and counts, and light indices, each in a
+// buffer the shader reads through a buffer texture
+GLuint lightBuffers[3];
+GLuint lightTextures[3];
+// Bytes in the three buffers
+size_t gpuLightBufferBytes = 0;
+// Totals since the last report
+int reportLightFrames = 0;
+double reportLightBinTime = 0.0;
+double reportLightsVisible = 0.0;
+double reportLightIndices = 0.0;
+double reportLitClusters = 0.0;
+int reportLightMax = 0;
+int reportLightDropped = 0;
+// Bin the lights without a window and quit, set with -lightbench
+GLint isLightBenchRun = 0;
+
+/* Particles */
+
+// Grey exhaust blown back from the engines and rising as it spreads, thin
+// white contrails from the wing tips and spray thrown up off the sea
+const ParticleType particleTypes[PARTICLE_TYPES] = {
+	{"exhaust", 8192, {-0.4f, 1.5f, 0.06f, 0.5f}, 80.0f, 0.8f, 3.0f, 0.3f, {0.3f, 0.3f, 0.32f, 0.45f}},
+	{"contrail", 8192, {0.0f, 0.3f, 0.04f, 0.12f}, 60.0f, 3.0f, 0.0f, 0.04f, {1.0f, 1.0f, 1.0f, 0.55f}},
+	{"spray", 8192, {9.8f, 0.5f, 0.05f, 0.25f}, 600.0f, 1.0f, 3.0f, 1.2f, {0.85f, 0.92f, 1.0f, 0.6f}}
+};
+// Kind of particle each emitter makes and where it sits on the plane
+// model, the spray emitter is moved down onto the sea
+const int particleEmitterTypes[PARTICLE_EMITTERS] = {PARTICLE_EXHAUST, PARTICLE_EXHAUST, PARTICLE_CONTRAIL, PARTICLE_CONTRAIL, PARTICLE_SPRAY};
+const GLfloat particleEmitterPositions[PARTICLE_EMITTERS][3] = {
+	{0.25f, -0.12f, 0.35f}, {0.25f, -0.12f, -0.35f}, {-0.28f, -0.15f, 1.0f}, {-0.34f, -0.15f, -1.0f}, {0.0f, 0.0f, 0.0f}
+};
+// Where each emitter was last frame and the part of a particle it still owes
+GLfloat particleEmitterLast[PARTICLE_EMITTERS][3];
+float particleEmitterCarry[PARTICLE_EMITTERS];
+// Emitters start over where they are, without a trail from where they
+// were, after a frame the particles were not moved in
+GLint isParticleEmitterPlaced = 0;
+// One pool for each kind, updated on a thread pool of their own
+ParticlePool *particlePools[PARTICLE_TYPES];
+ThreadPool *particleThreads = NULL;
+// Position and size, and fade, of each kind in buffers the particle
+// program reads through buffer textures
+GLuint particleBuffers[PARTICLE_TYPES][2];
+GLuint particleTextures[PARTICLE_TYPES][2];
+size_t gpuParticleBufferBytes = 0;
+// Particle program, its uniform locations and the empty vertex array the
+// instanced draws run from
+GLuint particleProgram = 0;
+GLint particleModelViewLocation;
+GLint particleColorLocation;
+GLint particleUseFogLocation;
+GLuint particleVertexArray = 0;
+// Draw the particles, toggled with e
+GLint isParticlesOn = 1;
+// Totals since the last report
+int reportParticleFrames = 0;
+double reportParticleCount = 0.0;
+double reportParticleUpdateTime = 0.0;
+unsigned long reportParticleDropped = 0;
+// Fly many aircraft without a window and quit, set with -particlebench
+GLint isParticleBenchRun = 0;
+
+/* Multiplayer */
+
+// Connection to the relay, only stepped on the simulation thread. NULL
+// when not joined
+NetClient *netClient = NULL;
+// Join the relay on this machine, set with -join
+GLint isNetJoin = 0;
+// Run as the relay without a window, set with -relay
+GLint isRelayRun = 0;
+// Time the network with many players and quit, set with -netbench
+GLint isNetBenchRun = 0;
+// Network totals at the last report
+NetStats reportNetStats;
+
+/* Telemetry */
+
+// Ring the flight state is published to every step, only written on the
+// simulation thread. Closed when it could not be made
+TelemetryRing telemetryRing;
+// Samples published and the seconds it took, and the same at the last report
+unsigned long telemetrySamples = 0;
+double telemetryTime = 0.0;
+unsigned long reportTelemetrySamples = 0;
+double reportTelemetryTime = 0.0;
+// Seconds the last frame took, written by the renderer for the samples
+volatile float telemetryFrameTime = 0.0f;
+
+/* Frame capture */
+
+// Every frame is written to this video, set with -capture. Capture starts
+// on the first frame and is only tried once
+const char *captureFileName = NULL;
+GLint isCaptureStarted = 0;
+CaptureEncoder *captureEncoder = NULL;
+// Size of the video, the window's size when capture started, made even
+int captureWidth = 0;
+int captureHeight = 0;
+// Pack buffers the frames are read back into, with a fence and state each
+GLuint capturePBO[CAPTURE_SLOTS];
+GLsync captureFences[CAPTURE_SLOTS];
+int captureSlotStates[CAPTURE_SLOTS];
+// Next slot read into, mapped and freed, they go round in that order
+int captureNextSlot = 0;
+int captureMapSlot = 0;
+int captureFreeSlot = 0;
+// Frames read back and dropped, main thread seconds spent on them, and
+// the same with the frames written and their time at the last report
+unsigned long captureFrames = 0;
+unsigned long captureDropped = 0;
+double captureTime = 0.0;
+unsigned long reportCaptureFrames = 0;
+unsigned long reportCaptureDropped = 0;
+double reportCaptureTime = 0.0;
+LONG reportCaptureWritten = 0;
+double reportCaptureEncodeTime = 0.0;
+
+/* World streaming */
+
+// Tiles around the plane, only updated on the simulation thread. NULL
+// when it could not be made
+World *streamWorld = NULL;
+// Whether the sea, sky and mountains were being drawn at the start of
+// this step. The grid draws no ground, so the camera is not kept above
+// it and no tiles are streamed. Only touched on the simulation thread
+GLint isWorldShown = 0;
+// Origin the particles and scattered lights were last placed against,
+// only touched on the render thread
+int renderOriginTile[2] = {0, 0};
+// Loaded tiles in view at the last snapshot, the origin they were placed
+// against and their version, only touched on the simulation thread
+int simTerrainTiles[WORLD_VIEW_TILES][2];
+int simTerrainTileCount = 0;
+int simTerrainOrigin[2] = {0, 0};
+unsigned long simTerrainVersion = 0;
+// World totals at the last report
+WorldStats reportWorldStats;
+// Time the ground queries and quit, set with -groundbench
+GLint isGroundBenchRun = 0;
+
+/* Batch flights */
+
+// Control script flown without a window, set with -headless
+const char *headlessScriptName = NULL;
+// Every step of it is written here, set with -trace
+const char *traceFileName = NULL;
+// Seconds to fly it for instead of to its end, set with -seconds
+double headlessSeconds = 0.0;
+// Control script flown many times over, set with -montecarlo, how many
+// times, set with -flights (0 for the default) and the seed, set with -seed
+const char *monteCarloScriptName = NULL;
+int monteCarloFlights = 0;
+unsigned int monteCarloSeed = 1;
+// Controls written here as a script while flying, set with -record. Only
+// written on the simulation thread, with the controls of the last step
+const char *recordFileName = NULL;
+FILE *recordFile = NULL;
+FlightControls recordControls;
+
+// Cube corners, also the directions looked up in the cube map
+const GLfloat skyboxCorners[8][3] = {
+	{-1.0f, -1.0f, -1.0f}, {1.0f, -1.0f, -1.0f}, {1.0f, 1.0f, -1.0f}, {-1.0f, 1.0f, -1.0f},
+	{-1.0f, -1.0f, 1.0f}, {1.0f, -1.0f, 1.0f}, {1.0f, 1.0f, 1.0f}, {-1.0f, 1.0f, 1.0f}
+};
+// Corners of each face, in the same order as the cube map faces
+const int skyboxFaceCorners[6][4] = {
+	{1, 2, 6, 5}, {4, 7, 3, 0}, {3, 7, 6, 2}, {0, 1, 5, 4}, {5, 6, 7, 4}, {0, 3, 2, 1}
+};
+
+// Skybox program for the shader path and its uniform locations
+GLuint skyboxProgram = 0;
+GLint skyboxModelViewLocation;
+GLint skyboxTintLocation;
+Mesh skyboxMesh;
+GpuMesh skyboxGpuMesh;
+
+// Occlusion query counting the pixels the sky shades
+GLuint skyQuery = 0;
+// Query waiting on a result, a new one is not started until it is read
+GLint isSkyQueryPending = 0;
+GLint isSkyQueryActive = 0;
+// Sky vertices sent this frame
+int frameSkyVertices = 0;
+// Totals since the last report
+double reportSkyVertices = 0.0;
+double reportSkyPixels = 0.0;
+int reportSkyPixelFrames = 0;
+
 /* Set up image stuff for loading in PPM */
 
 // Image sizes for sea and sky
@@ -187,42 +969,312 @@ GLubyte *imageDataSea;
 GLubyte *imageDataSky;
 GLubyte *imageDataMountain;
 
+/* Texture streaming */
+
+// Pixel buffer objects used to stream texture uploads
+GLuint texturePBO[2];
+// Which pixel buffer object gets the next upload
+GLint texturePBOIndex = 0;
+// If pixel buffer objects can be used for uploads
+GLint isPBOUpload = 0;
+
+/* Software renderer */
+
+// Render with the software renderer without a window, set with -software
+GLint isSoftwareRun = 0;
+// Frames to render for each thread count
+int softwareFrames = 100;
+// Size of the software frames
+int softwareWidth = 640;
+int softwareHeight = 640;
+// Image file to save the last frame to, NULL for none
+const char *softwareImageName = NULL;
+
+// Textures for the software renderer, they use the CPU image data
+SoftTexture seaSoftTexture;
+SoftTexture skySoftTexture;
+SoftTexture mountainSoftTexture;
+
+// Draws handed to the software renderer each frame
+SoftDraw *softwareDraws;
+
+/* Memory report */
+
+// Estimated bytes each texture takes on the card, with its mipmaps
+size_t seaTextureBytes = 0;
+size_t skyTextureBytes = 0;
+size_t mountainTextureBytes = 0;
+size_t skyboxTextureBytes = 0;
+size_t propImpostorTextureBytes = 0;
+// Bytes given to vertex, index and uniform buffers
+size_t gpuBufferBytes = 0;
+// Bytes last given to each texture streaming pixel buffer
+size_t gpuPixelBufferBytes[2] = {0, 0};
+// Estimated bytes of the offscreen framebuffer's color and depth
+size_t gpuFramebufferBytes = 0;
+// Calls recorded into display lists
+int displayListCallCount = 0;
+// GLU quadric objects made so far
+int quadricCount = 0;
+
+/* Simulation thread */
+
+// Thread stepping the simulation and the flag that stops it
+HANDLE simulationThread = NULL;
+volatile LONG isSimulationStopping = 0;
+// Steps taken so far
+unsigned long simulationStep = 0;
+
+// Snapshots passed from the simulation to the renderer
+SimSnapshot simSnapshots[3];
+TripleBuffer snapshotBuffer;
+// Snapshot being drawn this frame
+SimSnapshot *renderSnapshot;
+
+/* Occlusion culling */
+
+// Cull mountains hidden behind nearer ones, toggled with o
+GLint isOcclusionCulling = 1;
+// Only used by the culling thread once it starts
+OcclusionBuffer *occlusionBuffer = NULL;
+// Thread culling each snapshot between the simulation and the renderer
+HANDLE cullingThread = NULL;
+volatile LONG isCullingStopping = 0;
+// Set when the simulation publishes a snapshot
+HANDLE snapshotEvent = NULL;
+// Culled snapshots passed from the culling thread to the renderer
+SimSnapshot culledSnapshots[3];
+TripleBuffer culledBuffer;
+// Settings passed from the main thread to the culling thread
+CullSettings cullSettings[3];
+TripleBuffer cullSettingsBuffer;
+// Mountains nearest first and their distances, one for each mountain
+int *cullOrder;
+float *cullDistances;
+// Totals since the last report
+int reportCullFrames = 0;
+double reportCullMountains = 0.0;
+double reportCullOccluded = 0.0;
+double reportCullOutside = 0.0;
+double reportCullOccluders = 0.0;
+double reportCullTime = 0.0;
+
+/* Asset hot reload */
+
+// Watches the asset folder while the window is open
+AssetWatcher *assetWatcher = NULL;
+// Newest read of each asset not swapped in yet. The watcher thread
+// replaces them and the renderer takes them, both with an interlocked swap
+AssetReload * volatile pendingReloads[ASSET_COUNT];
+
+/* Lazy asset loading */
+
+// Where each asset is, only changed by the renderer. The models are read
+// before the window opens, the textures when they are first drawn
+GLint assetStates[ASSET_COUNT] = {ASSET_STATE_READY, ASSET_STATE_READY, ASSET_STATE_NOT_LOADED, ASSET_STATE_NOT_LOADED, ASSET_STATE_NOT_LOADED};
+// Thread reading each texture on its first use, NULL once it is waited on
+HANDLE assetLoadThreads[ASSET_COUNT];
+// When each texture was first asked for
+double assetRequestTimes[ASSET_COUNT];
+
+/* Asset pack */
+
+// Pack the models and images are used from where it was found. Meshes and
+// images from it point into the mapping, which stays open until the end
+AssetPack assetPack;
+GLint isAssetPackOpen = 0;
+// Read the loose files even if there is a pack, set with -loose
+GLint isLooseAssets = 0;
+// Write the pack from the loose files and quit, set with -pack
+GLint isPackRun = 0;
+// When the program started, for the time to the first presented frame
+double programStartTime = 0.0;
+GLint isFirstFrameDrawn = 0;
+
 
 // Function name list
 
 // Setup stuff
+void loadSceneConfig(const char *fileName);
+void setUpSceneStorage();
 void setUpMountains();
 void setUpTexture();
 void loadSea();
 void loadSky();
 void loadMountain();
+void setUpTextureStreaming();
+void streamTexture(GLuint textureID, int width, int height, GLubyte *imageData);
 void lightingSetUp();
 void setUpProp();
+void setUpPropImpostor();
+int bakePropImpostor(GLubyte *pixels);
 void setUpPlane();
+GLuint compileModelList(Mesh *mesh, int isSpecularSet, int *listCalls);
 void setUpFrameReferenceGrid();
+void setUpMaterials();
+int planeMaterialIndex(int objectCount);
+int propMaterialIndex(int objectCount);
+void setUpShaderPath();
+GLuint compileShader(GLenum type, const char *source);
+void uploadMesh(GpuMesh *gpuMesh, Mesh *mesh);
+void buildSceneMeshes();
+void freeSceneMeshes();
+void setUpSkybox();
+void setUpSkyboxShader(const char *uniformBlocks);
+int makeSkyboxFaces(unsigned char **faces, const GLubyte *pixels, int width, int height);
+void uploadSkyboxFaces(unsigned char **faces, int size);
+void releasePixelBuffers();
+void deleteGpuMesh(GpuMesh *gpuMesh);
+void setUpSceneLights(int count);
+void setUpLightClusters();
+void setUpParticleShader(const char *uniformBlocks);
+void setUpParticles();
 
 // Move objects
-void planeTricks();
-void moveAllPlane();
+void buildObjectTransforms(GLfloat (*matrices)[16]);
+void applyPlaneRoll(Transform *plane, int isRolling, int isCrazyRolling, GLfloat height, GLfloat amount);
+void finishPlaneTransforms(Transform *plane, GLfloat spin, GLfloat (*matrices)[16]);
+void buildRemoteTransforms(const NetPlane *remote, GLfloat (*matrices)[16]);
+void stepSimulation();
+void positionScene();
+void publishSnapshot();
+void fillSnapshot(SimSnapshot *snapshot);
+void fillSnapshotWorld(SimSnapshot *snapshot);
+void copySnapshot(SimSnapshot *destination, const SimSnapshot *source);
+void startSimulationThread();
+void stopSimulationThread();
+DWORD WINAPI simulationThreadMain(LPVOID parameter);
+
+// World streaming
+void startWorld(int loaderCount);
+void updateWorld();
+void getWorldPosition(double *position);
+void rebaseRenderState(const int *origin);
+void buildTerrainMeshes(const SimSnapshot *snapshot);
+void addTerrainCell(Mesh *mesh, int corner, int width);
+void drawMeshArrays(Mesh *mesh);
+void drawTerrain();
+void placeSceneLight(const GLfloat *camera, GLfloat *position);
+void runGroundBenchmark();
+
+// Occlusion culling
+void cullMountains(SimSnapshot *snapshot, const CullSettings *settings);
+void fillCullSettings(CullSettings *settings);
+void publishCullSettings();
+void startCullingThread();
+void stopCullingThread();
+DWORD WINAPI cullingThreadMain(LPVOID parameter);
+
+// Asset hot reload
+void startAssetWatcher();
+void stopAssetWatcher();
+void assetChanged(const char *fileName, double changeTime, void *context);
+AssetReload *readAssetReload(int asset, const char *fileName, double changeTime);
+void freeAssetReload(AssetReload *reload);
+void applyAssetReloads();
+void swapModel(AssetReload *reload, Mesh *mesh, Mesh *lowMesh, Arena *arena, GpuMesh *gpuMesh, GpuMesh *lowGpuMesh);
+const char *assetFileName(int asset);
+
+// Lazy asset loading
+void requestAsset(int asset);
+DWORD WINAPI assetLoadThreadMain(LPVOID parameter);
+int readSkyboxFaces(AssetReload *reload);
+void waitForAssetLoads();
+
+// Asset pack
+void openAssetPack();
+void writeAssetPack();
+int loadPackImage(const char *fileName, GLubyte **pixels, int *width, int *height);
+int loadPackModel(const char *fileName, Mesh *mesh, Mesh *lowMesh);
+void loadModel(const char *fileName, Mesh *mesh, Mesh *lowMesh, MeshMaterialFunction materialForObject, int lowDetailCells);
 
 // Drawing functions
 void drawPlane();
+void drawRemotePlanes();
 void drawSkyAndSea();
 void drawFrameReferenceGrid();
 void enableFog();
 void drawProps();
+int isPropImpostorUsed();
+void drawPropImpostors();
+void drawModel(GLuint displayList, int listCalls, Mesh *mesh, GpuMesh *gpuMesh, int object);
+void drawGpuMesh(GpuMesh *gpuMesh, int material, GLuint textureID, int useFog);
+void drawGpuMeshObject(GpuMesh *gpuMesh, int object, int material, GLuint textureID, int useFog);
+void setUpFrameUniformRing();
+void updateFrameUniforms();
+void writeFrameUniforms(const FrameUniforms *frameUniforms);
+void fenceFrameUniforms();
+void drawSkyAndSeaShaderPath();
+void drawFrameReferenceGridShaderPath();
+int quadricDriverCalls(int slices, int stacks);
+void drawSkybox();
+void drawSkyboxShaderPath();
+void beginSkyQuery();
+void endSkyQuery();
+void readSkyQuery();
+
+// Frame capture
+void startCapture();
+void readCaptureFrame();
+void collectCaptureFrames(int isFinishing);
+void finishCapture();
+
+// Clustered lights
+void updateLightClusters();
+void stepSceneLights();
+void runLightBenchmark();
+
+// Particles
+void updateParticles(double frameTime);
+void drawParticles();
+void runParticleBenchmark();
+
+// Multiplayer
+void updateNetwork();
+void runRelay();
+void runNetBenchmark();
+
+// Telemetry
+void publishTelemetry(double stepStartTime);
+
+// Batch flights
+void runHeadless();
+void runMonteCarlo();
 
 // Keyboard and mouse listeners
 void normalKeys(unsigned char key, int x, int y);
 void specialKeys(int key, int x, int y);
 void specialKeysReleased(int key, int x, int y);
 void mousePosition(int x, int y);
+void publishControls();
+
+// Quality governor
+void updateQualityGovernor(double frameTime);
+void printQualityLevel(const char *reason);
+int isMountainInRange(const WorldMountain *mountain, const GLfloat *camera);
+void setUpSceneFramebuffer();
+void beginSceneFramebuffer();
+void endSceneFramebuffer();
 
 // Other
 void printOutControls();
 void myResize(int newWidth, int newHeight);
 void fullScreen();
 void wireRenderingCheck();
+SIZE_T getResidentSetSize();
+void printStartupReport();
+void printSceneReport();
+void printArenaReport(const Arena *arena);
+void printMemoryReport();
+size_t estimateTextureBytes(GLenum target, int isMipmapped);
+double getTime();
+void updateFrameReport();
+
+// Software renderer
+void parseCommandLine(int argc, char **argv);
+void runSoftwareRenderer();
+void setSoftwareDraw(SoftDraw *draw, Mesh *mesh, float *modelView, int material, SoftTexture *texture, int useFog, int lineWidth);
+int buildSoftwareScene(SoftFrame *frame, SoftDraw *draws, const SimSnapshot *snapshot);
 
 // Main functions
 void init(void);
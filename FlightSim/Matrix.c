@@ -0,0 +1,350 @@
+
+/************************************************************************************
+
+	File: 			Matrix.c
+
+	Description:	4x4 matrix functions for building transforms on the CPU.
+					Matrices are column major like OpenGL, element row r and
+					column c is at matrix[c*4 + r], so they can be handed
+					straight to glLoadMatrixf or glUniformMatrix4fv. The
+					translate, rotate and scale functions multiply onto the
+					right like their gl counterparts do to the current matrix.
+					Multiplies use SSE when the compiler targets it, one
+					column of the result at a time.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for matrix functions
+#include "Matrix.h"
+// Math header
+#include <math.h>
+// memcpy
+#include <string.h>
+
+// x64 always has SSE, x86 has it with /arch:SSE or better
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#define MATRIX_SSE
+// SSE intrinsics
+#include <xmmintrin.h>
+#endif
+
+// Conversion multiplier from degrees to radians
+#define MATRIX_DEG_TO_RAD 0.0174532925f
+
+/************************************************************************
+
+	Function:		matrixIdentity
+
+	Description:	Sets a matrix to the identity.
+
+*************************************************************************/
+void matrixIdentity(float *matrix) {
+	int i = 0;
+
+	for(i = 0; i < 16; i++) {
+		matrix[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+	}
+}
+
+/************************************************************************
+
+	Function:		matrixCopy
+
+	Description:	Copies a matrix.
+
+*************************************************************************/
+void matrixCopy(float *result, const float *matrix) {
+	memcpy(result, matrix, 16 * sizeof(float));
+}
+
+/************************************************************************
+
+	Function:		matrixMultiply
+
+	Description:	Sets result to left times right. Result can be the same
+					as either input.
+
+*************************************************************************/
+void matrixMultiply(float *result, const float *left, const float *right) {
+	float product[16];
+
+	matrixMultiplyArray(product, left, right, 1);
+	matrixCopy(result, product);
+}
+
+/************************************************************************
+
+	Function:		matrixMultiplyArray
+
+	Description:	Sets each of count matrices in results to left times the
+					matching matrix in rights, like turning an array of
+					model matrices into model view matrices. Left is only
+					loaded once. Results must not overlap the inputs.
+
+*************************************************************************/
+void matrixMultiplyArray(float *results, const float *left, const float *rights, int count) {
+#ifdef MATRIX_SSE
+	// Columns of left, each result column is a sum of them
+	__m128 leftColumns[4];
+	__m128 sum;
+#else
+	int row = 0;
+#endif
+	const float *right;
+	float *result;
+	int column = 0;
+	int i = 0;
+
+#ifdef MATRIX_SSE
+	for(column = 0; column < 4; column++) {
+		leftColumns[column] = _mm_loadu_ps(&left[column*4]);
+	}
+#endif
+
+	for(i = 0; i < count; i++) {
+		right = &rights[i*16];
+		result = &results[i*16];
+		for(column = 0; column < 4; column++) {
+#ifdef MATRIX_SSE
+			sum = _mm_mul_ps(leftColumns[0], _mm_set1_ps(right[column*4]));
+			sum = _mm_add_ps(sum, _mm_mul_ps(leftColumns[1], _mm_set1_ps(right[column*4 + 1])));
+			sum = _mm_add_ps(sum, _mm_mul_ps(leftColumns[2], _mm_set1_ps(right[column*4 + 2])));
+			sum = _mm_add_ps(sum, _mm_mul_ps(leftColumns[3], _mm_set1_ps(right[column*4 + 3])));
+			_mm_storeu_ps(&result[column*4], sum);
+#else
+			for(row = 0; row < 4; row++) {
+				result[column*4 + row] = left[row] * right[column*4]
+					+ left[4 + row] * right[column*4 + 1]
+					+ left[8 + row] * right[column*4 + 2]
+					+ left[12 + row] * right[column*4 + 3];
+			}
+#endif
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		matrixTranslate
+
+	Description:	Multiplies a translation onto the matrix like glTranslatef.
+
+*************************************************************************/
+void matrixTranslate(float *matrix, float x, float y, float z) {
+	int row = 0;
+
+	// Only the last column changes
+	for(row = 0; row < 4; row++) {
+		matrix[12 + row] += matrix[row] * x + matrix[4 + row] * y + matrix[8 + row] * z;
+	}
+}
+
+/************************************************************************
+
+	Function:		matrixRotate
+
+	Description:	Multiplies a rotation of angle degrees around an axis
+					onto the matrix like glRotatef.
+
+*************************************************************************/
+void matrixRotate(float *matrix, float angle, float x, float y, float z) {
+	float rotation[16];
+	float length = (float)sqrt(x * x + y * y + z * z);
+	float c = (float)cos(angle * MATRIX_DEG_TO_RAD);
+	float s = (float)sin(angle * MATRIX_DEG_TO_RAD);
+	float t = 1.0f - c;
+
+	if(length == 0.0f) {
+		return;
+	}
+	x /= length;
+	y /= length;
+	z /= length;
+
+	// Rotation about an axis, same as the glRotate man page
+	rotation[0] = x * x * t + c;
+	rotation[1] = y * x * t + z * s;
+	rotation[2] = x * z * t - y * s;
+	rotation[3] = 0.0f;
+	rotation[4] = x * y * t - z * s;
+	rotation[5] = y * y * t + c;
+	rotation[6] = y * z * t + x * s;
+	rotation[7] = 0.0f;
+	rotation[8] = x * z * t + y * s;
+	rotation[9] = y * z * t - x * s;
+	rotation[10] = z * z * t + c;
+	rotation[11] = 0.0f;
+	rotation[12] = 0.0f;
+	rotation[13] = 0.0f;
+	rotation[14] = 0.0f;
+	rotation[15] = 1.0f;
+
+	matrixMultiply(matrix, matrix, rotation);
+}
+
+/************************************************************************
+
+	Function:		matrixScale
+
+	Description:	Multiplies a scale onto the matrix like glScalef.
+
+*************************************************************************/
+void matrixScale(float *matrix, float x, float y, float z) {
+	int row = 0;
+
+	for(row = 0; row < 4; row++) {
+		matrix[row] *= x;
+		matrix[4 + row] *= y;
+		matrix[8 + row] *= z;
+	}
+}
+
+/************************************************************************
+
+	Function:		matrixLookAt
+
+	Description:	Multiplies a camera looking from eye to center onto the
+					matrix like gluLookAt.
+
+*************************************************************************/
+void matrixLookAt(float *matrix, const float *eye, const float *center, const float *up) {
+	float forward[3];
+	float side[3];
+	float newUp[3];
+	float view[16];
+	float length = 0.0f;
+	int i = 0;
+
+	// Direction we are looking
+	for(i = 0; i < 3; i++) {
+		forward[i] = center[i] - eye[i];
+	}
+	length = (float)sqrt(forward[0] * forward[0] + forward[1] * forward[1] + forward[2] * forward[2]);
+	if(length > 0.0f) {
+		for(i = 0; i < 3; i++) {
+			forward[i] /= length;
+		}
+	}
+
+	// Side is forward cross up
+	side[0] = forward[1] * up[2] - forward[2] * up[1];
+	side[1] = forward[2] * up[0] - forward[0] * up[2];
+	side[2] = forward[0] * up[1] - forward[1] * up[0];
+	length = (float)sqrt(side[0] * side[0] + side[1] * side[1] + side[2] * side[2]);
+	if(length > 0.0f) {
+		for(i = 0; i < 3; i++) {
+			side[i] /= length;
+		}
+	}
+
+	// Recompute up as side cross forward
+	newUp[0] = side[1] * forward[2] - side[2] * forward[1];
+	newUp[1] = side[2] * forward[0] - side[0] * forward[2];
+	newUp[2] = side[0] * forward[1] - side[1] * forward[0];
+
+	// Rows are side, up and backwards
+	matrixIdentity(view);
+	for(i = 0; i < 3; i++) {
+		view[i*4] = side[i];
+		view[i*4 + 1] = newUp[i];
+		view[i*4 + 2] = -forward[i];
+	}
+
+	matrixMultiply(matrix, matrix, view);
+	matrixTranslate(matrix, -eye[0], -eye[1], -eye[2]);
+}
+
+/************************************************************************
+
+	Function:		matrixPerspective
+
+	Description:	Sets a perspective projection like gluPerspective.
+
+*************************************************************************/
+void matrixPerspective(float *matrix, float fovy, float aspect, float zNear, float zFar) {
+	float f = 1.0f / (float)tan(fovy * MATRIX_DEG_TO_RAD / 2.0f);
+
+	matrixIdentity(matrix);
+	matrix[0] = f / aspect;
+	matrix[5] = f;
+	matrix[10] = (zFar + zNear) / (zNear - zFar);
+	matrix[11] = -1.0f;
+	matrix[14] = 2.0f * zFar * zNear / (zNear - zFar);
+	matrix[15] = 0.0f;
+}
+
+/************************************************************************
+
+	Function:		matrixOrtho
+
+	Description:	Sets a parallel projection like glOrtho.
+
+*************************************************************************/
+void matrixOrtho(float *matrix, float left, float right, float bottom, float top, float zNear, float zFar) {
+	matrixIdentity(matrix);
+	matrix[0] = 2.0f / (right - left);
+	matrix[5] = 2.0f / (top - bottom);
+	matrix[10] = -2.0f / (zFar - zNear);
+	matrix[12] = -(right + left) / (right - left);
+	matrix[13] = -(top + bottom) / (top - bottom);
+	matrix[14] = -(zFar + zNear) / (zFar - zNear);
+}
+
+/************************************************************************
+
+	Function:		matrixTransform
+
+	Description:	Multiplies a 4 component vector by the matrix.
+
+*************************************************************************/
+void matrixTransform(const float *matrix, const float *vector, float *result) {
+	float transformed[4];
+	int row = 0;
+
+	for(row = 0; row < 4; row++) {
+		transformed[row] = matrix[row] * vector[0] + matrix[4 + row] * vector[1] + matrix[8 + row] * vector[2] + matrix[12 + row] * vector[3];
+	}
+
+	memcpy(result, transformed, sizeof(transformed));
+}
+
+/************************************************************************
+
+	Function:		matrixNormal
+
+	Description:	Works out the inverse transpose of the top left 3x3 of a
+					modelview matrix as a column major 3x3, the same matrix
+					fixed function uses to move normals into eye space.
+
+*************************************************************************/
+void matrixNormal(const float *matrix, float *normalMatrix) {
+	// Cofactors of the 3x3, row then column
+	float cofactor[3][3];
+	float determinant;
+	int row = 0;
+	int column = 0;
+
+	cofactor[0][0] = matrix[5] * matrix[10] - matrix[9] * matrix[6];
+	cofactor[0][1] = -(matrix[1] * matrix[10] - matrix[9] * matrix[2]);
+	cofactor[0][2] = matrix[1] * matrix[6] - matrix[5] * matrix[2];
+	cofactor[1][0] = -(matrix[4] * matrix[10] - matrix[8] * matrix[6]);
+	cofactor[1][1] = matrix[0] * matrix[10] - matrix[8] * matrix[2];
+	cofactor[1][2] = -(matrix[0] * matrix[6] - matrix[4] * matrix[2]);
+	cofactor[2][0] = matrix[4] * matrix[9] - matrix[8] * matrix[5];
+	cofactor[2][1] = -(matrix[0] * matrix[9] - matrix[8] * matrix[1]);
+	cofactor[2][2] = matrix[0] * matrix[5] - matrix[4] * matrix[1];
+
+	determinant = matrix[0] * cofactor[0][0] + matrix[4] * cofactor[0][1] + matrix[8] * cofactor[0][2];
+	if(determinant == 0.0f) {
+		determinant = 1.0f;
+	}
+
+	// The transpose of the inverse is the cofactor matrix over the determinant
+	for(row = 0; row < 3; row++) {
+		for(column = 0; column < 3; column++) {
+			normalMatrix[column*3 + row] = cofactor[row][column] / determinant;
+		}
+	}
+}
@@ -0,0 +1,33 @@
+/*
+ * Matrix.h
+ * Mike Northorp
+ * 4x4 column major matrices built on the CPU the same way the GL matrix
+ * stack builds them. Does not depend on OpenGL so it works without a window.
+ */
+
+#ifndef MATRIX_H_
+#define MATRIX_H_
+
+/* Function list */
+
+// Setting and combining
+void matrixIdentity(float *matrix);
+void matrixCopy(float *result, const float *matrix);
+void matrixMultiply(float *result, const float *left, const float *right);
+void matrixMultiplyArray(float *results, const float *left, const float *rights, int count);
+
+// Multiply onto the right like glTranslatef, glRotatef and glScalef
+void matrixTranslate(float *matrix, float x, float y, float z);
+void matrixRotate(float *matrix, float angle, float x, float y, float z);
+void matrixScale(float *matrix, float x, float y, float z);
+
+// Camera matrices like gluLookAt, gluPerspective and glOrtho
+void matrixLookAt(float *matrix, const float *eye, const float *center, const float *up);
+void matrixPerspective(float *matrix, float fovy, float aspect, float zNear, float zFar);
+void matrixOrtho(float *matrix, float left, float right, float bottom, float top, float zNear, float zFar);
+
+// Using a matrix
+void matrixTransform(const float *matrix, const float *vector, float *result);
+void matrixNormal(const float *matrix, float *normalMatrix);
+
+#endif /* MATRIX_H_ */
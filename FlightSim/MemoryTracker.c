@@ -0,0 +1,182 @@
+
+/************************************************************************************
+
+	File: 			MemoryTracker.c
+
+	Description:	Tracked heap allocation. Each allocation has a small header
+					in front holding its size and category, so frees and
+					reallocs can take the bytes back off the right counter.
+					The counters are interlocked so any thread can allocate.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for memory tracking functions
+#include "MemoryTracker.h"
+// Interlocked functions
+#include <windows.h>
+// Memory allocation
+#include <stdlib.h>
+// memset
+#include <string.h>
+
+// Bytes in front of each allocation, a multiple of 16 so the alignment
+// malloc gives is kept
+#define MEMORY_HEADER_SIZE 16
+
+// Size and category of an allocation, stored in front of it
+typedef struct {
+	size_t size;
+	int category;
+} MemoryHeader;
+
+// Bytes, most bytes and allocations held by each category
+static volatile LONG memoryBytes[MEMORY_CATEGORIES];
+static volatile LONG memoryPeakBytes[MEMORY_CATEGORIES];
+static volatile LONG memoryAllocations[MEMORY_CATEGORIES];
+
+// Names shown in the memory report
+static const char *memoryNames[MEMORY_CATEGORIES] = {
+	"Arenas",
+	"Meshes",
+	"Software renderer",
+	"Thread pool",
+	"Occlusion culling",
+	"Skybox",
+	"Asset reloads",
+	"Clustered lights",
+	"Particles",
+	"Network",
+	"Flights",
+	"Frame capture",
+	"World tiles"
+};
+
+/************************************************************************
+
+	Function:		memoryCount
+
+	Description:	Adds bytes and allocations to a category, either can be
+					negative, and raises its peak.
+
+*************************************************************************/
+static void memoryCount(int category, LONG bytes, LONG allocations) {
+	LONG total = InterlockedExchangeAdd(&memoryBytes[category], bytes) + bytes;
+	LONG peak = memoryPeakBytes[category];
+	LONG seen;
+
+	InterlockedExchangeAdd(&memoryAllocations[category], allocations);
+
+	// Another thread may raise the peak at the same time
+	while(total > peak) {
+		seen = InterlockedCompareExchange(&memoryPeakBytes[category], total, peak);
+		if(seen == peak) {
+			break;
+		}
+		peak = seen;
+	}
+}
+
+/************************************************************************
+
+	Function:		memoryAlloc
+
+	Description:	Allocates size bytes counted against a category. Returns
+					NULL if memory runs out, like malloc.
+
+*************************************************************************/
+void *memoryAlloc(int category, size_t size) {
+	MemoryHeader *header = (MemoryHeader*)malloc(MEMORY_HEADER_SIZE + size);
+
+	if(header == NULL) {
+		return NULL;
+	}
+
+	header->size = size;
+	header->category = category;
+	memoryCount(category, (LONG)size, 1);
+
+	return (char*)header + MEMORY_HEADER_SIZE;
+}
+
+/************************************************************************
+
+	Function:		memoryAllocZeroed
+
+	Description:	Allocates size bytes set to zero, like calloc.
+
+*************************************************************************/
+void *memoryAllocZeroed(int category, size_t size) {
+	void *memory = memoryAlloc(category, size);
+
+	if(memory != NULL) {
+		memset(memory, 0, size);
+	}
+	return memory;
+}
+
+/************************************************************************
+
+	Function:		memoryRealloc
+
+	Description:	Resizes an allocation, like realloc. A NULL allocation is
+					made new in the category, otherwise it stays in the one it
+					was made in. Returns NULL and leaves the old allocation
+					alone if memory runs out.
+
+*************************************************************************/
+void *memoryRealloc(int category, void *memory, size_t size) {
+	MemoryHeader *header;
+	size_t oldSize;
+
+	if(memory == NULL) {
+		return memoryAlloc(category, size);
+	}
+
+	header = (MemoryHeader*)((char*)memory - MEMORY_HEADER_SIZE);
+	oldSize = header->size;
+	header = (MemoryHeader*)realloc(header, MEMORY_HEADER_SIZE + size);
+	if(header == NULL) {
+		return NULL;
+	}
+
+	header->size = size;
+	memoryCount(header->category, (LONG)size - (LONG)oldSize, 0);
+
+	return (char*)header + MEMORY_HEADER_SIZE;
+}
+
+/************************************************************************
+
+	Function:		memoryFree
+
+	Description:	Frees an allocation made by memoryAlloc and takes it off
+					its category. NULL is ignored.
+
+*************************************************************************/
+void memoryFree(void *memory) {
+	MemoryHeader *header;
+
+	if(memory == NULL) {
+		return;
+	}
+
+	header = (MemoryHeader*)((char*)memory - MEMORY_HEADER_SIZE);
+	memoryCount(header->category, -(LONG)header->size, -1);
+	free(header);
+}
+
+/************************************************************************
+
+	Function:		memoryGetStats
+
+	Description:	Fills in what a category holds right now.
+
+*************************************************************************/
+void memoryGetStats(int category, MemoryStats *stats) {
+	stats->name = memoryNames[category];
+	stats->bytes = (size_t)memoryBytes[category];
+	stats->peakBytes = (size_t)memoryPeakBytes[category];
+	stats->allocations = (int)memoryAllocations[category];
+}
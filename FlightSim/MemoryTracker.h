@@ -0,0 +1,52 @@
+/*
+ * MemoryTracker.h
+ * Mike Northorp
+ * Tracked heap allocation. Every allocation is counted against the part of
+ * the program that made it so the memory report can show where the memory
+ * goes. Safe to use from any thread.
+ */
+
+#ifndef MEMORYTRACKER_H_
+#define MEMORYTRACKER_H_
+
+// size_t
+#include <stddef.h>
+
+/* Defines */
+
+// Parts of the program memory is counted against
+#define MEMORY_ARENAS 0
+#define MEMORY_MESHES 1
+#define MEMORY_SOFT_RASTER 2
+#define MEMORY_THREAD_POOL 3
+#define MEMORY_OCCLUSION 4
+#define MEMORY_SKYBOX 5
+#define MEMORY_ASSETS 6
+#define MEMORY_LIGHTS 7
+#define MEMORY_PARTICLES 8
+#define MEMORY_NETWORK 9
+#define MEMORY_FLIGHT 10
+#define MEMORY_CAPTURE 11
+#define MEMORY_WORLD 12
+#define MEMORY_CATEGORIES 13
+
+/* Typedefs and structs */
+
+// What one part of the program holds
+typedef struct {
+	const char *name;
+	size_t bytes;
+	size_t peakBytes;
+	// Allocations not freed yet
+	int allocations;
+} MemoryStats;
+
+/* Function list */
+
+void *memoryAlloc(int category, size_t size);
+void *memoryAllocZeroed(int category, size_t size);
+void *memoryRealloc(int category, void *memory, size_t size);
+void memoryFree(void *memory);
+void memoryGetStats(int category, MemoryStats *stats);
+
+#endif /* MEMORYTRACKER_H_ */
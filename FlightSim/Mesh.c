@@ -0,0 +1,699 @@
+
+/************************************************************************************
+
+	File: 			Mesh.c
+
+	Description:	Builds indexed triangle meshes on the CPU. Polygons are split
+					into triangle fans for solid drawing and their outlines are
+					kept as an edge list so wireframe drawing matches glPolygonMode
+					on the original polygons. The cylinder, disk and sphere builders
+					lay out vertices, normals and texture coordinates the same way
+					as gluCylinder, gluDisk and glutSolidSphere. Model files
+					(plane.txt, prop.txt) are read in here too so they can be
+					loaded without a GL context. A mesh set up with an arena
+					takes its arrays from it and they go when the arena is
+					reset.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for mesh types and functions
+#include "Mesh.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+// Math header
+#include <math.h>
+// File read in
+#include <stdio.h>
+// memcpy
+#include <string.h>
+
+// Two times PI for going around a circle
+#define MESH_TWO_PI 6.28318531f
+
+/************************************************************************
+
+	Function:		meshResize
+
+	Description:	Gives an array room for newCapacity elements, from the
+					arena if there is one or else the heap. Exits if memory
+					runs out.
+
+*************************************************************************/
+static void *meshResize(Arena *arena, void *array, int *capacity, int newCapacity, size_t elementSize) {
+	if(arena != NULL) {
+		array = arenaGrow(arena, array, *capacity * elementSize, newCapacity * elementSize);
+	} else {
+		array = memoryRealloc(MEMORY_MESHES, array, newCapacity * elementSize);
+		if(array == NULL) {
+			exit(1);
+		}
+	}
+
+	*capacity = newCapacity;
+	return array;
+}
+
+/************************************************************************
+
+	Function:		meshGrow
+
+	Description:	Makes sure an array has room for the needed number of
+					elements, doubling its capacity when it runs out.
+
+*************************************************************************/
+static void *meshGrow(Arena *arena, void *array, int *capacity, int needed, size_t elementSize) {
+	// New capacity to grow to
+	int newCapacity = *capacity;
+
+	// Already enough room
+	if(needed <= *capacity) {
+		return array;
+	}
+
+	// Start with a small array and double it until it fits
+	if(newCapacity < 64) {
+		newCapacity = 64;
+	}
+	while(newCapacity < needed) {
+		newCapacity *= 2;
+	}
+
+	return meshResize(arena, array, capacity, newCapacity, elementSize);
+}
+
+/************************************************************************
+
+	Function:		meshInit
+
+	Description:	Sets up an empty mesh that keeps its arrays on the heap.
+
+*************************************************************************/
+void meshInit(Mesh *mesh) {
+	meshInitArena(mesh, NULL);
+}
+
+/************************************************************************
+
+	Function:		meshInitArena
+
+	Description:	Sets up an empty mesh that takes its arrays from an
+					arena, or the heap if it is NULL.
+
+*************************************************************************/
+void meshInitArena(Mesh *mesh, Arena *arena) {
+	mesh->vertices = NULL;
+	mesh->vertexCount = 0;
+	mesh->vertexCapacity = 0;
+
+	mesh->triangleIndices = NULL;
+	mesh->triangleIndexCount = 0;
+	mesh->triangleIndexCapacity = 0;
+
+	mesh->edgeIndices = NULL;
+	mesh->edgeIndexCount = 0;
+	mesh->edgeIndexCapacity = 0;
+
+	mesh->polygons = NULL;
+	mesh->polygonCount = 0;
+	mesh->polygonCapacity = 0;
+
+	mesh->arena = arena;
+}
+
+/************************************************************************
+
+	Function:		meshReserve
+
+	Description:	Makes room for a known number of vertices, indices and
+					polygons up front so the arrays are sized exactly rather
+					than doubled as they are added.
+
+*************************************************************************/
+void meshReserve(Mesh *mesh, int vertexCount, int triangleIndexCount, int edgeIndexCount, int polygonCount) {
+	if(vertexCount > mesh->vertexCapacity) {
+		mesh->vertices = (MeshVertex*)meshResize(mesh->arena, mesh->vertices, &mesh->vertexCapacity, vertexCount, sizeof(MeshVertex));
+	}
+	if(triangleIndexCount > mesh->triangleIndexCapacity) {
+		mesh->triangleIndices = (unsigned int*)meshResize(mesh->arena, mesh->triangleIndices, &mesh->triangleIndexCapacity, triangleIndexCount, sizeof(unsigned int));
+	}
+	if(edgeIndexCount > mesh->edgeIndexCapacity) {
+		mesh->edgeIndices = (unsigned int*)meshResize(mesh->arena, mesh->edgeIndices, &mesh->edgeIndexCapacity, edgeIndexCount, sizeof(unsigned int));
+	}
+	if(polygonCount > mesh->polygonCapacity) {
+		mesh->polygons = (MeshPolygon*)meshResize(mesh->arena, mesh->polygons, &mesh->polygonCapacity, polygonCount, sizeof(MeshPolygon));
+	}
+}
+
+/************************************************************************
+
+	Function:		meshFree
+
+	Description:	Frees all the memory of a mesh and leaves it empty. Arrays
+					from an arena are left for the arena reset to take back.
+
+*************************************************************************/
+void meshFree(Mesh *mesh) {
+	if(mesh->arena == NULL) {
+		memoryFree(mesh->vertices);
+		memoryFree(mesh->triangleIndices);
+		memoryFree(mesh->edgeIndices);
+		memoryFree(mesh->polygons);
+	}
+	meshInitArena(mesh, mesh->arena);
+}
+
+/************************************************************************
+
+	Function:		meshAddVertex
+
+	Description:	Adds a vertex to the mesh and returns its index.
+
+*************************************************************************/
+int meshAddVertex(Mesh *mesh, const MeshVertex *vertex) {
+	mesh->vertices = (MeshVertex*)meshGrow(mesh->arena, mesh->vertices, &mesh->vertexCapacity, mesh->vertexCount + 1, sizeof(MeshVertex));
+	mesh->vertices[mesh->vertexCount] = *vertex;
+	return mesh->vertexCount++;
+}
+
+/************************************************************************
+
+	Function:		meshAddTriangle
+
+	Description:	Adds a triangle made of three existing vertices.
+
+*************************************************************************/
+void meshAddTriangle(Mesh *mesh, int a, int b, int c) {
+	mesh->triangleIndices = (unsigned int*)meshGrow(mesh->arena, mesh->triangleIndices, &mesh->triangleIndexCapacity, mesh->triangleIndexCount + 3, sizeof(unsigned int));
+	mesh->triangleIndices[mesh->triangleIndexCount++] = a;
+	mesh->triangleIndices[mesh->triangleIndexCount++] = b;
+	mesh->triangleIndices[mesh->triangleIndexCount++] = c;
+}
+
+/************************************************************************
+
+	Function:		meshAddEdge
+
+	Description:	Adds a wireframe edge between two existing vertices.
+
+*************************************************************************/
+void meshAddEdge(Mesh *mesh, int a, int b) {
+	mesh->edgeIndices = (unsigned int*)meshGrow(mesh->arena, mesh->edgeIndices, &mesh->edgeIndexCapacity, mesh->edgeIndexCount + 2, sizeof(unsigned int));
+	mesh->edgeIndices[mesh->edgeIndexCount++] = a;
+	mesh->edgeIndices[mesh->edgeIndexCount++] = b;
+}
+
+/************************************************************************
+
+	Function:		meshAddPolygon
+
+	Description:	Adds a convex polygon the way GL_POLYGON would draw it.
+					It is split into a triangle fan and its outline is added
+					as edges. Two corners make a single line. Each corner gets
+					the face normal from the winding (counter clockwise is
+					the front) so lines can tell which side they are on.
+
+*************************************************************************/
+void meshAddPolygon(Mesh *mesh, const MeshVertex *corners, int cornerCount) {
+	// Index of the first corner in the mesh
+	int first = 0;
+	// Face normal using Newell's method
+	float faceNormal[3] = {0.0f, 0.0f, 0.0f};
+	float length = 0.0f;
+	const float *current;
+	const float *next;
+	int i = 0;
+	int k = 0;
+
+	// Ignore anything that is not a line or polygon
+	if(cornerCount < 2 || cornerCount > MESH_MAX_POLYGON_CORNERS) {
+		return;
+	}
+
+	// Sum the cross products around the outline, lines are left at 0
+	if(cornerCount > 2) {
+		for(i = 0; i < cornerCount; i++) {
+			current = corners[i].position;
+			next = corners[(i + 1) % cornerCount].position;
+			faceNormal[0] += (current[1] - next[1]) * (current[2] + next[2]);
+			faceNormal[1] += (current[2] - next[2]) * (current[0] + next[0]);
+			faceNormal[2] += (current[0] - next[0]) * (current[1] + next[1]);
+		}
+		length = (float)sqrt(faceNormal[0] * faceNormal[0] + faceNormal[1] * faceNormal[1] + faceNormal[2] * faceNormal[2]);
+		if(length > 0.0f) {
+			for(k = 0; k < 3; k++) {
+				faceNormal[k] /= length;
+			}
+		}
+	}
+
+	// Add all the corners
+	for(i = 0; i < cornerCount; i++) {
+		k = meshAddVertex(mesh, &corners[i]);
+		mesh->vertices[k].faceNormal[0] = faceNormal[0];
+		mesh->vertices[k].faceNormal[1] = faceNormal[1];
+		mesh->vertices[k].faceNormal[2] = faceNormal[2];
+		if(i == 0) {
+			first = k;
+		}
+	}
+
+	// Remember the polygon itself
+	mesh->polygons = (MeshPolygon*)meshGrow(mesh->arena, mesh->polygons, &mesh->polygonCapacity, mesh->polygonCount + 1, sizeof(MeshPolygon));
+	mesh->polygons[mesh->polygonCount].firstVertex = first;
+	mesh->polygons[mesh->polygonCount].cornerCount = cornerCount;
+	mesh->polygonCount++;
+
+	// A line only has the one edge
+	if(cornerCount == 2) {
+		meshAddEdge(mesh, first, first + 1);
+		return;
+	}
+
+	// Fan out from the first corner
+	for(i = 1; i < cornerCount - 1; i++) {
+		meshAddTriangle(mesh, first, first + i, first + i + 1);
+	}
+
+	// Outline of the polygon
+	for(i = 0; i < cornerCount; i++) {
+		meshAddEdge(mesh, first + i, first + (i + 1) % cornerCount);
+	}
+}
+
+/************************************************************************
+
+	Function:		meshAddCylinder
+
+	Description:	Adds a cylinder along the z axis in the same layout as
+					gluCylinder with smooth normals and textures turned on.
+					A top radius of 0 makes a cone.
+
+*************************************************************************/
+void meshAddCylinder(Mesh *mesh, float baseRadius, float topRadius, float height, int slices, int stacks, float material) {
+	// Corners of each quad
+	MeshVertex quad[4];
+	// Normal is tilted in by how much the radius shrinks
+	float deltaRadius = baseRadius - topRadius;
+	float length = (float)sqrt(deltaRadius * deltaRadius + height * height);
+	float xyNormalRatio = height / length;
+	float zNormal = deltaRadius / length;
+	// Angle, heights and radii for the current quad
+	float angle[2];
+	float z[2];
+	float radius[2];
+	int i = 0;
+	int j = 0;
+	int k = 0;
+
+	// Room for every quad up front
+	meshReserve(mesh, mesh->vertexCount + slices * stacks * 4, mesh->triangleIndexCount + slices * stacks * 6,
+		mesh->edgeIndexCount + slices * stacks * 8, mesh->polygonCount + slices * stacks);
+
+	for(j = 0; j < stacks; j++) {
+		// Bottom and top of the stack
+		z[0] = j * height / stacks;
+		z[1] = (j + 1) * height / stacks;
+		radius[0] = baseRadius - deltaRadius * ((float)j / stacks);
+		radius[1] = baseRadius - deltaRadius * ((float)(j + 1) / stacks);
+
+		for(i = 0; i < slices; i++) {
+			// Left and right side of the slice
+			angle[0] = MESH_TWO_PI * i / slices;
+			angle[1] = MESH_TWO_PI * (i + 1) / slices;
+
+			// Same order a quad strip gives: bottom left, top left, top right, bottom right
+			for(k = 0; k < 4; k++) {
+				// Which side and which stack edge this corner is on
+				int side = (k == 0 || k == 1) ? 0 : 1;
+				int top = (k == 1 || k == 2) ? 1 : 0;
+
+				quad[k].position[0] = radius[top] * (float)sin(angle[side]);
+				quad[k].position[1] = radius[top] * (float)cos(angle[side]);
+				quad[k].position[2] = z[top];
+				quad[k].normal[0] = xyNormalRatio * (float)sin(angle[side]);
+				quad[k].normal[1] = xyNormalRatio * (float)cos(angle[side]);
+				quad[k].normal[2] = zNormal;
+				quad[k].texCoord[0] = 1.0f - (float)(i + side) / slices;
+				quad[k].texCoord[1] = (float)(j + top) / stacks;
+				quad[k].material = material;
+			}
+
+			meshAddPolygon(mesh, quad, 4);
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		meshAddDisk
+
+	Description:	Adds a flat disk facing +z in the same layout as gluDisk
+					with textures turned on. An inner radius of 0 closes the
+					middle with a triangle fan.
+
+*************************************************************************/
+void meshAddDisk(Mesh *mesh, float innerRadius, float outerRadius, int slices, int loops, float material) {
+	// Corners of each quad or fan triangle
+	MeshVertex quad[4];
+	float deltaRadius = outerRadius - innerRadius;
+	float angle[2];
+	float radius[2];
+	int i = 0;
+	int j = 0;
+	int k = 0;
+
+	// Room for every quad up front, the middle fan needs less
+	meshReserve(mesh, mesh->vertexCount + slices * loops * 4, mesh->triangleIndexCount + slices * loops * 6,
+		mesh->edgeIndexCount + slices * loops * 8, mesh->polygonCount + slices * loops);
+
+	for(j = 0; j < loops; j++) {
+		// Outer and inner edge of this loop
+		radius[0] = outerRadius - deltaRadius * ((float)j / loops);
+		radius[1] = outerRadius - deltaRadius * ((float)(j + 1) / loops);
+
+		for(i = 0; i < slices; i++) {
+			angle[0] = MESH_TWO_PI * i / slices;
+			angle[1] = MESH_TWO_PI * (i + 1) / slices;
+
+			for(k = 0; k < 4; k++) {
+				int side = (k == 0 || k == 1) ? 0 : 1;
+				int inner = (k == 1 || k == 2) ? 1 : 0;
+
+				quad[k].position[0] = radius[inner] * (float)sin(angle[side]);
+				quad[k].position[1] = radius[inner] * (float)cos(angle[side]);
+				quad[k].position[2] = 0.0f;
+				quad[k].normal[0] = 0.0f;
+				quad[k].normal[1] = 0.0f;
+				quad[k].normal[2] = 1.0f;
+				quad[k].texCoord[0] = radius[inner] / outerRadius / 2.0f * (float)sin(angle[side]) + 0.5f;
+				quad[k].texCoord[1] = radius[inner] / outerRadius / 2.0f * (float)cos(angle[side]) + 0.5f;
+				quad[k].material = material;
+			}
+
+			// The middle loop of a full disk is a fan so drop the doubled centre corner
+			if(radius[1] == 0.0f) {
+				quad[2] = quad[3];
+				meshAddPolygon(mesh, quad, 3);
+			} else {
+				meshAddPolygon(mesh, quad, 4);
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		meshAddSphere
+
+	Description:	Adds a sphere centred on the origin in the same layout
+					as glutSolidSphere, normals point straight out.
+
+*************************************************************************/
+void meshAddSphere(Mesh *mesh, float radius, int slices, int stacks, float material) {
+	MeshVertex quad[4];
+	float theta[2];
+	float phi[2];
+	int i = 0;
+	int j = 0;
+	int k = 0;
+
+	for(j = 0; j < stacks; j++) {
+		// Angle down from the +z pole
+		phi[0] = MESH_TWO_PI / 2.0f * j / stacks;
+		phi[1] = MESH_TWO_PI / 2.0f * (j + 1) / stacks;
+
+		for(i = 0; i < slices; i++) {
+			theta[0] = MESH_TWO_PI * i / slices;
+			theta[1] = MESH_TWO_PI * (i + 1) / slices;
+
+			for(k = 0; k < 4; k++) {
+				int side = (k == 0 || k == 1) ? 0 : 1;
+				int lower = (k == 1 || k == 2) ? 1 : 0;
+
+				quad[k].normal[0] = (float)(cos(theta[side]) * sin(phi[lower]));
+				quad[k].normal[1] = (float)(sin(theta[side]) * sin(phi[lower]));
+				quad[k].normal[2] = (float)cos(phi[lower]);
+				quad[k].position[0] = radius * quad[k].normal[0];
+				quad[k].position[1] = radius * quad[k].normal[1];
+				quad[k].position[2] = radius * quad[k].normal[2];
+				quad[k].texCoord[0] = (float)(i + side) / slices;
+				quad[k].texCoord[1] = (float)(j + lower) / stacks;
+				quad[k].material = material;
+			}
+
+			meshAddPolygon(mesh, quad, 4);
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		meshLoadObject
+
+	Description:	Reads a model file into the mesh. Lines starting with v
+					are vertices, n are normals (one for each vertex), g starts
+					the next object and f is a face listing vertex numbers
+					from 1. Each object gets its material from
+					materialForObject, counting from 0. Vertices and normals
+					are kept in arrays that grow as needed so any size of
+					model fits. The mesh must be set up already and stays in
+					its arena. Returns 0 if the file could not be read.
+
+*************************************************************************/
+int meshLoadObject(Mesh *mesh, const char *fileName, MeshMaterialFunction materialForObject) {
+	// Vertices and normals read so far, three floats each
+	float *positions = NULL;
+	float *normals = NULL;
+	int positionCount = 0;
+	int positionCapacity = 0;
+	int normalCount = 0;
+	int normalCapacity = 0;
+	// Corners of the current face
+	MeshVertex corners[MESH_MAX_POLYGON_CORNERS];
+	int cornerCount = 0;
+	int objectCount = -1;
+	int materialIndex = 0;
+	int vertexIndex = 0;
+	float value[3];
+	char *token;
+	char *end;
+	// Char array to store each line
+	char string[256];
+	FILE *fileStream;
+
+	// Start with an empty mesh, in the arena it was set up with
+	meshInitArena(mesh, mesh->arena);
+
+	fileStream = fopen(fileName, "rt");
+	if(fileStream == NULL) {
+		return 0;
+	}
+
+	// Read each file line while it is not null
+	while(fgets(string, sizeof(string), fileStream) != NULL) {
+		if(sscanf(string, "v %f %f %f ", &value[0], &value[1], &value[2]) == 3) {
+			positions = (float*)meshGrow(NULL, positions, &positionCapacity, (positionCount + 1) * 3, sizeof(float));
+			memcpy(&positions[positionCount * 3], value, sizeof(value));
+			positionCount++;
+		} else if(sscanf(string, "n %f %f %f ", &value[0], &value[1], &value[2]) == 3) {
+			normals = (float*)meshGrow(NULL, normals, &normalCapacity, (normalCount + 1) * 3, sizeof(float));
+			memcpy(&normals[normalCount * 3], value, sizeof(value));
+			normalCount++;
+		} else if(string[0] == 'g') {
+			// Next object
+			objectCount++;
+		} else if(string[0] == 'f') {
+			// Colors depend on which object it is
+			materialIndex = materialForObject(objectCount);
+			cornerCount = 0;
+
+			// Vertex numbers follow the f
+			token = string + 1;
+			for(;;) {
+				vertexIndex = (int)strtol(token, &end, 10) - 1;
+				if(end == token) {
+					break;
+				}
+				token = end;
+
+				// Skip anything that points past what has been read
+				if(vertexIndex < 0 || vertexIndex >= positionCount || vertexIndex >= normalCount || cornerCount >= MESH_MAX_POLYGON_CORNERS) {
+					continue;
+				}
+				memcpy(corners[cornerCount].position, &positions[vertexIndex * 3], 3 * sizeof(float));
+				memcpy(corners[cornerCount].normal, &normals[vertexIndex * 3], 3 * sizeof(float));
+				corners[cornerCount].texCoord[0] = 0.0f;
+				corners[cornerCount].texCoord[1] = 0.0f;
+				corners[cornerCount].material = (float)materialIndex;
+				cornerCount++;
+			}
+
+			meshAddPolygon(mesh, corners, cornerCount);
+		}
+	}
+
+	fclose(fileStream);
+	memoryFree(positions);
+	memoryFree(normals);
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		meshCompareCells
+
+	Description:	qsort comparison putting vertices in the same cell next
+					to each other.
+
+*************************************************************************/
+static int meshCompareCells(const void *a, const void *b) {
+	const MeshCell *cellA = (const MeshCell*)a;
+	const MeshCell *cellB = (const MeshCell*)b;
+
+	if(cellA->cell != cellB->cell) {
+		return cellA->cell < cellB->cell ? -1 : 1;
+	}
+	return cellA->vertex - cellB->vertex;
+}
+
+/************************************************************************
+
+	Function:		meshSimplify
+
+	Description:	Builds a lower detail copy of a mesh by vertex clustering.
+					The mesh bounds are split into a grid with cellsAcross
+					cells along the longest side and every corner moves to
+					the average position of the corners in its cell. Corners
+					that end up in the same cell as the one before are
+					dropped, and so are polygons left with fewer than three
+					corners. Normals, texture coordinates and materials are
+					kept. The result must be set up already and stays in its
+					arena. Exits if memory runs out.
+
+*************************************************************************/
+void meshSimplify(Mesh *result, const Mesh *mesh, int cellsAcross) {
+	// Cell of each vertex, sorted so each cell is one run
+	MeshCell *cells;
+	// Position each vertex moves to and the cell it is in
+	float *snapped;
+	int *cellOf;
+	// Corners of the polygon being simplified
+	MeshVertex corners[MESH_MAX_POLYGON_CORNERS];
+	// Cell of each kept corner
+	int cornerCells[MESH_MAX_POLYGON_CORNERS];
+	float minimum[3];
+	float maximum[3];
+	float cellSize = 0.0f;
+	float sum[3];
+	int cellCount[3];
+	int cornerCount = 0;
+	int first = 0;
+	int vertex = 0;
+	int i = 0;
+	int j = 0;
+	int k = 0;
+
+	meshInitArena(result, result->arena);
+	if(mesh->vertexCount == 0 || cellsAcross < 1) {
+		return;
+	}
+
+	cells = (MeshCell*)memoryAlloc(MEMORY_MESHES, mesh->vertexCount * sizeof(MeshCell));
+	snapped = (float*)memoryAlloc(MEMORY_MESHES, mesh->vertexCount * 3 * sizeof(float));
+	cellOf = (int*)memoryAlloc(MEMORY_MESHES, mesh->vertexCount * sizeof(int));
+	if(cells == NULL || snapped == NULL || cellOf == NULL) {
+		exit(1);
+	}
+
+	// Bounds and the cell size from the longest side
+	for(k = 0; k < 3; k++) {
+		minimum[k] = maximum[k] = mesh->vertices[0].position[k];
+	}
+	for(i = 1; i < mesh->vertexCount; i++) {
+		for(k = 0; k < 3; k++) {
+			if(mesh->vertices[i].position[k] < minimum[k]) {
+				minimum[k] = mesh->vertices[i].position[k];
+			}
+			if(mesh->vertices[i].position[k] > maximum[k]) {
+				maximum[k] = mesh->vertices[i].position[k];
+			}
+		}
+	}
+	for(k = 0; k < 3; k++) {
+		if(maximum[k] - minimum[k] > cellSize) {
+			cellSize = maximum[k] - minimum[k];
+		}
+	}
+	cellSize /= cellsAcross;
+	if(cellSize <= 0.0f) {
+		cellSize = 1.0f;
+	}
+	for(k = 0; k < 3; k++) {
+		cellCount[k] = (int)((maximum[k] - minimum[k]) / cellSize) + 1;
+	}
+
+	// Which cell each vertex is in
+	for(i = 0; i < mesh->vertexCount; i++) {
+		int cell[3];
+
+		for(k = 0; k < 3; k++) {
+			cell[k] = (int)((mesh->vertices[i].position[k] - minimum[k]) / cellSize);
+			if(cell[k] >= cellCount[k]) {
+				cell[k] = cellCount[k] - 1;
+			}
+		}
+		cells[i].cell = (cell[0] * cellCount[1] + cell[1]) * cellCount[2] + cell[2];
+		cells[i].vertex = i;
+	}
+	qsort(cells, mesh->vertexCount, sizeof(MeshCell), meshCompareCells);
+
+	// Average each run of vertices in the same cell
+	for(first = 0; first < mesh->vertexCount; first = i) {
+		sum[0] = sum[1] = sum[2] = 0.0f;
+		for(i = first; i < mesh->vertexCount && cells[i].cell == cells[first].cell; i++) {
+			for(k = 0; k < 3; k++) {
+				sum[k] += mesh->vertices[cells[i].vertex].position[k];
+			}
+		}
+		for(j = first; j < i; j++) {
+			vertex = cells[j].vertex;
+			for(k = 0; k < 3; k++) {
+				snapped[vertex * 3 + k] = sum[k] / (i - first);
+			}
+			cellOf[vertex] = cells[first].cell;
+		}
+	}
+
+	// Add each polygon again with the moved corners
+	for(i = 0; i < mesh->polygonCount; i++) {
+		cornerCount = 0;
+		for(j = 0; j < mesh->polygons[i].cornerCount; j++) {
+			vertex = mesh->polygons[i].firstVertex + j;
+			if(cornerCount > 0 && cellOf[vertex] == cornerCells[cornerCount - 1]) {
+				continue;
+			}
+			corners[cornerCount] = mesh->vertices[vertex];
+			for(k = 0; k < 3; k++) {
+				corners[cornerCount].position[k] = snapped[vertex * 3 + k];
+			}
+			cornerCells[cornerCount] = cellOf[vertex];
+			cornerCount++;
+		}
+		// The outline closes back on the first corner
+		if(cornerCount > 1 && cornerCells[cornerCount - 1] == cornerCells[0]) {
+			cornerCount--;
+		}
+
+		if(cornerCount >= 3 || (cornerCount == 2 && mesh->polygons[i].cornerCount == 2)) {
+			meshAddPolygon(result, corners, cornerCount);
+		}
+	}
+
+	memoryFree(cells);
+	memoryFree(snapped);
+	memoryFree(cellOf);
+}
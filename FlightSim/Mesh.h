@@ -0,0 +1,107 @@
+/*
+ * Mesh.h
+ * Mike Northorp
+ * Indexed triangle meshes built on the CPU. Used for the vertex buffers of
+ * the shader render path and by the software rasterizer. Does not depend on
+ * OpenGL so tools can use it too.
+ */
+
+#ifndef MESH_H_
+#define MESH_H_
+
+// Meshes can take their arrays from an arena
+#include "Arena.h"
+
+/* Defines */
+
+// Most corners a single polygon can have when added to a mesh
+#define MESH_MAX_POLYGON_CORNERS 32
+
+/* Typedefs and structs */
+
+// A material as laid out in the shader material table (std140), mesh
+// vertices hold an index into a table of these
+typedef struct {
+	float diffuse[4];
+	float ambient[4];
+	float specular[4];
+	// x is the shininess, y is 1 when only the front is set, rest is padding
+	float shininess[4];
+} Material;
+
+// One vertex of a mesh, interleaved so it can go straight into a vertex buffer
+typedef struct {
+	float position[3];
+	float normal[3];
+	// Normal of the polygon from its winding, filled in by meshAddPolygon
+	float faceNormal[3];
+	float texCoord[2];
+	// Material table index, stored as a float so it is a plain vertex attribute
+	float material;
+} MeshVertex;
+
+// A polygon as it was added, its corners are the vertices from firstVertex on
+typedef struct {
+	int firstVertex;
+	int cornerCount;
+} MeshPolygon;
+
+// Grid cell a vertex falls in, used when simplifying a mesh
+typedef struct {
+	int cell;
+	int vertex;
+} MeshCell;
+
+// Returns the material table index for an object (group) in a model file
+typedef int (*MeshMaterialFunction)(int objectCount);
+
+// Indexed mesh with a triangle list for solid drawing and an edge list
+// holding the polygon outlines for wireframe drawing. The polygons are
+// kept too so they can be drawn again as GL_POLYGON
+typedef struct {
+	MeshVertex *vertices;
+	int vertexCount;
+	int vertexCapacity;
+
+	unsigned int *triangleIndices;
+	int triangleIndexCount;
+	int triangleIndexCapacity;
+
+	unsigned int *edgeIndices;
+	int edgeIndexCount;
+	int edgeIndexCapacity;
+
+	MeshPolygon *polygons;
+	int polygonCount;
+	int polygonCapacity;
+
+	// Arena the arrays come from, NULL for the heap
+	Arena *arena;
+} Mesh;
+
+/* Function list */
+
+// Setup and teardown
+void meshInit(Mesh *mesh);
+void meshInitArena(Mesh *mesh, Arena *arena);
+void meshReserve(Mesh *mesh, int vertexCount, int triangleIndexCount, int edgeIndexCount, int polygonCount);
+void meshFree(Mesh *mesh);
+
+// Building blocks
+int meshAddVertex(Mesh *mesh, const MeshVertex *vertex);
+void meshAddTriangle(Mesh *mesh, int a, int b, int c);
+void meshAddEdge(Mesh *mesh, int a, int b);
+void meshAddPolygon(Mesh *mesh, const MeshVertex *corners, int cornerCount);
+
+// Shapes laid out the same as the matching glu quadric
+void meshAddCylinder(Mesh *mesh, float baseRadius, float topRadius, float height, int slices, int stacks, float material);
+void meshAddDisk(Mesh *mesh, float innerRadius, float outerRadius, int slices, int loops, float material);
+void meshAddSphere(Mesh *mesh, float radius, int slices, int stacks, float material);
+
+// Model files
+int meshLoadObject(Mesh *mesh, const char *fileName, MeshMaterialFunction materialForObject);
+
+// Level of detail
+void meshSimplify(Mesh *result, const Mesh *mesh, int cellsAcross);
+
+#endif /* MESH_H_ */
@@ -0,0 +1,341 @@
+
+/************************************************************************************
+
+	File: 			MonteCarlo.c
+
+	Description:	Flies many copies of a control script at once. Every
+					flight keeps its own state, controls, script place and
+					random numbers, and writes only its own result, so the
+					flights share nothing but the script and the path of the
+					script flown as written, which are only read. The flights
+					are spread over a thread pool one index each and summed
+					up once they have all landed or crashed.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for monte carlo types and functions
+#include "MonteCarlo.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation and sorting
+#include <stdlib.h>
+// String functions
+#include <string.h>
+// Square root for the deviation
+#include <math.h>
+
+/* Defines */
+
+// How much of a gust is left the next step, so it dies away
+#define MONTE_CARLO_GUST_DECAY 0.95f
+// Part of the flights the percentiles leave out at each end
+#define MONTE_CARLO_PERCENTILE 0.05f
+
+/************************************************************************
+
+	Function:		monteCarloRandom
+
+	Description:	Next random number from -1 to 1.
+
+*************************************************************************/
+static float monteCarloRandom(unsigned int *seed) {
+	*seed = *seed * 1664525u + 1013904223u;
+	return (*seed >> 8) / 8388608.0f - 1.0f;
+}
+
+/************************************************************************
+
+	Function:		monteCarloFlightSeed
+
+	Description:	Mixes the run's seed with the flight number so that
+					flights next to each other get unrelated numbers, and
+					each flight gets the same ones whichever thread flies it.
+
+*************************************************************************/
+static unsigned int monteCarloFlightSeed(unsigned int seed, int flight) {
+	unsigned int hash = seed ^ ((unsigned int)flight * 0x9E3779B9u);
+
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	hash *= 0xC2B2AE35u;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+/************************************************************************
+
+	Function:		monteCarloFlyOne
+
+	Description:	Pool task flying flight number index. Moves the start,
+					heading and speed, delays the script's controls and
+					adds gusts to the tilt every step. Stops when the plane
+					goes into the sea or the steps run out.
+
+*************************************************************************/
+static void monteCarloFlyOne(void *context, int index) {
+	MonteCarloRun *run = (MonteCarloRun*)context;
+	const MonteCarloConfig *config = &run->config;
+	MonteCarloResult *result = &run->results[index];
+	// Our own place in the shared events
+	FlightScript script = run->script;
+	FlightControls controls;
+	FlightControls flown;
+	FlightState state;
+	const double *expected;
+	double position[3];
+	unsigned int seed = monteCarloFlightSeed(config->seed, index);
+	unsigned long delay = 0;
+	unsigned long step = 0;
+	float gust = 0.0f;
+	float offset[3];
+	float distance = 0.0f;
+	double totalDeviation = 0.0;
+
+	flightRestartScript(&script);
+	memset(&controls, 0, sizeof(controls));
+	memset(result, 0, sizeof(MonteCarloResult));
+
+	// Shake up the start
+	flightInit(&state);
+	state.position[0] += config->startSpread * monteCarloRandom(&seed);
+	state.position[1] += config->startSpread * monteCarloRandom(&seed);
+	state.position[2] += config->startSpread * monteCarloRandom(&seed);
+	state.turnAngle += config->headingSpread * monteCarloRandom(&seed);
+	state.speed *= 1.0f + config->speedSpread * monteCarloRandom(&seed);
+	delay = (unsigned long)((config->maxDelay + 1) * (monteCarloRandom(&seed) + 1.0f) * 0.5f);
+	if(delay > config->maxDelay) {
+		delay = config->maxDelay;
+	}
+	result->lowest = state.position[1];
+	result->highest = state.position[1];
+
+	for(step = 0; step < config->steps; step++) {
+		// The script's controls come late, then the gust is added on
+		if(step >= delay) {
+			flightApplyScript(&script, step - delay, &controls);
+		}
+		gust = gust * MONTE_CARLO_GUST_DECAY + config->gustStrength * monteCarloRandom(&seed);
+		flown = controls;
+		flown.tilt += gust;
+		if(flown.tilt < -1.0f) {
+			flown.tilt = -1.0f;
+		} else if(flown.tilt > 1.0f) {
+			flown.tilt = 1.0f;
+		}
+		flightStep(&state, &flown);
+
+		if(state.position[1] < result->lowest) {
+			result->lowest = state.position[1];
+		}
+		if(state.position[1] > result->highest) {
+			result->highest = state.position[1];
+		}
+		expected = &run->path[step * 3];
+		flightWorldPosition(&state, position);
+		offset[0] = (float)(position[0] - expected[0]);
+		offset[1] = (float)(position[1] - expected[1]);
+		offset[2] = (float)(position[2] - expected[2]);
+		distance = (float)sqrt(offset[0] * offset[0] + offset[1] * offset[1] + offset[2] * offset[2]);
+		totalDeviation += distance;
+		if(distance > result->largestDeviation) {
+			result->largestDeviation = distance;
+		}
+
+		if(state.position[1] < MONTE_CARLO_SEA_LEVEL) {
+			result->crashStep = step + 1;
+			step++;
+			break;
+		}
+	}
+
+	result->meanDeviation = step > 0 ? (float)(totalDeviation / step) : 0.0f;
+	flightWorldPosition(&state, result->finalPosition);
+}
+
+/************************************************************************
+
+	Function:		monteCarloDefaults
+
+	Description:	A thousand one minute flights from about a plane's
+					length of the start, up to 5 degrees off the heading
+					and 10 in 100 off the speed, with light gusts and the
+					controls up to half a second late.
+
+*************************************************************************/
+void monteCarloDefaults(MonteCarloConfig *config) {
+	config->flightCount = 1000;
+	config->steps = 60 * FLIGHT_STEP_RATE;
+	config->seed = 1;
+	config->startSpread = 0.5f;
+	config->headingSpread = 5.0f;
+	config->speedSpread = 0.1f;
+	config->gustStrength = 0.02f;
+	config->maxDelay = FLIGHT_STEP_RATE / 2;
+}
+
+/************************************************************************
+
+	Function:		monteCarloCreate
+
+	Description:	Sets up a run of the script, which has to outlive the
+					run, and flies it once as written for the path the
+					flights are measured against. Returns NULL when out of
+					memory.
+
+*************************************************************************/
+MonteCarloRun *monteCarloCreate(const MonteCarloConfig *config, const FlightScript *script) {
+	MonteCarloRun *run;
+	FlightControls controls;
+	FlightState state;
+	unsigned long step = 0;
+
+	if(config->flightCount <= 0 || config->steps == 0) {
+		return NULL;
+	}
+	run = (MonteCarloRun*)memoryAllocZeroed(MEMORY_FLIGHT, sizeof(MonteCarloRun));
+	if(run == NULL) {
+		return NULL;
+	}
+	run->config = *config;
+	run->script = *script;
+	run->path = (double*)memoryAlloc(MEMORY_FLIGHT, config->steps * 3 * sizeof(double));
+	run->results = (MonteCarloResult*)memoryAllocZeroed(MEMORY_FLIGHT, config->flightCount * sizeof(MonteCarloResult));
+	if(run->path == NULL || run->results == NULL) {
+		monteCarloDestroy(run);
+		return NULL;
+	}
+
+	// The script flown as written
+	flightRestartScript(&run->script);
+	flightInit(&state);
+	memset(&controls, 0, sizeof(controls));
+	for(step = 0; step < config->steps; step++) {
+		flightApplyScript(&run->script, step, &controls);
+		flightStep(&state, &controls);
+		flightWorldPosition(&state, &run->path[step * 3]);
+	}
+	flightRestartScript(&run->script);
+
+	return run;
+}
+
+/************************************************************************
+
+	Function:		monteCarloFly
+
+	Description:	Flies every flight of the run on the pool and returns
+					once they are all done. Flying a run again gives the
+					same results whatever the pool's size.
+
+*************************************************************************/
+void monteCarloFly(MonteCarloRun *run, ThreadPool *pool) {
+	threadPoolRun(pool, monteCarloFlyOne, run, run->config.flightCount);
+}
+
+/************************************************************************
+
+	Function:		monteCarloCompare
+
+	Description:	qsort order for the percentiles, lowest first.
+
+*************************************************************************/
+static int monteCarloCompare(const void *a, const void *b) {
+	float first = *(const float*)a;
+	float second = *(const float*)b;
+
+	return first < second ? -1 : (first > second ? 1 : 0);
+}
+
+/************************************************************************
+
+	Function:		monteCarloSummarize
+
+	Description:	Adds up the results of a flown run: the crash rate,
+					the altitude envelope and the path deviation.
+
+*************************************************************************/
+void monteCarloSummarize(const MonteCarloRun *run, MonteCarloSummary *summary) {
+	const MonteCarloResult *result;
+	int count = run->config.flightCount;
+	int cut = (int)(count * MONTE_CARLO_PERCENTILE);
+	float *sorted;
+	double crashSteps = 0.0;
+	double meanDeviation = 0.0;
+	double meanLargest = 0.0;
+	int i = 0;
+
+	memset(summary, 0, sizeof(MonteCarloSummary));
+	summary->flightCount = count;
+	summary->lowest = run->results[0].lowest;
+	summary->highest = run->results[0].highest;
+
+	for(i = 0; i < count; i++) {
+		result = &run->results[i];
+		if(result->crashStep > 0) {
+			summary->crashCount++;
+			crashSteps += result->crashStep;
+		}
+		if(result->lowest < summary->lowest) {
+			summary->lowest = result->lowest;
+		}
+		if(result->highest > summary->highest) {
+			summary->highest = result->highest;
+		}
+		if(result->largestDeviation > summary->largestDeviation) {
+			summary->largestDeviation = result->largestDeviation;
+		}
+		meanDeviation += result->meanDeviation;
+		meanLargest += result->largestDeviation;
+	}
+	summary->crashRate = (float)summary->crashCount / count;
+	summary->meanCrashTime = summary->crashCount > 0 ? (float)(crashSteps / summary->crashCount / FLIGHT_STEP_RATE) : 0.0f;
+	summary->meanDeviation = (float)(meanDeviation / count);
+	summary->meanLargestDeviation = (float)(meanLargest / count);
+
+	// Percentiles from the sorted heights and deviations, the extremes
+	// stand in when out of memory
+	summary->lowestPercentile = summary->lowest;
+	summary->highestPercentile = summary->highest;
+	summary->deviationPercentile = summary->largestDeviation;
+	sorted = (float*)memoryAlloc(MEMORY_FLIGHT, count * sizeof(float));
+	if(sorted == NULL) {
+		return;
+	}
+	for(i = 0; i < count; i++) {
+		sorted[i] = run->results[i].lowest;
+	}
+	qsort(sorted, count, sizeof(float), monteCarloCompare);
+	summary->lowestPercentile = sorted[cut];
+	for(i = 0; i < count; i++) {
+		sorted[i] = run->results[i].highest;
+	}
+	qsort(sorted, count, sizeof(float), monteCarloCompare);
+	summary->highestPercentile = sorted[count - 1 - cut];
+	for(i = 0; i < count; i++) {
+		sorted[i] = run->results[i].largestDeviation;
+	}
+	qsort(sorted, count, sizeof(float), monteCarloCompare);
+	summary->deviationPercentile = sorted[count - 1 - cut];
+	memoryFree(sorted);
+}
+
+/************************************************************************
+
+	Function:		monteCarloDestroy
+
+	Description:	Frees a run, the script it was made from is left alone.
+
+*************************************************************************/
+void monteCarloDestroy(MonteCarloRun *run) {
+	if(run == NULL) {
+		return;
+	}
+
+	memoryFree(run->path);
+	memoryFree(run->results);
+	memoryFree(run);
+}
@@ -0,0 +1,97 @@
+/*
+ * MonteCarlo.h
+ * Mike Northorp
+ * Flies many copies of a control script side by side on a thread pool,
+ * each from its own seed with the start and controls shaken up, and sums
+ * up how many crashed, how high and low they went and how far they
+ * strayed from the script flown as written.
+ */
+
+#ifndef MONTECARLO_H_
+#define MONTECARLO_H_
+
+// Flight state, controls and scripts
+#include "Flight.h"
+// Worker threads to fly on
+#include "ThreadPool.h"
+
+/* Defines */
+
+// A flight that drops below this height has gone into the sea
+#define MONTE_CARLO_SEA_LEVEL 0.0f
+
+/* Typedefs and structs */
+
+// How many flights, how long and how much each is shaken up
+typedef struct {
+	int flightCount;
+	// Steps each flight takes unless it crashes first
+	unsigned long steps;
+	// Flight i always gets the same random numbers for the same seed
+	unsigned int seed;
+	// Most the start moves in each direction, turns in degrees and changes
+	// speed by as a part of the speed
+	float startSpread;
+	float headingSpread;
+	float speedSpread;
+	// Gusts push the tilt about, wandering by up to this much a step
+	float gustStrength;
+	// Most steps the script's controls can come late by
+	unsigned long maxDelay;
+} MonteCarloConfig;
+
+// How one flight went
+typedef struct {
+	// Step it went into the sea, 0 if it never did
+	unsigned long crashStep;
+	float lowest;
+	float highest;
+	// Distance from the script flown as written at the same step
+	float meanDeviation;
+	float largestDeviation;
+	// Where it ended in the whole world
+	double finalPosition[3];
+} MonteCarloResult;
+
+// Many flights of one script
+typedef struct {
+	MonteCarloConfig config;
+	// Shared by every flight, only read while flying
+	FlightScript script;
+	// Whole world position after every step of the script flown as
+	// written
+	double *path;
+	MonteCarloResult *results;
+} MonteCarloRun;
+
+// Totals over every flight of a run
+typedef struct {
+	int flightCount;
+	int crashCount;
+	float crashRate;
+	// Mean seconds into the flight of the crashes
+	float meanCrashTime;
+	// Altitude envelope: the lowest and highest any flight went, and the
+	// height 5 in 100 flights went below and 5 in 100 above
+	float lowest;
+	float lowestPercentile;
+	float highestPercentile;
+	float highest;
+	// Path deviation: mean over the flights of their mean and largest
+	// distance from the script, the largest 95 in 100 stayed within and
+	// the largest of all
+	float meanDeviation;
+	float meanLargestDeviation;
+	float deviationPercentile;
+	float largestDeviation;
+} MonteCarloSummary;
+
+/* Function list */
+
+void monteCarloDefaults(MonteCarloConfig *config);
+MonteCarloRun *monteCarloCreate(const MonteCarloConfig *config, const FlightScript *script);
+void monteCarloFly(MonteCarloRun *run, ThreadPool *pool);
+void monteCarloSummarize(const MonteCarloRun *run, MonteCarloSummary *summary);
+void monteCarloDestroy(MonteCarloRun *run);
+
+#endif /* MONTECARLO_H_ */
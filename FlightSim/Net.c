@@ -0,0 +1,918 @@
+
+/************************************************************************************
+
+	File: 			Net.c
+
+	Description:	Multiplayer over UDP. A simulator sends the relay its
+					plane NET_SEND_RATE times a second and the relay sends
+					each simulator the planes of all the others as often.
+					Every packet says which of the other side's packets it
+					is a difference against and which it acknowledges, and
+					the next packet back is a difference against that one.
+					Each plane state lists the fields that changed and then
+					how much each changed, zigzagged so small differences
+					either way take one byte. A lost packet costs nothing
+					but a slightly larger difference in the next one.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Windows sockets, before windows.h is pulled in
+#include <winsock2.h>
+// Include headerfile for network types and functions
+#include "Net.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// memcpy, memcmp
+#include <string.h>
+// Math header
+#include <math.h>
+
+// Packet types, after the two magic bytes
+#define NET_MAGIC_0 'F'
+#define NET_MAGIC_1 'S'
+#define NET_PACKET_STATE 1
+#define NET_PACKET_WORLD 2
+// Heading steps in a full turn, headings wrap around
+#define NET_FULL_TURN ((int)(360.0f * NET_ANGLE_SCALE))
+
+// Packet being written or read
+typedef struct {
+	unsigned char data[NET_MAX_PACKET];
+	int size;
+	int position;
+	// Set when a write ran off the end or a read ran past the packet
+	int isBad;
+} NetBuffer;
+
+// Baseline of a plane nothing was acknowledged for
+static const NetState netZeroState;
+
+/************************************************************************
+
+	Function:		netTime
+
+	Description:	Seconds from the performance counter, for the time
+					spent in the network code.
+
+*************************************************************************/
+static double netTime() {
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+/************************************************************************
+
+	Function:		netRound
+
+	Description:	Rounds to the nearest whole number.
+
+*************************************************************************/
+static int netRound(double value) {
+	return (int)floor(value + 0.5);
+}
+
+/************************************************************************
+
+	Function:		netQuantise
+
+	Description:	Turns a plane into whole numbers for sending. The
+					heading is kept within one turn.
+
+*************************************************************************/
+void netQuantise(const NetPlane *plane, NetState *state) {
+	int i = 0;
+
+	for(i = 0; i < 3; i++) {
+		state->fields[NET_FIELD_X + i] = netRound(plane->position[i] * NET_POSITION_SCALE);
+	}
+	state->fields[NET_FIELD_TURN] = netRound(plane->turnAngle * NET_ANGLE_SCALE) % NET_FULL_TURN;
+	if(state->fields[NET_FIELD_TURN] < 0) {
+		state->fields[NET_FIELD_TURN] += NET_FULL_TURN;
+	}
+	state->fields[NET_FIELD_TILT] = netRound(plane->sideTilt * NET_ANGLE_SCALE);
+	state->fields[NET_FIELD_ROLL_AMOUNT] = netRound(plane->rollAmount * NET_ANGLE_SCALE);
+	state->fields[NET_FIELD_ROLL_HEIGHT] = netRound(plane->rollHeight * NET_ROLL_HEIGHT_SCALE);
+	state->fields[NET_FIELD_ROLL_FLAGS] = (plane->isRolling ? NET_ROLLING : 0) | (plane->isCrazyRolling ? NET_CRAZY_ROLLING : 0);
+	state->fields[NET_FIELD_STEP] = (int)plane->step;
+}
+
+/************************************************************************
+
+	Function:		netDequantise
+
+	Description:	Turns a received state back into a plane.
+
+*************************************************************************/
+void netDequantise(const NetState *state, NetPlane *plane) {
+	int i = 0;
+
+	for(i = 0; i < 3; i++) {
+		plane->position[i] = state->fields[NET_FIELD_X + i] / (double)NET_POSITION_SCALE;
+	}
+	plane->turnAngle = state->fields[NET_FIELD_TURN] / NET_ANGLE_SCALE;
+	plane->sideTilt = state->fields[NET_FIELD_TILT] / NET_ANGLE_SCALE;
+	plane->rollAmount = state->fields[NET_FIELD_ROLL_AMOUNT] / NET_ANGLE_SCALE;
+	plane->rollHeight = state->fields[NET_FIELD_ROLL_HEIGHT] / NET_ROLL_HEIGHT_SCALE;
+	plane->isRolling = (state->fields[NET_FIELD_ROLL_FLAGS] & NET_ROLLING) != 0;
+	plane->isCrazyRolling = (state->fields[NET_FIELD_ROLL_FLAGS] & NET_CRAZY_ROLLING) != 0;
+	plane->step = (unsigned int)state->fields[NET_FIELD_STEP];
+}
+
+/************************************************************************
+
+	Function:		netWriteUnsigned
+
+	Description:	Writes a number seven bits at a time, lowest first, with
+					the top bit set on every byte but the last.
+
+*************************************************************************/
+static void netWriteUnsigned(NetBuffer *buffer, unsigned int value) {
+	do {
+		if(buffer->size >= NET_MAX_PACKET) {
+			buffer->isBad = 1;
+			return;
+		}
+		buffer->data[buffer->size++] = (unsigned char)((value & 0x7f) | (value > 0x7f ? 0x80 : 0));
+		value >>= 7;
+	} while(value != 0);
+}
+
+/************************************************************************
+
+	Function:		netReadUnsigned
+
+	Description:	Reads a number written by netWriteUnsigned.
+
+*************************************************************************/
+static unsigned int netReadUnsigned(NetBuffer *buffer) {
+	unsigned int value = 0;
+	int shift = 0;
+	int byte = 0;
+
+	do {
+		if(buffer->position >= buffer->size || shift > 28) {
+			buffer->isBad = 1;
+			return 0;
+		}
+		byte = buffer->data[buffer->position++];
+		value |= (unsigned int)(byte & 0x7f) << shift;
+		shift += 7;
+	} while(byte & 0x80);
+
+	return value;
+}
+
+/************************************************************************
+
+	Function:		netFieldDifference
+
+	Description:	How much a field changed from its baseline. Headings
+					take the short way round.
+
+*************************************************************************/
+static int netFieldDifference(int field, int value, int baseline) {
+	int difference = value - baseline;
+
+	if(field == NET_FIELD_TURN) {
+		if(difference > NET_FULL_TURN / 2) {
+			difference -= NET_FULL_TURN;
+		} else if(difference < -NET_FULL_TURN / 2) {
+			difference += NET_FULL_TURN;
+		}
+	}
+
+	return difference;
+}
+
+/************************************************************************
+
+	Function:		netWriteState
+
+	Description:	Writes which fields changed from the baseline as one
+					bit each, then the change in each of them zigzagged so
+					small changes either way stay small. A plane that did
+					not change takes one byte.
+
+*************************************************************************/
+static void netWriteState(NetBuffer *buffer, const NetState *state, const NetState *baseline) {
+	int differences[NET_FIELDS];
+	unsigned int changed = 0;
+	int i = 0;
+
+	for(i = 0; i < NET_FIELDS; i++) {
+		differences[i] = netFieldDifference(i, state->fields[i], baseline->fields[i]);
+		if(differences[i] != 0) {
+			changed |= 1u << i;
+		}
+	}
+
+	netWriteUnsigned(buffer, changed);
+	for(i = 0; i < NET_FIELDS; i++) {
+		if(differences[i] != 0) {
+			netWriteUnsigned(buffer, ((unsigned int)differences[i] << 1) ^ (unsigned int)(differences[i] >> 31));
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		netReadState
+
+	Description:	Reads a state written by netWriteState against the
+					same baseline.
+
+*************************************************************************/
+static void netReadState(NetBuffer *buffer, NetState *state, const NetState *baseline) {
+	unsigned int changed = netReadUnsigned(buffer);
+	unsigned int value = 0;
+	int i = 0;
+
+	*state = *baseline;
+	for(i = 0; i < NET_FIELDS; i++) {
+		if(changed & (1u << i)) {
+			value = netReadUnsigned(buffer);
+			state->fields[i] += (int)(value >> 1) ^ -(int)(value & 1);
+		}
+	}
+
+	// Heading back within one turn
+	state->fields[NET_FIELD_TURN] %= NET_FULL_TURN;
+	if(state->fields[NET_FIELD_TURN] < 0) {
+		state->fields[NET_FIELD_TURN] += NET_FULL_TURN;
+	}
+}
+
+/************************************************************************
+
+	Function:		netFindState
+
+	Description:	State of a plane in a world, the zero state when the
+					plane is not in it.
+
+*************************************************************************/
+static const NetState *netFindState(const NetWorld *world, unsigned int id) {
+	int i = 0;
+
+	for(i = 0; world != NULL && i < world->count; i++) {
+		if(world->ids[i] == id) {
+			return &world->states[i];
+		}
+	}
+
+	return &netZeroState;
+}
+
+/************************************************************************
+
+	Function:		netStartPacket
+
+	Description:	Empties a buffer and writes the magic bytes and type.
+
+*************************************************************************/
+static void netStartPacket(NetBuffer *buffer, int type) {
+	buffer->size = 3;
+	buffer->position = 0;
+	buffer->isBad = 0;
+	buffer->data[0] = NET_MAGIC_0;
+	buffer->data[1] = NET_MAGIC_1;
+	buffer->data[2] = (unsigned char)type;
+}
+
+/************************************************************************
+
+	Function:		netOpenSocket
+
+	Description:	Opens a UDP socket on the loopback address that never
+					blocks. Port 0 lets the system pick one. Returns
+					INVALID_SOCKET when it can not.
+
+*************************************************************************/
+static SOCKET netOpenSocket(int port) {
+	WSADATA data;
+	SOCKET netSocket;
+	struct sockaddr_in address;
+	u_long isNonBlocking = 1;
+
+	if(WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+		return INVALID_SOCKET;
+	}
+
+	netSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if(netSocket == INVALID_SOCKET) {
+		WSACleanup();
+		return INVALID_SOCKET;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons((u_short)port);
+	if(bind(netSocket, (struct sockaddr*)&address, sizeof(address)) == SOCKET_ERROR ||
+		ioctlsocket(netSocket, FIONBIO, &isNonBlocking) == SOCKET_ERROR) {
+		closesocket(netSocket);
+		WSACleanup();
+		return INVALID_SOCKET;
+	}
+
+	return netSocket;
+}
+
+/************************************************************************
+
+	Function:		netCloseSocket
+
+	Description:	Closes a socket opened by netOpenSocket.
+
+*************************************************************************/
+static void netCloseSocket(SOCKET netSocket) {
+	closesocket(netSocket);
+	WSACleanup();
+}
+
+/************************************************************************
+
+	Function:		netSendPacket
+
+	Description:	Sends a buffer to an address and counts it. A buffer
+					that ran out of room is not sent. Returns the bytes
+					sent.
+
+*************************************************************************/
+static int netSendPacket(SOCKET netSocket, const unsigned char *address, NetBuffer *buffer, NetStats *stats) {
+	if(buffer->isBad) {
+		return 0;
+	}
+
+	if(sendto(netSocket, (const char*)buffer->data, buffer->size, 0, (const struct sockaddr*)address, sizeof(struct sockaddr_in)) != buffer->size) {
+		return 0;
+	}
+	stats->bytesSent += buffer->size;
+	stats->packetsSent++;
+	return buffer->size;
+}
+
+/************************************************************************
+
+	Function:		netReceivePacket
+
+	Description:	Takes the next packet waiting on the socket and where
+					it came from. Returns 0 when there are none left.
+					Packets without the magic bytes are skipped.
+
+*************************************************************************/
+static int netReceivePacket(SOCKET netSocket, NetBuffer *buffer, unsigned char *address, NetStats *stats) {
+	int addressSize = sizeof(struct sockaddr_in);
+	int size = 0;
+
+	for(;;) {
+		size = recvfrom(netSocket, (char*)buffer->data, NET_MAX_PACKET, 0, (struct sockaddr*)address, &addressSize);
+		if(size == SOCKET_ERROR) {
+			// A send to a closed port comes back as a reset, keep going
+			if(WSAGetLastError() == WSAECONNRESET) {
+				continue;
+			}
+			return 0;
+		}
+
+		stats->bytesReceived += size;
+		stats->packetsReceived++;
+		if(size >= 3 && buffer->data[0] == NET_MAGIC_0 && buffer->data[1] == NET_MAGIC_1) {
+			buffer->size = size;
+			buffer->position = 3;
+			buffer->isBad = 0;
+			return 1;
+		}
+		stats->packetsDropped++;
+	}
+}
+
+/************************************************************************
+
+	Function:		netIsSameAddress
+
+	Description:	If two sockaddr_in are the same address and port.
+
+*************************************************************************/
+static int netIsSameAddress(const unsigned char *first, const unsigned char *second) {
+	const struct sockaddr_in *a = (const struct sockaddr_in*)first;
+	const struct sockaddr_in *b = (const struct sockaddr_in*)second;
+
+	return a->sin_port == b->sin_port && a->sin_addr.s_addr == b->sin_addr.s_addr;
+}
+
+/************************************************************************
+
+	Function:		netClientCreate
+
+	Description:	Opens a connection to the relay on the loopback address
+					at the port. Nothing is sent until the first state.
+					Returns NULL when the socket can not be opened.
+
+*************************************************************************/
+NetClient *netClientCreate(int port) {
+	NetClient *client = (NetClient*)memoryAllocZeroed(MEMORY_NETWORK, sizeof(NetClient));
+	struct sockaddr_in *relayAddress;
+
+	if(client == NULL) {
+		return NULL;
+	}
+
+	client->socket = netOpenSocket(0);
+	if(client->socket == INVALID_SOCKET) {
+		memoryFree(client);
+		return NULL;
+	}
+
+	relayAddress = (struct sockaddr_in*)client->relayAddress;
+	relayAddress->sin_family = AF_INET;
+	relayAddress->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	relayAddress->sin_port = htons((u_short)port);
+
+	return client;
+}
+
+/************************************************************************
+
+	Function:		netClientDestroy
+
+	Description:	Closes the connection. Does nothing for NULL. The relay
+					drops the plane once it stops hearing from it.
+
+*************************************************************************/
+void netClientDestroy(NetClient *client) {
+	if(client == NULL) {
+		return;
+	}
+
+	netCloseSocket(client->socket);
+	memoryFree(client);
+}
+
+/************************************************************************
+
+	Function:		netClientSend
+
+	Description:	Sends the plane to the relay as a difference against
+					the newest state the relay acknowledged, or in full when
+					there is none still kept, and acknowledges the newest
+					world received.
+
+*************************************************************************/
+void netClientSend(NetClient *client, const NetPlane *plane) {
+	NetBuffer buffer;
+	NetState *state;
+	const NetState *baseline = &netZeroState;
+	unsigned int baselineSequence = 0;
+	double startTime = netTime();
+	int stateStart = 0;
+
+	client->sendSequence++;
+	state = &client->sentStates[client->sendSequence % NET_HISTORY];
+	netQuantise(plane, state);
+	if(client->ackedSequence != 0 && client->sendSequence - client->ackedSequence < NET_HISTORY) {
+		baselineSequence = client->ackedSequence;
+		baseline = &client->sentStates[baselineSequence % NET_HISTORY];
+	}
+
+	netStartPacket(&buffer, NET_PACKET_STATE);
+	netWriteUnsigned(&buffer, client->sendSequence);
+	netWriteUnsigned(&buffer, baselineSequence);
+	netWriteUnsigned(&buffer, client->worldSequence);
+	stateStart = buffer.size;
+	netWriteState(&buffer, state, baseline);
+
+	if(netSendPacket(client->socket, client->relayAddress, &buffer, &client->stats) > 0) {
+		client->stats.statesSent++;
+		client->stats.stateBytes += buffer.size - stateStart;
+	}
+	client->stats.cpuTime += netTime() - startTime;
+}
+
+/************************************************************************
+
+	Function:		netClientAddState
+
+	Description:	Adds a state that came in to a remote plane, dropping
+					the oldest when it is full. A step older than the
+					newest means the remote simulator started over.
+
+*************************************************************************/
+static void netClientAddState(NetRemote *remote, const NetState *state, double now) {
+	unsigned int step = (unsigned int)state->fields[NET_FIELD_STEP];
+	unsigned int newestStep = 0;
+	double offset = now - (double)step / NET_STEP_RATE;
+
+	if(remote->stateCount > 0) {
+		newestStep = (unsigned int)remote->states[remote->stateCount - 1].fields[NET_FIELD_STEP];
+		if(step == newestStep) {
+			return;
+		}
+		if(step < newestStep) {
+			remote->stateCount = 0;
+		}
+	}
+
+	if(remote->stateCount == NET_INTERPOLATION_STATES) {
+		memmove(remote->states, remote->states + 1, (NET_INTERPOLATION_STATES - 1) * sizeof(NetState));
+		remote->stateCount--;
+	}
+	remote->states[remote->stateCount++] = *state;
+
+	if(remote->stateCount == 1 || offset < remote->timeOffset) {
+		remote->timeOffset = offset;
+	}
+}
+
+/************************************************************************
+
+	Function:		netClientReceive
+
+	Description:	Reads every packet from the relay. Each world is read
+					against the world it names as its baseline, kept as the
+					newest world, and its planes added to the remote planes.
+					Remote planes missing from it have left. Worlds older
+					than the newest, or whose baseline is gone, are dropped.
+
+*************************************************************************/
+void netClientReceive(NetClient *client, double now) {
+	NetBuffer buffer;
+	NetWorld world;
+	const NetWorld *baselineWorld;
+	NetRemote *remote;
+	unsigned char address[16];
+	unsigned int baselineSequence = 0;
+	unsigned int stateAck = 0;
+	double startTime = netTime();
+	int isInWorld = 0;
+	int i = 0;
+	int k = 0;
+
+	while(netReceivePacket(client->socket, &buffer, address, &client->stats)) {
+		if(!netIsSameAddress(address, client->relayAddress) || buffer.data[2] != NET_PACKET_WORLD) {
+			client->stats.packetsDropped++;
+			continue;
+		}
+
+		world.sequence = netReadUnsigned(&buffer);
+		baselineSequence = netReadUnsigned(&buffer);
+		stateAck = netReadUnsigned(&buffer);
+		world.count = (int)netReadUnsigned(&buffer);
+		baselineWorld = NULL;
+		if(baselineSequence != 0) {
+			baselineWorld = &client->worlds[baselineSequence % NET_HISTORY];
+			if(baselineWorld->sequence != baselineSequence) {
+				baselineWorld = NULL;
+				buffer.isBad = 1;
+			}
+		}
+		if(world.sequence <= client->worldSequence || world.count > NET_MAX_PLAYERS) {
+			buffer.isBad = 1;
+		}
+
+		for(i = 0; i < world.count && !buffer.isBad; i++) {
+			world.ids[i] = netReadUnsigned(&buffer);
+			netReadState(&buffer, &world.states[i], netFindState(baselineWorld, world.ids[i]));
+		}
+		if(buffer.isBad) {
+			client->stats.packetsDropped++;
+			continue;
+		}
+
+		client->worlds[world.sequence % NET_HISTORY] = world;
+		client->worldSequence = world.sequence;
+		if(stateAck > client->ackedSequence && stateAck <= client->sendSequence) {
+			client->ackedSequence = stateAck;
+		}
+
+		// Planes that left free their slots first
+		for(k = 0; k < NET_MAX_PLAYERS; k++) {
+			isInWorld = 0;
+			for(i = 0; i < world.count; i++) {
+				if(client->remotes[k].id == world.ids[i]) {
+					isInWorld = 1;
+					break;
+				}
+			}
+			if(!isInWorld) {
+				client->remotes[k].id = 0;
+			}
+		}
+
+		// Planes in the world, into the slot they had or a free one
+		for(i = 0; i < world.count; i++) {
+			remote = NULL;
+			for(k = 0; k < NET_MAX_PLAYERS; k++) {
+				if(client->remotes[k].id == world.ids[i]) {
+					remote = &client->remotes[k];
+					break;
+				}
+				if(remote == NULL && client->remotes[k].id == 0) {
+					remote = &client->remotes[k];
+				}
+			}
+			if(remote == NULL) {
+				continue;
+			}
+			if(remote->id != world.ids[i]) {
+				remote->id = world.ids[i];
+				remote->stateCount = 0;
+			}
+			netClientAddState(remote, &world.states[i], now);
+		}
+	}
+
+	client->stats.cpuTime += netTime() - startTime;
+}
+
+/************************************************************************
+
+	Function:		netClientRemotes
+
+	Description:	Fills in every remote plane as it was a little while
+					ago, interpolated between the two states either side of
+					that moment. Past the newest state the plane waits
+					there rather than guessing ahead. Returns how many
+					planes were filled in.
+
+*************************************************************************/
+int netClientRemotes(NetClient *client, double now, NetPlane *planes, int maxPlanes) {
+	const NetRemote *remote;
+	NetPlane before;
+	NetPlane after;
+	NetPlane *plane;
+	// Step of the remote's simulation to show
+	double targetStep = 0.0;
+	double startTime = netTime();
+	float amount = 0.0f;
+	float turn = 0.0f;
+	int count = 0;
+	int i = 0;
+	int k = 0;
+
+	for(i = 0; i < NET_MAX_PLAYERS && count < maxPlanes; i++) {
+		remote = &client->remotes[i];
+		if(remote->id == 0 || remote->stateCount == 0) {
+			continue;
+		}
+		plane = &planes[count++];
+
+		targetStep = (now - remote->timeOffset - NET_INTERPOLATION_DELAY) * NET_STEP_RATE;
+		for(k = 0; k < remote->stateCount - 1; k++) {
+			if((unsigned int)remote->states[k + 1].fields[NET_FIELD_STEP] > targetStep) {
+				break;
+			}
+		}
+		netDequantise(&remote->states[k], &before);
+		if(k == remote->stateCount - 1 || targetStep <= before.step) {
+			*plane = before;
+			continue;
+		}
+		netDequantise(&remote->states[k + 1], &after);
+
+		// Heading the short way round, rolls only when both are the same roll
+		amount = (float)((targetStep - before.step) / (double)(after.step - before.step));
+		*plane = before;
+		for(k = 0; k < 3; k++) {
+			plane->position[k] += (after.position[k] - before.position[k]) * amount;
+		}
+		turn = after.turnAngle - before.turnAngle;
+		if(turn > 180.0f) {
+			turn -= 360.0f;
+		} else if(turn < -180.0f) {
+			turn += 360.0f;
+		}
+		plane->turnAngle += turn * amount;
+		plane->sideTilt += (after.sideTilt - before.sideTilt) * amount;
+		if(before.isRolling == after.isRolling && before.isCrazyRolling == after.isCrazyRolling) {
+			plane->rollAmount += (after.rollAmount - before.rollAmount) * amount;
+			plane->rollHeight += (after.rollHeight - before.rollHeight) * amount;
+		}
+		plane->step = (unsigned int)targetStep;
+	}
+
+	client->stats.cpuTime += netTime() - startTime;
+	return count;
+}
+
+/************************************************************************
+
+	Function:		netRelayCreate
+
+	Description:	Opens the relay on the loopback address at the port.
+					Returns NULL when the socket can not be opened, most
+					likely because another relay has the port.
+
+*************************************************************************/
+NetRelay *netRelayCreate(int port) {
+	NetRelay *relay = (NetRelay*)memoryAllocZeroed(MEMORY_NETWORK, sizeof(NetRelay));
+
+	if(relay == NULL) {
+		return NULL;
+	}
+
+	relay->socket = netOpenSocket(port);
+	if(relay->socket == INVALID_SOCKET) {
+		memoryFree(relay);
+		return NULL;
+	}
+
+	return relay;
+}
+
+/************************************************************************
+
+	Function:		netRelayDestroy
+
+	Description:	Closes the relay. Does nothing for NULL.
+
+*************************************************************************/
+void netRelayDestroy(NetRelay *relay) {
+	if(relay == NULL) {
+		return;
+	}
+
+	netCloseSocket(relay->socket);
+	memoryFree(relay);
+}
+
+/************************************************************************
+
+	Function:		netRelayReceive
+
+	Description:	Waits up to waitTime seconds for a packet, then reads
+					every packet there is. A simulator it has not heard
+					from gets a free slot. Each state is read against the
+					state it names as its baseline and kept as the newest.
+					Simulators not heard from for NET_TIMEOUT are dropped.
+
+*************************************************************************/
+void netRelayReceive(NetRelay *relay, double now, double waitTime) {
+	NetBuffer buffer;
+	NetState state;
+	NetRelayClient *client;
+	fd_set readable;
+	struct timeval timeout;
+	unsigned char address[16];
+	unsigned int sequence = 0;
+	unsigned int baselineSequence = 0;
+	unsigned int worldAck = 0;
+	double startTime = 0.0;
+	int i = 0;
+
+	// Sleep until a packet comes in or the wait is over
+	FD_ZERO(&readable);
+	FD_SET(relay->socket, &readable);
+	timeout.tv_sec = (long)waitTime;
+	timeout.tv_usec = (long)((waitTime - timeout.tv_sec) * 1000000.0);
+	select((int)relay->socket + 1, &readable, NULL, NULL, &timeout);
+
+	startTime = netTime();
+	while(netReceivePacket(relay->socket, &buffer, address, &relay->stats)) {
+		// Simulator it came from, or a slot for a new one
+		client = NULL;
+		for(i = 0; i < NET_MAX_PLAYERS; i++) {
+			if(relay->clients[i].isUsed && netIsSameAddress(relay->clients[i].address, address)) {
+				client = &relay->clients[i];
+				break;
+			}
+		}
+		if(client == NULL && buffer.data[2] == NET_PACKET_STATE) {
+			for(i = 0; i < NET_MAX_PLAYERS; i++) {
+				if(!relay->clients[i].isUsed) {
+					client = &relay->clients[i];
+					memset(client, 0, sizeof(NetRelayClient));
+					client->isUsed = 1;
+					client->id = ++relay->nextId;
+					memcpy(client->address, address, sizeof(client->address));
+					relay->clientCount++;
+					break;
+				}
+			}
+			if(client == NULL) {
+				relay->clientsRefused++;
+			}
+		}
+		if(client == NULL || buffer.data[2] != NET_PACKET_STATE) {
+			relay->stats.packetsDropped++;
+			continue;
+		}
+		client->stats.bytesReceived += buffer.size;
+		client->stats.packetsReceived++;
+
+		sequence = netReadUnsigned(&buffer);
+		baselineSequence = netReadUnsigned(&buffer);
+		worldAck = netReadUnsigned(&buffer);
+		if(client->hasState && sequence <= client->stateSequence) {
+			buffer.isBad = 1;
+		}
+		if(baselineSequence != 0 && client->stateSequences[baselineSequence % NET_HISTORY] != baselineSequence) {
+			buffer.isBad = 1;
+		}
+		if(!buffer.isBad) {
+			netReadState(&buffer, &state, baselineSequence != 0 ? &client->states[baselineSequence % NET_HISTORY] : &netZeroState);
+		}
+		if(buffer.isBad) {
+			client->stats.packetsDropped++;
+			relay->stats.packetsDropped++;
+			continue;
+		}
+
+		client->states[sequence % NET_HISTORY] = state;
+		client->stateSequences[sequence % NET_HISTORY] = sequence;
+		client->stateSequence = sequence;
+		client->hasState = 1;
+		client->lastHeard = now;
+		if(worldAck > client->ackedWorld && worldAck <= client->sendSequence) {
+			client->ackedWorld = worldAck;
+		}
+	}
+
+	// Drop the ones that went quiet
+	for(i = 0; i < NET_MAX_PLAYERS; i++) {
+		if(relay->clients[i].isUsed && now - relay->clients[i].lastHeard > NET_TIMEOUT) {
+			relay->clients[i].isUsed = 0;
+			relay->clientCount--;
+		}
+	}
+
+	relay->stats.cpuTime += netTime() - startTime;
+}
+
+/************************************************************************
+
+	Function:		netRelaySend
+
+	Description:	Sends each simulator the newest state of every other
+					plane as a difference against the newest world it
+					acknowledged, or in full when there is none still kept,
+					and acknowledges its newest state.
+
+*************************************************************************/
+void netRelaySend(NetRelay *relay) {
+	NetBuffer buffer;
+	NetRelayClient *client;
+	NetRelayClient *other;
+	NetWorld *world;
+	const NetWorld *baselineWorld;
+	double startTime = netTime();
+	int stateStart = 0;
+	int stateBytes = 0;
+	int i = 0;
+	int k = 0;
+
+	for(i = 0; i < NET_MAX_PLAYERS; i++) {
+		client = &relay->clients[i];
+		if(!client->isUsed) {
+			continue;
+		}
+
+		client->sendSequence++;
+		world = &client->sentWorlds[client->sendSequence % NET_HISTORY];
+		world->sequence = client->sendSequence;
+		world->count = 0;
+		for(k = 0; k < NET_MAX_PLAYERS; k++) {
+			other = &relay->clients[k];
+			if(k != i && other->isUsed && other->hasState) {
+				world->ids[world->count] = other->id;
+				world->states[world->count] = other->states[other->stateSequence % NET_HISTORY];
+				world->count++;
+			}
+		}
+
+		baselineWorld = NULL;
+		if(client->ackedWorld != 0 && client->sendSequence - client->ackedWorld < NET_HISTORY) {
+			baselineWorld = &client->sentWorlds[client->ackedWorld % NET_HISTORY];
+		}
+
+		netStartPacket(&buffer, NET_PACKET_WORLD);
+		netWriteUnsigned(&buffer, world->sequence);
+		netWriteUnsigned(&buffer, baselineWorld != NULL ? baselineWorld->sequence : 0);
+		netWriteUnsigned(&buffer, client->stateSequence);
+		netWriteUnsigned(&buffer, world->count);
+		stateBytes = 0;
+		for(k = 0; k < world->count; k++) {
+			netWriteUnsigned(&buffer, world->ids[k]);
+			stateStart = buffer.size;
+			netWriteState(&buffer, &world->states[k], netFindState(baselineWorld, world->ids[k]));
+			stateBytes += buffer.size - stateStart;
+		}
+
+		if(netSendPacket(relay->socket, client->address, &buffer, &client->stats) > 0) {
+			client->stats.statesSent += world->count;
+			client->stats.stateBytes += stateBytes;
+			relay->stats.bytesSent += buffer.size;
+			relay->stats.packetsSent++;
+			relay->stats.statesSent += world->count;
+			relay->stats.stateBytes += stateBytes;
+		}
+	}
+
+	relay->stats.cpuTime += netTime() - startTime;
+}
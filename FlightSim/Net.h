@@ -0,0 +1,184 @@
+/*
+ * Net.h
+ * Mike Northorp
+ * Multiplayer over UDP through a relay. Each simulator sends its plane to
+ * the relay and the relay sends every simulator the planes of the others.
+ * Plane states are quantised to whole numbers and only the fields that
+ * changed since the last state the other side acknowledged are sent, as
+ * small differences. Remote planes are drawn a little in the past,
+ * interpolated between the states that came in. Does not depend on
+ * OpenGL so the relay runs without a window.
+ */
+
+#ifndef NET_H_
+#define NET_H_
+
+// Windows types, the sockets themselves are only used in Net.c
+#include <windows.h>
+
+/* Defines */
+
+// Port the relay listens on, on the loopback address
+#define NET_DEFAULT_PORT 27960
+// Most planes sharing the sky, the relay turns away any more
+#define NET_MAX_PLAYERS 32
+// States and worlds kept to be differences against, a power of two. An
+// acknowledgement older than this is too old and a full state is sent
+#define NET_HISTORY 32
+// Largest packet, under the usual network packet size
+#define NET_MAX_PACKET 1200
+// Packets sent each second both ways
+#define NET_SEND_RATE 20
+// Simulation steps each second, the plane states are stamped with a step
+#define NET_STEP_RATE 60
+// How far in the past remote planes are drawn, two packets' worth so
+// there is nearly always a state on each side
+#define NET_INTERPOLATION_DELAY 0.1
+// States kept for each remote plane to interpolate between
+#define NET_INTERPOLATION_STATES 16
+// Players not heard from for this long are dropped by the relay
+#define NET_TIMEOUT 3.0
+
+// Quantised fields of a plane state
+#define NET_FIELD_X 0
+#define NET_FIELD_Y 1
+#define NET_FIELD_Z 2
+#define NET_FIELD_TURN 3
+#define NET_FIELD_TILT 4
+#define NET_FIELD_ROLL_AMOUNT 5
+#define NET_FIELD_ROLL_HEIGHT 6
+#define NET_FIELD_ROLL_FLAGS 7
+#define NET_FIELD_STEP 8
+#define NET_FIELDS 9
+// Steps per position unit, per degree and per unit of roll height
+#define NET_POSITION_SCALE 256.0f
+#define NET_ANGLE_SCALE 64.0f
+#define NET_ROLL_HEIGHT_SCALE 1024.0f
+// Roll flags
+#define NET_ROLLING 1
+#define NET_CRAZY_ROLLING 2
+
+/* Typedefs and structs */
+
+// Plane as the simulation has it, placed in the whole world
+typedef struct {
+	double position[3];
+	// Heading and bank in degrees
+	float turnAngle;
+	float sideTilt;
+	// Barrel roll or crazy roll under way and how far along it is
+	int isRolling;
+	int isCrazyRolling;
+	float rollAmount;
+	float rollHeight;
+	// Simulation step of the plane it came from
+	unsigned int step;
+} NetPlane;
+
+// Plane as it is sent, every field a whole number
+typedef struct {
+	int fields[NET_FIELDS];
+} NetState;
+
+// Planes of every other player the relay sent a simulator in one packet
+typedef struct {
+	unsigned int sequence;
+	int count;
+	unsigned int ids[NET_MAX_PLAYERS];
+	NetState states[NET_MAX_PLAYERS];
+} NetWorld;
+
+// Bytes, packets and time spent, for the reports
+typedef struct {
+	unsigned long bytesSent;
+	unsigned long bytesReceived;
+	unsigned long packetsSent;
+	unsigned long packetsReceived;
+	// Packets that could not be read, or whose baseline was gone
+	unsigned long packetsDropped;
+	// Plane states sent and the bytes they took, without packet headers
+	unsigned long statesSent;
+	unsigned long stateBytes;
+	// Seconds spent sending, receiving and interpolating
+	double cpuTime;
+} NetStats;
+
+// A remote plane and the states that came in for it, newest last
+typedef struct {
+	// 0 when the slot is free
+	unsigned int id;
+	int stateCount;
+	NetState states[NET_INTERPOLATION_STATES];
+	// Arrival time less the state's step time, the smallest seen is the
+	// best guess at how the remote steps line up with the local clock
+	double timeOffset;
+} NetRemote;
+
+// One simulator's connection to the relay
+typedef struct {
+	UINT_PTR socket;
+	// Relay's address, a sockaddr_in
+	unsigned char relayAddress[16];
+
+	// States sent, by sequence, and the newest the relay acknowledged
+	unsigned int sendSequence;
+	NetState sentStates[NET_HISTORY];
+	unsigned int ackedSequence;
+
+	// Worlds received, by sequence, the newest is acknowledged
+	NetWorld worlds[NET_HISTORY];
+	unsigned int worldSequence;
+
+	NetRemote remotes[NET_MAX_PLAYERS];
+	NetStats stats;
+} NetClient;
+
+// The relay's view of one simulator
+typedef struct {
+	int isUsed;
+	unsigned int id;
+	unsigned char address[16];
+	double lastHeard;
+
+	// States received and their sequences, and the newest sequence
+	int hasState;
+	unsigned int stateSequence;
+	NetState states[NET_HISTORY];
+	unsigned int stateSequences[NET_HISTORY];
+
+	// Worlds sent, by sequence, and the newest it acknowledged
+	unsigned int sendSequence;
+	NetWorld sentWorlds[NET_HISTORY];
+	unsigned int ackedWorld;
+
+	NetStats stats;
+} NetRelayClient;
+
+// Relay every simulator sends its plane to
+typedef struct {
+	UINT_PTR socket;
+	unsigned int nextId;
+	int clientCount;
+	NetRelayClient clients[NET_MAX_PLAYERS];
+	NetStats stats;
+	// Simulators turned away because every slot was taken
+	unsigned long clientsRefused;
+} NetRelay;
+
+/* Function list */
+
+void netQuantise(const NetPlane *plane, NetState *state);
+void netDequantise(const NetState *state, NetPlane *plane);
+
+NetClient *netClientCreate(int port);
+void netClientDestroy(NetClient *client);
+void netClientSend(NetClient *client, const NetPlane *plane);
+void netClientReceive(NetClient *client, double now);
+int netClientRemotes(NetClient *client, double now, NetPlane *planes, int maxPlanes);
+
+NetRelay *netRelayCreate(int port);
+void netRelayDestroy(NetRelay *relay);
+void netRelayReceive(NetRelay *relay, double now, double waitTime);
+void netRelaySend(NetRelay *relay);
+
+#endif /* NET_H_ */
@@ -0,0 +1,434 @@
+
+/************************************************************************************
+
+	File: 			Occlusion.c
+
+	Description:	Occlusion culling against a small software depth buffer.
+					Occluder triangles are filled four texels at a time with
+					SSE edge functions, keeping the nearest depth. The
+					pyramid is then built four texels at a time keeping the
+					farthest depth of each 2 by 2 block. An object is tested
+					by projecting the corners of a hull around it, picking
+					the level where its screen rectangle covers at most 4 by
+					4 texels and checking whether its nearest depth is
+					behind all of them.
+					Texel centres are at whole numbers like the software
+					renderer. Occluders should sit inside the objects they
+					stand for so nothing is hidden that should be seen.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for occlusion types and functions
+#include "Occlusion.h"
+// Matrix functions for projecting corners
+#include "Matrix.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+// Math header
+#include <math.h>
+// SSE intrinsics
+#include <xmmintrin.h>
+
+/************************************************************************
+
+	Function:		occlusionCreate
+
+	Description:	Makes a depth buffer and its pyramid. The width is
+					rounded up to a multiple of 4. Returns NULL if memory
+					runs out.
+
+*************************************************************************/
+OcclusionBuffer *occlusionCreate(int width, int height) {
+	OcclusionBuffer *buffer = (OcclusionBuffer*)memoryAllocZeroed(MEMORY_OCCLUSION, sizeof(OcclusionBuffer));
+	int levelWidth = (width + 3) & ~3;
+	int levelHeight = height;
+
+	if(buffer == NULL) {
+		return NULL;
+	}
+
+	// Halve until a single texel covers the screen
+	while(buffer->levelCount < OCCLUSION_MAX_LEVELS) {
+		buffer->widths[buffer->levelCount] = levelWidth;
+		buffer->heights[buffer->levelCount] = levelHeight;
+		buffer->levels[buffer->levelCount] = (float*)memoryAlloc(MEMORY_OCCLUSION, levelWidth * levelHeight * sizeof(float));
+		if(buffer->levels[buffer->levelCount] == NULL) {
+			occlusionDestroy(buffer);
+			return NULL;
+		}
+		buffer->levelCount++;
+
+		if(levelWidth == 1 && levelHeight == 1) {
+			break;
+		}
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+
+	occlusionClear(buffer);
+	return buffer;
+}
+
+/************************************************************************
+
+	Function:		occlusionDestroy
+
+	Description:	Frees a depth buffer made by occlusionCreate.
+
+*************************************************************************/
+void occlusionDestroy(OcclusionBuffer *buffer) {
+	int i = 0;
+
+	if(buffer == NULL) {
+		return;
+	}
+
+	for(i = 0; i < buffer->levelCount; i++) {
+		memoryFree(buffer->levels[i]);
+	}
+	memoryFree(buffer);
+}
+
+/************************************************************************
+
+	Function:		occlusionClear
+
+	Description:	Sets the depth buffer to the far plane. The pyramid is
+					not touched until occlusionBuildPyramid.
+
+*************************************************************************/
+void occlusionClear(OcclusionBuffer *buffer) {
+	__m128 farPlane = _mm_set1_ps(1.0f);
+	float *depth = buffer->levels[0];
+	int count = buffer->widths[0] * buffer->heights[0];
+	int i = 0;
+
+	// Width is a multiple of 4 so the count is too
+	for(i = 0; i < count; i += 4) {
+		_mm_storeu_ps(depth + i, farPlane);
+	}
+
+	buffer->triangleCount = 0;
+}
+
+/************************************************************************
+
+	Function:		occlusionProject
+
+	Description:	Projects a point to window coordinates and depth.
+					Returns 0 if it is in front of the near plane or behind
+					the camera.
+
+*************************************************************************/
+static int occlusionProject(const OcclusionBuffer *buffer, const float *viewProjection, const float *position, float *window) {
+	float point[4];
+	float clip[4];
+
+	point[0] = position[0];
+	point[1] = position[1];
+	point[2] = position[2];
+	point[3] = 1.0f;
+	matrixTransform(viewProjection, point, clip);
+
+	if(clip[3] <= 0.0f || clip[2] < -clip[3]) {
+		return 0;
+	}
+
+	window[0] = (clip[0] / clip[3] * 0.5f + 0.5f) * buffer->widths[0] - 0.5f;
+	window[1] = (clip[1] / clip[3] * 0.5f + 0.5f) * buffer->heights[0] - 0.5f;
+	window[2] = clip[2] / clip[3] * 0.5f + 0.5f;
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		occlusionPlane
+
+	Description:	Evaluates A*x + B*y + C for four texels in a row.
+
+*************************************************************************/
+static __m128 occlusionPlane(const float *plane, __m128 laneX, float y) {
+	return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), laneX), _mm_set1_ps(plane[1] * y + plane[2]));
+}
+
+/************************************************************************
+
+	Function:		occlusionDrawTriangles
+
+	Description:	Draws occluder triangles into the depth buffer, keeping
+					the nearest depth. Positions are x, y, z and indices
+					come three to a triangle. Triangles reaching past the
+					near plane are left out, which only means less is
+					culled. Either winding is drawn.
+
+*************************************************************************/
+void occlusionDrawTriangles(OcclusionBuffer *buffer, const float *viewProjection, const float *positions, const int *indices, int triangleCount) {
+	int width = buffer->widths[0];
+	int height = buffer->heights[0];
+	__m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 edgeStep[3];
+	__m128 edgeValue[3];
+	__m128 depthStep, depth, oldDepth, inside, laneX;
+	// Window position and depth of each corner
+	float corners[3][3];
+	float swap[3];
+	// Edge opposite each corner and the depth, as A*x + B*y + C
+	float edges[3][3];
+	float plane[3];
+	float area = 0.0f;
+	float minCorner, maxCorner;
+	float *depthRow;
+	int minX, maxX, minY, maxY;
+	int isClipped = 0;
+	int t, i, k, a, b, x, y;
+
+	for(t = 0; t < triangleCount; t++) {
+		isClipped = 0;
+		for(i = 0; i < 3; i++) {
+			if(!occlusionProject(buffer, viewProjection, positions + indices[t * 3 + i] * 3, corners[i])) {
+				isClipped = 1;
+			}
+		}
+		if(isClipped) {
+			continue;
+		}
+
+		// Counter clockwise on screen so the inside of every edge is positive
+		area = (corners[1][0] - corners[0][0]) * (corners[2][1] - corners[0][1]) - (corners[2][0] - corners[0][0]) * (corners[1][1] - corners[0][1]);
+		if(fabs(area) < 1e-6f) {
+			continue;
+		}
+		if(area < 0.0f) {
+			for(k = 0; k < 3; k++) {
+				swap[k] = corners[1][k];
+				corners[1][k] = corners[2][k];
+				corners[2][k] = swap[k];
+			}
+			area = -area;
+		}
+
+		for(i = 0; i < 3; i++) {
+			a = (i + 1) % 3;
+			b = (i + 2) % 3;
+			edges[i][0] = corners[a][1] - corners[b][1];
+			edges[i][1] = corners[b][0] - corners[a][0];
+			edges[i][2] = corners[a][0] * corners[b][1] - corners[a][1] * corners[b][0];
+		}
+
+		// Depth through the barycentric weights, each edge over the area
+		for(k = 0; k < 3; k++) {
+			plane[k] = (edges[0][k] * corners[0][2] + edges[1][k] * corners[1][2] + edges[2][k] * corners[2][2]) / area;
+		}
+
+		// Texel centres it can cover
+		minCorner = corners[0][0] < corners[1][0] ? corners[0][0] : corners[1][0];
+		minCorner = minCorner < corners[2][0] ? minCorner : corners[2][0];
+		maxCorner = corners[0][0] > corners[1][0] ? corners[0][0] : corners[1][0];
+		maxCorner = maxCorner > corners[2][0] ? maxCorner : corners[2][0];
+		minX = (int)ceil(minCorner);
+		maxX = (int)floor(maxCorner);
+		minCorner = corners[0][1] < corners[1][1] ? corners[0][1] : corners[1][1];
+		minCorner = minCorner < corners[2][1] ? minCorner : corners[2][1];
+		maxCorner = corners[0][1] > corners[1][1] ? corners[0][1] : corners[1][1];
+		maxCorner = maxCorner > corners[2][1] ? maxCorner : corners[2][1];
+		minY = (int)ceil(minCorner);
+		maxY = (int)floor(maxCorner);
+		if(minX < 0) {
+			minX = 0;
+		}
+		if(minY < 0) {
+			minY = 0;
+		}
+		if(maxX > width - 1) {
+			maxX = width - 1;
+		}
+		if(maxY > height - 1) {
+			maxY = height - 1;
+		}
+		if(minX > maxX || minY > maxY) {
+			continue;
+		}
+
+		// Start on a multiple of 4, the width is one so the last four never run over
+		minX &= ~3;
+		for(i = 0; i < 3; i++) {
+			edgeStep[i] = _mm_set1_ps(edges[i][0] * 4.0f);
+		}
+		depthStep = _mm_set1_ps(plane[0] * 4.0f);
+
+		for(y = minY; y <= maxY; y++) {
+			depthRow = buffer->levels[0] + y * width;
+			laneX = _mm_add_ps(_mm_set1_ps((float)minX), laneOffsets);
+			for(i = 0; i < 3; i++) {
+				edgeValue[i] = occlusionPlane(edges[i], laneX, (float)y);
+			}
+			depth = occlusionPlane(plane, laneX, (float)y);
+
+			for(x = minX; x <= maxX; x += 4) {
+				inside = _mm_and_ps(_mm_cmpge_ps(edgeValue[0], zero), _mm_and_ps(_mm_cmpge_ps(edgeValue[1], zero), _mm_cmpge_ps(edgeValue[2], zero)));
+				if(_mm_movemask_ps(inside)) {
+					// Keep the nearer depth where the texel is inside
+					oldDepth = _mm_loadu_ps(depthRow + x);
+					_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(depth, oldDepth)), _mm_andnot_ps(inside, oldDepth)));
+				}
+
+				// Next four texels
+				for(i = 0; i < 3; i++) {
+					edgeValue[i] = _mm_add_ps(edgeValue[i], edgeStep[i]);
+				}
+				depth = _mm_add_ps(depth, depthStep);
+			}
+		}
+
+		buffer->triangleCount++;
+	}
+}
+
+/************************************************************************
+
+	Function:		occlusionBuildPyramid
+
+	Description:	Fills each level of the pyramid from the one below,
+					keeping the farthest depth of every 2 by 2 block. Odd
+					sizes repeat the last row or column.
+
+*************************************************************************/
+void occlusionBuildPyramid(OcclusionBuffer *buffer) {
+	const float *row0;
+	const float *row1;
+	float *result;
+	__m128 left, right;
+	float farthest;
+	int sourceWidth, sourceHeight, width, height;
+	int level, x, y, x0, x1;
+
+	for(level = 1; level < buffer->levelCount; level++) {
+		sourceWidth = buffer->widths[level - 1];
+		sourceHeight = buffer->heights[level - 1];
+		width = buffer->widths[level];
+		height = buffer->heights[level];
+
+		for(y = 0; y < height; y++) {
+			row0 = buffer->levels[level - 1] + (2 * y) * sourceWidth;
+			row1 = buffer->levels[level - 1] + (2 * y + 1 < sourceHeight ? 2 * y + 1 : 2 * y) * sourceWidth;
+			result = buffer->levels[level] + y * width;
+
+			// Four texels from eight at a time, the rows first then neighbouring pairs
+			for(x = 0; x + 4 <= width && 2 * x + 8 <= sourceWidth; x += 4) {
+				left = _mm_max_ps(_mm_loadu_ps(row0 + 2 * x), _mm_loadu_ps(row1 + 2 * x));
+				right = _mm_max_ps(_mm_loadu_ps(row0 + 2 * x + 4), _mm_loadu_ps(row1 + 2 * x + 4));
+				_mm_storeu_ps(result + x, _mm_max_ps(_mm_shuffle_ps(left, right, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(left, right, _MM_SHUFFLE(3, 1, 3, 1))));
+			}
+
+			// The rest one at a time
+			for(; x < width; x++) {
+				x0 = 2 * x;
+				x1 = 2 * x + 1 < sourceWidth ? 2 * x + 1 : 2 * x;
+				farthest = row0[x0];
+				farthest = row0[x1] > farthest ? row0[x1] : farthest;
+				farthest = row1[x0] > farthest ? row1[x0] : farthest;
+				farthest = row1[x1] > farthest ? row1[x1] : farthest;
+				result[x] = farthest;
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		occlusionTestPoints
+
+	Description:	Tests the convex hull of some world space points, x, y
+					and z each, against the pyramid. Returns
+					OCCLUSION_OCCLUDED if it is behind everything drawn over
+					it, OCCLUSION_OUTSIDE if it is off the screen and
+					OCCLUSION_VISIBLE otherwise, including when it reaches
+					through the near plane.
+
+*************************************************************************/
+int occlusionTestPoints(const OcclusionBuffer *buffer, const float *viewProjection, const float *points, int pointCount) {
+	float window[3];
+	float minX = 0.0f;
+	float maxX = 0.0f;
+	float minY = 0.0f;
+	float maxY = 0.0f;
+	float nearest = 1.0f;
+	// Corners in front of the near plane or behind the camera
+	int clippedCount = 0;
+	int projectedCount = 0;
+	int x0, x1, y0, y1;
+	int level = 0;
+	int i, x, y;
+
+	// The nearest point of the hull is one of the points
+	for(i = 0; i < pointCount; i++) {
+		if(!occlusionProject(buffer, viewProjection, points + i * 3, window)) {
+			clippedCount++;
+			continue;
+		}
+
+		if(projectedCount == 0 || window[0] < minX) {
+			minX = window[0];
+		}
+		if(projectedCount == 0 || window[0] > maxX) {
+			maxX = window[0];
+		}
+		if(projectedCount == 0 || window[1] < minY) {
+			minY = window[1];
+		}
+		if(projectedCount == 0 || window[1] > maxY) {
+			maxY = window[1];
+		}
+		if(projectedCount == 0 || window[2] < nearest) {
+			nearest = window[2];
+		}
+		projectedCount++;
+	}
+
+	// All behind the near plane can not be seen, part way through could cover anything
+	if(clippedCount == pointCount) {
+		return OCCLUSION_OUTSIDE;
+	}
+	if(clippedCount > 0) {
+		return OCCLUSION_VISIBLE;
+	}
+
+	// Off the sides of the screen or past the far plane
+	if(maxX < -0.5f || minX > buffer->widths[0] - 0.5f || maxY < -0.5f || minY > buffer->heights[0] - 0.5f || nearest > 1.0f) {
+		return OCCLUSION_OUTSIDE;
+	}
+
+	// Texels under the rectangle, each covers half a texel either side of its centre
+	x0 = (int)floor(minX + 0.5f);
+	x1 = (int)floor(maxX + 0.5f);
+	y0 = (int)floor(minY + 0.5f);
+	y1 = (int)floor(maxY + 0.5f);
+	x0 = x0 < 0 ? 0 : x0;
+	y0 = y0 < 0 ? 0 : y0;
+	x1 = x1 > buffer->widths[0] - 1 ? buffer->widths[0] - 1 : x1;
+	y1 = y1 > buffer->heights[0] - 1 ? buffer->heights[0] - 1 : y1;
+
+	// Go up until the rectangle covers few enough texels
+	while(level < buffer->levelCount - 1 && (x1 - x0 >= OCCLUSION_TEST_TEXELS || y1 - y0 >= OCCLUSION_TEST_TEXELS)) {
+		x0 >>= 1;
+		x1 >>= 1;
+		y0 >>= 1;
+		y1 >>= 1;
+		level++;
+	}
+
+	for(y = y0; y <= y1; y++) {
+		for(x = x0; x <= x1; x++) {
+			if(nearest <= buffer->levels[level][y * buffer->widths[level] + x]) {
+				return OCCLUSION_VISIBLE;
+			}
+		}
+	}
+
+	return OCCLUSION_OCCLUDED;
+}
@@ -0,0 +1,51 @@
+/*
+ * Occlusion.h
+ * Mike Northorp
+ * Occlusion culling on the CPU. A few large occluders are drawn into a
+ * small depth buffer, which is reduced into a pyramid keeping the farthest
+ * depth of each block, and object bounds are tested against it before
+ * they are drawn. Does not depend on OpenGL so it can run on any thread.
+ */
+
+#ifndef OCCLUSION_H_
+#define OCCLUSION_H_
+
+/* Defines */
+
+// Most levels in the depth pyramid, enough for a 4096 texel wide buffer
+#define OCCLUSION_MAX_LEVELS 13
+
+// Widest a tested rectangle can be in texels at the level it is tested on,
+// the pyramid level is picked to fit it
+#define OCCLUSION_TEST_TEXELS 4
+
+// Results of testing a box
+#define OCCLUSION_VISIBLE 0
+#define OCCLUSION_OCCLUDED 1
+#define OCCLUSION_OUTSIDE 2
+
+/* Typedefs and structs */
+
+// Depth buffer and the pyramid made from it. Depths go from 0 at the near
+// plane to 1 at the far plane like the OpenGL depth buffer. Level 0 is the
+// depth buffer, each level after it is half the size and keeps the
+// farthest depth of the 2 by 2 texels under each texel
+typedef struct {
+	int levelCount;
+	int widths[OCCLUSION_MAX_LEVELS];
+	int heights[OCCLUSION_MAX_LEVELS];
+	float *levels[OCCLUSION_MAX_LEVELS];
+	// Occluder triangles drawn since the last clear
+	int triangleCount;
+} OcclusionBuffer;
+
+/* Function list */
+
+OcclusionBuffer *occlusionCreate(int width, int height);
+void occlusionDestroy(OcclusionBuffer *buffer);
+void occlusionClear(OcclusionBuffer *buffer);
+void occlusionDrawTriangles(OcclusionBuffer *buffer, const float *viewProjection, const float *positions, const int *indices, int triangleCount);
+void occlusionBuildPyramid(OcclusionBuffer *buffer);
+int occlusionTestPoints(const OcclusionBuffer *buffer, const float *viewProjection, const float *points, int pointCount);
+
+#endif /* OCCLUSION_H_ */
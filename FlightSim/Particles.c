@@ -0,0 +1,356 @@
+
+/************************************************************************************
+
+	File: 			Particles.c
+
+	Description:	Fixed capacity particle pools kept as a structure of
+					arrays. Every array of a pool comes out of one block
+					allocated when the pool is made. The update moves each
+					chunk of particles four at a time with SSE, drops the
+					ones past their life while keeping the rest in order at
+					the start of the chunk and writes what the shaders
+					read. The chunks are then closed up so the live
+					particles are first again.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for particle types and functions
+#include "Particles.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+// memmove
+#include <string.h>
+// Math header
+#include <math.h>
+// SSE intrinsics
+#include <xmmintrin.h>
+
+// Arrays of a particle each, then the position and size drawn for each
+#define PARTICLE_ARRAYS 8
+// Floats in a pool's block for each particle
+#define PARTICLE_FLOATS (PARTICLE_ARRAYS + PARTICLE_DRAW_FLOATS + 1)
+
+/************************************************************************
+
+	Function:		particleRun
+
+	Description:	Runs a task over the thread pool, or on this thread when
+					there is no pool.
+
+*************************************************************************/
+static void particleRun(ParticlePool *particles, ThreadPoolTask task, int taskCount) {
+	int i = 0;
+
+	if(particles->threadPool != NULL) {
+		threadPoolRun(particles->threadPool, task, particles, taskCount);
+	} else {
+		for(i = 0; i < taskCount; i++) {
+			task(particles, i);
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		particleRandom
+
+	Description:	Next random number from -1 to 1 for the spread.
+
+*************************************************************************/
+static float particleRandom(ParticlePool *particles) {
+	particles->seed = particles->seed * 1664525u + 1013904223u;
+	return (particles->seed >> 8) / 8388608.0f - 1.0f;
+}
+
+/************************************************************************
+
+	Function:		particleCreate
+
+	Description:	Makes an empty pool with room for capacity particles,
+					rounded up to whole chunks. The thread pool can be NULL
+					to update on the calling thread.
+
+*************************************************************************/
+ParticlePool *particleCreate(int capacity, const ParticleMotion *motion, ThreadPool *threadPool) {
+	ParticlePool *particles = (ParticlePool*)memoryAllocZeroed(MEMORY_PARTICLES, sizeof(ParticlePool));
+	float *block;
+	int i = 0;
+
+	if(particles == NULL) {
+		return NULL;
+	}
+
+	capacity = (capacity + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK * PARTICLE_CHUNK;
+	block = (float*)memoryAllocZeroed(MEMORY_PARTICLES, (size_t)capacity * PARTICLE_FLOATS * sizeof(float));
+	particles->chunkCounts = (int*)memoryAllocZeroed(MEMORY_PARTICLES, capacity / PARTICLE_CHUNK * sizeof(int));
+	if(block == NULL || particles->chunkCounts == NULL) {
+		memoryFree(block);
+		particleDestroy(particles);
+		return NULL;
+	}
+
+	// Each array is a stretch of the block, positionX first so it frees the block
+	particles->positionX = block;
+	particles->positionY = block + capacity;
+	particles->positionZ = block + 2 * capacity;
+	particles->velocityX = block + 3 * capacity;
+	particles->velocityY = block + 4 * capacity;
+	particles->velocityZ = block + 5 * capacity;
+	particles->age = block + 6 * capacity;
+	particles->life = block + 7 * capacity;
+	particles->drawData = block + PARTICLE_ARRAYS * capacity;
+	particles->drawFades = block + (PARTICLE_ARRAYS + PARTICLE_DRAW_FLOATS) * capacity;
+	// The last lanes of an update can read unused places, keep their fade
+	// from dividing by zero
+	for(i = 0; i < capacity; i++) {
+		particles->life[i] = 1.0f;
+	}
+
+	particles->threadPool = threadPool;
+	particles->motion = *motion;
+	particles->capacity = capacity;
+	particles->seed = 1;
+
+	return particles;
+}
+
+/************************************************************************
+
+	Function:		particleDestroy
+
+	Description:	Frees a pool. Does nothing for NULL.
+
+*************************************************************************/
+void particleDestroy(ParticlePool *particles) {
+	if(particles == NULL) {
+		return;
+	}
+
+	memoryFree(particles->positionX);
+	memoryFree(particles->chunkCounts);
+	memoryFree(particles);
+}
+
+/************************************************************************
+
+	Function:		particleEmit
+
+	Description:	Adds count particles spread evenly along the line from
+					one point to another, so a fast emitter leaves an
+					unbroken trail, each with the velocity plus up to spread
+					either way on each axis and up to the life given. Past
+					the capacity the rest are dropped. Returns how many
+					were added.
+
+*************************************************************************/
+int particleEmit(ParticlePool *particles, int count, const float *from, const float *to, const float *velocity, float spread, float life) {
+	float along = 0.0f;
+	int added = count;
+	int i = 0;
+	int k = 0;
+
+	if(particles->count + added > particles->capacity) {
+		added = particles->capacity - particles->count;
+		particles->droppedCount += count - added;
+	}
+
+	for(i = 0; i < added; i++) {
+		k = particles->count + i;
+		along = (i + 0.5f + 0.5f * particleRandom(particles)) / count;
+		particles->positionX[k] = from[0] + (to[0] - from[0]) * along;
+		particles->positionY[k] = from[1] + (to[1] - from[1]) * along;
+		particles->positionZ[k] = from[2] + (to[2] - from[2]) * along;
+		particles->velocityX[k] = velocity[0] + spread * particleRandom(particles);
+		particles->velocityY[k] = velocity[1] + spread * particleRandom(particles);
+		particles->velocityZ[k] = velocity[2] + spread * particleRandom(particles);
+		// Between half and all of the life so they do not all go at once
+		particles->age[k] = 0.0f;
+		particles->life[k] = life * (0.75f + 0.25f * particleRandom(particles));
+	}
+
+	particles->count += added;
+	particles->emittedCount += added;
+	return added;
+}
+
+/************************************************************************
+
+	Function:		particleUpdateTask
+
+	Description:	Moves one chunk of particles on by the time step four
+					at a time, keeps the ones still alive in order at the
+					start of the chunk and writes their position, size and
+					fade for the shaders.
+
+*************************************************************************/
+static void particleUpdateTask(void *context, int index) {
+	ParticlePool *particles = (ParticlePool*)context;
+	int first = index * PARTICLE_CHUNK;
+	int last = first + PARTICLE_CHUNK;
+	// Values of every particle, to move the live ones down together
+	float *arrays[PARTICLE_ARRAYS];
+	__m128 timeStep = _mm_set1_ps(particles->timeStep);
+	__m128 keepVelocity = _mm_set1_ps(particles->keepVelocity);
+	__m128 fall = _mm_set1_ps(particles->motion.gravity * particles->timeStep);
+	__m128 startSize = _mm_set1_ps(particles->motion.startSize);
+	__m128 growth = _mm_set1_ps(particles->motion.growth);
+	__m128 velocity[3];
+	__m128 position[3];
+	__m128 age;
+	__m128 size;
+	int live = 0;
+	int i = 0;
+	int k = 0;
+
+	if(last > particles->count) {
+		last = particles->count;
+	}
+
+	// Velocity slows with the drag and falls with the gravity, then moves
+	// the particle. Past the count the lanes move unused places, the
+	// capacity is whole chunks so they are always there
+	for(i = first; i < last; i += 4) {
+		velocity[0] = _mm_mul_ps(_mm_loadu_ps(particles->velocityX + i), keepVelocity);
+		velocity[1] = _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(particles->velocityY + i), keepVelocity), fall);
+		velocity[2] = _mm_mul_ps(_mm_loadu_ps(particles->velocityZ + i), keepVelocity);
+		position[0] = _mm_add_ps(_mm_loadu_ps(particles->positionX + i), _mm_mul_ps(velocity[0], timeStep));
+		position[1] = _mm_add_ps(_mm_loadu_ps(particles->positionY + i), _mm_mul_ps(velocity[1], timeStep));
+		position[2] = _mm_add_ps(_mm_loadu_ps(particles->positionZ + i), _mm_mul_ps(velocity[2], timeStep));
+		_mm_storeu_ps(particles->velocityX + i, velocity[0]);
+		_mm_storeu_ps(particles->velocityY + i, velocity[1]);
+		_mm_storeu_ps(particles->velocityZ + i, velocity[2]);
+		_mm_storeu_ps(particles->positionX + i, position[0]);
+		_mm_storeu_ps(particles->positionY + i, position[1]);
+		_mm_storeu_ps(particles->positionZ + i, position[2]);
+		_mm_storeu_ps(particles->age + i, _mm_add_ps(_mm_loadu_ps(particles->age + i), timeStep));
+	}
+
+	// Close up behind the ones past their life
+	arrays[0] = particles->positionX;
+	arrays[1] = particles->positionY;
+	arrays[2] = particles->positionZ;
+	arrays[3] = particles->velocityX;
+	arrays[4] = particles->velocityY;
+	arrays[5] = particles->velocityZ;
+	arrays[6] = particles->age;
+	arrays[7] = particles->life;
+	live = first;
+	for(i = first; i < last; i++) {
+		if(particles->age[i] < particles->life[i]) {
+			if(live != i) {
+				for(k = 0; k < PARTICLE_ARRAYS; k++) {
+					arrays[k][live] = arrays[k][i];
+				}
+			}
+			live++;
+		}
+	}
+
+	// Position and size together for each particle, four turned from
+	// columns into rows at a time, and how far through its life each is
+	for(i = first; i < live; i += 4) {
+		position[0] = _mm_loadu_ps(particles->positionX + i);
+		position[1] = _mm_loadu_ps(particles->positionY + i);
+		position[2] = _mm_loadu_ps(particles->positionZ + i);
+		age = _mm_loadu_ps(particles->age + i);
+		size = _mm_add_ps(startSize, _mm_mul_ps(growth, age));
+		_MM_TRANSPOSE4_PS(position[0], position[1], position[2], size);
+		_mm_storeu_ps(particles->drawData + PARTICLE_DRAW_FLOATS * i, position[0]);
+		_mm_storeu_ps(particles->drawData + PARTICLE_DRAW_FLOATS * (i + 1), position[1]);
+		_mm_storeu_ps(particles->drawData + PARTICLE_DRAW_FLOATS * (i + 2), position[2]);
+		_mm_storeu_ps(particles->drawData + PARTICLE_DRAW_FLOATS * (i + 3), size);
+		_mm_storeu_ps(particles->drawFades + i, _mm_div_ps(age, _mm_loadu_ps(particles->life + i)));
+	}
+
+	particles->chunkCounts[index] = live - first;
+}
+
+/************************************************************************
+
+	Function:		particleUpdate
+
+	Description:	Moves every particle on by the time step in seconds and
+					drops the ones past their life. Each chunk is a task
+					of its own, then the live particles of each chunk are
+					moved down to follow the chunk before.
+
+*************************************************************************/
+void particleUpdate(ParticlePool *particles, float timeStep) {
+	// Every array that has to close up, and the floats of each particle in it
+	float *arrays[PARTICLE_ARRAYS + 2];
+	int floats[PARTICLE_ARRAYS + 2];
+	int chunkCount = (particles->count + PARTICLE_CHUNK - 1) / PARTICLE_CHUNK;
+	int first = 0;
+	int count = 0;
+	int i = 0;
+	int k = 0;
+
+	if(particles->count == 0) {
+		return;
+	}
+
+	particles->timeStep = timeStep;
+	particles->keepVelocity = (float)exp(-particles->motion.drag * timeStep);
+	particleRun(particles, particleUpdateTask, chunkCount);
+
+	arrays[0] = particles->positionX;
+	arrays[1] = particles->positionY;
+	arrays[2] = particles->positionZ;
+	arrays[3] = particles->velocityX;
+	arrays[4] = particles->velocityY;
+	arrays[5] = particles->velocityZ;
+	arrays[6] = particles->age;
+	arrays[7] = particles->life;
+	arrays[8] = particles->drawData;
+	arrays[9] = particles->drawFades;
+	for(k = 0; k < PARTICLE_ARRAYS + 2; k++) {
+		floats[k] = 1;
+	}
+	floats[8] = PARTICLE_DRAW_FLOATS;
+
+	for(i = 0; i < chunkCount; i++) {
+		first = i * PARTICLE_CHUNK;
+		if(first != count && particles->chunkCounts[i] > 0) {
+			for(k = 0; k < PARTICLE_ARRAYS + 2; k++) {
+				memmove(arrays[k] + count * floats[k], arrays[k] + first * floats[k], particles->chunkCounts[i] * floats[k] * sizeof(float));
+			}
+		}
+		count += particles->chunkCounts[i];
+	}
+
+	particles->count = count;
+}
+
+/************************************************************************
+
+	Function:		particleClear
+
+	Description:	Drops every particle in the pool.
+
+*************************************************************************/
+void particleClear(ParticlePool *particles) {
+	particles->count = 0;
+}
+
+/************************************************************************
+
+	Function:		particleShift
+
+	Description:	Moves every live particle by the same amount, for when
+					the world is moved under them. What the shaders read
+					follows at the next update.
+
+*************************************************************************/
+void particleShift(ParticlePool *particles, float x, float y, float z) {
+	int i = 0;
+
+	for(i = 0; i < particles->count; i++) {
+		particles->positionX[i] += x;
+		particles->positionY[i] += y;
+		particles->positionZ[i] += z;
+	}
+}
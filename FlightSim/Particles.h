@@ -0,0 +1,83 @@
+/*
+ * Particles.h
+ * Mike Northorp
+ * Pools of short lived particles for exhaust, contrails and spray. Each
+ * pool has a fixed capacity set when it is made and keeps every value in
+ * an array of its own, so nothing is allocated while particles come and
+ * go and the update runs four particles at a time with SSE across a
+ * thread pool. Does not depend on OpenGL so it can run without a window.
+ */
+
+#ifndef PARTICLES_H_
+#define PARTICLES_H_
+
+// Worker threads
+#include "ThreadPool.h"
+
+/* Defines */
+
+// Particles given to a thread at a time, a multiple of 4. Capacities are
+// rounded up to it
+#define PARTICLE_CHUNK 1024
+// Floats drawn for each particle: position and size
+#define PARTICLE_DRAW_FLOATS 4
+
+/* Typedefs and structs */
+
+// How the particles of a pool move and grow, the same for all of them
+typedef struct {
+	// Pulls down in units a second squared, below zero floats up
+	float gravity;
+	// Share of the velocity lost each second
+	float drag;
+	// Size when emitted and how much it grows each second
+	float startSize;
+	float growth;
+} ParticleMotion;
+
+// Fixed capacity pool of particles, live ones are always first
+typedef struct {
+	// NULL to update on the calling thread only
+	ThreadPool *threadPool;
+	ParticleMotion motion;
+	int capacity;
+	int count;
+
+	// One value of every particle in each array
+	float *positionX;
+	float *positionY;
+	float *positionZ;
+	float *velocityX;
+	float *velocityY;
+	float *velocityZ;
+	float *age;
+	float *life;
+
+	// What the shaders read: position and size, then how far through its
+	// life each particle is from 0 to 1
+	float *drawData;
+	float *drawFades;
+
+	// Current update
+	float timeStep;
+	float keepVelocity;
+	// Live particles each chunk kept
+	int *chunkCounts;
+	// Random spread, particles are only emitted from one thread
+	unsigned int seed;
+
+	// Totals since the pool was made
+	unsigned long emittedCount;
+	unsigned long droppedCount;
+} ParticlePool;
+
+/* Function list */
+
+ParticlePool *particleCreate(int capacity, const ParticleMotion *motion, ThreadPool *threadPool);
+void particleDestroy(ParticlePool *particles);
+int particleEmit(ParticlePool *particles, int count, const float *from, const float *to, const float *velocity, float spread, float life);
+void particleUpdate(ParticlePool *particles, float timeStep);
+void particleClear(ParticlePool *particles);
+void particleShift(ParticlePool *particles, float x, float y, float z);
+
+#endif /* PARTICLES_H_ */
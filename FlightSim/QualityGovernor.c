@@ -0,0 +1,96 @@
+
+/************************************************************************************
+
+	File: 			QualityGovernor.c
+
+	Description:	Picks a quality level from recent frame times. Frame times
+					are averaged over a window and the level only moves at the
+					end of a window. Going down a level takes one window over
+					the budget, going back up takes several windows well under
+					it, so the level does not flip back and forth around the
+					budget. The history starts over after every change so the
+					new level is judged on its own frames.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for governor types and functions
+#include "QualityGovernor.h"
+
+/************************************************************************
+
+	Function:		governorInit
+
+	Description:	Starts the governor at the best quality level.
+
+*************************************************************************/
+void governorInit(QualityGovernor *governor, int levelCount, double budget) {
+	governor->level = 0;
+	governor->levelCount = levelCount;
+	governor->budget = budget;
+	governor->averageFrameTime = 0.0;
+	governorReset(governor);
+}
+
+/************************************************************************
+
+	Function:		governorReset
+
+	Description:	Forgets the frame times seen so far, used after a change
+					and when frame times stop meaning anything like after a
+					resize.
+
+*************************************************************************/
+void governorReset(QualityGovernor *governor) {
+	governor->frameTimeSum = 0.0;
+	governor->frameCount = 0;
+	governor->windowsUnderBudget = 0;
+}
+
+/************************************************************************
+
+	Function:		governorAddFrame
+
+	Description:	Adds the time of one frame in seconds. At the end of a
+					window it returns GOVERNOR_DROP or GOVERNOR_RAISE if it
+					moved the level, otherwise GOVERNOR_KEEP.
+
+*************************************************************************/
+int governorAddFrame(QualityGovernor *governor, double frameTime) {
+	governor->frameTimeSum += frameTime;
+	governor->frameCount++;
+	if(governor->frameCount < GOVERNOR_WINDOW) {
+		return GOVERNOR_KEEP;
+	}
+
+	// Window is full, judge it and start the next one
+	governor->averageFrameTime = governor->frameTimeSum / governor->frameCount;
+	governor->frameTimeSum = 0.0;
+	governor->frameCount = 0;
+
+	// Over budget, drop right away
+	if(governor->averageFrameTime > governor->budget * GOVERNOR_DROP_RATIO) {
+		governor->windowsUnderBudget = 0;
+		if(governor->level < governor->levelCount - 1) {
+			governor->level++;
+			return GOVERNOR_DROP;
+		}
+		return GOVERNOR_KEEP;
+	}
+
+	// Well under budget for long enough, try the next level up
+	if(governor->averageFrameTime < governor->budget * GOVERNOR_RAISE_RATIO) {
+		governor->windowsUnderBudget++;
+		if(governor->windowsUnderBudget >= GOVERNOR_RAISE_WINDOWS && governor->level > 0) {
+			governor->level--;
+			governor->windowsUnderBudget = 0;
+			return GOVERNOR_RAISE;
+		}
+		return GOVERNOR_KEEP;
+	}
+
+	// In between, stay put
+	governor->windowsUnderBudget = 0;
+	return GOVERNOR_KEEP;
+}
@@ -0,0 +1,52 @@
+/*
+ * QualityGovernor.h
+ * Mike Northorp
+ * Watches recent frame times and picks a quality level that keeps them
+ * inside a budget. Level 0 is the best quality, higher levels are cheaper.
+ * Only decides on the level, the caller maps levels to settings.
+ */
+
+#ifndef QUALITYGOVERNOR_H_
+#define QUALITYGOVERNOR_H_
+
+/* Defines */
+
+// Frames averaged for each decision
+#define GOVERNOR_WINDOW 30
+// Drop quality when the average is over the budget by this much
+#define GOVERNOR_DROP_RATIO 1.1
+// Raise quality only when the average is this far under the budget
+#define GOVERNOR_RAISE_RATIO 0.7
+// Windows in a row under the budget before quality is raised
+#define GOVERNOR_RAISE_WINDOWS 3
+
+// Decisions
+#define GOVERNOR_KEEP 0
+#define GOVERNOR_DROP 1
+#define GOVERNOR_RAISE 2
+
+/* Typedefs and structs */
+
+typedef struct {
+	// Current level and how many there are
+	int level;
+	int levelCount;
+	// Seconds a frame should take
+	double budget;
+
+	// Frame times of the current window
+	double frameTimeSum;
+	int frameCount;
+	// Windows in a row that were far enough under the budget
+	int windowsUnderBudget;
+	// Average of the last full window
+	double averageFrameTime;
+} QualityGovernor;
+
+/* Function list */
+
+void governorInit(QualityGovernor *governor, int levelCount, double budget);
+void governorReset(QualityGovernor *governor);
+int governorAddFrame(QualityGovernor *governor, double frameTime);
+
+#endif /* QUALITYGOVERNOR_H_ */
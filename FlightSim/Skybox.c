@@ -0,0 +1,306 @@
+
+/************************************************************************************
+
+	File: 			Skybox.c
+
+	Description:	Turns the sky cylinder texture into cube map faces. Every
+					texel of a face is a direction from the eye, the direction
+					is followed out to the cylinder wall and the sky texture is
+					sampled where it hits. Above the open top and below the
+					bottom the nearest row is used. Images are RGB with the
+					first row at t = 0, the way glTexImage2D takes them, and
+					are read as P3 or P6 PPM files and written as P6.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for skybox types and functions
+#include "Skybox.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+// Math header
+#include <math.h>
+// File read and write
+#include <stdio.h>
+// sprintf
+#include <string.h>
+
+// Two times PI for going around the cylinder
+#define SKYBOX_TWO_PI 6.28318531f
+
+/************************************************************************
+
+	Function:		skyboxFaceDirection
+
+	Description:	Gives the direction through the point s, t (0 to 1) of a
+					cube map face, following the face layout in the OpenGL
+					specification. The direction is not normalized.
+
+*************************************************************************/
+void skyboxFaceDirection(int face, float s, float t, float *direction) {
+	// Position on the face from -1 to 1
+	float sc = 2.0f * s - 1.0f;
+	float tc = 2.0f * t - 1.0f;
+
+	switch(face) {
+		case 0:
+			direction[0] = 1.0f;
+			direction[1] = -tc;
+			direction[2] = -sc;
+			break;
+		case 1:
+			direction[0] = -1.0f;
+			direction[1] = -tc;
+			direction[2] = sc;
+			break;
+		case 2:
+			direction[0] = sc;
+			direction[1] = 1.0f;
+			direction[2] = tc;
+			break;
+		case 3:
+			direction[0] = sc;
+			direction[1] = -1.0f;
+			direction[2] = -tc;
+			break;
+		case 4:
+			direction[0] = sc;
+			direction[1] = -tc;
+			direction[2] = 1.0f;
+			break;
+		default:
+			direction[0] = -sc;
+			direction[1] = -tc;
+			direction[2] = -1.0f;
+			break;
+	}
+}
+
+/************************************************************************
+
+	Function:		skyboxSample
+
+	Description:	Samples an RGB image bilinear, wrapping s and clamping t.
+
+*************************************************************************/
+static void skyboxSample(const unsigned char *pixels, int width, int height, float s, float t, float *color) {
+	float u = s * width - 0.5f;
+	float v = t * height - 0.5f;
+	float fracU, fracV;
+	int x0, x1, y0, y1;
+	int k = 0;
+
+	x0 = (int)floor(u);
+	y0 = (int)floor(v);
+	fracU = u - x0;
+	fracV = v - y0;
+
+	// Wrap around the cylinder
+	x0 = ((x0 % width) + width) % width;
+	x1 = (x0 + 1) % width;
+
+	// Clamp at the top and bottom
+	y1 = y0 + 1;
+	if(y0 < 0) {
+		y0 = 0;
+	}
+	if(y1 < 0) {
+		y1 = 0;
+	}
+	if(y0 > height - 1) {
+		y0 = height - 1;
+	}
+	if(y1 > height - 1) {
+		y1 = height - 1;
+	}
+
+	for(k = 0; k < 3; k++) {
+		color[k] = (pixels[(y0 * width + x0) * 3 + k] * (1.0f - fracU) + pixels[(y0 * width + x1) * 3 + k] * fracU) * (1.0f - fracV)
+			+ (pixels[(y1 * width + x0) * 3 + k] * (1.0f - fracU) + pixels[(y1 * width + x1) * 3 + k] * fracU) * fracV;
+	}
+}
+
+/************************************************************************
+
+	Function:		skyboxReprojectFace
+
+	Description:	Fills one size by size RGB face of the cube map from the
+					cylinder texture. The cylinder is laid out like the sky
+					in the scene, a gluCylinder turned to stand up, so s goes
+					from 1 to 0 as the angle from -z turns towards +x.
+
+*************************************************************************/
+void skyboxReprojectFace(unsigned char *face, int size, int faceIndex, const SkyboxCylinder *cylinder, const unsigned char *pixels, int width, int height) {
+	float direction[3];
+	float color[3];
+	float across = 0.0f;
+	float angle = 0.0f;
+	float s = 0.0f;
+	float t = 0.0f;
+	int x = 0;
+	int y = 0;
+	int k = 0;
+
+	for(y = 0; y < size; y++) {
+		for(x = 0; x < size; x++) {
+			skyboxFaceDirection(faceIndex, (x + 0.5f) / size, (y + 0.5f) / size, direction);
+
+			// Around the cylinder
+			angle = (float)atan2(direction[0], -direction[2]);
+			if(angle < 0.0f) {
+				angle += SKYBOX_TWO_PI;
+			}
+			s = 1.0f - angle / SKYBOX_TWO_PI;
+
+			// Up the wall where the direction hits it, straight up or down uses the end rows
+			across = (float)sqrt(direction[0] * direction[0] + direction[2] * direction[2]);
+			if(across > 0.0f) {
+				t = (cylinder->eyeHeight + cylinder->radius * direction[1] / across) / cylinder->height;
+			} else {
+				t = direction[1] > 0.0f ? 1.0f : 0.0f;
+			}
+
+			skyboxSample(pixels, width, height, s, t, color);
+			for(k = 0; k < 3; k++) {
+				face[(y * size + x) * 3 + k] = (unsigned char)(color[k] + 0.5f);
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		skyboxFaceFileName
+
+	Description:	Makes the file name of a face, the prefix followed by
+					_px, _nx, _py, _ny, _pz or _nz and .ppm.
+
+*************************************************************************/
+void skyboxFaceFileName(char *fileName, const char *prefix, int face) {
+	const char *suffixes[SKYBOX_FACES] = {"px", "nx", "py", "ny", "pz", "nz"};
+
+	sprintf(fileName, "%s_%s.ppm", prefix, suffixes[face]);
+}
+
+/************************************************************************
+
+	Function:		skyboxReadNumber
+
+	Description:	Reads the next number of a PPM header, skipping comments.
+					Returns -1 if there is none.
+
+*************************************************************************/
+static int skyboxReadNumber(FILE *fileStream) {
+	int character;
+	int number = -1;
+
+	for(;;) {
+		character = fgetc(fileStream);
+		if(character == '#') {
+			while(character != '\n' && character != EOF) {
+				character = fgetc(fileStream);
+			}
+		} else if(character != ' ' && character != '\t' && character != '\r' && character != '\n') {
+			break;
+		}
+	}
+
+	while(character >= '0' && character <= '9') {
+		number = (number < 0 ? 0 : number * 10) + (character - '0');
+		character = fgetc(fileStream);
+	}
+
+	return number;
+}
+
+/************************************************************************
+
+	Function:		skyboxReadImage
+
+	Description:	Reads a P3 or P6 PPM file into a new RGB array with the
+					rows in file order, free it with memoryFree. Returns NULL
+					if the file is missing or not a PPM.
+
+*************************************************************************/
+unsigned char *skyboxReadImage(const char *fileName, int *width, int *height) {
+	FILE *fileStream;
+	unsigned char *pixels = NULL;
+	char magic[2];
+	int maxValue = 0;
+	int value = 0;
+	int count = 0;
+	int i = 0;
+
+	fileStream = fopen(fileName, "rb");
+	if(fileStream == NULL) {
+		return NULL;
+	}
+
+	if(fread(magic, 1, 2, fileStream) != 2 || magic[0] != 'P' || (magic[1] != '3' && magic[1] != '6')) {
+		fclose(fileStream);
+		return NULL;
+	}
+
+	*width = skyboxReadNumber(fileStream);
+	*height = skyboxReadNumber(fileStream);
+	maxValue = skyboxReadNumber(fileStream);
+	if(*width <= 0 || *height <= 0 || maxValue <= 0 || maxValue > 255) {
+		fclose(fileStream);
+		return NULL;
+	}
+
+	count = *width * *height * 3;
+	pixels = (unsigned char*)memoryAlloc(MEMORY_SKYBOX, count);
+	if(pixels == NULL) {
+		fclose(fileStream);
+		return NULL;
+	}
+
+	// Binary values start right after the single space following the header
+	if(magic[1] == '6') {
+		if((int)fread(pixels, 1, count, fileStream) != count) {
+			memoryFree(pixels);
+			pixels = NULL;
+		}
+	} else {
+		for(i = 0; i < count; i++) {
+			value = skyboxReadNumber(fileStream);
+			if(value < 0) {
+				memoryFree(pixels);
+				pixels = NULL;
+				break;
+			}
+			pixels[i] = (unsigned char)(value * 255 / maxValue);
+		}
+	}
+
+	fclose(fileStream);
+	return pixels;
+}
+
+/************************************************************************
+
+	Function:		skyboxWriteImage
+
+	Description:	Writes an RGB image as a P6 PPM file, first row first.
+					Returns 0 if the file could not be written.
+
+*************************************************************************/
+int skyboxWriteImage(const char *fileName, const unsigned char *pixels, int width, int height) {
+	FILE *fileStream;
+	int isWritten = 0;
+
+	fileStream = fopen(fileName, "wb");
+	if(fileStream == NULL) {
+		return 0;
+	}
+
+	fprintf(fileStream, "P6\n%d %d\n255\n", width, height);
+	isWritten = (fwrite(pixels, 3, width * height, fileStream) == (size_t)(width * height));
+
+	fclose(fileStream);
+	return isWritten;
+}
@@ -0,0 +1,36 @@
+/*
+ * Skybox.h
+ * Mike Northorp
+ * Reprojects the sky cylinder texture onto the six faces of a cube map and
+ * reads and writes the face images. Does not depend on OpenGL so the
+ * SkyboxTool can use it too.
+ */
+
+#ifndef SKYBOX_H_
+#define SKYBOX_H_
+
+/* Defines */
+
+// Faces of a cube map, in the same order as GL_TEXTURE_CUBE_MAP_POSITIVE_X on
+#define SKYBOX_FACES 6
+
+/* Typedefs and structs */
+
+// The textured sky cylinder being replaced. It stands on y = 0 around the
+// y axis and its texture wraps around once, t = 0 at the bottom
+typedef struct {
+	float radius;
+	float height;
+	// Height the sky is seen from, the faces are only exact from here
+	float eyeHeight;
+} SkyboxCylinder;
+
+/* Function list */
+
+void skyboxFaceDirection(int face, float s, float t, float *direction);
+void skyboxReprojectFace(unsigned char *face, int size, int faceIndex, const SkyboxCylinder *cylinder, const unsigned char *pixels, int width, int height);
+void skyboxFaceFileName(char *fileName, const char *prefix, int face);
+unsigned char *skyboxReadImage(const char *fileName, int *width, int *height);
+int skyboxWriteImage(const char *fileName, const unsigned char *pixels, int width, int height);
+
+#endif /* SKYBOX_H_ */
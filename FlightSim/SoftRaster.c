@@ -0,0 +1,1100 @@
+
+/************************************************************************************
+
+	File: 			SoftRaster.c
+
+	Description:	Software rasterizer for drawing the scene without a graphics
+					card, and as a reference that does not depend on the driver.
+					It lights vertices the same way GL_LIGHT0 and the shader path
+					do, then draws in three passes over the thread pool:
+					vertices are lit in chunks, primitives are clipped, set up
+					and sorted into screen tiles in chunks, then each tile is
+					cleared and drawn by one thread. Triangles are filled four
+					pixels at a time with SSE edge functions and a depth test,
+					lines are stepped one pixel at a time. Colors, texture
+					coordinates and fog distance are interpolated with
+					perspective correction and textures are sampled bilinear.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for software rasterizer types and functions
+#include "SoftRaster.h"
+// Matrix functions for the vertex transforms
+#include "Matrix.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+// memcpy and memset
+#include <string.h>
+// Math header
+#include <math.h>
+// File writing
+#include <stdio.h>
+// SSE2 intrinsics
+#include <emmintrin.h>
+
+// Back material for sides that only set GL_FRONT, the GL default material
+static const Material softDefaultMaterial = {
+	{0.8f, 0.8f, 0.8f, 1.0f},
+	{0.2f, 0.2f, 0.2f, 1.0f},
+	{0.0f, 0.0f, 0.0f, 1.0f},
+	{1.0f, 0.0f, 0.0f, 0.0f}
+};
+
+// Floats in a SoftVertex, clip position first
+#define SOFT_VERTEX_FLOATS 16
+
+/************************************************************************
+
+	Function:		softGrow
+
+	Description:	Makes sure an array has room for the needed number of
+					elements, doubling its capacity when it runs out.
+					Exits if memory runs out.
+
+*************************************************************************/
+static void *softGrow(void *array, int *capacity, int needed, size_t elementSize) {
+	int newCapacity = *capacity;
+
+	if(needed <= *capacity) {
+		return array;
+	}
+
+	if(newCapacity < 64) {
+		newCapacity = 64;
+	}
+	while(newCapacity < needed) {
+		newCapacity *= 2;
+	}
+
+	array = memoryRealloc(MEMORY_SOFT_RASTER, array, newCapacity * elementSize);
+	if(array == NULL) {
+		exit(1);
+	}
+
+	*capacity = newCapacity;
+	return array;
+}
+
+/************************************************************************
+
+	Function:		softRun
+
+	Description:	Runs a task over the thread pool, or on this thread when
+					there is no pool.
+
+*************************************************************************/
+static void softRun(SoftRaster *raster, ThreadPoolTask task, int taskCount) {
+	int i = 0;
+
+	if(raster->pool != NULL) {
+		threadPoolRun(raster->pool, task, raster, taskCount);
+	} else {
+		for(i = 0; i < taskCount; i++) {
+			task(raster, i);
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		softNormalize
+
+	Description:	Makes a 3 component vector unit length, zero stays zero.
+
+*************************************************************************/
+static void softNormalize(float *vector) {
+	float length = (float)sqrt(vector[0] * vector[0] + vector[1] * vector[1] + vector[2] * vector[2]);
+
+	if(length > 0.0f) {
+		vector[0] /= length;
+		vector[1] /= length;
+		vector[2] /= length;
+	}
+}
+
+/************************************************************************
+
+	Function:		softLightVertex
+
+	Description:	Lights one side of a vertex with GL_LIGHT0 and the global
+					ambient, using the infinite viewer fixed function uses.
+
+*************************************************************************/
+static void softLightVertex(const SoftFrame *frame, const float *normal, const float *lightDirection, const Material *material, float *color) {
+	float halfVector[3];
+	float diffuseAmount = normal[0] * lightDirection[0] + normal[1] * lightDirection[1] + normal[2] * lightDirection[2];
+	float specularAmount = 0.0f;
+	float halfAmount = 0.0f;
+	float value = 0.0f;
+	int i = 0;
+
+	if(diffuseAmount < 0.0f) {
+		diffuseAmount = 0.0f;
+	}
+
+	// Specular only shows on the lit side
+	if(diffuseAmount > 0.0f) {
+		halfVector[0] = lightDirection[0];
+		halfVector[1] = lightDirection[1];
+		halfVector[2] = lightDirection[2] + 1.0f;
+		softNormalize(halfVector);
+		halfAmount = normal[0] * halfVector[0] + normal[1] * halfVector[1] + normal[2] * halfVector[2];
+		if(halfAmount > 0.0f) {
+			specularAmount = (float)pow(halfAmount, material->shininess[0]);
+		}
+	}
+
+	for(i = 0; i < 3; i++) {
+		value = material->ambient[i] * (frame->globalAmbient[i] + frame->lightAmbient[i])
+			+ material->diffuse[i] * frame->lightDiffuse[i] * diffuseAmount
+			+ material->specular[i] * frame->lightSpecular[i] * specularAmount;
+		color[i] = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+	}
+	color[3] = material->diffuse[3];
+}
+
+/************************************************************************
+
+	Function:		softShadeVertices
+
+	Description:	Task that transforms and lights a range of vertices from
+					one draw, for both the front and the back.
+
+*************************************************************************/
+static void softShadeVertices(void *context, int rangeIndex) {
+	SoftRaster *raster = (SoftRaster*)context;
+	const SoftFrame *frame = raster->frame;
+	const SoftRange *range = &raster->vertexRanges[rangeIndex];
+	const SoftDraw *draw = &raster->draws[range->draw];
+	const MeshVertex *in = draw->mesh->vertices + range->first;
+	SoftVertex *out = raster->vertices + raster->drawFirstVertex[range->draw] + range->first;
+	const Material *material;
+	// Back of materials that set both sides keeps their colors without specular
+	Material backMaterial;
+	float normalMatrix[9];
+	float position[4];
+	float eye[4];
+	float normal[3];
+	float backNormal[3];
+	float faceNormal[3];
+	float lightDirection[3];
+	int materialIndex = 0;
+	int i = 0;
+	int k = 0;
+
+	matrixNormal(draw->modelView, normalMatrix);
+
+	for(i = 0; i < range->count; i++, in++, out++) {
+		// Into eye space then clip space
+		position[0] = in->position[0];
+		position[1] = in->position[1];
+		position[2] = in->position[2];
+		position[3] = 1.0f;
+		matrixTransform(draw->modelView, position, eye);
+		matrixTransform(frame->projection, eye, out->clip);
+
+		for(k = 0; k < 3; k++) {
+			normal[k] = normalMatrix[k] * in->normal[0] + normalMatrix[3 + k] * in->normal[1] + normalMatrix[6 + k] * in->normal[2];
+			faceNormal[k] = normalMatrix[k] * in->faceNormal[0] + normalMatrix[3 + k] * in->faceNormal[1] + normalMatrix[6 + k] * in->faceNormal[2];
+			lightDirection[k] = frame->lightPosition[k] - eye[k] * frame->lightPosition[3];
+		}
+		softNormalize(normal);
+		softNormalize(lightDirection);
+		for(k = 0; k < 3; k++) {
+			backNormal[k] = -normal[k];
+		}
+
+		// Light the front with the material and the back with its back material
+		materialIndex = draw->material >= 0 ? draw->material : (int)(in->material + 0.5f);
+		material = &frame->materials[materialIndex];
+		if(material->shininess[1] > 0.5f) {
+			backMaterial = softDefaultMaterial;
+		} else {
+			backMaterial = *material;
+			memcpy(backMaterial.specular, softDefaultMaterial.specular, sizeof(backMaterial.specular));
+			memcpy(backMaterial.shininess, softDefaultMaterial.shininess, sizeof(backMaterial.shininess));
+		}
+		softLightVertex(frame, normal, lightDirection, material, out->frontColor);
+		softLightVertex(frame, backNormal, lightDirection, &backMaterial, out->backColor);
+
+		// Lines pick their side from the polygon they came from
+		out->viewFacing = -(faceNormal[0] * eye[0] + faceNormal[1] * eye[1] + faceNormal[2] * eye[2]);
+		out->texCoord[0] = in->texCoord[0];
+		out->texCoord[1] = in->texCoord[1];
+		out->eyeDistance = (float)fabs(eye[2]);
+	}
+}
+
+/************************************************************************
+
+	Function:		softIsOutside
+
+	Description:	Returns 1 if every corner is outside the same side of the
+					view, not counting the near plane which gets clipped.
+
+*************************************************************************/
+static int softIsOutside(const float **corners, int cornerCount) {
+	int outside[5] = {1, 1, 1, 1, 1};
+	const float *clip;
+	int i = 0;
+
+	for(i = 0; i < cornerCount; i++) {
+		clip = corners[i];
+		outside[0] &= clip[0] < -clip[3];
+		outside[1] &= clip[0] > clip[3];
+		outside[2] &= clip[1] < -clip[3];
+		outside[3] &= clip[1] > clip[3];
+		outside[4] &= clip[2] > clip[3];
+	}
+
+	return outside[0] | outside[1] | outside[2] | outside[3] | outside[4];
+}
+
+/************************************************************************
+
+	Function:		softLerpVertex
+
+	Description:	Blends every value of two vertices.
+
+*************************************************************************/
+static void softLerpVertex(const float *a, const float *b, float amount, float *result) {
+	int i = 0;
+
+	for(i = 0; i < SOFT_VERTEX_FLOATS; i++) {
+		result[i] = a[i] + (b[i] - a[i]) * amount;
+	}
+}
+
+/************************************************************************
+
+	Function:		softAddTriangle
+
+	Description:	Sets up the edge functions, value planes and bounds of a
+					triangle in window coordinates and adds it to the chunk.
+					Corners are given counter clockwise.
+
+*************************************************************************/
+static void softAddTriangle(SoftRaster *raster, SoftChunk *chunk, const SoftDraw *draw, const float **window, const float **corners, int isFront) {
+	SoftTriangle *triangle;
+	// Corners relative to the first one
+	float relative[3][2];
+	// Values at each corner
+	float values[3][SOFT_TRIANGLE_VALUES];
+	// Offset of the color used for this side
+	int colorOffset = isFront ? 4 : 8;
+	float area = 0.0f;
+	float minX, minY, maxX, maxY;
+	int i = 0;
+	int k = 0;
+	const float *a;
+	const float *b;
+
+	for(i = 0; i < 3; i++) {
+		relative[i][0] = window[i][0] - window[0][0];
+		relative[i][1] = window[i][1] - window[0][1];
+	}
+	area = (window[1][0] - window[0][0]) * (window[2][1] - window[0][1]) - (window[2][0] - window[0][0]) * (window[1][1] - window[0][1]);
+	if(area <= 0.0f) {
+		return;
+	}
+
+	// Pixels it can touch, pixel centres are at whole numbers
+	minX = maxX = window[0][0];
+	minY = maxY = window[0][1];
+	for(i = 1; i < 3; i++) {
+		if(window[i][0] < minX) minX = window[i][0];
+		if(window[i][0] > maxX) maxX = window[i][0];
+		if(window[i][1] < minY) minY = window[i][1];
+		if(window[i][1] > maxY) maxY = window[i][1];
+	}
+	if(minX < 0.0f) minX = 0.0f;
+	if(minY < 0.0f) minY = 0.0f;
+	if(maxX > raster->width - 1) maxX = (float)(raster->width - 1);
+	if(maxY > raster->height - 1) maxY = (float)(raster->height - 1);
+	if((int)ceil(minX) > (int)floor(maxX) || (int)ceil(minY) > (int)floor(maxY)) {
+		return;
+	}
+
+	chunk->triangles = (SoftTriangle*)softGrow(chunk->triangles, &chunk->triangleCapacity, chunk->triangleCount + 1, sizeof(SoftTriangle));
+	triangle = &chunk->triangles[chunk->triangleCount++];
+	triangle->minX = (int)ceil(minX);
+	triangle->minY = (int)ceil(minY);
+	triangle->maxX = (int)floor(maxX);
+	triangle->maxY = (int)floor(maxY);
+	triangle->texture = draw->texture;
+	triangle->useFog = draw->useFog;
+	triangle->origin[0] = window[0][0];
+	triangle->origin[1] = window[0][1];
+
+	// Edge opposite each corner, positive inside
+	for(i = 0; i < 3; i++) {
+		a = relative[(i + 1) % 3];
+		b = relative[(i + 2) % 3];
+		triangle->edges[i][0] = a[1] - b[1];
+		triangle->edges[i][1] = b[0] - a[0];
+		triangle->edges[i][2] = a[0] * b[1] - a[1] * b[0];
+		// Pixels right on a top or left edge belong to this triangle
+		triangle->isTopLeft[i] = triangle->edges[i][0] > 0.0f || (triangle->edges[i][0] == 0.0f && triangle->edges[i][1] < 0.0f);
+	}
+
+	// Depth and 1/w are linear on screen, the rest are divided by w first
+	for(i = 0; i < 3; i++) {
+		values[i][0] = window[i][2];
+		values[i][1] = window[i][3];
+		for(k = 0; k < 4; k++) {
+			values[i][2 + k] = corners[i][colorOffset + k] * window[i][3];
+		}
+		values[i][6] = corners[i][12] * window[i][3];
+		values[i][7] = corners[i][13] * window[i][3];
+		values[i][8] = corners[i][14] * window[i][3];
+	}
+
+	// Plane through the three values using the barycentric weights, it
+	// goes through the first corner's value at the origin
+	for(k = 0; k < SOFT_TRIANGLE_VALUES; k++) {
+		for(i = 0; i < 2; i++) {
+			triangle->planes[k][i] = (triangle->edges[0][i] * values[0][k] + triangle->edges[1][i] * values[1][k] + triangle->edges[2][i] * values[2][k]) / area;
+		}
+		triangle->planes[k][2] = values[0][k];
+	}
+}
+
+/************************************************************************
+
+	Function:		softSetUpTriangle
+
+	Description:	Clips a triangle against the near plane, works out which
+					side faces the camera and adds what is left as triangles.
+
+*************************************************************************/
+static void softSetUpTriangle(SoftRaster *raster, SoftChunk *chunk, const SoftDraw *draw, const SoftVertex *first, const SoftVertex *second, const SoftVertex *third) {
+	const float *corners[3];
+	// Clipped polygon, at most one more corner than it started with
+	float polygon[4][SOFT_VERTEX_FLOATS];
+	float window[4][4];
+	const float *triangleWindow[3];
+	const float *triangleCorners[3];
+	const float *a;
+	const float *b;
+	float aDistance, bDistance, invW;
+	float area = 0.0f;
+	int cornerCount = 0;
+	int isFront = 0;
+	int i = 0;
+
+	corners[0] = first->clip;
+	corners[1] = second->clip;
+	corners[2] = third->clip;
+	if(softIsOutside(corners, 3)) {
+		return;
+	}
+
+	// Keep the part in front of the near plane, z >= -w
+	for(i = 0; i < 3; i++) {
+		a = corners[i];
+		b = corners[(i + 1) % 3];
+		aDistance = a[2] + a[3];
+		bDistance = b[2] + b[3];
+		if(aDistance >= 0.0f) {
+			memcpy(polygon[cornerCount++], a, sizeof(polygon[0]));
+		}
+		if((aDistance >= 0.0f) != (bDistance >= 0.0f)) {
+			softLerpVertex(a, b, aDistance / (aDistance - bDistance), polygon[cornerCount++]);
+		}
+	}
+	if(cornerCount < 3) {
+		return;
+	}
+
+	// Into window coordinates with pixel centres at whole numbers
+	for(i = 0; i < cornerCount; i++) {
+		invW = 1.0f / polygon[i][3];
+		window[i][0] = (polygon[i][0] * invW * 0.5f + 0.5f) * raster->width - 0.5f;
+		window[i][1] = (polygon[i][1] * invW * 0.5f + 0.5f) * raster->height - 0.5f;
+		window[i][2] = polygon[i][2] * invW * 0.5f + 0.5f;
+		window[i][3] = invW;
+	}
+
+	// Counter clockwise on screen is the front like GL
+	for(i = 0; i < cornerCount; i++) {
+		area += window[i][0] * window[(i + 1) % cornerCount][1] - window[(i + 1) % cornerCount][0] * window[i][1];
+	}
+	if(area == 0.0f) {
+		return;
+	}
+	isFront = area > 0.0f;
+
+	// Fan out from the first corner, back faces are flipped to counter clockwise
+	for(i = 1; i < cornerCount - 1; i++) {
+		triangleWindow[0] = window[0];
+		triangleCorners[0] = polygon[0];
+		triangleWindow[isFront ? 1 : 2] = window[i];
+		triangleCorners[isFront ? 1 : 2] = polygon[i];
+		triangleWindow[isFront ? 2 : 1] = window[i + 1];
+		triangleCorners[isFront ? 2 : 1] = polygon[i + 1];
+		softAddTriangle(raster, chunk, draw, triangleWindow, triangleCorners, isFront);
+	}
+}
+
+/************************************************************************
+
+	Function:		softSetUpLine
+
+	Description:	Clips a line against the near plane and adds it to the
+					chunk in window coordinates.
+
+*************************************************************************/
+static void softSetUpLine(SoftRaster *raster, SoftChunk *chunk, const SoftDraw *draw, const SoftVertex *first, const SoftVertex *second) {
+	SoftLine *line;
+	const float *corners[2];
+	float ends[2][SOFT_VERTEX_FLOATS];
+	float window[2][2];
+	float startDistance, endDistance, invW;
+	float minX, minY, maxX, maxY;
+	int width = draw->lineWidth < 1 ? 1 : draw->lineWidth;
+	int i = 0;
+	int k = 0;
+
+	corners[0] = first->clip;
+	corners[1] = second->clip;
+	if(softIsOutside(corners, 2)) {
+		return;
+	}
+
+	// Keep the part in front of the near plane
+	startDistance = corners[0][2] + corners[0][3];
+	endDistance = corners[1][2] + corners[1][3];
+	if(startDistance < 0.0f && endDistance < 0.0f) {
+		return;
+	}
+	memcpy(ends[0], corners[0], sizeof(ends[0]));
+	memcpy(ends[1], corners[1], sizeof(ends[1]));
+	if(startDistance < 0.0f) {
+		softLerpVertex(corners[0], corners[1], startDistance / (startDistance - endDistance), ends[0]);
+	} else if(endDistance < 0.0f) {
+		softLerpVertex(corners[1], corners[0], endDistance / (endDistance - startDistance), ends[1]);
+	}
+
+	for(i = 0; i < 2; i++) {
+		invW = 1.0f / ends[i][3];
+		window[i][0] = (ends[i][0] * invW * 0.5f + 0.5f) * raster->width;
+		window[i][1] = (ends[i][1] * invW * 0.5f + 0.5f) * raster->height;
+	}
+
+	// Pixels it can touch, wide lines spread out both ways
+	minX = (window[0][0] < window[1][0] ? window[0][0] : window[1][0]) - width;
+	maxX = (window[0][0] > window[1][0] ? window[0][0] : window[1][0]) + width;
+	minY = (window[0][1] < window[1][1] ? window[0][1] : window[1][1]) - width;
+	maxY = (window[0][1] > window[1][1] ? window[0][1] : window[1][1]) + width;
+	if(minX < 0.0f) minX = 0.0f;
+	if(minY < 0.0f) minY = 0.0f;
+	if(maxX > raster->width - 1) maxX = (float)(raster->width - 1);
+	if(maxY > raster->height - 1) maxY = (float)(raster->height - 1);
+	if(minX > maxX || minY > maxY) {
+		return;
+	}
+
+	chunk->lines = (SoftLine*)softGrow(chunk->lines, &chunk->lineCapacity, chunk->lineCount + 1, sizeof(SoftLine));
+	line = &chunk->lines[chunk->lineCount++];
+	line->start[0] = window[0][0];
+	line->start[1] = window[0][1];
+	line->end[0] = window[1][0];
+	line->end[1] = window[1][1];
+	line->width = width;
+	line->minX = (int)minX;
+	line->minY = (int)minY;
+	line->maxX = (int)maxX;
+	line->maxY = (int)maxY;
+	line->texture = draw->texture;
+	line->useFog = draw->useFog;
+
+	// Depth and 1/w, then everything else over w
+	for(i = 0; i < 2; i++) {
+		invW = 1.0f / ends[i][3];
+		line->values[i][0] = ends[i][2] * invW * 0.5f + 0.5f;
+		line->values[i][1] = invW;
+		for(k = 0; k < 12; k++) {
+			line->values[i][2 + k] = ends[i][4 + k] * invW;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		softSetUpChunk
+
+	Description:	Task that sets up a chunk of primitives from one draw
+					and sorts them into bins for the tiles they touch.
+
+*************************************************************************/
+static void softSetUpChunk(void *context, int chunkIndex) {
+	SoftRaster *raster = (SoftRaster*)context;
+	SoftChunk *chunk = &raster->chunks[chunkIndex];
+	const SoftDraw *draw = &raster->draws[chunk->range.draw];
+	const Mesh *mesh = draw->mesh;
+	const SoftVertex *vertices = raster->vertices + raster->drawFirstVertex[chunk->range.draw];
+	const unsigned int *indices;
+	int entryCount = 0;
+	int tileX, tileY, tile;
+	int i = 0;
+
+	chunk->triangleCount = 0;
+	chunk->lineCount = 0;
+
+	// Wireframe draws the outlines, line only meshes always do
+	if(draw->isLineDraw || mesh->triangleIndexCount == 0) {
+		indices = mesh->edgeIndices + chunk->range.first * 2;
+		for(i = 0; i < chunk->range.count; i++, indices += 2) {
+			softSetUpLine(raster, chunk, draw, &vertices[indices[0]], &vertices[indices[1]]);
+		}
+	} else {
+		indices = mesh->triangleIndices + chunk->range.first * 3;
+		for(i = 0; i < chunk->range.count; i++, indices += 3) {
+			softSetUpTriangle(raster, chunk, draw, &vertices[indices[0]], &vertices[indices[1]], &vertices[indices[2]]);
+		}
+	}
+
+	// Count the entries for each tile
+	memset(chunk->binStarts, 0, (raster->tileCount + 1) * sizeof(int));
+	for(i = 0; i < chunk->triangleCount; i++) {
+		for(tileY = chunk->triangles[i].minY / SOFT_TILE_SIZE; tileY <= chunk->triangles[i].maxY / SOFT_TILE_SIZE; tileY++) {
+			for(tileX = chunk->triangles[i].minX / SOFT_TILE_SIZE; tileX <= chunk->triangles[i].maxX / SOFT_TILE_SIZE; tileX++) {
+				chunk->binStarts[tileY * raster->tilesX + tileX + 1]++;
+			}
+		}
+	}
+	for(i = 0; i < chunk->lineCount; i++) {
+		for(tileY = chunk->lines[i].minY / SOFT_TILE_SIZE; tileY <= chunk->lines[i].maxY / SOFT_TILE_SIZE; tileY++) {
+			for(tileX = chunk->lines[i].minX / SOFT_TILE_SIZE; tileX <= chunk->lines[i].maxX / SOFT_TILE_SIZE; tileX++) {
+				chunk->binStarts[tileY * raster->tilesX + tileX + 1]++;
+			}
+		}
+	}
+
+	// Turn the counts into starts
+	for(tile = 0; tile < raster->tileCount; tile++) {
+		chunk->binStarts[tile + 1] += chunk->binStarts[tile];
+		chunk->binCursors[tile] = chunk->binStarts[tile];
+	}
+	entryCount = chunk->binStarts[raster->tileCount];
+	chunk->binEntries = (int*)softGrow(chunk->binEntries, &chunk->binEntryCapacity, entryCount, sizeof(int));
+
+	// Fill the bins in draw order, lines are stored as -1 - index
+	for(i = 0; i < chunk->triangleCount; i++) {
+		for(tileY = chunk->triangles[i].minY / SOFT_TILE_SIZE; tileY <= chunk->triangles[i].maxY / SOFT_TILE_SIZE; tileY++) {
+			for(tileX = chunk->triangles[i].minX / SOFT_TILE_SIZE; tileX <= chunk->triangles[i].maxX / SOFT_TILE_SIZE; tileX++) {
+				chunk->binEntries[chunk->binCursors[tileY * raster->tilesX + tileX]++] = i;
+			}
+		}
+	}
+	for(i = 0; i < chunk->lineCount; i++) {
+		for(tileY = chunk->lines[i].minY / SOFT_TILE_SIZE; tileY <= chunk->lines[i].maxY / SOFT_TILE_SIZE; tileY++) {
+			for(tileX = chunk->lines[i].minX / SOFT_TILE_SIZE; tileX <= chunk->lines[i].maxX / SOFT_TILE_SIZE; tileX++) {
+				chunk->binEntries[chunk->binCursors[tileY * raster->tilesX + tileX]++] = -1 - i;
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		softSampleTexture
+
+	Description:	Samples a texture bilinear with repeat wrapping.
+
+*************************************************************************/
+static void softSampleTexture(const SoftTexture *texture, float s, float t, float *texel) {
+	float u = s * texture->width - 0.5f;
+	float v = t * texture->height - 0.5f;
+	float uFloor = (float)floor(u);
+	float vFloor = (float)floor(v);
+	float uAmount = u - uFloor;
+	float vAmount = v - vFloor;
+	int x0 = (int)uFloor % texture->width;
+	int y0 = (int)vFloor % texture->height;
+	int x1, y1;
+	const unsigned char *row0;
+	const unsigned char *row1;
+	int i = 0;
+
+	// Wrap around both ways
+	if(x0 < 0) x0 += texture->width;
+	if(y0 < 0) y0 += texture->height;
+	x1 = (x0 + 1) % texture->width;
+	y1 = (y0 + 1) % texture->height;
+
+	row0 = texture->pixels + y0 * texture->width * 3;
+	row1 = texture->pixels + y1 * texture->width * 3;
+	for(i = 0; i < 3; i++) {
+		texel[i] = ((row0[x0 * 3 + i] * (1.0f - uAmount) + row0[x1 * 3 + i] * uAmount) * (1.0f - vAmount)
+			+ (row1[x0 * 3 + i] * (1.0f - uAmount) + row1[x1 * 3 + i] * uAmount) * vAmount) / 255.0f;
+	}
+}
+
+/************************************************************************
+
+	Function:		softShadePixel
+
+	Description:	Modulates the color by the texture, adds exponential fog
+					and writes the pixel.
+
+*************************************************************************/
+static void softShadePixel(const SoftFrame *frame, const SoftTexture *texture, int useFog, float *color, float s, float t, float fogDistance, unsigned char *pixel) {
+	float texel[3];
+	float fogAmount = 0.0f;
+	int i = 0;
+
+	if(texture != NULL) {
+		softSampleTexture(texture, s, t, texel);
+		for(i = 0; i < 3; i++) {
+			color[i] *= texel[i];
+		}
+	}
+
+	if(useFog) {
+		fogAmount = (float)exp(-frame->fogDensity * fogDistance);
+		if(fogAmount > 1.0f) {
+			fogAmount = 1.0f;
+		}
+		for(i = 0; i < 3; i++) {
+			color[i] = frame->fogColor[i] + (color[i] - frame->fogColor[i]) * fogAmount;
+		}
+	}
+
+	for(i = 0; i < 4; i++) {
+		if(color[i] < 0.0f) {
+			color[i] = 0.0f;
+		} else if(color[i] > 1.0f) {
+			color[i] = 1.0f;
+		}
+		pixel[i] = (unsigned char)(color[i] * 255.0f + 0.5f);
+	}
+}
+
+/************************************************************************
+
+	Function:		softPlane
+
+	Description:	Works out a value plane for four pixels in a row.
+
+*************************************************************************/
+static __m128 softPlane(const float *plane, __m128 laneX, float y) {
+	return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane[0]), laneX), _mm_set1_ps(plane[1] * y + plane[2]));
+}
+
+/************************************************************************
+
+	Function:		softDrawTriangle
+
+	Description:	Fills the part of a triangle inside a tile. Steps four
+					pixels at a time, testing the three edge functions and
+					the depth for all four at once, then shades the pixels
+					that pass.
+
+*************************************************************************/
+static void softDrawTriangle(SoftRaster *raster, const SoftTriangle *triangle, int tileMinX, int tileMinY, int tileMaxX, int tileMaxY) {
+	// Start on a multiple of 4 so the four pixels line up with the tile
+	int minX = (triangle->minX > tileMinX ? triangle->minX : tileMinX) & ~3;
+	int maxX = triangle->maxX < tileMaxX ? triangle->maxX : tileMaxX;
+	int minY = triangle->minY > tileMinY ? triangle->minY : tileMinY;
+	int maxY = triangle->maxY < tileMaxY ? triangle->maxY : tileMaxY;
+	__m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 four = _mm_set1_ps(4.0f);
+	__m128 lastX = _mm_set1_ps(maxX - triangle->origin[0]);
+	__m128 edgeStep[3];
+	__m128 edgeValue[3];
+	__m128 topLeft[3];
+	__m128 laneX, inside, depth, oldDepth, w;
+	// Values for the four pixels after dividing by 1/w
+	float lanes[SOFT_TRIANGLE_VALUES][4];
+	float color[4];
+	float *depthRow;
+	unsigned char *colorRow;
+	float rowY;
+	int x, y, i, lane, mask;
+
+	if(minX > maxX || minY > maxY) {
+		return;
+	}
+
+	for(i = 0; i < 3; i++) {
+		edgeStep[i] = _mm_set1_ps(triangle->edges[i][0] * 4.0f);
+		topLeft[i] = triangle->isTopLeft[i] ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+	}
+
+	for(y = minY; y <= maxY; y++) {
+		rowY = y - triangle->origin[1];
+		depthRow = raster->depthBuffer + y * raster->stride;
+		colorRow = raster->colorBuffer + y * raster->stride * 4;
+		laneX = _mm_add_ps(_mm_set1_ps(minX - triangle->origin[0]), laneOffsets);
+		for(i = 0; i < 3; i++) {
+			edgeValue[i] = softPlane(triangle->edges[i], laneX, rowY);
+		}
+
+		for(x = minX; x <= maxX; x += 4) {
+			// Inside all three edges, a value of exactly 0 only counts on top and left edges
+			inside = _mm_cmple_ps(laneX, lastX);
+			for(i = 0; i < 3; i++) {
+				inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(edgeValue[i], zero), _mm_and_ps(_mm_cmpeq_ps(edgeValue[i], zero), topLeft[i])));
+			}
+
+			if(_mm_movemask_ps(inside)) {
+				// Depth test, less than like GL_LESS
+				depth = softPlane(triangle->planes[0], laneX, rowY);
+				oldDepth = _mm_loadu_ps(depthRow + x);
+				inside = _mm_and_ps(inside, _mm_cmplt_ps(depth, oldDepth));
+				mask = _mm_movemask_ps(inside);
+
+				if(mask) {
+					_mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(inside, depth), _mm_andnot_ps(inside, oldDepth)));
+
+					// Undo the divide by w for the rest of the values
+					w = _mm_div_ps(one, softPlane(triangle->planes[1], laneX, rowY));
+					for(i = 2; i < SOFT_TRIANGLE_VALUES; i++) {
+						_mm_storeu_ps(lanes[i], _mm_mul_ps(softPlane(triangle->planes[i], laneX, rowY), w));
+					}
+
+					for(lane = 0; lane < 4; lane++) {
+						if(mask & (1 << lane)) {
+							color[0] = lanes[2][lane];
+							color[1] = lanes[3][lane];
+							color[2] = lanes[4][lane];
+							color[3] = lanes[5][lane];
+							softShadePixel(raster->frame, triangle->texture, triangle->useFog, color, lanes[6][lane], lanes[7][lane], lanes[8][lane], colorRow + (x + lane) * 4);
+						}
+					}
+				}
+			}
+
+			// Next four pixels
+			laneX = _mm_add_ps(laneX, four);
+			for(i = 0; i < 3; i++) {
+				edgeValue[i] = _mm_add_ps(edgeValue[i], edgeStep[i]);
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		softPlotLine
+
+	Description:	Depth tests and shades one pixel of a line at amount
+					along it.
+
+*************************************************************************/
+static void softPlotLine(SoftRaster *raster, const SoftLine *line, int x, int y, float amount) {
+	float values[SOFT_LINE_VALUES];
+	float color[4];
+	float *depth = raster->depthBuffer + y * raster->stride + x;
+	float w;
+	// Offset of the color for the side this pixel is on
+	int colorOffset;
+	int i = 0;
+
+	values[0] = line->values[0][0] + (line->values[1][0] - line->values[0][0]) * amount;
+	if(!(values[0] < *depth)) {
+		return;
+	}
+	*depth = values[0];
+
+	for(i = 1; i < SOFT_LINE_VALUES; i++) {
+		values[i] = line->values[0][i] + (line->values[1][i] - line->values[0][i]) * amount;
+	}
+	w = 1.0f / values[1];
+
+	colorOffset = values[13] >= 0.0f ? 2 : 6;
+	for(i = 0; i < 4; i++) {
+		color[i] = values[colorOffset + i] * w;
+	}
+	softShadePixel(raster->frame, line->texture, line->useFog, color, values[10] * w, values[11] * w, values[12] * w, raster->colorBuffer + (y * raster->stride + x) * 4);
+}
+
+/************************************************************************
+
+	Function:		softDrawLine
+
+	Description:	Draws the part of a line inside a tile. Steps along the
+					longer axis one pixel at a time like GL lines, wide lines
+					are that many pixels across the shorter axis.
+
+*************************************************************************/
+static void softDrawLine(SoftRaster *raster, const SoftLine *line, int tileMinX, int tileMinY, int tileMaxX, int tileMaxY) {
+	float deltaX = line->end[0] - line->start[0];
+	float deltaY = line->end[1] - line->start[1];
+	int isXMajor = fabs(deltaX) >= fabs(deltaY);
+	// Long and short axis of the line
+	float majorStart = isXMajor ? line->start[0] : line->start[1];
+	float majorDelta = isXMajor ? deltaX : deltaY;
+	float minorStart = isXMajor ? line->start[1] : line->start[0];
+	float minorDelta = isXMajor ? deltaY : deltaX;
+	int majorMin = isXMajor ? tileMinX : tileMinY;
+	int majorMax = isXMajor ? tileMaxX : tileMaxY;
+	int minorMin = isXMajor ? tileMinY : tileMinX;
+	int minorMax = isXMajor ? tileMaxY : tileMaxX;
+	float low, high, amount;
+	int first, last, major, minor, centre, k;
+
+	if(majorDelta == 0.0f) {
+		return;
+	}
+
+	// Pixels whose centres are between the ends
+	low = majorDelta > 0.0f ? majorStart : majorStart + majorDelta;
+	high = majorDelta > 0.0f ? majorStart + majorDelta : majorStart;
+	first = (int)ceil(low - 0.5f);
+	last = (int)ceil(high - 0.5f) - 1;
+	if(first < majorMin) first = majorMin;
+	if(last > majorMax) last = majorMax;
+
+	for(major = first; major <= last; major++) {
+		amount = (major + 0.5f - majorStart) / majorDelta;
+		centre = (int)floor(minorStart + amount * minorDelta);
+
+		for(k = 0; k < line->width; k++) {
+			minor = centre - (line->width - 1) / 2 + k;
+			if(minor < minorMin || minor > minorMax) {
+				continue;
+			}
+			if(isXMajor) {
+				softPlotLine(raster, line, major, minor, amount);
+			} else {
+				softPlotLine(raster, line, minor, major, amount);
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		softDrawTile
+
+	Description:	Task that clears a tile then draws everything binned to
+					it, going through the chunks in order so later draws
+					land on top the same as on the card.
+
+*************************************************************************/
+static void softDrawTile(void *context, int tile) {
+	SoftRaster *raster = (SoftRaster*)context;
+	const SoftFrame *frame = raster->frame;
+	const SoftChunk *chunk;
+	int minX = (tile % raster->tilesX) * SOFT_TILE_SIZE;
+	int minY = (tile / raster->tilesX) * SOFT_TILE_SIZE;
+	int maxX = minX + SOFT_TILE_SIZE - 1;
+	int maxY = minY + SOFT_TILE_SIZE - 1;
+	unsigned char clearColor[4];
+	unsigned char *pixel;
+	float *depth;
+	int entry;
+	int c, k, x, y;
+
+	if(maxX > raster->width - 1) maxX = raster->width - 1;
+	if(maxY > raster->height - 1) maxY = raster->height - 1;
+
+	// Clear color and depth
+	for(k = 0; k < 4; k++) {
+		clearColor[k] = (unsigned char)(frame->clearColor[k] * 255.0f + 0.5f);
+	}
+	for(y = minY; y <= maxY; y++) {
+		depth = raster->depthBuffer + y * raster->stride;
+		pixel = raster->colorBuffer + (y * raster->stride + minX) * 4;
+		for(x = minX; x <= maxX; x++, pixel += 4) {
+			depth[x] = 1.0f;
+			memcpy(pixel, clearColor, 4);
+		}
+	}
+
+	for(c = 0; c < raster->chunkCount; c++) {
+		chunk = &raster->chunks[c];
+		for(k = chunk->binStarts[tile]; k < chunk->binStarts[tile + 1]; k++) {
+			entry = chunk->binEntries[k];
+			if(entry >= 0) {
+				softDrawTriangle(raster, &chunk->triangles[entry], minX, minY, maxX, maxY);
+			} else {
+				softDrawLine(raster, &chunk->lines[-1 - entry], minX, minY, maxX, maxY);
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		softRasterCreate
+
+	Description:	Makes a rasterizer with its own color and depth buffers.
+					The pool can be NULL to draw on the calling thread.
+
+*************************************************************************/
+SoftRaster *softRasterCreate(int width, int height, ThreadPool *pool) {
+	SoftRaster *raster = (SoftRaster*)memoryAllocZeroed(MEMORY_SOFT_RASTER, sizeof(SoftRaster));
+
+	if(raster == NULL) {
+		return NULL;
+	}
+
+	raster->width = width;
+	raster->height = height;
+	raster->stride = (width + 3) & ~3;
+	raster->colorBuffer = (unsigned char*)memoryAllocZeroed(MEMORY_SOFT_RASTER, raster->stride * height * 4);
+	raster->depthBuffer = (float*)memoryAllocZeroed(MEMORY_SOFT_RASTER, raster->stride * height * sizeof(float));
+	raster->tilesX = (width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+	raster->tilesY = (height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+	raster->tileCount = raster->tilesX * raster->tilesY;
+	raster->pool = pool;
+
+	if(raster->colorBuffer == NULL || raster->depthBuffer == NULL) {
+		softRasterDestroy(raster);
+		return NULL;
+	}
+
+	return raster;
+}
+
+/************************************************************************
+
+	Function:		softRasterDestroy
+
+	Description:	Frees the rasterizer and all its memory. Does not destroy
+					the thread pool.
+
+*************************************************************************/
+void softRasterDestroy(SoftRaster *raster) {
+	int i = 0;
+
+	if(raster == NULL) {
+		return;
+	}
+
+	for(i = 0; i < raster->chunkCapacity; i++) {
+		memoryFree(raster->chunks[i].triangles);
+		memoryFree(raster->chunks[i].lines);
+		memoryFree(raster->chunks[i].binStarts);
+		memoryFree(raster->chunks[i].binCursors);
+		memoryFree(raster->chunks[i].binEntries);
+	}
+	memoryFree(raster->chunks);
+	memoryFree(raster->vertices);
+	memoryFree(raster->drawFirstVertex);
+	memoryFree(raster->vertexRanges);
+	memoryFree(raster->colorBuffer);
+	memoryFree(raster->depthBuffer);
+	memoryFree(raster);
+}
+
+/************************************************************************
+
+	Function:		softRasterDraw
+
+	Description:	Draws a frame into the color buffer. Lights the vertices
+					of every draw, sets up and bins the primitives, then
+					draws the tiles, each pass spread over the thread pool.
+
+*************************************************************************/
+void softRasterDraw(SoftRaster *raster, const SoftFrame *frame, const SoftDraw *draws, int drawCount) {
+	const Mesh *mesh;
+	int vertexCount = 0;
+	int rangeCount = 0;
+	int primitiveCount = 0;
+	int oldCapacity = 0;
+	int d = 0;
+	int i = 0;
+
+	raster->frame = frame;
+	raster->draws = draws;
+	raster->drawCount = drawCount;
+
+	// Where each draw's lit vertices go and the ranges to light them in
+	raster->drawFirstVertex = (int*)softGrow(raster->drawFirstVertex, &raster->drawCapacity, drawCount, sizeof(int));
+	for(d = 0; d < drawCount; d++) {
+		raster->drawFirstVertex[d] = vertexCount;
+		for(i = 0; i < draws[d].mesh->vertexCount; i += SOFT_CHUNK_SIZE) {
+			raster->vertexRanges = (SoftRange*)softGrow(raster->vertexRanges, &raster->vertexRangeCapacity, rangeCount + 1, sizeof(SoftRange));
+			raster->vertexRanges[rangeCount].draw = d;
+			raster->vertexRanges[rangeCount].first = i;
+			raster->vertexRanges[rangeCount].count = draws[d].mesh->vertexCount - i < SOFT_CHUNK_SIZE ? draws[d].mesh->vertexCount - i : SOFT_CHUNK_SIZE;
+			rangeCount++;
+		}
+		vertexCount += draws[d].mesh->vertexCount;
+	}
+	raster->vertices = (SoftVertex*)softGrow(raster->vertices, &raster->vertexCapacity, vertexCount, sizeof(SoftVertex));
+	softRun(raster, softShadeVertices, rangeCount);
+
+	// Split the primitives of each draw into chunks
+	raster->chunkCount = 0;
+	for(d = 0; d < drawCount; d++) {
+		mesh = draws[d].mesh;
+		if(draws[d].isLineDraw || mesh->triangleIndexCount == 0) {
+			primitiveCount = mesh->edgeIndexCount / 2;
+		} else {
+			primitiveCount = mesh->triangleIndexCount / 3;
+		}
+
+		for(i = 0; i < primitiveCount; i += SOFT_CHUNK_SIZE) {
+			// New chunks get their bins the first time they are used
+			if(raster->chunkCount == raster->chunkCapacity) {
+				oldCapacity = raster->chunkCapacity;
+				raster->chunks = (SoftChunk*)softGrow(raster->chunks, &raster->chunkCapacity, raster->chunkCount + 1, sizeof(SoftChunk));
+				memset(raster->chunks + oldCapacity, 0, (raster->chunkCapacity - oldCapacity) * sizeof(SoftChunk));
+			}
+			if(raster->chunks[raster->chunkCount].binStarts == NULL) {
+				raster->chunks[raster->chunkCount].binStarts = (int*)memoryAlloc(MEMORY_SOFT_RASTER, (raster->tileCount + 1) * sizeof(int));
+				raster->chunks[raster->chunkCount].binCursors = (int*)memoryAlloc(MEMORY_SOFT_RASTER, raster->tileCount * sizeof(int));
+				if(raster->chunks[raster->chunkCount].binStarts == NULL || raster->chunks[raster->chunkCount].binCursors == NULL) {
+					exit(1);
+				}
+			}
+
+			raster->chunks[raster->chunkCount].range.draw = d;
+			raster->chunks[raster->chunkCount].range.first = i;
+			raster->chunks[raster->chunkCount].range.count = primitiveCount - i < SOFT_CHUNK_SIZE ? primitiveCount - i : SOFT_CHUNK_SIZE;
+			raster->chunkCount++;
+		}
+	}
+	softRun(raster, softSetUpChunk, raster->chunkCount);
+
+	// Every tile is independent now
+	softRun(raster, softDrawTile, raster->tileCount);
+
+	// Count what was drawn
+	raster->triangleCount = 0;
+	raster->lineCount = 0;
+	for(i = 0; i < raster->chunkCount; i++) {
+		raster->triangleCount += raster->chunks[i].triangleCount;
+		raster->lineCount += raster->chunks[i].lineCount;
+	}
+}
+
+/************************************************************************
+
+	Function:		softRasterWriteImage
+
+	Description:	Saves the color buffer as a binary PPM image, top row
+					first. Returns 0 if the file could not be written.
+
+*************************************************************************/
+int softRasterWriteImage(SoftRaster *raster, const char *fileName) {
+	FILE *fileStream = fopen(fileName, "wb");
+	const unsigned char *pixel;
+	int x, y;
+
+	if(fileStream == NULL) {
+		return 0;
+	}
+
+	fprintf(fileStream, "P6\n%d %d\n255\n", raster->width, raster->height);
+	for(y = raster->height - 1; y >= 0; y--) {
+		pixel = raster->colorBuffer + y * raster->stride * 4;
+		for(x = 0; x < raster->width; x++, pixel += 4) {
+			fwrite(pixel, 1, 3, fileStream);
+		}
+	}
+
+	fclose(fileStream);
+	return 1;
+}
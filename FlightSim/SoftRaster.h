@@ -0,0 +1,182 @@
+/*
+ * SoftRaster.h
+ * Mike Northorp
+ * Software rasterizer that draws the same meshes as the shader path into
+ * memory. The screen is split into tiles that are drawn across a thread
+ * pool. Does not depend on OpenGL so it runs without a window.
+ */
+
+#ifndef SOFTRASTER_H_
+#define SOFTRASTER_H_
+
+// Meshes and materials
+#include "Mesh.h"
+// Worker threads
+#include "ThreadPool.h"
+
+/* Defines */
+
+// Width and height of a screen tile in pixels, must be a multiple of 4
+#define SOFT_TILE_SIZE 64
+// Vertices or primitives handed to a thread at a time
+#define SOFT_CHUNK_SIZE 1024
+// Values interpolated across a triangle: depth, 1/w, then red, green,
+// blue, alpha, s, t and fog distance divided by w
+#define SOFT_TRIANGLE_VALUES 9
+// Values at each end of a line: depth, 1/w, then the front and back
+// colors, s, t, fog distance and facing divided by w
+#define SOFT_LINE_VALUES 14
+
+/* Typedefs and structs */
+
+// RGB texture, the first row is t = 0 like glTexImage2D. Sampled bilinear
+// with repeat wrapping
+typedef struct {
+	const unsigned char *pixels;
+	int width;
+	int height;
+} SoftTexture;
+
+// One mesh to draw, the same values drawGpuMesh takes
+typedef struct {
+	const Mesh *mesh;
+	float modelView[16];
+	// Material table index, -1 uses the materials stored in the mesh
+	int material;
+	// NULL for untextured
+	const SoftTexture *texture;
+	int useFog;
+	// Draw the polygon outlines, line only meshes always do
+	int isLineDraw;
+	int lineWidth;
+} SoftDraw;
+
+// Camera, light and fog for a frame, the same values as FrameUniforms
+typedef struct {
+	float projection[16];
+	// Light position in eye space
+	float lightPosition[4];
+	float lightAmbient[4];
+	float lightDiffuse[4];
+	float lightSpecular[4];
+	float globalAmbient[4];
+	float fogColor[4];
+	float fogDensity;
+	float clearColor[4];
+	// Material table the draws index into
+	const Material *materials;
+} SoftFrame;
+
+// A vertex after lighting, in clip space
+typedef struct {
+	float clip[4];
+	float frontColor[4];
+	float backColor[4];
+	float texCoord[2];
+	float eyeDistance;
+	// Positive when the polygon the vertex belongs to faces the camera
+	float viewFacing;
+} SoftVertex;
+
+// A triangle ready to rasterize, counter clockwise on screen. Edge
+// functions are A*x + B*y + C for the edge opposite each corner and each
+// value is a plane in the same form, with x and y measured from the first
+// corner to keep precision. Pixel centres are at whole numbers
+typedef struct {
+	float origin[2];
+	float edges[3][3];
+	int isTopLeft[3];
+	float planes[SOFT_TRIANGLE_VALUES][3];
+	// Pixels it can touch
+	int minX;
+	int minY;
+	int maxX;
+	int maxY;
+	const SoftTexture *texture;
+	int useFog;
+} SoftTriangle;
+
+// A line ready to rasterize, ends are in window coordinates
+typedef struct {
+	float start[2];
+	float end[2];
+	float values[2][SOFT_LINE_VALUES];
+	int width;
+	int minX;
+	int minY;
+	int maxX;
+	int maxY;
+	const SoftTexture *texture;
+	int useFog;
+} SoftLine;
+
+// A run of vertices or primitives from one draw
+typedef struct {
+	int draw;
+	int first;
+	int count;
+} SoftRange;
+
+// Primitives set up by one task and the tiles they touch. Bins list the
+// primitives for each tile in draw order, negative entries are lines
+typedef struct {
+	SoftRange range;
+	SoftTriangle *triangles;
+	int triangleCount;
+	int triangleCapacity;
+	SoftLine *lines;
+	int lineCount;
+	int lineCapacity;
+	// Where each tile's entries start, one extra at the end
+	int *binStarts;
+	int *binCursors;
+	int *binEntries;
+	int binEntryCapacity;
+} SoftChunk;
+
+// Framebuffer and working memory, reused every frame
+typedef struct {
+	int width;
+	int height;
+	// Row stride in pixels, rounded up to a multiple of 4
+	int stride;
+	// RGBA rows from the bottom up, like glReadPixels
+	unsigned char *colorBuffer;
+	float *depthBuffer;
+
+	int tilesX;
+	int tilesY;
+	int tileCount;
+	// NULL to draw on the calling thread only
+	ThreadPool *pool;
+
+	// Current frame
+	const SoftFrame *frame;
+	const SoftDraw *draws;
+	int drawCount;
+
+	// Lit vertices for every draw
+	SoftVertex *vertices;
+	int vertexCapacity;
+	int *drawFirstVertex;
+	int drawCapacity;
+	SoftRange *vertexRanges;
+	int vertexRangeCapacity;
+
+	SoftChunk *chunks;
+	int chunkCount;
+	int chunkCapacity;
+
+	// Primitives drawn in the last frame
+	int triangleCount;
+	int lineCount;
+} SoftRaster;
+
+/* Function list */
+
+SoftRaster *softRasterCreate(int width, int height, ThreadPool *pool);
+void softRasterDestroy(SoftRaster *raster);
+void softRasterDraw(SoftRaster *raster, const SoftFrame *frame, const SoftDraw *draws, int drawCount);
+int softRasterWriteImage(SoftRaster *raster, const char *fileName);
+
+#endif /* SOFTRASTER_H_ */
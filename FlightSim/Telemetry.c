@@ -0,0 +1,240 @@
+
+/************************************************************************************
+
+	File: 			Telemetry.c
+
+	Description:	Writes and reads the telemetry ring. Each slot has a
+					sequence that is made odd before the sample is copied in
+					and even after, like a sequence lock, so a reader can
+					tell a whole sample from one being written over and no
+					side ever waits on the other.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for telemetry types and functions
+#include "Telemetry.h"
+// String functions
+#include <string.h>
+// Writer's mutex name
+#include <stdio.h>
+
+/************************************************************************
+
+	Function:		telemetryCreate
+
+	Description:	Takes the writer's mutex, then makes the named shared
+					memory and maps it for writing. The ring only has room
+					for one writer, so returns TELEMETRY_TAKEN while another
+					simulator holds the mutex. Shared memory left by a
+					simulator that has quit, kept by a reader that still has
+					it open, is taken over and started again from the first
+					sample. The header is filled in last so a reader that
+					opens it early sees no samples rather than a half made
+					ring. Returns 0 and leaves the ring closed if it can not
+					be made.
+
+*************************************************************************/
+int telemetryCreate(TelemetryRing *ring, const char *name) {
+	DWORD size = sizeof(TelemetryHeader) + TELEMETRY_CAPACITY * sizeof(TelemetrySlot);
+	char writerName[MAX_PATH];
+	DWORD waited = 0;
+
+	memset(ring, 0, sizeof(TelemetryRing));
+	sprintf(writerName, "%s%s", name, TELEMETRY_WRITER_SUFFIX);
+	ring->writer = CreateMutexA(NULL, FALSE, writerName);
+	if(ring->writer == NULL) {
+		return 0;
+	}
+	// A simulator that quit without letting go leaves it abandoned
+	waited = WaitForSingleObject(ring->writer, 0);
+	if(waited != WAIT_OBJECT_0 && waited != WAIT_ABANDONED) {
+		CloseHandle(ring->writer);
+		ring->writer = NULL;
+		return TELEMETRY_TAKEN;
+	}
+
+	ring->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, name);
+	if(ring->mapping == NULL) {
+		telemetryDestroy(ring);
+		return 0;
+	}
+	ring->header = (TelemetryHeader*)MapViewOfFile(ring->mapping, FILE_MAP_WRITE, 0, 0, size);
+	if(ring->header == NULL) {
+		telemetryDestroy(ring);
+		return 0;
+	}
+	ring->slots = (TelemetrySlot*)(ring->header + 1);
+
+	// Readers opening it from here on wait for the magic, and readers
+	// already on it see the head go back and read from the start
+	ring->header->magic = 0;
+	MemoryBarrier();
+	InterlockedExchange(&ring->header->head, 0);
+	ring->header->version = TELEMETRY_VERSION;
+	ring->header->capacity = TELEMETRY_CAPACITY;
+	ring->header->sampleBytes = sizeof(TelemetrySample);
+	MemoryBarrier();
+	ring->header->magic = TELEMETRY_MAGIC;
+
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		telemetryDestroy
+
+	Description:	Unmaps the ring and lets go of the writer's mutex, so
+					the next simulator can publish. The shared memory goes
+					away once the readers close it too.
+
+*************************************************************************/
+void telemetryDestroy(TelemetryRing *ring) {
+	if(ring->header != NULL) {
+		UnmapViewOfFile(ring->header);
+	}
+	if(ring->mapping != NULL) {
+		CloseHandle(ring->mapping);
+	}
+	if(ring->writer != NULL) {
+		ReleaseMutex(ring->writer);
+		CloseHandle(ring->writer);
+	}
+	memset(ring, 0, sizeof(TelemetryRing));
+}
+
+/************************************************************************
+
+	Function:		telemetryPublish
+
+	Description:	Copies a sample into the next slot, over the oldest,
+					and moves the head past it. Only one thread may publish.
+					Never waits on the readers.
+
+*************************************************************************/
+void telemetryPublish(TelemetryRing *ring, const TelemetrySample *sample) {
+	TelemetrySlot *slot;
+
+	if(ring->header == NULL) {
+		return;
+	}
+
+	slot = &ring->slots[ring->head & (TELEMETRY_CAPACITY - 1)];
+	InterlockedExchange(&slot->sequence, (LONG)(ring->head * 2 + 1));
+	slot->sample = *sample;
+	InterlockedExchange(&slot->sequence, (LONG)(ring->head * 2 + 2));
+
+	ring->head++;
+	InterlockedExchange(&ring->header->head, (LONG)ring->head);
+}
+
+/************************************************************************
+
+	Function:		telemetryOpen
+
+	Description:	Maps the named shared memory for reading and checks its
+					header. The reader starts at the newest sample. Returns
+					0 and leaves the reader closed if there is no ring, most
+					likely because the simulator is not running.
+
+*************************************************************************/
+int telemetryOpen(TelemetryReader *reader, const char *name) {
+	memset(reader, 0, sizeof(TelemetryReader));
+	reader->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+	if(reader->mapping == NULL) {
+		return 0;
+	}
+	reader->header = (const TelemetryHeader*)MapViewOfFile(reader->mapping, FILE_MAP_READ, 0, 0, 0);
+	if(reader->header == NULL) {
+		telemetryClose(reader);
+		return 0;
+	}
+
+	// Layout has to match this build
+	if(reader->header->magic != TELEMETRY_MAGIC || reader->header->version != TELEMETRY_VERSION ||
+		reader->header->sampleBytes != sizeof(TelemetrySample) || reader->header->capacity == 0 ||
+		(reader->header->capacity & (reader->header->capacity - 1)) != 0) {
+		telemetryClose(reader);
+		return 0;
+	}
+	reader->capacity = reader->header->capacity;
+	reader->slots = (const TelemetrySlot*)(reader->header + 1);
+	reader->next = (unsigned int)reader->header->head;
+	if(reader->next > 0) {
+		reader->next--;
+	}
+
+	return 1;
+}
+
+/************************************************************************
+
+	Function:		telemetryClose
+
+	Description:	Unmaps the ring.
+
+*************************************************************************/
+void telemetryClose(TelemetryReader *reader) {
+	if(reader->header != NULL) {
+		UnmapViewOfFile(reader->header);
+	}
+	if(reader->mapping != NULL) {
+		CloseHandle(reader->mapping);
+	}
+	memset(reader, 0, sizeof(TelemetryReader));
+}
+
+/************************************************************************
+
+	Function:		telemetryRead
+
+	Description:	Copies out the next sample and returns 1, or returns 0
+					when there is no newer one. A reader a whole ring behind
+					skips to the oldest sample still kept, and a sample
+					written over while it was copied is skipped, both
+					counted as missed. A ring started over by a new
+					simulator is read from its head.
+
+*************************************************************************/
+int telemetryRead(TelemetryReader *reader, TelemetrySample *sample) {
+	const TelemetrySlot *slot;
+	unsigned int head = 0;
+	unsigned int sequence = 0;
+
+	if(reader->header == NULL) {
+		return 0;
+	}
+
+	head = (unsigned int)reader->header->head;
+	MemoryBarrier();
+
+	// Simulator started the ring over
+	if((int)(head - reader->next) < 0) {
+		reader->next = head;
+	}
+
+	while(reader->next != head) {
+		// Slot of the head is the next to be written, leave it alone
+		if(head - reader->next >= reader->capacity) {
+			reader->missed += head - reader->next - (reader->capacity - 1);
+			reader->next = head - (reader->capacity - 1);
+		}
+
+		slot = &reader->slots[reader->next & (reader->capacity - 1)];
+		sequence = (unsigned int)slot->sequence;
+		MemoryBarrier();
+		*sample = slot->sample;
+		MemoryBarrier();
+		if(sequence == reader->next * 2 + 2 && (unsigned int)slot->sequence == sequence) {
+			reader->next++;
+			return 1;
+		}
+
+		// Written over before or while it was copied
+		reader->missed++;
+		reader->next++;
+	}
+
+	return 0;
+}
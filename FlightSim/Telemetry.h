@@ -0,0 +1,115 @@
+/*
+ * Telemetry.h
+ * Mike Northorp
+ * Flight state published every simulation step into a ring of samples in
+ * named shared memory, for instrument panels, dashboards and scripts to
+ * read while the simulator runs. There is one writer and any number of
+ * readers. Readers never write to the ring, so a slow or stopped reader
+ * never holds the simulator up; it misses the samples that were written
+ * over. Does not depend on OpenGL.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+// Named file mappings and interlocked stores
+#include <windows.h>
+
+/* Defines */
+
+// Shared memory the simulator publishes to, in the session's namespace
+#define TELEMETRY_NAME "Local\\FlightSimTelemetry"
+// "FSTM" read as a little endian number, and the layout version
+#define TELEMETRY_MAGIC 0x4D545346
+#define TELEMETRY_VERSION 1
+// Samples kept, a power of two. At 60 steps a second a reader can fall
+// 17 seconds behind before it misses any
+#define TELEMETRY_CAPACITY 1024
+// Ends the shared memory's name for the mutex its writer holds. A
+// mutex can not share the shared memory's name
+#define TELEMETRY_WRITER_SUFFIX "Writer"
+// telemetryCreate found the writer's mutex held, as another simulator
+// on the machine publishes to the shared memory
+#define TELEMETRY_TAKEN -1
+
+// Roll flags
+#define TELEMETRY_ROLLING 1
+#define TELEMETRY_CRAZY_ROLLING 2
+
+/* Typedefs and structs */
+
+// Flight state after one simulation step
+typedef struct {
+	// Seconds since the simulator started
+	double time;
+	// Simulation step it was taken after
+	unsigned int step;
+	// Where the plane is in the whole world
+	float position[3];
+	// Heading and bank in degrees, speed in units a second
+	float heading;
+	float sideTilt;
+	float speed;
+	// Roll flags, the climb into the roll from 0 to 1.1 and the roll
+	// from 0 to 360 degrees
+	unsigned int rollFlags;
+	float rollHeight;
+	float rollAmount;
+	// Seconds the last drawn frame and this step took
+	float frameTime;
+	float stepTime;
+} TelemetrySample;
+
+// Start of the shared memory, one cache line. Head is how many samples
+// have been published, sample n is in slot n modulo the capacity
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int capacity;
+	unsigned int sampleBytes;
+	volatile LONG head;
+	unsigned int reserved[11];
+} TelemetryHeader;
+
+// One sample and its sequence, one cache line. The sequence is odd while
+// sample n is being written, 2n+1, and even once it is whole, 2n+2
+typedef struct {
+	volatile LONG sequence;
+	unsigned int reserved;
+	TelemetrySample sample;
+} TelemetrySlot;
+
+// The simulator's side of the ring
+typedef struct {
+	// Held while the ring is written to, only writers open it
+	HANDLE writer;
+	HANDLE mapping;
+	TelemetryHeader *header;
+	TelemetrySlot *slots;
+	// Samples published, the shared head trails this
+	unsigned int head;
+} TelemetryRing;
+
+// A reader's side of the ring
+typedef struct {
+	HANDLE mapping;
+	const TelemetryHeader *header;
+	const TelemetrySlot *slots;
+	unsigned int capacity;
+	// Next sample to read
+	unsigned int next;
+	// Samples written over before they were read
+	unsigned long missed;
+} TelemetryReader;
+
+/* Function list */
+
+int telemetryCreate(TelemetryRing *ring, const char *name);
+void telemetryDestroy(TelemetryRing *ring);
+void telemetryPublish(TelemetryRing *ring, const TelemetrySample *sample);
+
+int telemetryOpen(TelemetryReader *reader, const char *name);
+void telemetryClose(TelemetryReader *reader);
+int telemetryRead(TelemetryReader *reader, TelemetrySample *sample);
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,292 @@
+
+/************************************************************************************
+
+	File: 			ThreadPool.c
+
+	Description:	A pool of Win32 worker threads for splitting work like screen
+					tiles across cores. threadPoolRun gives each thread an even
+					run of the indices, which it works through from the front.
+					A thread that runs out steals the back half of another's
+					run, so faster threads pick up more of the work without
+					every index going through one shared counter. The calling
+					thread works too.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for thread pool types and functions
+#include "ThreadPool.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+
+/* Defines */
+
+// Packs and unpacks a run of indices in a queue
+#define THREAD_POOL_RANGE(first, end) (((LONGLONG)(end) << 32) | (ULONG)(first))
+#define THREAD_POOL_FIRST(range) ((LONG)((range) & 0xFFFFFFFF))
+#define THREAD_POOL_END(range) ((LONG)((range) >> 32))
+
+/************************************************************************
+
+	Function:		threadPoolReadRange
+
+	Description:	Reads a queue's run in one piece, a plain read of the
+					64 bit value can be torn on 32 bit builds.
+
+*************************************************************************/
+static LONGLONG threadPoolReadRange(ThreadPoolQueue *queue) {
+	return InterlockedCompareExchange64(&queue->range, 0, 0);
+}
+
+/************************************************************************
+
+	Function:		threadPoolWork
+
+	Description:	Takes indices from the front of this thread's run until
+					it is empty, then steals the back half of the next run
+					that has any left, running the first stolen index and
+					keeping the rest. Returns when every run is empty. The
+					first index of a run is never moved, only run, so an
+					exchange can not mistake an old run for a new one.
+
+*************************************************************************/
+static void threadPoolWork(ThreadPool *pool, int threadIndex) {
+	ThreadPoolQueue *own = &pool->queues[threadIndex];
+	ThreadPoolQueue *victim;
+	LONGLONG range;
+	LONG first = 0;
+	LONG end = 0;
+	LONG half = 0;
+	int isStolen = 0;
+	int i = 0;
+
+	for(;;) {
+		// Next index off the front of our own run
+		range = threadPoolReadRange(own);
+		first = THREAD_POOL_FIRST(range);
+		end = THREAD_POOL_END(range);
+		if(first < end) {
+			if(InterlockedCompareExchange64(&own->range, THREAD_POOL_RANGE(first + 1, end), range) == range) {
+				pool->task(pool->context, (int)first);
+			}
+			continue;
+		}
+
+		// Out of work, look round the other threads for some
+		isStolen = 0;
+		for(i = 1; i < pool->threadCount && !isStolen; i++) {
+			victim = &pool->queues[(threadIndex + i) % pool->threadCount];
+			for(;;) {
+				range = threadPoolReadRange(victim);
+				first = THREAD_POOL_FIRST(range);
+				end = THREAD_POOL_END(range);
+				if(first >= end) {
+					break;
+				}
+				half = (end - first + 1) / 2;
+				if(InterlockedCompareExchange64(&victim->range, THREAD_POOL_RANGE(first, end - half), range) == range) {
+					InterlockedExchange64(&own->range, THREAD_POOL_RANGE(end - half + 1, end));
+					InterlockedIncrement(&pool->stealCount);
+					pool->task(pool->context, (int)(end - half));
+					isStolen = 1;
+					break;
+				}
+			}
+		}
+		if(!isStolen) {
+			break;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		threadPoolWorker
+
+	Description:	Main loop of a worker thread. Waits for a job, works on
+					it and the last one to finish signals the calling thread.
+
+*************************************************************************/
+static DWORD WINAPI threadPoolWorker(LPVOID parameter) {
+	ThreadPool *pool = (ThreadPool*)parameter;
+	// Which start event belongs to this worker
+	int workerIndex;
+
+	// The pool pointer is shared so find our slot from the thread count order
+	workerIndex = InterlockedIncrement(&pool->activeWorkers);
+
+	for(;;) {
+		WaitForSingleObject(pool->startEvents[workerIndex], INFINITE);
+		if(pool->isShuttingDown) {
+			break;
+		}
+
+		threadPoolWork(pool, workerIndex);
+
+		// Last worker out wakes up the caller
+		if(InterlockedDecrement(&pool->activeWorkers) == 0) {
+			SetEvent(pool->doneEvent);
+		}
+	}
+
+	return 0;
+}
+
+/************************************************************************
+
+	Function:		threadPoolCreate
+
+	Description:	Creates a pool with the given number of threads, counting
+					the calling thread. 0 or less uses one per processor.
+					Workers that can not be started are left out, so the
+					pool may have fewer threads than asked for, down to
+					just the calling thread. Returns NULL if out of memory.
+
+*************************************************************************/
+ThreadPool *threadPoolCreate(int threadCount) {
+	ThreadPool *pool = (ThreadPool*)memoryAllocZeroed(MEMORY_THREAD_POOL, sizeof(ThreadPool));
+	int i = 0;
+
+	if(pool == NULL) {
+		return NULL;
+	}
+
+	// Clamp the thread count
+	if(threadCount <= 0) {
+		threadCount = threadPoolProcessorCount();
+	}
+	if(threadCount > THREAD_POOL_MAX_THREADS) {
+		threadCount = THREAD_POOL_MAX_THREADS;
+	}
+	pool->doneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if(pool->doneEvent == NULL) {
+		memoryFree(pool);
+		return NULL;
+	}
+
+	// Slot 0 is the calling thread, workers count up activeWorkers to find their slot
+	for(i = 1; i < threadCount; i++) {
+		pool->startEvents[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if(pool->startEvents[i] == NULL) {
+			break;
+		}
+	}
+	threadCount = i;
+	for(i = 1; i < threadCount; i++) {
+		pool->threads[i] = CreateThread(NULL, 0, threadPoolWorker, pool, 0, NULL);
+		if(pool->threads[i] == NULL) {
+			break;
+		}
+	}
+	// Events of the workers that did not start are not needed
+	threadCount = i;
+	for(; i < THREAD_POOL_MAX_THREADS; i++) {
+		if(pool->startEvents[i] != NULL) {
+			CloseHandle(pool->startEvents[i]);
+			pool->startEvents[i] = NULL;
+		}
+	}
+	pool->threadCount = threadCount;
+
+	// Wait for every worker to take its slot before the count is reused
+	while(pool->activeWorkers < threadCount - 1) {
+		Sleep(0);
+	}
+	pool->activeWorkers = 0;
+
+	return pool;
+}
+
+/************************************************************************
+
+	Function:		threadPoolRun
+
+	Description:	Runs a task for every index from 0 to taskCount - 1 and
+					returns once they are all done.
+
+*************************************************************************/
+void threadPoolRun(ThreadPool *pool, ThreadPoolTask task, void *context, int taskCount) {
+	int i = 0;
+
+	if(taskCount <= 0) {
+		return;
+	}
+
+	// Set up the job, an even run of the indices for each thread
+	pool->task = task;
+	pool->context = context;
+	pool->taskCount = taskCount;
+	pool->stealCount = 0;
+	for(i = 0; i < pool->threadCount; i++) {
+		pool->queues[i].range = THREAD_POOL_RANGE((LONGLONG)taskCount * i / pool->threadCount,
+			(LONGLONG)taskCount * (i + 1) / pool->threadCount);
+	}
+
+	// Single thread pools just run it here
+	if(pool->threadCount <= 1) {
+		threadPoolWork(pool, 0);
+		return;
+	}
+
+	// Wake the workers
+	pool->activeWorkers = pool->threadCount - 1;
+	MemoryBarrier();
+	for(i = 1; i < pool->threadCount; i++) {
+		SetEvent(pool->startEvents[i]);
+	}
+
+	// Help out then wait for the stragglers
+	threadPoolWork(pool, 0);
+	WaitForSingleObject(pool->doneEvent, INFINITE);
+}
+
+/************************************************************************
+
+	Function:		threadPoolDestroy
+
+	Description:	Stops the worker threads and frees the pool.
+
+*************************************************************************/
+void threadPoolDestroy(ThreadPool *pool) {
+	int i = 0;
+
+	if(pool == NULL) {
+		return;
+	}
+
+	// Wake everyone up to exit
+	pool->isShuttingDown = 1;
+	MemoryBarrier();
+	for(i = 1; i < pool->threadCount; i++) {
+		SetEvent(pool->startEvents[i]);
+	}
+	for(i = 1; i < pool->threadCount; i++) {
+		WaitForSingleObject(pool->threads[i], INFINITE);
+		CloseHandle(pool->threads[i]);
+		CloseHandle(pool->startEvents[i]);
+	}
+
+	CloseHandle(pool->doneEvent);
+	memoryFree(pool);
+}
+
+/************************************************************************
+
+	Function:		threadPoolProcessorCount
+
+	Description:	Returns the number of logical processors.
+
+*************************************************************************/
+int threadPoolProcessorCount() {
+	SYSTEM_INFO systemInfo;
+
+	GetSystemInfo(&systemInfo);
+	if(systemInfo.dwNumberOfProcessors < 1) {
+		return 1;
+	}
+
+	return (int)systemInfo.dwNumberOfProcessors;
+}
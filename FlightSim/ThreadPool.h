@@ -0,0 +1,64 @@
+/*
+ * ThreadPool.h
+ * Mike Northorp
+ * Small pool of worker threads that run a task over a range of indices,
+ * the calling thread helps out and returns once every index is done.
+ */
+
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+// Windows threads and interlocked functions
+#include <windows.h>
+
+/* Defines */
+
+// Most threads a pool can have
+#define THREAD_POOL_MAX_THREADS 64
+
+/* Typedefs and structs */
+
+// A task is called once for each index from 0 to taskCount - 1
+typedef void (*ThreadPoolTask)(void *context, int index);
+
+// Indices one thread has left of the current job, the first in the low
+// half and one past the last in the high half so both change in one
+// interlocked exchange. Each is on a cache line of its own
+typedef struct {
+	volatile LONGLONG range;
+	char padding[64 - sizeof(LONGLONG)];
+} ThreadPoolQueue;
+
+// Pool of worker threads, the calling thread counts as one of them
+typedef struct {
+	// Threads including the calling thread
+	int threadCount;
+	HANDLE threads[THREAD_POOL_MAX_THREADS];
+	// Each worker waits on its own start event
+	HANDLE startEvents[THREAD_POOL_MAX_THREADS];
+	// Set by the last worker to finish
+	HANDLE doneEvent;
+
+	// Current job
+	ThreadPoolTask task;
+	void *context;
+	int taskCount;
+	// Each thread starts with an even share of the indices and takes from
+	// the front of its own, then steals the back half of another's
+	ThreadPoolQueue queues[THREAD_POOL_MAX_THREADS];
+	// Times a thread ran out and stole during the current job
+	volatile LONG stealCount;
+	// Workers still running the current job
+	volatile LONG activeWorkers;
+	// Tells the workers to exit
+	volatile LONG isShuttingDown;
+} ThreadPool;
+
+/* Function list */
+
+ThreadPool *threadPoolCreate(int threadCount);
+void threadPoolRun(ThreadPool *pool, ThreadPoolTask task, void *context, int taskCount);
+void threadPoolDestroy(ThreadPool *pool);
+int threadPoolProcessorCount();
+
+#endif /* THREADPOOL_H_ */
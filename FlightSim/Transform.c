@@ -0,0 +1,189 @@
+
+/************************************************************************************
+
+	File: 			Transform.c
+
+	Description:	Rigid transforms as a quaternion and a position. Adding a
+					rotation is one quaternion multiply instead of a 4x4
+					matrix multiply, and the matrix is only built once the
+					whole chain is known. Angles are in degrees like glRotatef.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for transform types and functions
+#include "Transform.h"
+// Math header
+#include <math.h>
+
+// Conversion multiplier from degrees to radians
+#define TRANSFORM_DEG_TO_RAD 0.0174532925f
+
+/************************************************************************
+
+	Function:		quaternionFromAxisAngle
+
+	Description:	Sets a quaternion to a rotation of angle degrees around
+					an axis. A zero axis gives no rotation.
+
+*************************************************************************/
+void quaternionFromAxisAngle(float *quaternion, float angle, float x, float y, float z) {
+	float length = (float)sqrt(x * x + y * y + z * z);
+	float halfAngle = angle * TRANSFORM_DEG_TO_RAD * 0.5f;
+	float s = 0.0f;
+
+	if(length == 0.0f) {
+		quaternion[0] = 0.0f;
+		quaternion[1] = 0.0f;
+		quaternion[2] = 0.0f;
+		quaternion[3] = 1.0f;
+		return;
+	}
+
+	s = (float)sin(halfAngle) / length;
+	quaternion[0] = x * s;
+	quaternion[1] = y * s;
+	quaternion[2] = z * s;
+	quaternion[3] = (float)cos(halfAngle);
+}
+
+/************************************************************************
+
+	Function:		quaternionMultiply
+
+	Description:	Sets result to left times right, the rotation that does
+					right first and then left. Result can be the same as
+					either input.
+
+*************************************************************************/
+void quaternionMultiply(float *result, const float *left, const float *right) {
+	float product[4];
+
+	product[0] = left[3] * right[0] + left[0] * right[3] + left[1] * right[2] - left[2] * right[1];
+	product[1] = left[3] * right[1] - left[0] * right[2] + left[1] * right[3] + left[2] * right[0];
+	product[2] = left[3] * right[2] + left[0] * right[1] - left[1] * right[0] + left[2] * right[3];
+	product[3] = left[3] * right[3] - left[0] * right[0] - left[1] * right[1] - left[2] * right[2];
+
+	result[0] = product[0];
+	result[1] = product[1];
+	result[2] = product[2];
+	result[3] = product[3];
+}
+
+/************************************************************************
+
+	Function:		quaternionRotate
+
+	Description:	Rotates a vector by a unit quaternion. Uses
+					v + 2w(q x v) + 2q x (q x v) so no matrix is needed.
+
+*************************************************************************/
+void quaternionRotate(const float *quaternion, const float *vector, float *result) {
+	// Twice q cross v
+	float cross[3];
+	float rotated[3];
+
+	cross[0] = 2.0f * (quaternion[1] * vector[2] - quaternion[2] * vector[1]);
+	cross[1] = 2.0f * (quaternion[2] * vector[0] - quaternion[0] * vector[2]);
+	cross[2] = 2.0f * (quaternion[0] * vector[1] - quaternion[1] * vector[0]);
+
+	rotated[0] = vector[0] + quaternion[3] * cross[0] + quaternion[1] * cross[2] - quaternion[2] * cross[1];
+	rotated[1] = vector[1] + quaternion[3] * cross[1] + quaternion[2] * cross[0] - quaternion[0] * cross[2];
+	rotated[2] = vector[2] + quaternion[3] * cross[2] + quaternion[0] * cross[1] - quaternion[1] * cross[0];
+
+	result[0] = rotated[0];
+	result[1] = rotated[1];
+	result[2] = rotated[2];
+}
+
+/************************************************************************
+
+	Function:		transformIdentity
+
+	Description:	Sets a transform to no rotation at the origin.
+
+*************************************************************************/
+void transformIdentity(Transform *transform) {
+	transform->rotation[0] = 0.0f;
+	transform->rotation[1] = 0.0f;
+	transform->rotation[2] = 0.0f;
+	transform->rotation[3] = 1.0f;
+	transform->position[0] = 0.0f;
+	transform->position[1] = 0.0f;
+	transform->position[2] = 0.0f;
+}
+
+/************************************************************************
+
+	Function:		transformTranslate
+
+	Description:	Multiplies a translation onto the transform like
+					glTranslatef, so it moves along the rotated axes.
+
+*************************************************************************/
+void transformTranslate(Transform *transform, float x, float y, float z) {
+	float offset[3];
+
+	offset[0] = x;
+	offset[1] = y;
+	offset[2] = z;
+	quaternionRotate(transform->rotation, offset, offset);
+
+	transform->position[0] += offset[0];
+	transform->position[1] += offset[1];
+	transform->position[2] += offset[2];
+}
+
+/************************************************************************
+
+	Function:		transformRotate
+
+	Description:	Multiplies a rotation of angle degrees around an axis
+					onto the transform like glRotatef.
+
+*************************************************************************/
+void transformRotate(Transform *transform, float angle, float x, float y, float z) {
+	float rotation[4];
+
+	quaternionFromAxisAngle(rotation, angle, x, y, z);
+	quaternionMultiply(transform->rotation, transform->rotation, rotation);
+}
+
+/************************************************************************
+
+	Function:		transformToMatrix
+
+	Description:	Builds the column major matrix for a transform, ready
+					for glMultMatrixf or a uniform buffer.
+
+*************************************************************************/
+void transformToMatrix(const Transform *transform, float *matrix) {
+	const float *q = transform->rotation;
+	float xx = q[0] * q[0];
+	float yy = q[1] * q[1];
+	float zz = q[2] * q[2];
+	float xy = q[0] * q[1];
+	float xz = q[0] * q[2];
+	float yz = q[1] * q[2];
+	float wx = q[3] * q[0];
+	float wy = q[3] * q[1];
+	float wz = q[3] * q[2];
+
+	matrix[0] = 1.0f - 2.0f * (yy + zz);
+	matrix[1] = 2.0f * (xy + wz);
+	matrix[2] = 2.0f * (xz - wy);
+	matrix[3] = 0.0f;
+	matrix[4] = 2.0f * (xy - wz);
+	matrix[5] = 1.0f - 2.0f * (xx + zz);
+	matrix[6] = 2.0f * (yz + wx);
+	matrix[7] = 0.0f;
+	matrix[8] = 2.0f * (xz + wy);
+	matrix[9] = 2.0f * (yz - wx);
+	matrix[10] = 1.0f - 2.0f * (xx + yy);
+	matrix[11] = 0.0f;
+	matrix[12] = transform->position[0];
+	matrix[13] = transform->position[1];
+	matrix[14] = transform->position[2];
+	matrix[15] = 1.0f;
+}
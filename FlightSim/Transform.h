@@ -0,0 +1,34 @@
+/*
+ * Transform.h
+ * Mike Northorp
+ * Rigid transforms kept as a unit quaternion and a position. Chains of
+ * translations and rotations are built the same way as with the GL matrix
+ * stack and turned into one matrix at the end. Does not depend on OpenGL.
+ */
+
+#ifndef TRANSFORM_H_
+#define TRANSFORM_H_
+
+/* Typedefs and structs */
+
+// Rotation then position, the same as the matrix translate(position) *
+// rotate(rotation). The quaternion is x, y, z then w
+typedef struct {
+	float rotation[4];
+	float position[3];
+} Transform;
+
+/* Function list */
+
+// Quaternions
+void quaternionFromAxisAngle(float *quaternion, float angle, float x, float y, float z);
+void quaternionMultiply(float *result, const float *left, const float *right);
+void quaternionRotate(const float *quaternion, const float *vector, float *result);
+
+// Multiply onto the right like glTranslatef and glRotatef
+void transformIdentity(Transform *transform);
+void transformTranslate(Transform *transform, float x, float y, float z);
+void transformRotate(Transform *transform, float angle, float x, float y, float z);
+void transformToMatrix(const Transform *transform, float *matrix);
+
+#endif /* TRANSFORM_H_ */
@@ -0,0 +1,77 @@
+
+/************************************************************************************
+
+	File: 			TripleBuffer.c
+
+	Description:	Lock free triple buffer. The writer fills its own slot and
+					swaps it with the shared one, the reader swaps its slot with
+					the shared one when something new was published. The swaps
+					are interlocked so they also order the slot contents.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for triple buffer types and functions
+#include "TripleBuffer.h"
+
+/************************************************************************
+
+	Function:		tripleBufferInit
+
+	Description:	Gives the writer slot 0, the reader slot 2 and puts slot 1
+					in the middle with nothing published.
+
+*************************************************************************/
+void tripleBufferInit(TripleBuffer *buffer) {
+	buffer->writeIndex = 0;
+	buffer->sharedIndex = 1;
+	buffer->readIndex = 2;
+}
+
+/************************************************************************
+
+	Function:		tripleBufferWriteIndex
+
+	Description:	Returns the slot the writer should fill next.
+
+*************************************************************************/
+int tripleBufferWriteIndex(TripleBuffer *buffer) {
+	return buffer->writeIndex;
+}
+
+/************************************************************************
+
+	Function:		tripleBufferPublish
+
+	Description:	Hands the filled slot to the reader and takes back the
+					one in the middle. If the reader never took the last
+					published slot it is simply written over next time.
+
+*************************************************************************/
+void tripleBufferPublish(TripleBuffer *buffer) {
+	LONG previous;
+
+	previous = InterlockedExchange(&buffer->sharedIndex, buffer->writeIndex | TRIPLE_BUFFER_FRESH);
+	buffer->writeIndex = previous & ~TRIPLE_BUFFER_FRESH;
+}
+
+/************************************************************************
+
+	Function:		tripleBufferRead
+
+	Description:	Takes the newest published slot if there is one and
+					returns the slot the reader should use. Keeps returning
+					the same slot until something new is published.
+
+*************************************************************************/
+int tripleBufferRead(TripleBuffer *buffer) {
+	LONG previous;
+
+	if(buffer->sharedIndex & TRIPLE_BUFFER_FRESH) {
+		previous = InterlockedExchange(&buffer->sharedIndex, buffer->readIndex);
+		buffer->readIndex = previous & ~TRIPLE_BUFFER_FRESH;
+	}
+
+	return buffer->readIndex;
+}
@@ -0,0 +1,41 @@
+/*
+ * TripleBuffer.h
+ * Mike Northorp
+ * Lock free triple buffer for handing values from one thread to another.
+ * The writer always has a slot to fill and the reader always gets the
+ * newest published slot, neither one ever waits on the other.
+ */
+
+#ifndef TRIPLEBUFFER_H_
+#define TRIPLEBUFFER_H_
+
+// Windows interlocked functions
+#include <windows.h>
+
+/* Defines */
+
+// Set in the shared index when the writer published a slot the reader has
+// not taken yet
+#define TRIPLE_BUFFER_FRESH 4
+
+/* Typedefs and structs */
+
+// Indices into three slots the caller owns. The writer and the reader
+// each hold one slot, the third is passed between them
+typedef struct {
+	// Only touched by the writer
+	int writeIndex;
+	// Slot in the middle plus TRIPLE_BUFFER_FRESH
+	volatile LONG sharedIndex;
+	// Only touched by the reader
+	int readIndex;
+} TripleBuffer;
+
+/* Function list */
+
+void tripleBufferInit(TripleBuffer *buffer);
+int tripleBufferWriteIndex(TripleBuffer *buffer);
+void tripleBufferPublish(TripleBuffer *buffer);
+int tripleBufferRead(TripleBuffer *buffer);
+
+#endif /* TRIPLEBUFFER_H_ */
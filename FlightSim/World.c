@@ -0,0 +1,1582 @@
+
+/************************************************************************************
+
+	File: 			World.c
+
+	Description:	Tiled world streamed in around the plane. The heights
+					come from value noise over the whole world, so tiles
+					meet without seams, and the mountains on a tile come
+					from a hash of its coordinates and the seed. Tiles in
+					view and a block of tiles ahead along the heading are
+					asked for as the plane crosses tile edges. Loader
+					threads make them, taking the tile wanted most recently
+					first, and the cache drops the tiles used longest ago,
+					furthest ones first, to make room. Each tile is made
+					with a min/max quadtree over its ground and mountains,
+					which the ground height and ray queries walk down.
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Include headerfile for world types and functions
+#include "World.h"
+// Tracked allocation
+#include "MemoryTracker.h"
+// Memory allocation
+#include <stdlib.h>
+// String functions
+#include <string.h>
+// Math functions
+#include <math.h>
+// SSE for the ground queries
+#include <xmmintrin.h>
+
+/* Defines */
+
+// Lattice spacing and height of each noise octave
+#define WORLD_NOISE_OCTAVES 3
+// Lowers the noise so most of the world is sea with islands in it
+#define WORLD_HEIGHT_OFFSET -3.5
+// Around the start the ground falls away to open sea
+#define WORLD_HOME_INNER 60.0
+#define WORLD_HOME_OUTER 120.0
+#define WORLD_HOME_DEPTH -3.0
+// Mountain sizes, as they always were
+#define WORLD_MOUNTAIN_MIN_HEIGHT 2
+#define WORLD_MOUNTAIN_HEIGHTS 18
+#define WORLD_MOUNTAIN_MIN_WIDTH 1
+#define WORLD_MOUNTAIN_WIDTHS 6
+// Hash salts keeping the noise and the mountains apart
+#define WORLD_SALT_MOUNTAINS 101u
+#define WORLD_SALT_LOOKUP 202u
+// Deepest the ray walk through a tile's quadtree can stack up
+#define WORLD_TREE_STACK 16
+// Distance for rays that never cross a tile edge
+#define WORLD_RAY_NEVER 1.0e30f
+
+// Last tile a run of ground queries looked up, as they mostly fall on
+// the same one
+typedef struct {
+	int tileX;
+	int tileZ;
+	const WorldTile *tile;
+	int isValid;
+} WorldTileCache;
+
+/* Globals */
+
+static const double noiseSpacing[WORLD_NOISE_OCTAVES] = {170.0, 70.0, 23.0};
+static const double noiseHeight[WORLD_NOISE_OCTAVES] = {9.0, 4.0, 1.5};
+// Where each level of the quadtree starts in the node arrays
+static const int treeStart[WORLD_TREE_LEVELS] = {0, 1, 5, 21};
+
+/************************************************************************
+
+	Function:		worldTime
+
+	Description:	Seconds from the performance counter, for the load
+					latency.
+
+*************************************************************************/
+static double worldTime() {
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+/************************************************************************
+
+	Function:		worldHash
+
+	Description:	Mixes the seed, a pair of coordinates and a salt into
+					32 well spread bits.
+
+*************************************************************************/
+static unsigned int worldHash(unsigned int seed, int x, int z, unsigned int salt) {
+	unsigned int hash = seed * 0x9E3779B9u;
+
+	hash ^= (unsigned int)x * 0x85EBCA6Bu;
+	hash ^= (unsigned int)z * 0xC2B2AE35u;
+	hash ^= salt * 0x27D4EB2Fu;
+	hash ^= hash >> 15;
+	hash *= 0x2C1B3C6Du;
+	hash ^= hash >> 12;
+	hash *= 0x297A2D39u;
+	hash ^= hash >> 15;
+
+	return hash;
+}
+
+/************************************************************************
+
+	Function:		worldNoise
+
+	Description:	Value noise for one octave, between -1 and 1, eased
+					between the lattice points.
+
+*************************************************************************/
+static double worldNoise(unsigned int seed, unsigned int octave, double x, double z) {
+	double cellX = floor(x / noiseSpacing[octave]);
+	double cellZ = floor(z / noiseSpacing[octave]);
+	double u = x / noiseSpacing[octave] - cellX;
+	double v = z / noiseSpacing[octave] - cellZ;
+	int latticeX = (int)cellX;
+	int latticeZ = (int)cellZ;
+	double corners[4];
+	int i = 0;
+
+	corners[0] = (double)worldHash(seed, latticeX, latticeZ, octave);
+	corners[1] = (double)worldHash(seed, latticeX + 1, latticeZ, octave);
+	corners[2] = (double)worldHash(seed, latticeX, latticeZ + 1, octave);
+	corners[3] = (double)worldHash(seed, latticeX + 1, latticeZ + 1, octave);
+	for(i = 0; i < 4; i++) {
+		corners[i] = corners[i] / 2147483647.5 - 1.0;
+	}
+
+	u = u * u * (3.0 - 2.0 * u);
+	v = v * v * (3.0 - 2.0 * v);
+
+	return (corners[0] + (corners[1] - corners[0]) * u) * (1.0 - v) +
+		(corners[2] + (corners[3] - corners[2]) * u) * v;
+}
+
+/************************************************************************
+
+	Function:		worldHeight
+
+	Description:	Ground height anywhere in the world. Below 0 is sea.
+
+*************************************************************************/
+static double worldHeight(unsigned int seed, double x, double z) {
+	double height = WORLD_HEIGHT_OFFSET;
+	double distance = sqrt(x * x + z * z);
+	double blend = 0.0;
+	unsigned int octave = 0;
+
+	for(octave = 0; octave < WORLD_NOISE_OCTAVES; octave++) {
+		height += noiseHeight[octave] * worldNoise(seed, octave, x, z);
+	}
+
+	// Keep the start over open sea
+	if(distance < WORLD_HOME_OUTER) {
+		blend = (distance - WORLD_HOME_INNER) / (WORLD_HOME_OUTER - WORLD_HOME_INNER);
+		blend = blend < 0.0 ? 0.0 : blend;
+		blend = blend * blend * (3.0 - 2.0 * blend);
+		height = WORLD_HOME_DEPTH + (height - WORLD_HOME_DEPTH) * blend;
+	}
+
+	return height;
+}
+
+/************************************************************************
+
+	Function:		worldMountainBase
+
+	Description:	Height a mountain rises from, bilinear between the
+					corners of its cell. The corners come from the tile's
+					heights when it has them, otherwise from the noise the
+					same way, so a neighbour's mountain gets the very base
+					it has on its own tile. Mountains at sea rise from the
+					sea.
+
+*************************************************************************/
+static float worldMountainBase(World *world, int tileX, int tileZ, const float *heights, float x, float z) {
+	double spacing = (double)WORLD_TILE_SIZE / WORLD_TILE_CELLS;
+	float cellSize = WORLD_TILE_SIZE / WORLD_TILE_CELLS;
+	float u = x / cellSize;
+	float v = z / cellSize;
+	int column = (int)u;
+	int row = (int)v;
+	float patch[4];
+	const float *corner;
+	int stride = WORLD_TILE_CORNERS;
+	float base = 0.0f;
+
+	column = column < 0 ? 0 : (column >= WORLD_TILE_CELLS ? WORLD_TILE_CELLS - 1 : column);
+	row = row < 0 ? 0 : (row >= WORLD_TILE_CELLS ? WORLD_TILE_CELLS - 1 : row);
+	u -= (float)column;
+	v -= (float)row;
+	if(heights != NULL) {
+		corner = &heights[row * WORLD_TILE_CORNERS + column];
+	} else {
+		patch[0] = (float)worldHeight(world->seed, (double)(tileX * WORLD_TILE_CELLS + column) * spacing,
+			(double)(tileZ * WORLD_TILE_CELLS + row) * spacing);
+		patch[1] = (float)worldHeight(world->seed, (double)(tileX * WORLD_TILE_CELLS + column + 1) * spacing,
+			(double)(tileZ * WORLD_TILE_CELLS + row) * spacing);
+		patch[2] = (float)worldHeight(world->seed, (double)(tileX * WORLD_TILE_CELLS + column) * spacing,
+			(double)(tileZ * WORLD_TILE_CELLS + row + 1) * spacing);
+		patch[3] = (float)worldHeight(world->seed, (double)(tileX * WORLD_TILE_CELLS + column + 1) * spacing,
+			(double)(tileZ * WORLD_TILE_CELLS + row + 1) * spacing);
+		corner = patch;
+		stride = 2;
+	}
+
+	base = (corner[0] + (corner[1] - corner[0]) * u) * (1.0f - v) +
+		(corner[stride] + (corner[stride + 1] - corner[stride]) * u) * v;
+
+	return base < 0.0f ? 0.0f : base;
+}
+
+/************************************************************************
+
+	Function:		worldMakeMountains
+
+	Description:	Places the mountains of a tile from the hash of its
+					coordinates, all but their bases, and returns how many
+					there are.
+
+*************************************************************************/
+static int worldMakeMountains(World *world, int tileX, int tileZ, WorldMountain *mountains) {
+	unsigned int random = worldHash(world->seed, tileX, tileZ, WORLD_SALT_MOUNTAINS);
+	int count = WORLD_TILE_MIN_MOUNTAINS + (int)(random % (WORLD_TILE_MAX_MOUNTAINS - WORLD_TILE_MIN_MOUNTAINS + 1));
+	WorldMountain *mountain;
+	int i = 0;
+
+	for(i = 0; i < count; i++) {
+		mountain = &mountains[i];
+		random = random * 1664525u + 1013904223u;
+		mountain->x = (float)(random >> 8) / 16777216.0f * WORLD_TILE_SIZE;
+		random = random * 1664525u + 1013904223u;
+		mountain->z = (float)(random >> 8) / 16777216.0f * WORLD_TILE_SIZE;
+		random = random * 1664525u + 1013904223u;
+		mountain->height = (float)(WORLD_MOUNTAIN_MIN_HEIGHT + (int)((random >> 8) % WORLD_MOUNTAIN_HEIGHTS));
+		random = random * 1664525u + 1013904223u;
+		mountain->width = (float)(WORLD_MOUNTAIN_MIN_WIDTH + (int)((random >> 8) % WORLD_MOUNTAIN_WIDTHS));
+		mountain->base = 0.0f;
+	}
+
+	return count;
+}
+
+/************************************************************************
+
+	Function:		worldGatherCones
+
+	Description:	Collects the mountains reaching over a tile for the
+					ground queries, its own and then those of its eight
+					neighbours that reach over its edges, moved onto it.
+					Neighbours are placed again from their hash rather
+					than looked up, so it does not matter which of them
+					are loaded.
+
+*************************************************************************/
+static void worldGatherCones(World *world, WorldTile *tile) {
+	WorldMountain neighbour[WORLD_TILE_MAX_MOUNTAINS];
+	WorldMountain *cone;
+	float offsetX = 0.0f;
+	float offsetZ = 0.0f;
+	int count = 0;
+	int dx = 0;
+	int dz = 0;
+	int i = 0;
+
+	memcpy(tile->cones, tile->mountains, tile->mountainCount * sizeof(WorldMountain));
+	tile->coneCount = tile->mountainCount;
+	for(dz = -1; dz <= 1; dz++) {
+		for(dx = -1; dx <= 1; dx++) {
+			if(dx == 0 && dz == 0) {
+				continue;
+			}
+			offsetX = (float)dx * WORLD_TILE_SIZE;
+			offsetZ = (float)dz * WORLD_TILE_SIZE;
+			count = worldMakeMountains(world, tile->tileX + dx, tile->tileZ + dz, neighbour);
+			for(i = 0; i < count && tile->coneCount < WORLD_TILE_MAX_CONES; i++) {
+				cone = &neighbour[i];
+				if(cone->x + offsetX + cone->width <= 0.0f || cone->x + offsetX - cone->width >= WORLD_TILE_SIZE ||
+					cone->z + offsetZ + cone->width <= 0.0f || cone->z + offsetZ - cone->width >= WORLD_TILE_SIZE) {
+					continue;
+				}
+				cone->base = worldMountainBase(world, tile->tileX + dx, tile->tileZ + dz, NULL, cone->x, cone->z);
+				cone->x += offsetX;
+				cone->z += offsetZ;
+				tile->cones[tile->coneCount++] = *cone;
+			}
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		worldTreeIndex
+
+	Description:	Index of a node within its level of the quadtree from
+					its column and row there. The bits are interleaved so
+					the four children of a node sit together, in order
+					across then down.
+
+*************************************************************************/
+static int worldTreeIndex(int level, int x, int z) {
+	int index = 0;
+	int bit = 0;
+
+	for(bit = level - 1; bit >= 0; bit--) {
+		index = index * 4 + ((z >> bit) & 1) * 2 + ((x >> bit) & 1);
+	}
+
+	return index;
+}
+
+/************************************************************************
+
+	Function:		worldBuildTree
+
+	Description:	Makes the min/max quadtree of a tile. Each leaf holds
+					the lowest and highest corner of its cells, raised to
+					the peaks of the cones reaching over it, and each node
+					above the lowest and highest of its four children.
+
+*************************************************************************/
+static void worldBuildTree(WorldTile *tile) {
+	int across = WORLD_TILE_CELLS / WORLD_TREE_LEAF_CELLS;
+	float leafSize = WORLD_TILE_SIZE / (WORLD_TILE_CELLS / WORLD_TREE_LEAF_CELLS);
+	const WorldMountain *cone;
+	float low = 0.0f;
+	float high = 0.0f;
+	float height = 0.0f;
+	int leaf = 0;
+	int node = 0;
+	int child = 0;
+	int level = 0;
+	int x = 0;
+	int z = 0;
+	int row = 0;
+	int column = 0;
+	int i = 0;
+
+	for(z = 0; z < across; z++) {
+		for(x = 0; x < across; x++) {
+			low = 1.0e30f;
+			high = -1.0e30f;
+			for(row = z * WORLD_TREE_LEAF_CELLS; row <= (z + 1) * WORLD_TREE_LEAF_CELLS; row++) {
+				for(column = x * WORLD_TREE_LEAF_CELLS; column <= (x + 1) * WORLD_TREE_LEAF_CELLS; column++) {
+					height = tile->heights[row * WORLD_TILE_CORNERS + column];
+					low = height < low ? height : low;
+					high = height > high ? height : high;
+				}
+			}
+
+			leaf = worldTreeIndex(WORLD_TREE_LEVELS - 1, x, z);
+			tile->leafCones[leaf] = 0;
+			for(i = 0; i < tile->coneCount; i++) {
+				cone = &tile->cones[i];
+				if(cone->x + cone->width > (float)x * leafSize && cone->x - cone->width < (float)(x + 1) * leafSize &&
+					cone->z + cone->width > (float)z * leafSize && cone->z - cone->width < (float)(z + 1) * leafSize) {
+					tile->leafCones[leaf] |= 1u << i;
+					height = cone->base + cone->height;
+					high = height > high ? height : high;
+				}
+			}
+			tile->treeLow[treeStart[WORLD_TREE_LEVELS - 1] + leaf] = low;
+			tile->treeHigh[treeStart[WORLD_TREE_LEVELS - 1] + leaf] = high;
+		}
+	}
+
+	for(level = WORLD_TREE_LEVELS - 2; level >= 0; level--) {
+		for(node = 0; node < (1 << (2 * level)); node++) {
+			child = treeStart[level + 1] + 4 * node;
+			low = tile->treeLow[child];
+			high = tile->treeHigh[child];
+			for(i = 1; i < 4; i++) {
+				low = tile->treeLow[child + i] < low ? tile->treeLow[child + i] : low;
+				high = tile->treeHigh[child + i] > high ? tile->treeHigh[child + i] : high;
+			}
+			tile->treeLow[treeStart[level] + node] = low;
+			tile->treeHigh[treeStart[level] + node] = high;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		worldMakeTile
+
+	Description:	Fills in the heights and mountains of a tile from its
+					coordinates. Corners are placed by whole cell numbers
+					so neighbouring tiles get the very same border heights.
+					The cones and quadtree for the ground queries are made
+					along with them, off the sim thread.
+
+*************************************************************************/
+static void worldMakeTile(World *world, WorldTile *tile) {
+	double cellSize = (double)WORLD_TILE_SIZE / WORLD_TILE_CELLS;
+	WorldMountain *mountain;
+	float height = 0.0f;
+	int row = 0;
+	int column = 0;
+	int i = 0;
+
+	tile->lowest = 1.0e30f;
+	tile->highest = -1.0e30f;
+	for(row = 0; row < WORLD_TILE_CORNERS; row++) {
+		for(column = 0; column < WORLD_TILE_CORNERS; column++) {
+			height = (float)worldHeight(world->seed,
+				(double)(tile->tileX * WORLD_TILE_CELLS + column) * cellSize,
+				(double)(tile->tileZ * WORLD_TILE_CELLS + row) * cellSize);
+			tile->heights[row * WORLD_TILE_CORNERS + column] = height;
+			tile->lowest = height < tile->lowest ? height : tile->lowest;
+			tile->highest = height > tile->highest ? height : tile->highest;
+		}
+	}
+
+	tile->mountainCount = worldMakeMountains(world, tile->tileX, tile->tileZ, tile->mountains);
+	for(i = 0; i < tile->mountainCount; i++) {
+		mountain = &tile->mountains[i];
+		mountain->base = worldMountainBase(world, tile->tileX, tile->tileZ, tile->heights, mountain->x, mountain->z);
+		if(mountain->base + mountain->height > tile->highest) {
+			tile->highest = mountain->base + mountain->height;
+		}
+	}
+
+	worldGatherCones(world, tile);
+	worldBuildTree(tile);
+}
+
+/************************************************************************
+
+	Function:		worldLookupSlot
+
+	Description:	Where a tile's coordinates start looking in the
+					lookup table.
+
+*************************************************************************/
+static int worldLookupSlot(World *world, int tileX, int tileZ) {
+	return (int)(worldHash(0, tileX, tileZ, WORLD_SALT_LOOKUP) & (unsigned int)world->lookupMask);
+}
+
+/************************************************************************
+
+	Function:		worldLookup
+
+	Description:	Index of the tile at the coordinates, or -1 when it is
+					not in the cache.
+
+*************************************************************************/
+static int worldLookup(World *world, int tileX, int tileZ) {
+	int slot = worldLookupSlot(world, tileX, tileZ);
+	WorldTile *tile;
+
+	while(world->lookup[slot] != -1) {
+		tile = &world->tiles[world->lookup[slot]];
+		if(tile->tileX == tileX && tile->tileZ == tileZ) {
+			return world->lookup[slot];
+		}
+		slot = (slot + 1) & world->lookupMask;
+	}
+
+	return -1;
+}
+
+/************************************************************************
+
+	Function:		worldInsert
+
+	Description:	Adds a tile to the lookup table under its coordinates.
+
+*************************************************************************/
+static void worldInsert(World *world, int index) {
+	int slot = worldLookupSlot(world, world->tiles[index].tileX, world->tiles[index].tileZ);
+
+	while(world->lookup[slot] != -1) {
+		slot = (slot + 1) & world->lookupMask;
+	}
+	world->lookup[slot] = index;
+}
+
+/************************************************************************
+
+	Function:		worldRemove
+
+	Description:	Takes a tile out of the lookup table, moving back any
+					tile after it that would otherwise no longer be found.
+
+*************************************************************************/
+static void worldRemove(World *world, int index) {
+	int slot = worldLookupSlot(world, world->tiles[index].tileX, world->tiles[index].tileZ);
+	int next = 0;
+	int home = 0;
+
+	while(world->lookup[slot] != index) {
+		slot = (slot + 1) & world->lookupMask;
+	}
+
+	next = (slot + 1) & world->lookupMask;
+	while(world->lookup[next] != -1) {
+		home = worldLookupSlot(world, world->tiles[world->lookup[next]].tileX, world->tiles[world->lookup[next]].tileZ);
+		// Move it back unless its home lies between the hole and it
+		if((next > slot && (home <= slot || home > next)) ||
+			(next < slot && home <= slot && home > next)) {
+			world->lookup[slot] = world->lookup[next];
+			slot = next;
+		}
+		next = (next + 1) & world->lookupMask;
+	}
+	world->lookup[slot] = -1;
+}
+
+/************************************************************************
+
+	Function:		worldEvict
+
+	Description:	Picks the tile to reuse. Tiles never used go first,
+					then the loaded tile used longest ago, the furthest of
+					those. Tiles in view or ahead this update and tiles
+					still loading are kept. Returns -1 when all are kept.
+
+*************************************************************************/
+static int worldEvict(World *world) {
+	WorldTile *tile;
+	int best = -1;
+	int bestDistance = 0;
+	int distance = 0;
+	int i = 0;
+
+	for(i = 0; i < world->tileCount; i++) {
+		tile = &world->tiles[i];
+		if(tile->state == WORLD_TILE_EMPTY) {
+			return i;
+		}
+		if(tile->state != WORLD_TILE_READY || tile->lastUsed == world->updateCount) {
+			continue;
+		}
+
+		distance = abs(tile->tileX - world->centerX) > abs(tile->tileZ - world->centerZ) ?
+			abs(tile->tileX - world->centerX) : abs(tile->tileZ - world->centerZ);
+		if(best == -1 || tile->lastUsed < world->tiles[best].lastUsed ||
+			(tile->lastUsed == world->tiles[best].lastUsed && distance > bestDistance)) {
+			best = i;
+			bestDistance = distance;
+		}
+	}
+
+	return best;
+}
+
+/************************************************************************
+
+	Function:		worldTouch
+
+	Description:	Marks the tile at the coordinates as used this update,
+					asking for it to be loaded when it is not in the cache.
+					Returns the tile or NULL when there was no room.
+
+*************************************************************************/
+static WorldTile *worldTouch(World *world, int tileX, int tileZ, int isAhead) {
+	WorldTile *tile;
+	double startTime = 0.0;
+	double latency = 0.0;
+	int index = worldLookup(world, tileX, tileZ);
+
+	if(index >= 0) {
+		world->tiles[index].lastUsed = world->updateCount;
+		return &world->tiles[index];
+	}
+
+	index = worldEvict(world);
+	if(index < 0) {
+		world->stats.dropped++;
+		return NULL;
+	}
+	tile = &world->tiles[index];
+	if(tile->state != WORLD_TILE_EMPTY) {
+		worldRemove(world, index);
+		world->stats.evictions++;
+	}
+
+	tile->tileX = tileX;
+	tile->tileZ = tileZ;
+	tile->lastUsed = world->updateCount;
+	tile->requestOrder = world->requestCount++;
+	tile->requestTime = worldTime();
+	worldInsert(world, index);
+	world->stats.requests++;
+	if(isAhead) {
+		world->stats.prefetches++;
+	}
+
+	if(world->loaderCount == 0) {
+		// Made here and now when there are no loaders
+		startTime = worldTime();
+		worldMakeTile(world, tile);
+		tile->state = WORLD_TILE_READY;
+		latency = worldTime() - tile->requestTime;
+		world->stats.loads++;
+		world->stats.loadLatency += latency;
+		world->stats.loadTime += worldTime() - startTime;
+		if(latency > world->stats.loadLatencyMax) {
+			world->stats.loadLatencyMax = latency;
+		}
+	} else {
+		InterlockedExchange(&tile->state, WORLD_TILE_QUEUED);
+		SetEvent(world->wakeEvent);
+	}
+
+	return tile;
+}
+
+/************************************************************************
+
+	Function:		worldTakeTile
+
+	Description:	Claims the queued tile wanted most recently, first
+					asked for among those, for a loader. Returns -1 when
+					nothing is queued.
+
+*************************************************************************/
+static int worldTakeTile(World *world) {
+	WorldTile *tile;
+	int best = -1;
+	int i = 0;
+
+	for(;;) {
+		best = -1;
+		for(i = 0; i < world->tileCount; i++) {
+			tile = &world->tiles[i];
+			if(tile->state != WORLD_TILE_QUEUED) {
+				continue;
+			}
+			if(best == -1 || tile->lastUsed > world->tiles[best].lastUsed ||
+				(tile->lastUsed == world->tiles[best].lastUsed && tile->requestOrder < world->tiles[best].requestOrder)) {
+				best = i;
+			}
+		}
+
+		if(best == -1) {
+			return -1;
+		}
+		// Another loader may have claimed it first
+		if(InterlockedCompareExchange(&world->tiles[best].state, WORLD_TILE_LOADING, WORLD_TILE_QUEUED) == WORLD_TILE_QUEUED) {
+			return best;
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		worldLoaderMain
+
+	Description:	Makes queued tiles until the world is destroyed,
+					sleeping while nothing is queued.
+
+*************************************************************************/
+static DWORD WINAPI worldLoaderMain(LPVOID parameter) {
+	WorldLoader *loader = (WorldLoader*)parameter;
+	World *world = loader->world;
+	WorldTile *tile;
+	double startTime = 0.0;
+	double latency = 0.0;
+	int index = 0;
+
+	while(!world->isStopping) {
+		index = worldTakeTile(world);
+		if(index < 0) {
+			WaitForSingleObject(world->wakeEvent, INFINITE);
+			continue;
+		}
+		// Wake another loader in case more is queued
+		SetEvent(world->wakeEvent);
+
+		tile = &world->tiles[index];
+		startTime = worldTime();
+		worldMakeTile(world, tile);
+		latency = worldTime() - tile->requestTime;
+		loader->loadTime += worldTime() - startTime;
+		loader->loadLatency += latency;
+		if(latency > loader->loadLatencyMax) {
+			loader->loadLatencyMax = latency;
+		}
+		InterlockedIncrement(&loader->loads);
+		InterlockedExchange(&tile->state, WORLD_TILE_READY);
+	}
+
+	// Pass the stop on to the next loader
+	SetEvent(world->wakeEvent);
+
+	return 0;
+}
+
+/************************************************************************
+
+	Function:		worldCreate
+
+	Description:	Makes a world with as many tiles as fit in the cache
+					bytes, never fewer than the tiles in view and ahead,
+					and starts its loaders. Returns NULL on failure.
+
+*************************************************************************/
+World *worldCreate(unsigned int seed, size_t cacheBytes, int loaderCount) {
+	World *world;
+	int lookupSize = 1;
+	int i = 0;
+
+	world = (World*)memoryAllocZeroed(MEMORY_WORLD, sizeof(World));
+	if(world == NULL) {
+		return NULL;
+	}
+	world->seed = seed;
+
+	world->tileCount = (int)(cacheBytes / sizeof(WorldTile));
+	if(world->tileCount < 2 * WORLD_VIEW_TILES) {
+		world->tileCount = 2 * WORLD_VIEW_TILES;
+	}
+	while(lookupSize < 2 * world->tileCount) {
+		lookupSize *= 2;
+	}
+	world->lookupMask = lookupSize - 1;
+
+	world->tiles = (WorldTile*)memoryAllocZeroed(MEMORY_WORLD, world->tileCount * sizeof(WorldTile));
+	world->lookup = (int*)memoryAlloc(MEMORY_WORLD, lookupSize * sizeof(int));
+	world->wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if(world->tiles == NULL || world->lookup == NULL || world->wakeEvent == NULL) {
+		worldDestroy(world);
+		return NULL;
+	}
+	for(i = 0; i < lookupSize; i++) {
+		world->lookup[i] = -1;
+	}
+
+	loaderCount = loaderCount < 0 ? 0 : (loaderCount > WORLD_MAX_LOADER_THREADS ? WORLD_MAX_LOADER_THREADS : loaderCount);
+	for(i = 0; i < loaderCount; i++) {
+		world->loaders[i].world = world;
+		world->loaders[i].thread = CreateThread(NULL, 0, worldLoaderMain, &world->loaders[i], 0, NULL);
+		if(world->loaders[i].thread == NULL) {
+			break;
+		}
+		world->loaderCount++;
+	}
+	if(world->loaderCount < loaderCount) {
+		worldDestroy(world);
+		return NULL;
+	}
+
+	return world;
+}
+
+/************************************************************************
+
+	Function:		worldUpdate
+
+	Description:	Asks for the tiles around the plane, nearest first,
+					and the block of tiles ahead of it along the heading
+					whenever the plane crosses into another tile or the
+					block ahead moves. Tiles coming into view count as a
+					hit when they were already loaded. The position is
+					in the whole world, in doubles so the tile under the
+					plane is right however far it has flown.
+
+*************************************************************************/
+void worldUpdate(World *world, double x, double z, float directionX, float directionZ) {
+	int centerX = (int)floor(x / WORLD_TILE_SIZE);
+	int centerZ = (int)floor(z / WORLD_TILE_SIZE);
+	int aheadX = (int)floor((x + directionX * WORLD_PREFETCH_DISTANCE * WORLD_TILE_SIZE) / WORLD_TILE_SIZE);
+	int aheadZ = (int)floor((z + directionZ * WORLD_PREFETCH_DISTANCE * WORLD_TILE_SIZE) / WORLD_TILE_SIZE);
+	int previousX = world->centerX;
+	int previousZ = world->centerZ;
+	int ring = 0;
+	int dx = 0;
+	int dz = 0;
+
+	if(world->isPlaced && centerX == world->centerX && centerZ == world->centerZ &&
+		aheadX == world->aheadX && aheadZ == world->aheadZ) {
+		return;
+	}
+
+	world->updateCount++;
+	world->centerX = centerX;
+	world->centerZ = centerZ;
+
+	for(ring = 0; ring <= WORLD_VIEW_RADIUS; ring++) {
+		for(dz = -ring; dz <= ring; dz++) {
+			for(dx = -ring; dx <= ring; dx++) {
+				if(abs(dx) != ring && abs(dz) != ring) {
+					continue;
+				}
+
+				if(!world->isPlaced || abs(centerX + dx - previousX) > WORLD_VIEW_RADIUS ||
+					abs(centerZ + dz - previousZ) > WORLD_VIEW_RADIUS) {
+					if(worldFindTile(world, centerX + dx, centerZ + dz) != NULL) {
+						world->stats.hits++;
+					} else {
+						world->stats.misses++;
+					}
+				}
+				worldTouch(world, centerX + dx, centerZ + dz, 0);
+			}
+		}
+	}
+
+	for(dz = -WORLD_VIEW_RADIUS; dz <= WORLD_VIEW_RADIUS; dz++) {
+		for(dx = -WORLD_VIEW_RADIUS; dx <= WORLD_VIEW_RADIUS; dx++) {
+			worldTouch(world, aheadX + dx, aheadZ + dz, 1);
+		}
+	}
+
+	world->aheadX = aheadX;
+	world->aheadZ = aheadZ;
+	world->isPlaced = 1;
+}
+
+/************************************************************************
+
+	Function:		worldWaitForLoads
+
+	Description:	Waits until every tile asked for is loaded.
+
+*************************************************************************/
+void worldWaitForLoads(World *world) {
+	int isLoading = 1;
+	int i = 0;
+
+	while(isLoading) {
+		isLoading = 0;
+		for(i = 0; i < world->tileCount; i++) {
+			if(world->tiles[i].state == WORLD_TILE_QUEUED || world->tiles[i].state == WORLD_TILE_LOADING) {
+				isLoading = 1;
+				break;
+			}
+		}
+		if(isLoading) {
+			Sleep(1);
+		}
+	}
+}
+
+/************************************************************************
+
+	Function:		worldFindTile
+
+	Description:	The tile at the coordinates if it is loaded, otherwise
+					NULL. Only safe on the thread calling worldUpdate, which
+					is the only one that reuses tiles.
+
+*************************************************************************/
+const WorldTile *worldFindTile(World *world, int tileX, int tileZ) {
+	int index = worldLookup(world, tileX, tileZ);
+
+	if(index < 0 || world->tiles[index].state != WORLD_TILE_READY) {
+		return NULL;
+	}
+
+	return &world->tiles[index];
+}
+
+/************************************************************************
+
+	Function:		worldCachedTile
+
+	Description:	Looks a tile up unless it is the one the cache found
+					last. Tiles not loaded come back NULL and are sea.
+
+*************************************************************************/
+static const WorldTile *worldCachedTile(World *world, WorldTileCache *cache, int tileX, int tileZ) {
+	if(!cache->isValid || cache->tileX != tileX || cache->tileZ != tileZ) {
+		cache->tile = worldFindTile(world, tileX, tileZ);
+		cache->tileX = tileX;
+		cache->tileZ = tileZ;
+		cache->isValid = 1;
+	}
+
+	return cache->tile;
+}
+
+/************************************************************************
+
+	Function:		worldCellOf
+
+	Description:	Cell of a tile a point is over, with how far across it
+					the point is. Points on the far edges count as in the
+					last cell.
+
+*************************************************************************/
+static int worldCellOf(float position, float *fraction) {
+	float u = position / (WORLD_TILE_SIZE / WORLD_TILE_CELLS);
+	int cell = (int)u;
+
+	cell = cell < 0 ? 0 : (cell >= WORLD_TILE_CELLS ? WORLD_TILE_CELLS - 1 : cell);
+	*fraction = u - (float)cell;
+
+	return cell;
+}
+
+/************************************************************************
+
+	Function:		worldTileGround
+
+	Description:	Ground height over a point on a tile: the triangles the
+					terrain mesh draws, the sea and the cones of the leaf
+					the point is in, whichever is highest.
+
+*************************************************************************/
+static float worldTileGround(const WorldTile *tile, float x, float z) {
+	const WorldMountain *cone;
+	const float *corner;
+	unsigned int cones = 0;
+	float u = 0.0f;
+	float v = 0.0f;
+	float height = 0.0f;
+	float rise = 0.0f;
+	float distance = 0.0f;
+	int column = worldCellOf(x, &u);
+	int row = worldCellOf(z, &v);
+	int i = 0;
+
+	corner = &tile->heights[row * WORLD_TILE_CORNERS + column];
+	if(u + v <= 1.0f) {
+		height = corner[0] + (corner[1] - corner[0]) * u + (corner[WORLD_TILE_CORNERS] - corner[0]) * v;
+	} else {
+		height = corner[WORLD_TILE_CORNERS + 1] + (corner[WORLD_TILE_CORNERS] - corner[WORLD_TILE_CORNERS + 1]) * (1.0f - u) +
+			(corner[1] - corner[WORLD_TILE_CORNERS + 1]) * (1.0f - v);
+	}
+	height = height < 0.0f ? 0.0f : height;
+
+	cones = tile->leafCones[worldTreeIndex(WORLD_TREE_LEVELS - 1, column / WORLD_TREE_LEAF_CELLS, row / WORLD_TREE_LEAF_CELLS)];
+	for(i = 0; cones != 0; i++, cones >>= 1) {
+		if(!(cones & 1)) {
+			continue;
+		}
+		cone = &tile->cones[i];
+		distance = (float)sqrt((x - cone->x) * (x - cone->x) + (z - cone->z) * (z - cone->z));
+		if(distance < cone->width) {
+			rise = cone->base + cone->height * (1.0f - distance / cone->width);
+			height = rise > height ? rise : height;
+		}
+	}
+
+	return height;
+}
+
+/************************************************************************
+
+	Function:		worldGroundAt
+
+	Description:	Ground height over a point placed against the origin
+					tile, through the tile cache.
+
+*************************************************************************/
+static float worldGroundAt(World *world, WorldTileCache *cache, const int *origin, float x, float z) {
+	int tileX = (int)floor(x / WORLD_TILE_SIZE);
+	int tileZ = (int)floor(z / WORLD_TILE_SIZE);
+	const WorldTile *tile = worldCachedTile(world, cache, origin[0] + tileX, origin[1] + tileZ);
+
+	if(tile == NULL) {
+		return 0.0f;
+	}
+
+	return worldTileGround(tile, x - (float)tileX * WORLD_TILE_SIZE, z - (float)tileZ * WORLD_TILE_SIZE);
+}
+
+/************************************************************************
+
+	Function:		worldGroundHeight
+
+	Description:	Height of the ground, mountains or sea under a point
+					placed against the origin tile. Tiles not loaded are
+					sea. Only safe on the thread calling worldUpdate.
+
+*************************************************************************/
+float worldGroundHeight(World *world, const int *origin, float x, float z) {
+	WorldTileCache cache;
+
+	cache.isValid = 0;
+
+	return worldGroundAt(world, &cache, origin, x, z);
+}
+
+/************************************************************************
+
+	Function:		worldGroundHeights
+
+	Description:	Ground heights under many points, four at a time with
+					SSE. The corners and cones of each point are gathered
+					and then the triangles and cones worked out for all
+					four at once, giving the very same heights as
+					worldGroundHeight. Points left over go one at a time.
+
+*************************************************************************/
+void worldGroundHeights(World *world, const int *origin, const float *x, const float *z, float *heights, int count) {
+	WorldTileCache cache;
+	const WorldTile *tiles[4];
+	const WorldMountain *cone;
+	const float *corner;
+	float laneX[4];
+	float laneZ[4];
+	float laneU[4];
+	float laneV[4];
+	float corners[4][4];
+	float coneX[4];
+	float coneZ[4];
+	float coneBase[4];
+	float coneHeight[4];
+	float coneWidth[4];
+	unsigned int cones[4];
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 u, v, lower, upper, ground, isLower, dx, dz, distance, width, rise, isInside;
+	int tileX = 0;
+	int tileZ = 0;
+	int column = 0;
+	int row = 0;
+	int lane = 0;
+	int bit = 0;
+	int i = 0;
+
+	cache.isValid = 0;
+	for(i = 0; i + 4 <= count; i += 4) {
+		for(lane = 0; lane < 4; lane++) {
+			tileX = (int)floor(x[i + lane] / WORLD_TILE_SIZE);
+			tileZ = (int)floor(z[i + lane] / WORLD_TILE_SIZE);
+			tiles[lane] = worldCachedTile(world, &cache, origin[0] + tileX, origin[1] + tileZ);
+			laneX[lane] = x[i + lane] - (float)tileX * WORLD_TILE_SIZE;
+			laneZ[lane] = z[i + lane] - (float)tileZ * WORLD_TILE_SIZE;
+			if(tiles[lane] == NULL) {
+				corners[0][lane] = corners[1][lane] = corners[2][lane] = corners[3][lane] = 0.0f;
+				laneU[lane] = laneV[lane] = 0.0f;
+				cones[lane] = 0;
+				continue;
+			}
+			column = worldCellOf(laneX[lane], &laneU[lane]);
+			row = worldCellOf(laneZ[lane], &laneV[lane]);
+			corner = &tiles[lane]->heights[row * WORLD_TILE_CORNERS + column];
+			corners[0][lane] = corner[0];
+			corners[1][lane] = corner[1];
+			corners[2][lane] = corner[WORLD_TILE_CORNERS];
+			corners[3][lane] = corner[WORLD_TILE_CORNERS + 1];
+			cones[lane] = tiles[lane]->leafCones[worldTreeIndex(WORLD_TREE_LEVELS - 1,
+				column / WORLD_TREE_LEAF_CELLS, row / WORLD_TREE_LEAF_CELLS)];
+		}
+
+		// Both triangles of each cell, keeping the one the point is on
+		u = _mm_loadu_ps(laneU);
+		v = _mm_loadu_ps(laneV);
+		lower = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(corners[0]),
+			_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(corners[1]), _mm_loadu_ps(corners[0])), u)),
+			_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(corners[2]), _mm_loadu_ps(corners[0])), v));
+		upper = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(corners[3]),
+			_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(corners[2]), _mm_loadu_ps(corners[3])), _mm_sub_ps(one, u))),
+			_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(corners[1]), _mm_loadu_ps(corners[3])), _mm_sub_ps(one, v)));
+		isLower = _mm_cmple_ps(_mm_add_ps(u, v), one);
+		ground = _mm_or_ps(_mm_and_ps(isLower, lower), _mm_andnot_ps(isLower, upper));
+		ground = _mm_max_ps(ground, _mm_setzero_ps());
+
+		// A cone from each lane at a time, lanes out of cones take one
+		// too low to matter
+		while((cones[0] | cones[1] | cones[2] | cones[3]) != 0) {
+			for(lane = 0; lane < 4; lane++) {
+				if(cones[lane] == 0) {
+					coneX[lane] = laneX[lane];
+					coneZ[lane] = laneZ[lane];
+					coneBase[lane] = -1.0e30f;
+					coneHeight[lane] = 0.0f;
+					coneWidth[lane] = 1.0f;
+					continue;
+				}
+				for(bit = 0; !(cones[lane] & (1u << bit)); bit++) {
+				}
+				cones[lane] &= cones[lane] - 1;
+				cone = &tiles[lane]->cones[bit];
+				coneX[lane] = cone->x;
+				coneZ[lane] = cone->z;
+				coneBase[lane] = cone->base;
+				coneHeight[lane] = cone->height;
+				coneWidth[lane] = cone->width;
+			}
+			dx = _mm_sub_ps(_mm_loadu_ps(laneX), _mm_loadu_ps(coneX));
+			dz = _mm_sub_ps(_mm_loadu_ps(laneZ), _mm_loadu_ps(coneZ));
+			distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+			width = _mm_loadu_ps(coneWidth);
+			rise = _mm_add_ps(_mm_loadu_ps(coneBase),
+				_mm_mul_ps(_mm_loadu_ps(coneHeight), _mm_sub_ps(one, _mm_div_ps(distance, width))));
+			isInside = _mm_cmplt_ps(distance, width);
+			ground = _mm_max_ps(ground, _mm_or_ps(_mm_and_ps(isInside, rise), _mm_andnot_ps(isInside, ground)));
+		}
+
+		_mm_storeu_ps(&heights[i], ground);
+	}
+
+	for(; i < count; i++) {
+		heights[i] = worldGroundAt(world, &cache, origin, x[i], z[i]);
+	}
+}
+
+/************************************************************************
+
+	Function:		worldIsOnTile
+
+	Description:	Whether a ray placed on a tile is over it at a distance.
+
+*************************************************************************/
+static int worldIsOnTile(const float *position, const float *direction, double t) {
+	double x = position[0] + direction[0] * t;
+	double z = position[2] + direction[2] * t;
+
+	return x >= 0.0 && x <= WORLD_TILE_SIZE && z >= 0.0 && z <= WORLD_TILE_SIZE;
+}
+
+/************************************************************************
+
+	Function:		worldCastCone
+
+	Description:	Nearest hit of a ray on a cone closer than the best so
+					far, against its sloping side and the upright wall of
+					its base circle where the base stands above the ground
+					around. Worked in doubles as the quadratic loses a lot
+					of a float near grazing hits. Hits off the tile are left
+					to the neighbour the cone reaches over, which has it
+					too when it is loaded and is sea when it is not.
+
+*************************************************************************/
+static float worldCastCone(const WorldMountain *cone, const float *position, const float *direction, float best) {
+	double slope = (double)cone->width / cone->height;
+	double ox = (double)position[0] - cone->x;
+	double oz = (double)position[2] - cone->z;
+	// Height below the peak, as the radius grows down from it
+	double oy = (double)cone->base + cone->height - position[1];
+	double dx = direction[0];
+	double dz = direction[2];
+	double dy = -(double)direction[1];
+	double k = slope * slope;
+	double a = dx * dx + dz * dz - k * dy * dy;
+	double b = 2.0 * (ox * dx + oz * dz - k * oy * dy);
+	double c = ox * ox + oz * oz - k * oy * oy;
+	double root = 0.0;
+	double t = 0.0;
+	double below = 0.0;
+	int i = 0;
+
+	// The side, between the peak and the base
+	if(a != 0.0 || b != 0.0) {
+		root = b * b - 4.0 * a * c;
+		for(i = 0; i < 2 && root >= 0.0; i++) {
+			if(a != 0.0) {
+				t = (-b + (i == 0 ? -1.0 : 1.0) * sqrt(root) * (a > 0.0 ? 1.0 : -1.0)) / (2.0 * a);
+			} else {
+				t = -c / b;
+			}
+			below = oy + dy * t;
+			if(t >= 0.0 && below >= 0.0 && below <= cone->height) {
+				if(t < best && worldIsOnTile(position, direction, t)) {
+					best = (float)t;
+				}
+				break;
+			}
+		}
+	}
+
+	// The wall around the base
+	a = dx * dx + dz * dz;
+	if(a > 0.0) {
+		root = (ox * dx + oz * dz) * (ox * dx + oz * dz) - a * (ox * ox + oz * oz - (double)cone->width * cone->width);
+		if(root >= 0.0) {
+			t = (-(ox * dx + oz * dz) - sqrt(root)) / a;
+			if(t >= 0.0 && t < best && position[1] + direction[1] * t <= cone->base && worldIsOnTile(position, direction, t)) {
+				best = (float)t;
+			}
+		}
+	}
+
+	return best;
+}
+
+/************************************************************************
+
+	Function:		worldCastTriangles
+
+	Description:	Nearest hit of a ray on four triangles at once with
+					SSE, by Moller and Trumbore's test. Each triangle is a
+					corner and two edges, a row of four lanes for each of
+					their nine numbers.
+
+*************************************************************************/
+static float worldCastTriangles(float (*triangle)[4], const float *position, const float *direction, float best) {
+	__m128 dx = _mm_set1_ps(direction[0]);
+	__m128 dy = _mm_set1_ps(direction[1]);
+	__m128 dz = _mm_set1_ps(direction[2]);
+	__m128 e1x = _mm_loadu_ps(triangle[3]);
+	__m128 e1y = _mm_loadu_ps(triangle[4]);
+	__m128 e1z = _mm_loadu_ps(triangle[5]);
+	__m128 e2x = _mm_loadu_ps(triangle[6]);
+	__m128 e2y = _mm_loadu_ps(triangle[7]);
+	__m128 e2z = _mm_loadu_ps(triangle[8]);
+	__m128 px, py, pz, det, inverse, tx, ty, tz, qx, qy, qz, u, v, t, isHit;
+	float distances[4];
+	int i = 0;
+
+	px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	inverse = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	tx = _mm_sub_ps(_mm_set1_ps(position[0]), _mm_loadu_ps(triangle[0]));
+	ty = _mm_sub_ps(_mm_set1_ps(position[1]), _mm_loadu_ps(triangle[1]));
+	tz = _mm_sub_ps(_mm_set1_ps(position[2]), _mm_loadu_ps(triangle[2]));
+	u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inverse);
+
+	qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+	qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+	qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+	v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+	t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+	// Rays along a triangle's plane give no hit, nor do NaNs from them
+	isHit = _mm_cmpgt_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), det), _mm_set1_ps(1.0e-12f));
+	isHit = _mm_and_ps(isHit, _mm_cmpge_ps(u, _mm_setzero_ps()));
+	isHit = _mm_and_ps(isHit, _mm_cmpge_ps(v, _mm_setzero_ps()));
+	isHit = _mm_and_ps(isHit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	isHit = _mm_and_ps(isHit, _mm_cmpge_ps(t, _mm_setzero_ps()));
+	if(_mm_movemask_ps(isHit) == 0) {
+		return best;
+	}
+
+	_mm_storeu_ps(distances, _mm_or_ps(_mm_and_ps(isHit, t), _mm_andnot_ps(isHit, _mm_set1_ps(best))));
+	for(i = 0; i < 4; i++) {
+		best = distances[i] < best ? distances[i] : best;
+	}
+
+	return best;
+}
+
+/************************************************************************
+
+	Function:		worldCastLeaf
+
+	Description:	Nearest hit of a ray in a leaf of the quadtree, on the
+					eight triangles of its four cells, four at a time, and
+					on the cones reaching over it that no other leaf of the
+					tile has tried already.
+
+*************************************************************************/
+static float worldCastLeaf(const WorldTile *tile, int leafX, int leafZ, const float *position, const float *direction,
+	float best, unsigned int *triedCones) {
+	float cellSize = WORLD_TILE_SIZE / WORLD_TILE_CELLS;
+	float triangle[9][4];
+	const float *corner;
+	unsigned int cones = 0;
+	int column = 0;
+	int row = 0;
+	int lane = 0;
+	int i = 0;
+
+	// The first triangle of each cell, on its near corner
+	for(lane = 0; lane < 4; lane++) {
+		column = leafX * WORLD_TREE_LEAF_CELLS + (lane & 1);
+		row = leafZ * WORLD_TREE_LEAF_CELLS + (lane >> 1);
+		corner = &tile->heights[row * WORLD_TILE_CORNERS + column];
+		triangle[0][lane] = (float)column * cellSize;
+		triangle[1][lane] = corner[0];
+		triangle[2][lane] = (float)row * cellSize;
+		triangle[3][lane] = 0.0f;
+		triangle[4][lane] = corner[WORLD_TILE_CORNERS] - corner[0];
+		triangle[5][lane] = cellSize;
+		triangle[6][lane] = cellSize;
+		triangle[7][lane] = corner[1] - corner[0];
+		triangle[8][lane] = 0.0f;
+	}
+	best = worldCastTriangles(triangle, position, direction, best);
+
+	// And the second, on its far corner
+	for(lane = 0; lane < 4; lane++) {
+		column = leafX * WORLD_TREE_LEAF_CELLS + (lane & 1);
+		row = leafZ * WORLD_TREE_LEAF_CELLS + (lane >> 1);
+		corner = &tile->heights[row * WORLD_TILE_CORNERS + column];
+		triangle[0][lane] = (float)(column + 1) * cellSize;
+		triangle[1][lane] = corner[WORLD_TILE_CORNERS + 1];
+		triangle[2][lane] = (float)(row + 1) * cellSize;
+		triangle[3][lane] = 0.0f;
+		triangle[4][lane] = corner[1] - corner[WORLD_TILE_CORNERS + 1];
+		triangle[5][lane] = -cellSize;
+		triangle[6][lane] = -cellSize;
+		triangle[7][lane] = corner[WORLD_TILE_CORNERS] - corner[WORLD_TILE_CORNERS + 1];
+		triangle[8][lane] = 0.0f;
+	}
+	best = worldCastTriangles(triangle, position, direction, best);
+
+	cones = tile->leafCones[worldTreeIndex(WORLD_TREE_LEVELS - 1, leafX, leafZ)] & ~*triedCones;
+	*triedCones |= cones;
+	for(i = 0; cones != 0; i++, cones >>= 1) {
+		if(cones & 1) {
+			best = worldCastCone(&tile->cones[i], position, direction, best);
+		}
+	}
+
+	return best;
+}
+
+/************************************************************************
+
+	Function:		worldCastTile
+
+	Description:	Nearest hit of a ray on a tile, placed on the tile,
+					from where it enters. Walks down the quadtree testing
+					the four boxes of a node's children at once with SSE,
+					and goes into those hit nearest first, skipping any
+					further than the best hit so far.
+
+*************************************************************************/
+static float worldCastTile(const WorldTile *tile, const float *position, const float *direction, const float *inverse,
+	float start, float best) {
+	int stackLevel[WORLD_TREE_STACK];
+	int stackX[WORLD_TREE_STACK];
+	int stackZ[WORLD_TREE_STACK];
+	float stackEntry[WORLD_TREE_STACK];
+	float entries[4];
+	int order[4];
+	__m128 size, x0, z0, nearX, farX, nearY, farY, nearZ, farZ, entry, leave;
+	unsigned int triedCones = 0;
+	float childSize = 0.0f;
+	int top = 0;
+	int level = 0;
+	int node = 0;
+	int child = 0;
+	int x = 0;
+	int z = 0;
+	int hits = 0;
+	int count = 0;
+	int swap = 0;
+	int i = 0;
+	int j = 0;
+
+	stackLevel[0] = 0;
+	stackX[0] = 0;
+	stackZ[0] = 0;
+	stackEntry[0] = start;
+	top = 1;
+	while(top > 0) {
+		top--;
+		if(stackEntry[top] >= best) {
+			continue;
+		}
+		level = stackLevel[top];
+		x = stackX[top];
+		z = stackZ[top];
+		if(level == WORLD_TREE_LEVELS - 1) {
+			best = worldCastLeaf(tile, x, z, position, direction, best, &triedCones);
+			continue;
+		}
+
+		// Slabs of the four children's boxes, across then down
+		node = worldTreeIndex(level, x, z);
+		child = treeStart[level + 1] + 4 * node;
+		childSize = WORLD_TILE_SIZE / (float)(2 << level);
+		size = _mm_set1_ps(childSize);
+		x0 = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)(2 * x)), _mm_set_ps(1.0f, 0.0f, 1.0f, 0.0f)), size);
+		z0 = _mm_mul_ps(_mm_add_ps(_mm_set1_ps((float)(2 * z)), _mm_set_ps(1.0f, 1.0f, 0.0f, 0.0f)), size);
+		nearX = _mm_mul_ps(_mm_sub_ps(x0, _mm_set1_ps(position[0])), _mm_set1_ps(inverse[0]));
+		farX = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(x0, size), _mm_set1_ps(position[0])), _mm_set1_ps(inverse[0]));
+		nearZ = _mm_mul_ps(_mm_sub_ps(z0, _mm_set1_ps(position[2])), _mm_set1_ps(inverse[2]));
+		farZ = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(z0, size), _mm_set1_ps(position[2])), _mm_set1_ps(inverse[2]));
+		nearY = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&tile->treeLow[child]), _mm_set1_ps(position[1])), _mm_set1_ps(inverse[1]));
+		farY = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&tile->treeHigh[child]), _mm_set1_ps(position[1])), _mm_set1_ps(inverse[1]));
+		entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(nearX, farX), _mm_min_ps(nearZ, farZ)),
+			_mm_max_ps(_mm_min_ps(nearY, farY), _mm_set1_ps(stackEntry[top])));
+		leave = _mm_min_ps(_mm_min_ps(_mm_max_ps(nearX, farX), _mm_max_ps(nearZ, farZ)),
+			_mm_min_ps(_mm_max_ps(nearY, farY), _mm_set1_ps(best)));
+		hits = _mm_movemask_ps(_mm_cmple_ps(entry, leave));
+		if(hits == 0) {
+			continue;
+		}
+		_mm_storeu_ps(entries, entry);
+
+		// Children hit, furthest first so the nearest comes off next
+		count = 0;
+		for(i = 0; i < 4; i++) {
+			if(hits & (1 << i)) {
+				order[count++] = i;
+			}
+		}
+		for(i = 1; i < count; i++) {
+			for(j = i; j > 0 && entries[order[j]] > entries[order[j - 1]]; j--) {
+				swap = order[j];
+				order[j] = order[j - 1];
+				order[j - 1] = swap;
+			}
+		}
+		for(i = 0; i < count; i++) {
+			stackLevel[top] = level + 1;
+			stackX[top] = 2 * x + (order[i] & 1);
+			stackZ[top] = 2 * z + (order[i] >> 1);
+			stackEntry[top] = entries[order[i]];
+			top++;
+		}
+	}
+
+	return best;
+}
+
+/************************************************************************
+
+	Function:		worldCastOne
+
+	Description:	Distance along a ray to the ground, mountains or sea,
+					or -1 if there are none within its length. The sea is
+					a plane under everything, and the tiles the ray
+					crosses are stepped through in order until one is
+					entered past the nearest hit.
+
+*************************************************************************/
+static float worldCastOne(World *world, WorldTileCache *cache, const int *origin, const WorldRay *ray) {
+	const float *position = ray->position;
+	const float *direction = ray->direction;
+	const WorldTile *tile;
+	float local[3];
+	float inverse[3];
+	float best = ray->length;
+	float start = 0.0f;
+	float nextX = WORLD_RAY_NEVER;
+	float nextZ = WORLD_RAY_NEVER;
+	float stepDistanceX = WORLD_RAY_NEVER;
+	float stepDistanceZ = WORLD_RAY_NEVER;
+	int tileX = 0;
+	int tileZ = 0;
+	int stepX = 0;
+	int stepZ = 0;
+	int i = 0;
+
+	if(position[1] <= worldGroundAt(world, cache, origin, position[0], position[2])) {
+		return 0.0f;
+	}
+	if(direction[1] < 0.0f && -position[1] / direction[1] < best) {
+		best = -position[1] / direction[1];
+	}
+
+	for(i = 0; i < 3; i++) {
+		inverse[i] = 1.0f / (direction[i] != 0.0f ? direction[i] : 1.0e-30f);
+	}
+	tileX = (int)floor(position[0] / WORLD_TILE_SIZE);
+	tileZ = (int)floor(position[2] / WORLD_TILE_SIZE);
+	stepX = direction[0] > 0.0f ? 1 : -1;
+	stepZ = direction[2] > 0.0f ? 1 : -1;
+	if(direction[0] != 0.0f) {
+		nextX = ((float)(tileX + (stepX > 0 ? 1 : 0)) * WORLD_TILE_SIZE - position[0]) / direction[0];
+		stepDistanceX = WORLD_TILE_SIZE / (float)fabs(direction[0]);
+	}
+	if(direction[2] != 0.0f) {
+		nextZ = ((float)(tileZ + (stepZ > 0 ? 1 : 0)) * WORLD_TILE_SIZE - position[2]) / direction[2];
+		stepDistanceZ = WORLD_TILE_SIZE / (float)fabs(direction[2]);
+	}
+
+	while(start < best) {
+		tile = worldCachedTile(world, cache, origin[0] + tileX, origin[1] + tileZ);
+		if(tile != NULL) {
+			local[0] = position[0] - (float)tileX * WORLD_TILE_SIZE;
+			local[1] = position[1];
+			local[2] = position[2] - (float)tileZ * WORLD_TILE_SIZE;
+			best = worldCastTile(tile, local, direction, inverse, start, best);
+		}
+		if(nextX < nextZ) {
+			start = nextX;
+			nextX += stepDistanceX;
+			tileX += stepX;
+		} else {
+			start = nextZ;
+			nextZ += stepDistanceZ;
+			tileZ += stepZ;
+		}
+	}
+
+	return best < ray->length ? best : -1.0f;
+}
+
+/************************************************************************
+
+	Function:		worldCastRay
+
+	Description:	Distance along a ray placed against the origin tile to
+					the first ground, mountain or sea it hits, in lengths
+					of its direction, 0 if it starts under the ground, or
+					-1 if it hits nothing within its length. Tiles not
+					loaded are sea. Only safe on the thread calling
+					worldUpdate.
+
+*************************************************************************/
+float worldCastRay(World *world, const int *origin, const WorldRay *ray) {
+	WorldTileCache cache;
+
+	cache.isValid = 0;
+
+	return worldCastOne(world, &cache, origin, ray);
+}
+
+/************************************************************************
+
+	Function:		worldCastRays
+
+	Description:	Casts many rays, sharing the tile cache between them as
+					rays cast together mostly start on the same tile.
+
+*************************************************************************/
+void worldCastRays(World *world, const int *origin, const WorldRay *rays, float *distances, int count) {
+	WorldTileCache cache;
+	int i = 0;
+
+	cache.isValid = 0;
+	for(i = 0; i < count; i++) {
+		distances[i] = worldCastOne(world, &cache, origin, &rays[i]);
+	}
+}
+
+/************************************************************************
+
+	Function:		worldGetStats
+
+	Description:	Gathers the stats kept by the updates and the loaders.
+
+*************************************************************************/
+void worldGetStats(World *world, WorldStats *stats) {
+	WorldLoader *loader;
+	int i = 0;
+
+	*stats = world->stats;
+	for(i = 0; i < world->loaderCount; i++) {
+		loader = &world->loaders[i];
+		stats->loads += (unsigned long)loader->loads;
+		stats->loadLatency += loader->loadLatency;
+		stats->loadTime += loader->loadTime;
+		if(loader->loadLatencyMax > stats->loadLatencyMax) {
+			stats->loadLatencyMax = loader->loadLatencyMax;
+		}
+	}
+
+	stats->residentCount = 0;
+	for(i = 0; i < world->tileCount; i++) {
+		if(world->tiles[i].state == WORLD_TILE_READY) {
+			stats->residentCount++;
+		}
+	}
+	stats->tileCount = world->tileCount;
+	stats->cacheBytes = world->tileCount * sizeof(WorldTile);
+}
+
+/************************************************************************
+
+	Function:		worldDestroy
+
+	Description:	Stops the loaders and frees the world.
+
+*************************************************************************/
+void worldDestroy(World *world) {
+	int i = 0;
+
+	if(world == NULL) {
+		return;
+	}
+
+	InterlockedExchange(&world->isStopping, 1);
+	if(world->loaderCount > 0) {
+		SetEvent(world->wakeEvent);
+	}
+	for(i = 0; i < world->loaderCount; i++) {
+		WaitForSingleObject(world->loaders[i].thread, INFINITE);
+		CloseHandle(world->loaders[i].thread);
+	}
+	if(world->wakeEvent != NULL) {
+		CloseHandle(world->wakeEvent);
+	}
+
+	memoryFree(world->tiles);
+	memoryFree(world->lookup);
+	memoryFree(world);
+}
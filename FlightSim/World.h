@@ -0,0 +1,183 @@
+/*
+ * World.h
+ * Mike Northorp
+ * Unbounded tiled world around the plane. Each tile holds a heightmap,
+ * where anything below sea level is sea, and the mountains standing on
+ * it. Tiles are made from their coordinates and the world seed on loader
+ * threads, so every player with the same seed flies over the same world,
+ * and kept in a cache of fixed size that drops the tiles used longest ago.
+ * Each tile carries a min/max quadtree for ground height and ray queries.
+ */
+
+#ifndef WORLD_H_
+#define WORLD_H_
+
+// Windows threads, events and interlocked functions
+#include <windows.h>
+// The tile size the flight's position is measured on
+#include "Flight.h"
+
+/* Defines */
+
+// Width of a tile in world units, the same tile the flight's position
+// is measured on so the origin tile lines up with the world's
+#define WORLD_TILE_SIZE FLIGHT_TILE_SIZE
+// Heightmap cells across a tile, with a height at every corner
+#define WORLD_TILE_CELLS 16
+#define WORLD_TILE_CORNERS (WORLD_TILE_CELLS + 1)
+// Mountains on a tile
+#define WORLD_TILE_MIN_MOUNTAINS 2
+#define WORLD_TILE_MAX_MOUNTAINS 9
+// Tiles either side of the plane's tile that are in view. The sky
+// cylinder hides anything further than its radius of 200
+#define WORLD_VIEW_RADIUS 2
+#define WORLD_VIEW_TILES ((2 * WORLD_VIEW_RADIUS + 1) * (2 * WORLD_VIEW_RADIUS + 1))
+// Tiles ahead along the heading that the prefetched block is centered on
+#define WORLD_PREFETCH_DISTANCE 2
+// Loader threads, none loads tiles as they are asked for
+#define WORLD_LOADER_THREADS 2
+#define WORLD_MAX_LOADER_THREADS 8
+
+// Min/max quadtree over each tile, from the whole tile down to leaves of
+// 2 by 2 cells, with every node of every level in one array
+#define WORLD_TREE_LEVELS 4
+#define WORLD_TREE_LEAF_CELLS 2
+#define WORLD_TREE_LEAVES 64
+#define WORLD_TREE_NODES 85
+// Mountains reaching over a tile, its own and its neighbours'
+#define WORLD_TILE_MAX_CONES 32
+
+// Tile states
+#define WORLD_TILE_EMPTY 0
+#define WORLD_TILE_QUEUED 1
+#define WORLD_TILE_LOADING 2
+#define WORLD_TILE_READY 3
+
+/* Typedefs and structs */
+
+typedef struct {
+	// Center within the tile, the ground under it, and the cone size
+	float x;
+	float z;
+	float base;
+	float height;
+	float width;
+} WorldMountain;
+
+typedef struct {
+	int tileX;
+	int tileZ;
+	// One of the tile states, changed by the loaders once queued
+	volatile LONG state;
+	// Update the tile was last in view or ahead of the plane
+	unsigned long lastUsed;
+	// Loaders take the queued tile asked for first
+	unsigned long requestOrder;
+	double requestTime;
+
+	// Heights at the corners, row by row along x, and their range
+	float heights[WORLD_TILE_CORNERS * WORLD_TILE_CORNERS];
+	float lowest;
+	float highest;
+
+	int mountainCount;
+	WorldMountain mountains[WORLD_TILE_MAX_MOUNTAINS];
+
+	// Mountains reaching over the tile for the ground queries, its own
+	// then any of its neighbours' that reach over its edges, placed on it
+	int coneCount;
+	WorldMountain cones[WORLD_TILE_MAX_CONES];
+
+	// Min/max quadtree over the ground and the cones, made with the tile.
+	// A level at a time from the whole tile down, with the four children
+	// of a node next to each other. The lowest and highest ground or
+	// mountain under each node, and the cones reaching over each leaf
+	float treeLow[WORLD_TREE_NODES];
+	float treeHigh[WORLD_TREE_NODES];
+	unsigned int leafCones[WORLD_TREE_LEAVES];
+} WorldTile;
+
+// Ray for the ground queries, placed against an origin tile. Distances
+// are in lengths of the direction
+typedef struct {
+	float position[3];
+	float direction[3];
+	// Furthest along the direction to look
+	float length;
+} WorldRay;
+
+typedef struct {
+	// Tiles that came into view already loaded, and those that did not
+	unsigned long hits;
+	unsigned long misses;
+	// Loads asked for, how many of them were ahead of the plane, the
+	// tiles dropped to make room and the loads not asked for because
+	// every tile was in use
+	unsigned long requests;
+	unsigned long prefetches;
+	unsigned long evictions;
+	unsigned long dropped;
+	// Loads finished, seconds from asking to loaded in total and at most,
+	// and seconds spent making the tiles
+	unsigned long loads;
+	double loadLatency;
+	double loadLatencyMax;
+	double loadTime;
+	// Tiles loaded and what the cache holds
+	int residentCount;
+	int tileCount;
+	size_t cacheBytes;
+} WorldStats;
+
+typedef struct World World;
+
+typedef struct {
+	World *world;
+	HANDLE thread;
+	// Written by the loader, read for the stats
+	volatile LONG loads;
+	volatile double loadLatency;
+	volatile double loadLatencyMax;
+	volatile double loadTime;
+} WorldLoader;
+
+struct World {
+	unsigned int seed;
+
+	WorldTile *tiles;
+	int tileCount;
+	// Tile coordinates to tile index by open addressing, -1 when empty
+	int *lookup;
+	int lookupMask;
+
+	WorldLoader loaders[WORLD_MAX_LOADER_THREADS];
+	int loaderCount;
+	// Set when a tile is queued or the loaders should stop
+	HANDLE wakeEvent;
+	volatile LONG isStopping;
+
+	// Only touched by the thread calling worldUpdate
+	unsigned long updateCount;
+	unsigned long requestCount;
+	int isPlaced;
+	int centerX;
+	int centerZ;
+	int aheadX;
+	int aheadZ;
+	WorldStats stats;
+};
+
+/* Function list */
+
+World *worldCreate(unsigned int seed, size_t cacheBytes, int loaderCount);
+void worldUpdate(World *world, double x, double z, float directionX, float directionZ);
+void worldWaitForLoads(World *world);
+const WorldTile *worldFindTile(World *world, int tileX, int tileZ);
+float worldGroundHeight(World *world, const int *origin, float x, float z);
+void worldGroundHeights(World *world, const int *origin, const float *x, const float *z, float *heights, int count);
+float worldCastRay(World *world, const int *origin, const WorldRay *ray);
+void worldCastRays(World *world, const int *origin, const WorldRay *rays, float *distances, int count);
+void worldGetStats(World *world, WorldStats *stats);
+void worldDestroy(World *world);
+
+#endif /* WORLD_H_ */
@@ -0,0 +1,128 @@
+
+/************************************************************************************
+
+	File: 			SkyboxTool.c
+
+	Description:	Reprojects the sky cylinder texture (sky08.ppm) onto the six
+					faces of a cube map for the skybox. Run it from the FlightSim
+					folder and it writes skybox_px.ppm to skybox_nz.ppm next to the
+					other images, which FlightSim loads in place of making the
+					faces itself at startup. The faces can then be touched up or
+					replaced by hand. Also prints how the skybox compares to the
+					cylinder in vertices and texels.
+
+					Usage: SkyboxTool [-size n] [-eye height] [input.ppm] [prefix]
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Cylinder reprojection and PPM files
+#include "Skybox.h"
+// Tracked allocation, the images come from it
+#include "MemoryTracker.h"
+// File read in
+#include <stdio.h>
+// Include stdlib
+#include <stdlib.h>
+// String header for strcmp
+#include <string.h>
+
+/* Defines */
+
+// Sky cylinder in the scene, gluCylinder(200, 200, 100, 100, 100)
+#define SKY_RADIUS 200.0f
+#define SKY_HEIGHT 100.0f
+#define SKY_SLICES 100
+#define SKY_STACKS 100
+
+/************************************************************************
+
+	Function:		main
+
+	Description:	Reads the options and the sky image, writes the six faces
+					and prints the comparison with the cylinder.
+
+*************************************************************************/
+int main(int argc, char **argv) {
+	// Defaults match the scene, the eye is the camera height at the start
+	const char *inputName = "sky08.ppm";
+	const char *prefix = "skybox";
+	SkyboxCylinder cylinder = {SKY_RADIUS, SKY_HEIGHT, 3.2f};
+	int size = 128;
+	// Sky image and one face at a time
+	unsigned char *pixels;
+	unsigned char *face;
+	unsigned char swap;
+	char fileName[256];
+	int width = 0;
+	int height = 0;
+	int fileArgument = 0;
+	int count = 0;
+	int i = 0;
+	int k = 0;
+
+	for(i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "-size") == 0 && i + 1 < argc) {
+			size = atoi(argv[++i]);
+		} else if(strcmp(argv[i], "-eye") == 0 && i + 1 < argc) {
+			cylinder.eyeHeight = (float)atof(argv[++i]);
+		} else if(fileArgument == 0) {
+			inputName = argv[i];
+			fileArgument++;
+		} else {
+			prefix = argv[i];
+		}
+	}
+	if(size < 1) {
+		printf("Face size must be at least 1\n");
+		return 1;
+	}
+
+	pixels = skyboxReadImage(inputName, &width, &height);
+	if(pixels == NULL) {
+		printf("Could not read %s\n", inputName);
+		return 1;
+	}
+
+	// FlightSim stores images back to front, so t = 0 is the last row of the file
+	count = width * height;
+	for(i = 0; i < count / 2; i++) {
+		for(k = 0; k < 3; k++) {
+			swap = pixels[i * 3 + k];
+			pixels[i * 3 + k] = pixels[(count - 1 - i) * 3 + k];
+			pixels[(count - 1 - i) * 3 + k] = swap;
+		}
+	}
+
+	face = (unsigned char*)memoryAlloc(MEMORY_SKYBOX, size * size * 3);
+	if(face == NULL) {
+		printf("Out of memory\n");
+		memoryFree(pixels);
+		return 1;
+	}
+
+	for(i = 0; i < SKYBOX_FACES; i++) {
+		skyboxReprojectFace(face, size, i, &cylinder, pixels, width, height);
+		skyboxFaceFileName(fileName, prefix, i);
+		if(!skyboxWriteImage(fileName, face, size, size)) {
+			printf("Could not write %s\n", fileName);
+			memoryFree(face);
+			memoryFree(pixels);
+			return 1;
+		}
+		printf("Wrote %s\n", fileName);
+	}
+
+	// How the two compare before anything is drawn
+	printf("\nSky cylinder: %d quads, %d vertices as glu strips, %d vertices and %d indices as a mesh, %d texels\n",
+		SKY_SLICES * SKY_STACKS, SKY_STACKS * (SKY_SLICES + 1) * 2,
+		SKY_SLICES * SKY_STACKS * 4, SKY_SLICES * SKY_STACKS * 6, width * height);
+	printf("Skybox: 6 quads, 24 vertices, 36 indices, %d texels\n", size * size * SKYBOX_FACES);
+	printf("The cylinder shades every pixel it covers before the scene is drawn, the skybox is drawn last\n");
+	printf("and only shades the pixels nothing else covered. FlightSim's frame report (i) shows both.\n");
+
+	memoryFree(face);
+	memoryFree(pixels);
+	return 0;
+}
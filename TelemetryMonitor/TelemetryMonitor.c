@@ -0,0 +1,134 @@
+/************************************************************************************
+
+	File: 			TelemetryMonitor.c
+
+	Description:	Reads the flight state FlightSim publishes to shared memory
+					and prints it a few times a second, with how far behind
+					it is and how many samples it missed. Can also write
+					every sample to a CSV file for a spreadsheet or script.
+					Start it before or after FlightSim, it waits for the
+					simulator and picks it up again after a restart. It only
+					reads, so any number can run at once.
+
+					Usage: TelemetryMonitor [-rate n] [-seconds n] [-csv file]
+
+	Author:			Michael Northorp
+
+*************************************************************************************/
+
+// Shared memory ring and its samples
+#include "Telemetry.h"
+// File read in
+#include <stdio.h>
+// Include stdlib
+#include <stdlib.h>
+// String header for strcmp
+#include <string.h>
+
+/* Defines */
+
+// Milliseconds between looks at the ring. It holds 17 seconds of samples
+// so this only decides how fresh the printed lines are
+#define MONITOR_POLL_MS 5
+// Milliseconds between tries to open the ring while FlightSim is not running
+#define MONITOR_OPEN_MS 1000
+
+/************************************************************************
+
+	Function:		main
+
+	Description:	Reads the options, waits for the ring and reads every
+					sample from it, printing the newest at the rate asked
+					for until the time is up, or for ever.
+
+*************************************************************************/
+int main(int argc, char **argv) {
+	TelemetryReader reader;
+	TelemetrySample sample;
+	// Newest sample read since the last line
+	TelemetrySample newest;
+	FILE *csvFile = NULL;
+	const char *csvName = NULL;
+	// Lines printed a second, and seconds to run with 0 for ever
+	double rate = 4.0;
+	double seconds = 0.0;
+	double elapsed = 0.0;
+	double lineTime = 0.0;
+	unsigned long samplesRead = 0;
+	unsigned long missed = 0;
+	int hasNewest = 0;
+	int i = 0;
+
+	for(i = 1; i < argc; i++) {
+		if(strcmp(argv[i], "-rate") == 0 && i + 1 < argc) {
+			rate = atof(argv[++i]);
+		} else if(strcmp(argv[i], "-seconds") == 0 && i + 1 < argc) {
+			seconds = atof(argv[++i]);
+		} else if(strcmp(argv[i], "-csv") == 0 && i + 1 < argc) {
+			csvName = argv[++i];
+		}
+	}
+	if(rate <= 0.0) {
+		printf("Rate must be more than 0 lines a second\n");
+		return 1;
+	}
+
+	if(csvName != NULL) {
+		csvFile = fopen(csvName, "w");
+		if(csvFile == NULL) {
+			printf("Could not write %s\n", csvName);
+			return 1;
+		}
+		fprintf(csvFile, "time,step,x,y,z,heading,tilt,speed,roll flags,roll height,roll amount,frame ms,step ms\n");
+	}
+
+	printf("Waiting for FlightSim to publish to %s\n", TELEMETRY_NAME);
+	memset(&reader, 0, sizeof(reader));
+	while(seconds <= 0.0 || elapsed < seconds) {
+		// Open the ring when the simulator is up
+		if(reader.header == NULL) {
+			if(!telemetryOpen(&reader, TELEMETRY_NAME)) {
+				Sleep(MONITOR_OPEN_MS);
+				elapsed += MONITOR_OPEN_MS / 1000.0;
+				continue;
+			}
+			printf("Reading %u samples of %u bytes\n", reader.capacity, (unsigned int)sizeof(TelemetrySample));
+		}
+
+		while(telemetryRead(&reader, &sample)) {
+			newest = sample;
+			hasNewest = 1;
+			samplesRead++;
+			if(csvFile != NULL) {
+				fprintf(csvFile, "%.4f,%u,%.3f,%.3f,%.3f,%.2f,%.2f,%.3f,%u,%.2f,%.1f,%.3f,%.3f\n",
+					sample.time, sample.step, sample.position[0], sample.position[1], sample.position[2],
+					sample.heading, sample.sideTilt, sample.speed, sample.rollFlags, sample.rollHeight, sample.rollAmount,
+					sample.frameTime * 1000.0f, sample.stepTime * 1000.0f);
+			}
+		}
+
+		// Newest sample at the rate asked for
+		if(elapsed >= lineTime && hasNewest) {
+			printf("%8.2f s step %6u: at (%7.2f, %5.2f, %7.2f) heading %6.1f tilt %5.1f speed %4.1f%s%s, frame %5.1f ms, step %.3f ms, %u behind, %lu missed\n",
+				newest.time, newest.step, newest.position[0], newest.position[1], newest.position[2],
+				newest.heading, newest.sideTilt, newest.speed,
+				(newest.rollFlags & TELEMETRY_ROLLING) ? " rolling" : "",
+				(newest.rollFlags & TELEMETRY_CRAZY_ROLLING) ? " crazy rolling" : "",
+				newest.frameTime * 1000.0f, newest.stepTime * 1000.0f,
+				(unsigned int)reader.header->head - reader.next, reader.missed - missed);
+			missed = reader.missed;
+			hasNewest = 0;
+			lineTime = elapsed + 1.0 / rate;
+		}
+
+		Sleep(MONITOR_POLL_MS);
+		elapsed += MONITOR_POLL_MS / 1000.0;
+	}
+
+	printf("Read %lu samples, missed %lu\n", samplesRead, reader.missed);
+	if(csvFile != NULL) {
+		fclose(csvFile);
+	}
+	telemetryClose(&reader);
+	return 0;
+}